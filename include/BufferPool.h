@@ -0,0 +1,90 @@
+#ifndef BUFFERPOOL_H
+#define BUFFERPOOL_H
+
+#include "HttpClientModule.h"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace Net
+{
+    //
+    //  I/O buffers of the streams and the handlers, shared by all the sessions
+    //      the lengths are rounded up to a power of two class from 4 KiB to 1 MiB, the larger ones go to the system
+    //      each thread keeps a few buffers of every class, the others return to a shared list per class
+    //
+    class HTTPCLIENT_EXPORT BufferPool
+    {
+    public:
+        enum
+        {
+            MinClassLength = 4 * 1024,
+            MaxClassLength = 1024 * 1024
+        };
+
+        struct Statistics
+        {
+            //! served by a thread cache or a shared list
+            uint64_t reusedCount;
+            //! taken from and given back to the system
+            uint64_t allocatedCount;
+            uint64_t releasedCount;
+            //! not freed yet, the bytes are counted by the class length
+            uint64_t usedCount;
+            uint64_t usedBytes;
+            //! of the shared lists, the thread caches are not counted
+            uint64_t idleBytes;
+        };
+
+    public:
+        //! at least length bytes, NULL when out of memory
+        static void *Allocate(size_t length);
+        //! length is the one it was allocated with
+        static void Free(void *buffer, size_t length);
+
+        //! the classes are carved from transparent huge pages and kept till exit, the larger ones are backed by them too
+        //! Linux only, false when unsupported or any buffer was allocated before
+        static bool EnableHugePages();
+
+        static Statistics GetStatistics();
+
+        //! gives the idle buffers of the shared lists and the cache of the calling thread back to the system
+        //! the huge pages are kept
+        static void Trim();
+    };
+
+    //
+    //  length of the next read, follows the throughput observed
+    //      doubled once a read filled it, halved once one filled less than a quarter
+    //      bounded by the classes of BufferPool, so the buffers resized along are pooled
+    //
+    class AdaptiveReadLength
+    {
+    private:
+        uint32_t m_length;
+
+    public:
+        explicit AdaptiveReadLength(uint32_t initial = BufferPool::MinClassLength)
+            : m_length(initial)
+        {}
+
+    public:
+        uint32_t Get() const { return m_length; }
+
+        //! read is the length filled by the last read of Get() bytes
+        void Update(uint32_t read)
+        {
+            if (read >= m_length)
+            {
+                if (m_length < BufferPool::MaxClassLength)
+                    m_length *= 2;
+            }
+            else if (read < m_length / 4 && m_length > BufferPool::MinClassLength)
+            {
+                m_length /= 2;
+            }
+        }
+    };
+}
+
+#endif
@@ -5,6 +5,16 @@
 
 #include "HttpClientModule.h"
 #include "ScopedPointer.h"
+#include "BufferPool.h"
+
+#include <vector>
+
+#if !defined(_WIN32)
+#include <cstdio>
+#include <cstdlib>
+
+#include "StringConvertor.h"
+#endif
 
 class SimpleStringInputStream : public InputStream
 {
@@ -177,7 +187,7 @@ public:
 public:
     virtual void OnCompleted()
     {
-        *m_result = m_compltion->OnCompleted();
+        *m_result = this->m_compltion->OnCompleted();
     }
 };
 
@@ -206,12 +216,12 @@ public:
 public:
     virtual void OnCompleted()
     {
-        m_promisee.Resolve(m_compltion->OnCompleted());
+        m_promisee.Resolve(this->m_compltion->OnCompleted());
     }
 
     virtual void OnError(Exception *ex)
     {
-        m_promisee.Reject(m_compltion->OnException(ex));
+        m_promisee.Reject(this->m_compltion->OnException(ex));
     }
 };
 
@@ -251,32 +261,53 @@ template<typename T>
 class AbstractDownloadAsyncHandler : public AsyncHandler<T>
 {
 protected:
+#if defined(_WIN32)
     HANDLE m_hFile;
+#else
+    FILE *m_file;
+#endif
 
     std::wstring m_fileName;
+    Net::AdaptiveReadLength m_readLength;
     uint8_t *m_buffer;
     uint32_t m_bufferLength;
 
 public:
     AbstractDownloadAsyncHandler(const std::wstring& file)
+#if defined(_WIN32)
         : m_hFile(INVALID_HANDLE_VALUE)
+#else
+        : m_file(NULL)
+#endif
         , m_fileName()
+        , m_readLength()
         , m_buffer(NULL)
-        , m_bufferLength(4096)
+        , m_bufferLength(m_readLength.Get())
     {
+#if defined(_WIN32)
         m_hFile = ::CreateFileW(file.c_str(), GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
 
         if (INVALID_HANDLE_VALUE != m_hFile && NULL != m_hFile)
+#else
+        std::string path;
+        StringConvertor::FromString(file, path);
+        m_file = ::fopen(path.c_str(), "w+b");
+
+        if (NULL != m_file)
+#endif
         {
             m_fileName = file;
-            m_buffer = static_cast<uint8_t *>(::malloc(m_bufferLength));
+            m_buffer = static_cast<uint8_t *>(Net::BufferPool::Allocate(m_bufferLength));
         }
     }
 
     virtual ~AbstractDownloadAsyncHandler()
     {
-        if (m_buffer)
-            ::free(m_buffer);
+        Net::BufferPool::Free(m_buffer, m_bufferLength);
+#if !defined(_WIN32)
+        if (m_file)
+            ::fclose(m_file);
+#endif
     }
 
 public:
@@ -284,11 +315,24 @@ public:
 
     virtual void OnBodyAvailable(InputStream& inputStream)
     {
+        //! the buffer follows the read length
+        if (NULL != m_buffer && m_readLength.Get() != m_bufferLength)
+        {
+            Net::BufferPool::Free(m_buffer, m_bufferLength);
+            m_bufferLength = m_readLength.Get();
+            m_buffer = static_cast<uint8_t *>(Net::BufferPool::Allocate(m_bufferLength));
+        }
+
         uint32_t alreadyRead = inputStream.Read(m_buffer, m_bufferLength);
+        m_readLength.Update(alreadyRead);
         if (0 != alreadyRead)
         {
+#if defined(_WIN32)
             DWORD dwReadSize = 0;
             if (!::WriteFile(m_hFile, m_buffer, alreadyRead, &dwReadSize, NULL) || dwReadSize != alreadyRead)
+#else
+            if (::fwrite(m_buffer, 1, alreadyRead, m_file) != alreadyRead)
+#endif
             {
                 throw IOException();
             }
@@ -374,6 +418,73 @@ namespace Net
         }
     };
 
+    class UnsupportedProtocolException : public Exception
+    {
+    public:
+        virtual std::string What() const { return "Unsupported protocol"; }
+        virtual Exception *Clone() const
+        {
+            return new UnsupportedProtocolException;
+        }
+    };
+
+    //
+    //  the async session of a client, shared by its copies and the tasks not yet sent
+    //      created by the first async send, a client sending blocking requests only never starts the engine threads
+    //
+    class HTTPCLIENT_EXPORT SharedHttpSession
+    {
+    public:
+        AtomicRef m_ref;
+
+    private:
+        HttpSessionConfig m_config;
+
+        CriticalSection m_lock;
+        HttpSession *volatile m_session;
+
+    public:
+        explicit SharedHttpSession(const HttpSessionConfig& config);
+        ~SharedHttpSession();
+
+    public:
+        //! throws as the session constructor when failed to create, tried again by the next send
+        HttpSession& GetSession();
+
+    private:
+        SharedHttpSession(const SharedHttpSession&);
+        SharedHttpSession& operator = (const SharedHttpSession&);
+    };
+
+    //
+    //  the sync sessions of a client, shared by its copies
+    //      a session drives its own engine in the calling thread, so each serves one blocking request at a time
+    //      the returned ones keep their connections alive for the next request from any thread
+    //      as many as the cores are kept idle, the surplus of a burst is destroyed when returned
+    //
+    class HTTPCLIENT_EXPORT SyncHttpSessions
+    {
+    public:
+        AtomicRef m_ref;
+
+    private:
+        HttpSessionConfig m_config;
+
+        CriticalSection m_lock;
+        //! back is the most recently returned
+        std::vector<HttpSession *> m_idle;
+        size_t m_maxIdleCount;
+
+    public:
+        explicit SyncHttpSessions(const HttpSessionConfig& config);
+        ~SyncHttpSessions();
+
+    public:
+        //! an idle session or a new one
+        HttpSession *Acquire();
+        void Release(HttpSession *session);
+    };
+
     template<typename ReturnType, bool takeOwnership>
     class HttpSyncTask : public Task<ReturnType>
     {
@@ -381,10 +492,13 @@ namespace Net
         AsyncHandler<ReturnType> *m_completion;
         HttpRequest *m_request;
 
+        RefSharedPointer<SyncHttpSessions> m_sessions;
+
     public:
-        HttpSyncTask(HttpRequest *req, AsyncHandler<ReturnType> *completion)
+        HttpSyncTask(HttpRequest *req, AsyncHandler<ReturnType> *completion, const RefSharedPointer<SyncHttpSessions>& sessions)
             : m_completion(completion)
             , m_request(req)
+            , m_sessions(sessions)
         {}
 
     public:
@@ -407,21 +521,21 @@ namespace Net
 
             SyncCompletionGenericDelegate<ReturnType> delegate(m_completion, &result);
 
-            Net::HttpSessionConfig config;
-            config.IsAsync = false;
-
-            Net::HttpSession session(config);
+            //! borrowed for this request only
+            Net::HttpSession *session = m_sessions->Acquire();
 
             try
             {
                 //! handler send request
-                session.SendRequest(m_request, &delegate);
+                session->SendRequest(m_request, &delegate);
             }
             catch (const Exception& ex)
             {
                 delegate.OnError(ex.Clone());
             }
 
+            m_sessions->Release(session);
+
             return result;
         }
     };
@@ -433,10 +547,13 @@ namespace Net
         AsyncHandler<void> *m_completion;
         HttpRequest *m_request;
 
+        RefSharedPointer<SyncHttpSessions> m_sessions;
+
     public:
-        HttpSyncTask(HttpRequest *req, AsyncHandler<void> *completion)
+        HttpSyncTask(HttpRequest *req, AsyncHandler<void> *completion, const RefSharedPointer<SyncHttpSessions>& sessions)
             : m_completion(completion)
             , m_request(req)
+            , m_sessions(sessions)
         {}
 
     public:
@@ -457,20 +574,20 @@ namespace Net
         {
             SyncCompletionGenericDelegate<void> delegate(m_completion);
 
-            Net::HttpSessionConfig config;
-            config.IsAsync = false;
-
-            Net::HttpSession session(config);
+            //! borrowed for this request only
+            Net::HttpSession *session = m_sessions->Acquire();
 
             try
             {
                 //! handler send request
-                session.SendRequest(m_request, &delegate);
+                session->SendRequest(m_request, &delegate);
             }
             catch (const Exception& ex)
             {
                 delegate.OnError(ex.Clone());
             }
+
+            m_sessions->Release(session);
         }
     };
 
@@ -482,10 +599,15 @@ namespace Net
         HttpRequest *m_request;
         AsyncCompletionGenericDelegate *m_delegate;
 
+        //! released once sent
+        RefSharedPointer<SharedHttpSession> m_session;
+
     public:
-        HttpAsyncTask(HttpRequest *req, AsyncHandler<ReturnType> *handler)
+        HttpAsyncTask(HttpRequest *req, AsyncHandler<ReturnType> *handler, const RefSharedPointer<SharedHttpSession>& session)
             : m_asyncHandler(handler)
             , m_request(req)
+            , m_delegate(NULL)
+            , m_session(session)
         {
 
         }
@@ -505,22 +627,17 @@ namespace Net
     public:
         virtual void OnEnter(ThreadLocalManager *tlm, const Promisee<ReturnType>& promisee)
         {
-            //! get handler
-            Net::HttpSession *session = NULL;
-            session = tlm->Get<Net::HttpSession>();
+            //! the session of the client, whichever thread runs the task
+            //! the completion may delete the task in the engine thread, never let it release the last reference there
+            RefSharedPointer<SharedHttpSession> session(m_session);
+            m_session = RefSharedPointer<SharedHttpSession>();
 
-            if (!session)
-            {
-                session = new Net::HttpSession;
-                tlm->Register(session);
-            }
-            //
             //! handler send request
             m_delegate = new AsyncCompletionGenericDelegateImpl<ReturnType>(m_asyncHandler, promisee);
 
             try
             {
-                session->SendRequest(m_request, m_delegate);
+                session->GetSession().SendRequest(m_request, m_delegate);
             }
             catch (const Exception& ex)
             {
@@ -563,34 +680,49 @@ namespace Net
     //      CaptchaDownloadAsyncHandler handler;
     //      m_captcha.OnResult(client.Get(L"http://localhost:8080/captcha/captcha.php", &handler));
     //
+    //      The asynchronous requests of a client share one session, created by the first of them, so do its copies. The keep-alive connections
+    //      are reused no matter which thread sends the request. The requests in flight will be terminated once
+    //      the last copy destroyed. The synchronous ones borrow the idle sessions of the client, so that the
+    //      blocking request loops also reuse the connections.
+    //
     class HTTPCLIENT_EXPORT HttpClient
     {
+    private:
+        RefSharedPointer<SharedHttpSession> m_session;
+        RefSharedPointer<SyncHttpSessions> m_syncSessions;
+
     private:
         static AsyncHandler<HttpResponse> *AcquireDefaultHandler();
 
+    public:
+        //! use default config
+        HttpClient();
+        //! IsAsync is ignored
+        explicit HttpClient(const HttpSessionConfig& config);
+
     public:
         template<typename T>
         Promise<T> Send(HttpRequest *request, AsyncHandler<T> *completion, const ThreadContext& context)
         {
-            return Async::Make(new HttpAsyncTask<T>(request, completion), context);
+            return Async::Make(new HttpAsyncTask<T>(request, completion, m_session), context);
         }
 
         template<typename T>
         Promise<T> Get(const URL& url, AsyncHandler<T> *completion, const ThreadContext& context)
         {
-            return Async::Make(new HttpAsyncTask<T>(new HttpRequest(url), completion), context);
+            return Async::Make(new HttpAsyncTask<T>(new HttpRequest(url), completion, m_session), context);
         }
 
         template<typename T>
         Promise<T> SendBlock(HttpRequest *request, AsyncHandler<T> *completion, const ThreadContext& context)
         {
-            return Async::Make(new HttpSyncTask<T, true>(request, completion), context);
+            return Async::Make(new HttpSyncTask<T, true>(request, completion, m_syncSessions), context);
         }
 
         template<typename T>
         Promise<T> GetBlock(const URL& url, AsyncHandler<T> *completion, const ThreadContext& context)
         {
-            return Async::Make(new HttpSyncTask<T, true>(new HttpRequest(url), completion), context);
+            return Async::Make(new HttpSyncTask<T, true>(new HttpRequest(url), completion, m_syncSessions), context);
         }
 
         /**
@@ -617,29 +749,16 @@ namespace Net
         template<typename T>
         T Send(HttpRequest *request, AsyncHandler<T> *completion)
         {
-            HttpSyncTask<T, false> task(request, completion);
+            HttpSyncTask<T, false> task(request, completion, m_syncSessions);
             return task.Run();
         }
 
-        template<>
-        void Send<void>(HttpRequest *request, AsyncHandler<void> *completion)
-        {
-            HttpSyncTask<void, false> task(request, completion);
-            task.Run();
-        }
-
         template<typename T>
         T Get(HttpRequest *request, AsyncHandler<T> *completion)
         {
             return Send(request, completion);
         }
 
-        template<>
-        void Get<void>(HttpRequest *request, AsyncHandler<void> *completion)
-        {
-           Send(request, completion);
-        }
-
         template<typename T>
         T Get(const URL& url, AsyncHandler<T> *completion)
         {
@@ -647,34 +766,27 @@ namespace Net
             return Get(&req, completion);
         }
 
-        template<>
-        void Get<void>(const URL& url, AsyncHandler<void> *completion)
-        {
-            HttpRequest req(url);
-            Get(&req, completion);
-        }
-
         /**
             return HttpResponse
          */
         Promise<HttpResponse> Send(HttpRequest *request, const ThreadContext& context)
         {
-            return Async::Make(new HttpAsyncTask<HttpResponse>(request, HttpClient::AcquireDefaultHandler()), context);
+            return Async::Make(new HttpAsyncTask<HttpResponse>(request, HttpClient::AcquireDefaultHandler(), m_session), context);
         }
 
         Promise<HttpResponse> Get(const URL& url, const ThreadContext& context)
         {
-            return Async::Make(new HttpAsyncTask<HttpResponse>(new HttpRequest(url), HttpClient::AcquireDefaultHandler()), context);
+            return Async::Make(new HttpAsyncTask<HttpResponse>(new HttpRequest(url), HttpClient::AcquireDefaultHandler(), m_session), context);
         }
 
         Promise<HttpResponse> SendBlock(HttpRequest *request, const ThreadContext& context)
         {
-            return Async::Make(new HttpSyncTask<HttpResponse, true>(request, HttpClient::AcquireDefaultHandler()), context);
+            return Async::Make(new HttpSyncTask<HttpResponse, true>(request, HttpClient::AcquireDefaultHandler(), m_syncSessions), context);
         }
 
         Promise<HttpResponse> GetBlock(const URL& url, const ThreadContext& context)
         {
-            return Async::Make(new HttpSyncTask<HttpResponse, true>(new HttpRequest(url), HttpClient::AcquireDefaultHandler()), context);
+            return Async::Make(new HttpSyncTask<HttpResponse, true>(new HttpRequest(url), HttpClient::AcquireDefaultHandler(), m_syncSessions), context);
         }
 
         HttpResponse Get(const URL& url)
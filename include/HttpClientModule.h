@@ -112,6 +112,76 @@ namespace Net
         Value GetValue() const { return m_value; }
     };
 
+    //
+    //  the well-known header names, referred by id instead of by string
+    //      the ids index the tables, so the lookups of the common ones are array indexing
+    //
+    class HTTPCLIENT_EXPORT HeaderName
+    {
+    public:
+        enum Value
+        {
+            Accept = 0,
+            Accept_Charset,
+            Accept_Encoding,
+            Accept_Language,
+            Accept_Ranges,
+            Age,
+            Allow,
+            Authorization,
+            Cache_Control,
+            Connection,
+            Content_Disposition,
+            Content_Encoding,
+            Content_Language,
+            Content_Length,
+            Content_Location,
+            Content_Range,
+            Content_Type,
+            Cookie,
+            Date,
+            ETag,
+            Expect,
+            Expires,
+            Host,
+            If_Match,
+            If_Modified_Since,
+            If_None_Match,
+            If_Range,
+            Keep_Alive,
+            Last_Modified,
+            Location,
+            Pragma,
+            Proxy_Authenticate,
+            Proxy_Authorization,
+            Proxy_Connection,
+            Range,
+            Referer,
+            Retry_After,
+            Server,
+            Set_Cookie,
+            TE,
+            Trailer,
+            Transfer_Encoding,
+            Upgrade,
+            User_Agent,
+            Vary,
+            Via,
+            WWW_Authenticate,
+
+            //! the count of the known ones, not a well-known one when looked up
+            Unknown
+        };
+
+    public:
+        //! in the canonical case, "Content-Length"
+        static const char *GetName(Value name);
+        static size_t GetLength(Value name);
+
+        //! case-insensitive, Unknown when not a well-known one
+        static Value Find(const char *name, size_t length);
+    };
+
     class HTTPCLIENT_EXPORT HttpResponseHeaders
     {
         friend class HttpResponse;
@@ -129,6 +199,8 @@ namespace Net
         HttpResponseHeaders();
         HttpResponseHeaders(const wchar_t *rawHeader);
         HttpResponseHeaders(const wchar_t *rawHeader, const StatusCode& statusCode, const int64_t& contentLength);
+        //! UTF 8 in the same format, as received
+        HttpResponseHeaders(const char *rawHeader, const StatusCode& statusCode, const int64_t& contentLength);
         HttpResponseHeaders(const HttpResponseHeaders&);
 
         ~HttpResponseHeaders();
@@ -136,13 +208,29 @@ namespace Net
         HttpResponseHeaders& operator = (const HttpResponseHeaders&);
 
     public:
-        //!	no allocations, just headers offset
+        //! the names are matched as a whole, case-insensitively, the first one wins
+        //!	no allocations, the whole line
         const wchar_t *Get(const wchar_t *name, size_t& len) const;
+        //! no allocations, the value trimmed, NULL when not found
+        const wchar_t *GetValue(const wchar_t *name, size_t& len) const;
         StatusCode GetStatusCode() const { return m_statusCode; }
         int64_t GetContentLength() const { return m_contentLength; }
 
         String GetHead(const wchar_t *headName) const;
 
+        //
+        //  UTF 8 counterparts, no transcoding for the native session
+        //  the other form is converted once on first use
+        //
+        const char *Get(const char *name, size_t& len) const;
+        const char *GetValue(const char *name, size_t& len) const;
+
+        std::string GetHead(const char *headName) const;
+
+        //! the well-known ones by id, UTF 8
+        const char *GetValue(HeaderName::Value name, size_t& len) const;
+        std::string GetHead(HeaderName::Value name) const;
+
     public:
         bool IsNull() const { return m_rawHeaders; }
     };
@@ -169,55 +257,170 @@ namespace Net
         bool IsNull() const { return NULL == m_d; }
     };
 
+    //
+    //  the header lines are serialized as added, in UTF 8, in order and duplicates kept
+    //      the block is the exact wire form, the transport copies it as is
+    //
     class HTTPCLIENT_EXPORT RequestHeadersBuilder
     {
+        friend class HttpRequest;
+        friend class PreparedRequest;
+
     private:
         typedef std::map<String, String> Headers;
+        typedef std::map<std::string, std::string> HeaderBytes;
 
     private:
-        Headers m_headers;
+        //! each line ends with CRLF, without the blank line
+        std::string m_lines;
+
+    public:
+        RequestHeadersBuilder()
+            : m_lines()
+        {}
 
     public:
+        //! with the blank line, empty when no headers
         String ToString() const;
+        std::string ToBytes() const;
+
+        //! bytes of the lines, the blank line excluded
+        size_t GetLength() const { return m_lines.size(); }
+        bool IsEmpty() const { return m_lines.empty(); }
+
+        void Reserve(size_t length) { m_lines.reserve(length); }
+        void Clear() { m_lines.clear(); }
 
     public:
+        RequestHeadersBuilder& Add(const char *name, size_t nameLength, const char *value, size_t valueLength);
+        RequestHeadersBuilder& Add(const std::string& name, const std::string& value) { return Add(name.data(), name.size(), value.data(), value.size()); }
+        //! in the canonical case
+        RequestHeadersBuilder& Add(HeaderName::Value name, const std::string& value);
+
         RequestHeadersBuilder& operator << (const Headers::value_type& eachHeader);
+        RequestHeadersBuilder& operator << (const HeaderBytes::value_type& eachHeader) { return Add(eachHeader.first, eachHeader.second); }
+    };
+
+    //
+    //  the query appended to the url in place, UTF 8
+    //      the keys and the values are percent-encoded, the unreserved ones of RFC 3986 kept
+    //      each pair is sized exactly before written, so the url grows once per pair at most
+    //
+    class HTTPCLIENT_EXPORT QueryBuilder
+    {
+    private:
+        std::string m_url;
+        //! where the pairs go, the fragment if any stays behind them
+        std::string::size_type m_queryEnd;
+        bool m_hasQuery;
+
+    public:
+        //! the url or the path of a prepared request, the pairs follow its query if any
+        explicit QueryBuilder(const std::string& url = std::string())
+            : m_url(url)
+            , m_queryEnd(url.find('#'))
+            , m_hasQuery(std::string::npos != url.rfind('?', m_queryEnd))
+        {
+            if (std::string::npos == m_queryEnd)
+                m_queryEnd = url.size();
+        }
+
+    public:
+        const std::string& GetURL() const { return m_url; }
+        size_t GetLength() const { return m_url.size(); }
+
+        void Reserve(size_t length) { m_url.reserve(length); }
+
+    public:
+        QueryBuilder& Add(const char *key, size_t keyLength, const char *value, size_t valueLength);
+        QueryBuilder& Add(const std::string& key, const std::string& value) { return Add(key.data(), key.size(), value.data(), value.size()); }
+        //! transcoded to UTF 8 first
+        QueryBuilder& Add(const String& key, const String& value);
+    };
+
+    //
+    //  the request shape sent repeatedly, the url is cracked and the fixed head is serialized once
+    //      copies share the same immutable data, any thread may send through it
+    //      each HttpRequest made of it patches in the path, the extra headers and the body
+    //
+    class HTTPCLIENT_EXPORT PreparedRequest
+    {
+    public:
+        class PrivateData;
+
+    private:
+        RefSharedPointer<PrivateData> m_d;
+
+    public:
+        PreparedRequest();
+        //! throws InvalidURLFormatException, the fragment is dropped
+        explicit PreparedRequest(const std::string& url, const HttpVerb& verb = Get);
+        explicit PreparedRequest(const std::string& url, const HttpVerb& verb, const RequestHeadersBuilder& headers);
+        PreparedRequest(const PreparedRequest&);
+        ~PreparedRequest();
+
+        PreparedRequest& operator = (const PreparedRequest&);
+
+    public:
+        HttpVerb GetVerb() const;
+        const std::string& GetURLBytes() const;
+        //! the fixed ones, each line ends with CRLF
+        const std::string& GetHeadersBytes() const;
+
+        //! for the transports
+        const PrivateData *GetData() const { return m_d ? &*m_d : NULL; }
+
+    public:
+        bool IsNull() const { return !m_d; }
+
+    private:
+        void Prepare(const std::string& url, HttpVerb verb, const std::string& headers);
     };
 
+    //
+    //  the url and the headers are kept in UTF 8, as sent by the native session
+    //  the wide ones are converted on the way in and out
+    //
     class HTTPCLIENT_EXPORT HttpRequest
     {
     private:
         HttpVerb m_verb;
 
-        URL m_url;
-        String m_headersString;
+        std::string m_url;
+        std::string m_headers;
         InputStream *m_requestBodyStream;
+        PreparedRequest m_prepared;
 
         //! cancellation token
 
     public:
-        explicit HttpRequest(const URL& url, const HttpVerb& verb = Get)
-            : m_verb(verb)
-            , m_url(url)
-            , m_headersString()
-            , m_requestBodyStream(NULL)
-        {}
-        explicit HttpRequest(const URL& url, const HttpVerb& verb, const String& headersString, InputStream *bodyStream = NULL)
-            : m_url(url)
-            , m_headersString(headersString)
-            , m_requestBodyStream(bodyStream)
-            , m_verb(verb)
-        {}
+        explicit HttpRequest(const URL& url, const HttpVerb& verb = Get);
+        explicit HttpRequest(const URL& url, const HttpVerb& verb, const String& headersString, InputStream *bodyStream = NULL);
+        explicit HttpRequest(const std::string& url, const HttpVerb& verb = Get);
+        explicit HttpRequest(const std::string& url, const HttpVerb& verb, const std::string& headers, InputStream *bodyStream = NULL);
+        explicit HttpRequest(const std::string& url, const HttpVerb& verb, const RequestHeadersBuilder& headers, InputStream *bodyStream = NULL);
+        //! path with query replaces the prepared one unless empty, headers follow the prepared ones
+        //! throws InvalidURLFormatException when path is malformed
+        explicit HttpRequest(const PreparedRequest& prepared, const std::string& path = std::string(), const std::string& headers = std::string(), InputStream *bodyStream = NULL);
+        explicit HttpRequest(const PreparedRequest& prepared, const std::string& path, const RequestHeadersBuilder& headers, InputStream *bodyStream = NULL);
         ~HttpRequest() {}
 
     public:
         HttpVerb GetVerb() const { return m_verb; }
-        const URL& GetURL() const { return m_url; }
-        const String& GetHeadersString() const { return m_headersString; }
+        URL GetURL() const;
+        const std::string& GetURLBytes() const { return m_url; }
+        //! the prepared ones included
+        String GetHeadersString() const;
+        //! the prepared ones excluded
+        const std::string& GetHeadersBytes() const { return m_headers; }
         InputStream *GetRequestBodyStream() const { return m_requestBodyStream; }
+        const PreparedRequest& GetPrepared() const { return m_prepared; }
 
     public:
-        bool HasHeaders() const { return !m_headersString.empty(); }
+        bool HasHeaders() const { return !m_headers.empty(); }
+
+    private:
+        void Patch(const std::string& path);
 
     private:
         HttpRequest(const HttpRequest&);
@@ -226,6 +429,27 @@ namespace Net
 
     class HttpSessionConfig
     {
+    public:
+        //! transport engine on Linux, ignored by WinHttp
+        enum IoEngineType
+        {
+            EpollEngine = 0,
+            //! falls back to epoll when the kernel doesn't support it
+            UringEngine
+        };
+
+        //! protocols besides HTTP/1.1
+        enum ProtocolFlag
+        {
+            //! WinHttp negotiates it through ALPN over https, Windows 10 1607 and later
+            //! the native session speaks it over http with prior knowledge(h2c), so the server shall support that
+            Http2Protocol = 0x1,
+            //! QUIC of WinHttp, Windows 11 and later, discovered through Alt-Svc of the responses over TCP
+            //! 0-RTT and the connection migration are up to the system
+            //! Windows only, the native session throws UnsupportedProtocolException when created with it
+            Http3Protocol = 0x2
+        };
+
     public:
         //
         //  default is True
@@ -233,10 +457,56 @@ namespace Net
         bool IsAsync;
         bool IsAutoRedirectEnabled;
 
+        //! default is EpollEngine
+        IoEngineType EngineType;
+        //! engine threads of an async session, each pinned to a core, ignored by sync sessions and WinHttp
+        //! an origin is always served by the same one, so are its pooled connections
+        //! default is 1, the unpinned engine shared by all, 0 means one per online core
+        uint32_t ReactorCount;
+
+        //
+        //  keep-alive connections, pooled by scheme, host and port
+        //
+        //! default is 8, 0 disables keep-alive
+        uint32_t MaxIdleConnectionsPerHost;
+        //! idle and in use, the requests beyond wait for a returned connection
+        //! default is 0, no limit
+        uint32_t MaxConnectionsPerHost;
+        //! in milliseconds, default is 30000, ignored by WinHttp
+        uint32_t IdleConnectionTimeout;
+        //! requests in flight on one keep-alive connection, only the GETs without body are pipelined
+        //! those behind a broken pipeline are replayed on new connections
+        //! default is 1, no pipelining, ignored by WinHttp
+        uint32_t PipeliningDepth;
+
+        //! resolved addresses are cached per origin
+        //! in milliseconds, default is 60000, 0 disables, ignored by WinHttp
+        uint32_t DnsCacheTimeout;
+
+        //! combination of ProtocolFlag, default is 0, HTTP/1.1 only
+        //! all the requests to an origin are multiplexed on its HTTP/2 connections, up to MaxConnectionsPerHost of them
+        //! a connection idles out as the keep-alive ones, PipeliningDepth doesn't apply
+        uint32_t EnabledProtocols;
+
+        //! SO_RCVBUF and SO_SNDBUF of the sockets in bytes, ignored by WinHttp
+        //! default is 0, left to the kernel, which tunes them per connection by the throughput observed till they are set
+        uint32_t ReceiveBufferSize;
+        uint32_t SendBufferSize;
+
     public:
         HttpSessionConfig()
             : IsAsync(true)
             , IsAutoRedirectEnabled(false)
+            , EngineType(EpollEngine)
+            , ReactorCount(1)
+            , MaxIdleConnectionsPerHost(8)
+            , MaxConnectionsPerHost(0)
+            , IdleConnectionTimeout(30000)
+            , PipeliningDepth(1)
+            , DnsCacheTimeout(60000)
+            , EnabledProtocols(0)
+            , ReceiveBufferSize(0)
+            , SendBufferSize(0)
         {}
     };
 
@@ -1,6 +1,8 @@
 #ifndef POINTERTRAITS_H
 #define POINTERTRAITS_H
 
+#include <cstdlib>
+
 template<typename Type>
 struct PointerTrait
 {
@@ -2,6 +2,8 @@
 #define PROMISE_H
 
 #include <string>
+#include <stdexcept>
+#include <type_traits>
 
 #include "Thread.h"
 #include "Traits.h"
@@ -49,7 +51,8 @@ public:
 };
 
 //
-//
+//  OnEnter starts the operation and returns at once, the thread is given back to its context
+//  the promisee may be resolved in any thread, OnLeave follows in that thread
 //
 template<typename ReturnType>
 class AsyncTask
@@ -210,7 +213,7 @@ namespace Detail
         template<typename T>
         class PromiseCore : public PromiseChainHead
         {
-            template<typename T>
+            template<typename U>
             friend class PromiseCore;
 
         public:
@@ -458,7 +461,7 @@ namespace Detail
             }
 
         public:
-            virtual void OnFulfill(const ArgType& value)
+            virtual void OnFulfill(const ArgType& value) throw()
             {
                 if (m_nextCore->GetContext() == ThreadContext::Current())
                 {
@@ -471,7 +474,7 @@ namespace Detail
                 }
             }
 
-            virtual void OnRefused(Exception *exception)
+            virtual void OnRefused(Exception *exception) throw()
             {
                 Dispatcher::PostCallable(new ExceptionCallable<ArgType, NextReturnType>(m_forwarder, exception, m_nextCore), m_nextCore->GetContext());
             }
@@ -499,7 +502,7 @@ namespace Detail
             }
 
         public:
-            virtual void OnFulfill()
+            virtual void OnFulfill() throw()
             {
                 if (m_nextCore->GetContext() == ThreadContext::Current())
                 {
@@ -512,7 +515,7 @@ namespace Detail
                 }
             }
 
-            virtual void OnRefused(Exception *exception)
+            virtual void OnRefused(Exception *exception) throw()
             {
                 Dispatcher::PostCallable(new ExceptionCallable<void, NextReturnType>(m_forwarder, exception, m_nextCore), m_nextCore->GetContext());
             }
@@ -537,9 +540,9 @@ namespace Detail
             public:
                 virtual ReturnType Run()
                 {
-                    if (m_exception)
+                    if (this->m_exception)
                     {
-                        ScopedPointer<Exception> ex(m_exception);
+                        ScopedPointer<Exception> ex(this->m_exception);
                         return m_object->OnException(*ex);
                     }
                     else
@@ -571,9 +574,9 @@ namespace Detail
             public:
                 virtual ReturnType Run()
                 {
-                    if (m_exception)
+                    if (this->m_exception)
                     {
-                        ScopedPointer<Exception> ex(m_exception);
+                        ScopedPointer<Exception> ex(this->m_exception);
                         return m_object->OnException(*ex);
                     }
                     else
@@ -620,6 +623,17 @@ namespace Detail
                 OnException m_onException;
             };
 
+            //! a void promise passes nothing on success
+            template<typename ReturnType>
+            struct Functor<void, ReturnType>
+            {
+                typedef ReturnType(*OnSuccess)();
+                typedef ReturnType(*OnException)(const Exception&);
+
+                OnSuccess m_onSuccess;
+                OnException m_onException;
+            };
+
             template<typename ArgType, typename ReturnType>
             class FunctorPromiseProc : public Detail::Core::PromiseAbstractProc<ArgType, ReturnType>
             {
@@ -638,9 +652,9 @@ namespace Detail
             public:
                 virtual ReturnType Run()
                 {
-                    if (m_exception)
+                    if (this->m_exception)
                     {
-                        ScopedPointer<Exception> ex(m_exception);
+                        ScopedPointer<Exception> ex(this->m_exception);
                         return m_functor.m_onException(*ex);
                     }
                     else
@@ -672,9 +686,9 @@ namespace Detail
             public:
                 virtual ReturnType Run()
                 {
-                    if (m_exception)
+                    if (this->m_exception)
                     {
-                        ScopedPointer<Exception> ex(m_exception);
+                        ScopedPointer<Exception> ex(this->m_exception);
                         return m_functor.m_onException(*ex);
                     }
                     else
@@ -808,35 +822,6 @@ namespace Detail
             }
         };
 
-        template<typename ReturnType>
-        class ThreadPoolAsyncTask : public Private::_ThreadPoolAsyncGuard, public AsyncTask<ReturnType>
-        {
-        private:
-            AsyncTask<ReturnType> *m_task;
-
-        public:
-            ThreadPoolAsyncTask(AsyncTask<ReturnType> *task)
-                : m_task(task)
-            {}
-
-            virtual ~ThreadPoolAsyncTask()
-            {
-                delete m_task;
-            }
-
-        public:
-            virtual void OnEnter(ThreadLocalManager *tlm, const Promisee<ReturnType>& promisee)
-            {
-                Private::_ThreadPoolAsyncGuard::OnEnter();
-                m_task->OnEnter(tlm, promisee);
-            }
-            virtual void OnLeave(ThreadLocalManager *tlm)
-            {
-                m_task->OnLeave(tlm);
-                Private::_ThreadPoolAsyncGuard::OnLeave();
-            }
-        };
-
         template<typename ReturnType>
         class AsyncTaskPromiseProc : public Detail::Core::PromiseProc<ReturnType>
         {
@@ -853,11 +838,7 @@ namespace Detail
         public:
             virtual ReturnType Run()
             {
-                const ThreadContext& context = m_core->GetContext();
-                AsyncCallable *callable = context.IsThreadPool() ? new AsyncTaskWrapper<ReturnType>(new ThreadPoolAsyncTask<ReturnType>(m_task), m_core)
-                    : new AsyncTaskWrapper<ReturnType>(m_task, m_core);
-
-                Dispatcher::PostCallable(callable, context);
+                Dispatcher::PostCallable(new AsyncTaskWrapper<ReturnType>(m_task, m_core), m_core->GetContext());
                 return ReturnType();	//!	fake
             }
         };
@@ -1032,7 +1013,7 @@ public:
     template<typename T>
     static Promise<T> Make(Task<T> *task, const ThreadContext& context)
     {
-        Detail::Core::PromiseCore<T> *core = Detail::Core::PromiseCore<T>::Create<Detail::TaskBased::TaskCreateTrait>(task, context);
+        Detail::Core::PromiseCore<T> *core = Detail::Core::PromiseCore<T>::template Create<Detail::TaskBased::TaskCreateTrait>(task, context);
 
         Promise<T> promise;
         promise.m_core = core;
@@ -1043,7 +1024,7 @@ public:
     template<typename T>
     static Promise<T> Make(AsyncTask<T> *task, const ThreadContext& context)
     {
-        Detail::Core::PromiseCore<T> *core = Detail::Core::PromiseCore<T>::Create<Detail::TaskBased::AsyncTaskCreateTrait>(task, context);
+        Detail::Core::PromiseCore<T> *core = Detail::Core::PromiseCore<T>::template Create<Detail::TaskBased::AsyncTaskCreateTrait>(task, context);
 
         Promise<T> promise;
         promise.m_core = core;
@@ -1055,7 +1036,7 @@ public:
 template<typename T>
 class Promise
 {
-    template<typename T>
+    template<typename U>
     friend class Promise;
 
     friend class Promisee<T>;
@@ -1069,7 +1050,7 @@ public:
     template<typename Return, typename StaticInheritedClass>
     Promise<Return> Then(StaticInheritedClass *object, const ThreadContext& context)
     {
-        Detail::Core::PromiseCore<Return> *nextCore = m_core->AppendNext<Return, Detail::GeneralImpl::StaticInheritedClassImpl::StaticInheritedClassAppendTrait>(object, context);
+        Detail::Core::PromiseCore<Return> *nextCore = m_core->template AppendNext<Return, Detail::GeneralImpl::StaticInheritedClassImpl::StaticInheritedClassAppendTrait>(object, context);
 
         Promise<Return> nextPromise;
         nextPromise.m_core = nextCore;
@@ -1077,13 +1058,14 @@ public:
         return nextPromise;
     }
 
+    //! OnSuccess is Return(*)(T), or Return(*)() when T is void
     template<typename Return>
-    Promise<Return> Then(Return(*OnSuccess)(T), Return(*OnException)(const Exception&), const ThreadContext& context)
+    Promise<Return> Then(typename Detail::GeneralImpl::FunctorImpl::Functor<T, Return>::OnSuccess OnSuccess, Return(*OnException)(const Exception&), const ThreadContext& context)
     {
         Detail::GeneralImpl::FunctorImpl::Functor<T, Return> functor;
         functor.m_onException = OnException;
         functor.m_onSuccess = OnSuccess;
-        Detail::Core::PromiseCore<Return> *nextCore = m_core->AppendNext<Return, Detail::GeneralImpl::FunctorImpl::FunctorAppendTrait>(functor, context);
+        Detail::Core::PromiseCore<Return> *nextCore = m_core->template AppendNext<Return, Detail::GeneralImpl::FunctorImpl::FunctorAppendTrait>(functor, context);
 
         Promise<Return> nextPromise;
         nextPromise.m_core = nextCore;
@@ -9,7 +9,7 @@ class HTTPCLIENT_EXPORT RefSharedPointer
 {
 public:
     typedef typename PointerTypeTrait<T>::Type PointerType;
-    typedef typename RefSharedPointer<T, Deleter> SelfType;
+    typedef RefSharedPointer<T, Deleter> SelfType;
 
 private:
     PointerType *m_rawPtr;
@@ -53,29 +53,25 @@ public:
 
 public:
     operator bool() const { return NULL != m_rawPtr; }
-    bool operator == (PointerType *ptr) const { return ptr == m_rawPtr }
-    bool operator != (PointerType *ptr) const { return ptr != m_rawPtr }
+    bool operator == (PointerType *ptr) const { return ptr == m_rawPtr; }
+    bool operator != (PointerType *ptr) const { return ptr != m_rawPtr; }
 
-    bool operator == (const SelfType& ptr) const { return ptr.m_rawPtr == m_rawPtr }
-    bool operator != (const SelfType& ptr) const { return ptr.m_rawPtr != m_rawPtr }
+    bool operator == (const SelfType& ptr) const { return ptr.m_rawPtr == m_rawPtr; }
+    bool operator != (const SelfType& ptr) const { return ptr.m_rawPtr != m_rawPtr; }
 
     SelfType& operator = (const SelfType& t)
     {
+        //! add first, in case of self assignment
+        if (t.m_rawPtr)
+            t.m_rawPtr->m_ref.AddRef();
+
         if (m_rawPtr)
         {
             if (m_rawPtr->m_ref.Release())
-            {
                 Deleter::Deletes(m_rawPtr);
-                m_rawPtr = NULL;
-            }
-        }
-
-        if (t.m_rawPtr)
-        {
-            m_rawPtr = t.m_rawPtr;
-            m_rawPtr->m_ref.AddRef();
         }
 
+        m_rawPtr = t.m_rawPtr;
         return *this;
     }
 };
@@ -8,7 +8,7 @@ template<typename _Pointer_Type, typename _Deleter = DefaultDeleter<_Pointer_Typ
 class HTTPCLIENT_EXPORT ScopedPointer
 {
     typedef typename PointerTypeTrait<_Pointer_Type>::Type _Given_Pointer_Type;
-    typedef typename ScopedPointer<_Pointer_Type, _Deleter> _Self_Type;
+    typedef ScopedPointer<_Pointer_Type, _Deleter> _Self_Type;
 
 public:
     ScopedPointer(_Given_Pointer_Type *_raw_ptr)
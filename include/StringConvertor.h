@@ -32,6 +32,15 @@ public:
 
 class HTTPCLIENT_EXPORT StringConvertor
 {
+public:
+    enum Base64Alphabet
+    {
+        //! RFC 4648 section 4, padded
+        Base64Standard,
+        //! RFC 4648 section 5, not padded
+        Base64UrlSafe
+    };
+
 public:
     //! format includes
     //! 2x/X
@@ -39,8 +48,38 @@ public:
     static void FromBytes(const ConstBytesArray& array, std::string& out, const std::string& format = "2x");
     static void FromBytes(const ConstBytesArray& array, std::wstring& out, const std::string& format = "2x");
 
-    //! to UTF 8 encoding
+    //! to UTF 8 encoding, appended to out
+    //! lone surrogates and the code points beyond U+10FFFF are replaced with U+FFFD
     static void FromString(const std::wstring& input, std::string& out);
+    static void FromString(const wchar_t *input, size_t length, std::string& out);
+
+    //! from UTF 8 encoding, UTF 16 where wchar_t is 16 bits, appended to out
+    //! malformed sequences are replaced with U+FFFD
+    static void ToString(const std::string& input, std::wstring& out);
+    static void ToString(const char *input, size_t length, std::wstring& out);
+
+    //
+    //  written into the buffers of the caller, no allocations
+    //
+    //! 2 * length digits
+    static void ToHex(const uint8_t *data, size_t length, char *out, bool isUpperCase = false);
+    //! length / 2 bytes, false when length is odd or not a hex digit
+    static bool FromHex(const char *hex, size_t length, uint8_t *out);
+
+    static size_t GetBase64Length(size_t length, Base64Alphabet alphabet = Base64Standard);
+    //! GetBase64Length characters, returns the count
+    static size_t ToBase64(const uint8_t *data, size_t length, char *out, Base64Alphabet alphabet = Base64Standard);
+    //! padded or not, no line breaks, out holds length / 4 * 3 + 2 bytes at most
+    //! false when malformed
+    static bool FromBase64(const char *base64, size_t length, uint8_t *out, size_t& outLength, Base64Alphabet alphabet = Base64Standard);
+
+    //! the unreserved ones of RFC 3986 are kept, the others are escaped as %XX
+    static size_t GetPercentEncodedLength(const char *data, size_t length);
+    //! GetPercentEncodedLength characters, returns the count
+    static size_t ToPercentEncoding(const char *data, size_t length, char *out);
+    //! out holds length bytes at most, '+' is decoded as space when isPlusSpace as in forms
+    //! false when '%' is not followed by 2 hex digits
+    static bool FromPercentEncoding(const char *encoded, size_t length, char *out, size_t& outLength, bool isPlusSpace = false);
 };
 
 #endif
\ No newline at end of file
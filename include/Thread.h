@@ -1,11 +1,30 @@
 #ifndef THREAD_H
 #define THREAD_H
 
+#if defined(_WIN32)
 #include <Windows.h>
+#else
+#include <pthread.h>
+#include <stdint.h>
+
+typedef uint32_t DWORD;
+typedef void *HANDLE;
+typedef unsigned int UINT;
+typedef uintptr_t WPARAM;
+typedef intptr_t LPARAM;
+
+#ifndef INFINITE
+#define INFINITE 0xFFFFFFFF
+#endif
+#endif
+
+#include <cstddef>
 #include <map>
 
 #include "HttpClientExport.h"
 
+class _Mailbox;
+
 ///	thread related
 class HTTPCLIENT_EXPORT ThreadContext
 {
@@ -23,22 +42,32 @@ private:
     DWORD m_dwThreadID;
 
     HANDLE m_hHandle;
+#if defined(_WIN32)
     HWND m_hWnd;
+#endif
 
     Type m_type;
 
+    //! resolved once, so posting to the context never looks it up, NULL when made of a bare thread id
+    _Mailbox *m_mailbox;
+
 public:
     //! NB
     //! if u inside any thread and to get current context
     //! the type of context is always worker context
     static ThreadContext Current();
+#if defined(_WIN32)
     static ThreadContext FromUIWindow(HWND hWnd);
+#endif
     static ThreadContext FromThreadPool();
 
 public:
     ThreadContext(DWORD dwThreaID, HANDLE hThread);
+    ThreadContext(const ThreadContext& context);
     ~ThreadContext();
 
+    ThreadContext& operator = (const ThreadContext& context);
+
 public:
     bool IsThreadPool() const { return m_type == ThreadPoolContext; }
 
@@ -56,7 +85,23 @@ private:
     ThreadContext();
 };
 
-class HTTPCLIENT_EXPORT Callable
+//! link of the mailbox of a thread context, the posted ones are queued in place
+class HTTPCLIENT_EXPORT MailboxNode
+{
+    friend class _Mailbox;
+
+private:
+    MailboxNode *volatile m_next;
+    UINT m_message;
+
+public:
+    MailboxNode()
+        : m_next(NULL)
+        , m_message(0)
+    {}
+};
+
+class HTTPCLIENT_EXPORT Callable : public MailboxNode
 {
 public:
     virtual ~Callable() {}
@@ -64,7 +109,7 @@ public:
 };
 
 class Dispatcher;
-class HTTPCLIENT_EXPORT AsyncCallable
+class HTTPCLIENT_EXPORT AsyncCallable : public MailboxNode
 {
 public:
     virtual ~AsyncCallable() {}
@@ -152,7 +197,9 @@ public:
     static void PostCallable(AsyncCallable *callable, const ThreadContext& context);
 
 public:
+#if defined(_WIN32)
     bool EventDispatch(PMSG pMsg);
+#endif
     bool EventDispatch(UINT uMsg, WPARAM wParam, LPARAM lParam);
     ThreadLocalManager *GetThreadLocalManager() { return &m_manager; }
 };
@@ -165,29 +212,27 @@ public:
     static void Quit();
 };
 
-namespace Private
-{
-    class HTTPCLIENT_EXPORT _ThreadPoolAsyncGuard
-    {
-    private:
-        DWORD m_dwThreadID;
-
-    public:
-        void OnEnter();
-        void OnLeave();
-    };
-}
-
-#ifdef _WIN64
+#if defined(_WIN64)
 #define REF volatile LONGLONG
 #define Increment InterlockedIncrement64
 #define Decrement InterlockedDecrement64
 #define CompareExchange InterlockedCompareExchange64
-#else
+#elif defined(_WIN32)
 #define REF volatile LONG
 #define Increment InterlockedIncrement
 #define Decrement InterlockedDecrement
 #define CompareExchange InterlockedCompareExchange
+#else
+#define REF volatile long
+
+//! same semantics as Interlocked* family, returns the resulting value
+inline long Increment(volatile long *value) { return __sync_add_and_fetch(value, 1); }
+inline long Decrement(volatile long *value) { return __sync_sub_and_fetch(value, 1); }
+//! returns the initial value
+inline long CompareExchange(volatile long *dest, long exchange, long comparand)
+{
+    return __sync_val_compare_and_swap(dest, comparand, exchange);
+}
 #endif
 
 class HTTPCLIENT_EXPORT AtomicRef
@@ -211,6 +256,7 @@ public:
     }
 };
 
+#if defined(_WIN32)
 class CriticalSection
 {
     CRITICAL_SECTION m_criticalSection;
@@ -281,6 +327,58 @@ public:
         ::ResetEvent(m_resetEvent);
     }
 };
+#else
+//! recursive as CRITICAL_SECTION
+class CriticalSection
+{
+    pthread_mutex_t m_mutex;
+
+public:
+    CriticalSection()
+        : m_mutex()
+    {
+        pthread_mutexattr_t attr;
+        ::pthread_mutexattr_init(&attr);
+        ::pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+        ::pthread_mutex_init(&m_mutex, &attr);
+        ::pthread_mutexattr_destroy(&attr);
+    }
+    ~CriticalSection()
+    {
+        ::pthread_mutex_destroy(&m_mutex);
+    }
+
+public:
+    void Lock()
+    {
+        ::pthread_mutex_lock(&m_mutex);
+    }
+    void Unlock()
+    {
+        ::pthread_mutex_unlock(&m_mutex);
+    }
+};
+
+class HTTPCLIENT_EXPORT ManualResetEvent
+{
+private:
+    mutable pthread_mutex_t m_mutex;
+    pthread_cond_t m_cond;
+    bool m_isSignaled;
+
+public:
+    ManualResetEvent();
+    explicit ManualResetEvent(bool isSignaled);
+    ~ManualResetEvent();
+
+public:
+    bool Wait(DWORD timeout);
+    bool IsSignaled() const;
+
+    void Signal();
+    void Reset();
+};
+#endif
 
 template<typename T>
 class AutoLock
@@ -305,6 +403,9 @@ class HTTPCLIENT_EXPORT Thread
 {
 private:
     ThreadContext m_context;
+#if !defined(_WIN32)
+    pthread_t m_thread;
+#endif
 
 public:
     Thread();
@@ -101,8 +101,8 @@ class ReturnIsTemplate	//!	can convert
     typedef uint16_t Yes;
     typedef uint8_t No;
 
-    template<typename T>
-    static Yes _Tester(TemplateClass<T>);
+    template<typename U>
+    static Yes _Tester(TemplateClass<U>);
     static No _Tester(...);
 
 public:
@@ -0,0 +1,484 @@
+#include "BufferPool.h"
+
+#include <cstdlib>
+
+#if !defined(_WIN32)
+#include <sys/mman.h>
+#endif
+
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+#define BUFFERPOOL_HUGEPAGES
+#endif
+
+namespace Net
+{
+    namespace Details
+    {
+        enum
+        {
+            MinClassShift = 12,
+            MaxClassShift = 20,
+            PoolClassCount = MaxClassShift - MinClassShift + 1,
+            //! bytes a thread keeps of each class, one buffer of the larger ones
+            ThreadCacheBytes = 256 * 1024,
+            ThreadCacheDepth = 8,
+            //! bytes a shared list keeps, at least 4 buffers
+            SharedListBytes = 4 * 1024 * 1024,
+            //! of x86-64 and arm64 with 4 KiB pages
+            HugePageLength = 2 * 1024 * 1024
+        };
+
+        //! the link is stored in the idle buffer itself
+        struct IdleBuffer
+        {
+            IdleBuffer *next;
+        };
+
+        struct SizeClass
+        {
+            CriticalSection lock;
+            IdleBuffer *idle;
+            uint32_t idleCount;
+            uint32_t capacity;
+
+            REF reusedCount;
+            REF allocatedCount;
+            REF releasedCount;
+            REF usedCount;
+
+            SizeClass()
+                : lock()
+                , idle(NULL)
+                , idleCount(0)
+                , capacity(0)
+                , reusedCount(0)
+                , allocatedCount(0)
+                , releasedCount(0)
+                , usedCount(0)
+            {}
+        };
+
+        class SharedBufferPool
+        {
+        public:
+            SizeClass classes[PoolClassCount];
+
+            //! the mode is settled by the first buffer taken from the system
+            CriticalSection settingLock;
+            bool hasAllocated;
+            bool isHugePagesEnabled;
+
+            //! beyond the classes
+            CriticalSection largeLock;
+            uint64_t largeAllocatedCount;
+            uint64_t largeUsedCount;
+            uint64_t largeUsedBytes;
+
+            //! no cache when the thread exit can't be hooked
+            bool isThreadCacheEnabled;
+#if defined(_WIN32)
+            DWORD threadExitHook;
+#else
+            pthread_key_t threadExitHook;
+#endif
+
+        public:
+            SharedBufferPool();
+        };
+
+        struct ThreadCache
+        {
+            void *buffers[PoolClassCount][ThreadCacheDepth];
+            uint32_t counts[PoolClassCount];
+            bool isHooked;
+        };
+    }
+}
+
+using namespace Net;
+using namespace Net::Details;
+
+#if defined(_WIN32)
+static __declspec(thread) ThreadCache _threadCache;
+#else
+static __thread ThreadCache _threadCache;
+#endif
+
+//! never destroyed, the buffers may be freed by the static objects of the others at exit
+static SharedBufferPool& _Pool()
+{
+    static SharedBufferPool *pool = new SharedBufferPool;
+    return *pool;
+}
+
+static inline uint32_t _ClassOf(size_t length)
+{
+    if (length <= BufferPool::MinClassLength)
+        return 0;
+
+    uint32_t index = 0;
+    for (size_t n = (length - 1) >> MinClassShift; 0 != n; n >>= 1)
+        ++index;
+
+    return index;
+}
+
+static inline size_t _ClassLength(uint32_t index)
+{
+    return static_cast<size_t>(1) << (MinClassShift + index);
+}
+
+static inline uint32_t _ThreadCacheDepth(uint32_t index)
+{
+    size_t depth = ThreadCacheBytes / _ClassLength(index);
+    if (0 == depth)
+        return 1;
+
+    return depth < ThreadCacheDepth ? static_cast<uint32_t>(depth) : static_cast<uint32_t>(ThreadCacheDepth);
+}
+
+#if defined(BUFFERPOOL_HUGEPAGES)
+//! aligned to the huge page, so the kernel is able to back it by one
+static void *_MapHugePages(size_t length)
+{
+    size_t mapped = length + HugePageLength;
+    void *region = ::mmap(NULL, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (MAP_FAILED == region)
+        return NULL;
+
+    uintptr_t start = reinterpret_cast<uintptr_t>(region);
+    uintptr_t aligned = (start + HugePageLength - 1) & ~static_cast<uintptr_t>(HugePageLength - 1);
+    if (aligned != start)
+        ::munmap(region, aligned - start);
+    if (aligned + length != start + mapped)
+        ::munmap(reinterpret_cast<void *>(aligned + length), start + mapped - aligned - length);
+
+    ::madvise(reinterpret_cast<void *>(aligned), length, MADV_HUGEPAGE);
+    return reinterpret_cast<void *>(aligned);
+}
+#endif
+
+static void _FlushThreadCache(void *cache);
+
+#if defined(_WIN32)
+static VOID WINAPI _OnThreadExit(PVOID cache)
+{
+    _FlushThreadCache(cache);
+}
+#endif
+
+SharedBufferPool::SharedBufferPool()
+    : classes()
+    , settingLock()
+    , hasAllocated(false)
+    , isHugePagesEnabled(false)
+    , largeLock()
+    , largeAllocatedCount(0)
+    , largeUsedCount(0)
+    , largeUsedBytes(0)
+    , isThreadCacheEnabled(false)
+    , threadExitHook()
+{
+    for (uint32_t i = 0; i != PoolClassCount; ++i)
+    {
+        size_t capacity = SharedListBytes / _ClassLength(i);
+        classes[i].capacity = capacity < 4 ? 4 : static_cast<uint32_t>(capacity);
+    }
+
+#if defined(_WIN32)
+    threadExitHook = ::FlsAlloc(_OnThreadExit);
+    isThreadCacheEnabled = FLS_OUT_OF_INDEXES != threadExitHook;
+#else
+    isThreadCacheEnabled = 0 == ::pthread_key_create(&threadExitHook, _FlushThreadCache);
+#endif
+}
+
+//! false when the list is full, the buffer is left to the caller
+static bool _PushIdle(SizeClass& sizeClass, void *buffer)
+{
+    AutoLock<CriticalSection> locker(&sizeClass.lock);
+
+    if (sizeClass.idleCount >= sizeClass.capacity)
+        return false;
+
+    IdleBuffer *idle = static_cast<IdleBuffer *>(buffer);
+    idle->next = sizeClass.idle;
+    sizeClass.idle = idle;
+    ++sizeClass.idleCount;
+
+    return true;
+}
+
+static void *_PopIdle(SizeClass& sizeClass)
+{
+    AutoLock<CriticalSection> locker(&sizeClass.lock);
+
+    IdleBuffer *idle = sizeClass.idle;
+    if (NULL != idle)
+    {
+        sizeClass.idle = idle->next;
+        --sizeClass.idleCount;
+    }
+
+    return idle;
+}
+
+static void _Release(SizeClass& sizeClass, void *buffer)
+{
+    ::free(buffer);
+    ::Increment(&sizeClass.releasedCount);
+}
+
+static void _FlushThreadCache(void *cache)
+{
+    ThreadCache *threadCache = static_cast<ThreadCache *>(cache);
+    SharedBufferPool& pool = _Pool();
+
+    for (uint32_t i = 0; i != PoolClassCount; ++i)
+    {
+        for (uint32_t j = 0; j != threadCache->counts[i]; ++j)
+        {
+            if (!_PushIdle(pool.classes[i], threadCache->buffers[i][j]))
+                _Release(pool.classes[i], threadCache->buffers[i][j]);
+        }
+
+        threadCache->counts[i] = 0;
+    }
+}
+
+//! settles the mode on the first call
+static bool _IsHugePagesEnabled(SharedBufferPool& pool)
+{
+    AutoLock<CriticalSection> locker(&pool.settingLock);
+
+    pool.hasAllocated = true;
+    return pool.isHugePagesEnabled;
+}
+
+static void *_AllocateClass(SharedBufferPool& pool, uint32_t index)
+{
+    SizeClass& sizeClass = pool.classes[index];
+    size_t classLength = _ClassLength(index);
+
+#if defined(BUFFERPOOL_HUGEPAGES)
+    if (_IsHugePagesEnabled(pool))
+    {
+        //! the first one is returned, the others are idle
+        uint8_t *slab = static_cast<uint8_t *>(_MapHugePages(HugePageLength));
+        if (NULL == slab)
+            return NULL;
+
+        ::Increment(&sizeClass.allocatedCount);
+        for (size_t offset = classLength; offset != HugePageLength; offset += classLength)
+        {
+            _PushIdle(sizeClass, slab + offset);
+            ::Increment(&sizeClass.allocatedCount);
+        }
+
+        return slab;
+    }
+#else
+    _IsHugePagesEnabled(pool);
+#endif
+
+    void *buffer = ::malloc(classLength);
+    if (NULL != buffer)
+        ::Increment(&sizeClass.allocatedCount);
+
+    return buffer;
+}
+
+static void *_AllocateLarge(SharedBufferPool& pool, size_t length)
+{
+    void *buffer = NULL;
+
+#if defined(BUFFERPOOL_HUGEPAGES)
+    if (_IsHugePagesEnabled(pool))
+    {
+        size_t mapped = (length + HugePageLength - 1) & ~static_cast<size_t>(HugePageLength - 1);
+        buffer = _MapHugePages(mapped);
+    }
+    else
+#endif
+    {
+        _IsHugePagesEnabled(pool);
+        buffer = ::malloc(length);
+    }
+
+    if (NULL != buffer)
+    {
+        AutoLock<CriticalSection> locker(&pool.largeLock);
+
+        ++pool.largeAllocatedCount;
+        ++pool.largeUsedCount;
+        pool.largeUsedBytes += length;
+    }
+
+    return buffer;
+}
+
+static void _FreeLarge(SharedBufferPool& pool, void *buffer, size_t length)
+{
+    {
+        AutoLock<CriticalSection> locker(&pool.largeLock);
+
+        --pool.largeUsedCount;
+        pool.largeUsedBytes -= length;
+    }
+
+#if defined(BUFFERPOOL_HUGEPAGES)
+    //! the mode was settled by the allocation of the buffer
+    if (pool.isHugePagesEnabled)
+    {
+        size_t mapped = (length + HugePageLength - 1) & ~static_cast<size_t>(HugePageLength - 1);
+        ::munmap(buffer, mapped);
+        return;
+    }
+#endif
+
+    ::free(buffer);
+}
+
+void *BufferPool::Allocate(size_t length)
+{
+    SharedBufferPool& pool = _Pool();
+
+    if (length > MaxClassLength)
+        return _AllocateLarge(pool, length);
+
+    uint32_t index = _ClassOf(length);
+    SizeClass& sizeClass = pool.classes[index];
+
+    void *buffer = NULL;
+    if (0 != _threadCache.counts[index])
+        buffer = _threadCache.buffers[index][--_threadCache.counts[index]];
+    else
+        buffer = _PopIdle(sizeClass);
+
+    if (NULL != buffer)
+        ::Increment(&sizeClass.reusedCount);
+    else if (NULL == (buffer = _AllocateClass(pool, index)))
+        return NULL;
+
+    ::Increment(&sizeClass.usedCount);
+    return buffer;
+}
+
+void BufferPool::Free(void *buffer, size_t length)
+{
+    if (NULL == buffer)
+        return;
+
+    SharedBufferPool& pool = _Pool();
+
+    if (length > MaxClassLength)
+    {
+        _FreeLarge(pool, buffer, length);
+        return;
+    }
+
+    uint32_t index = _ClassOf(length);
+    SizeClass& sizeClass = pool.classes[index];
+
+    ::Decrement(&sizeClass.usedCount);
+
+    if (pool.isThreadCacheEnabled && _threadCache.counts[index] < _ThreadCacheDepth(index))
+    {
+        if (!_threadCache.isHooked)
+        {
+            //! any non-null value makes the hook called at the thread exit
+#if defined(_WIN32)
+            ::FlsSetValue(pool.threadExitHook, &_threadCache);
+#else
+            ::pthread_setspecific(pool.threadExitHook, &_threadCache);
+#endif
+            _threadCache.isHooked = true;
+        }
+
+        _threadCache.buffers[index][_threadCache.counts[index]++] = buffer;
+        return;
+    }
+
+    if (!_PushIdle(sizeClass, buffer))
+        _Release(sizeClass, buffer);
+}
+
+bool BufferPool::EnableHugePages()
+{
+#if defined(BUFFERPOOL_HUGEPAGES)
+    SharedBufferPool& pool = _Pool();
+    AutoLock<CriticalSection> locker(&pool.settingLock);
+
+    if (pool.hasAllocated)
+        return pool.isHugePagesEnabled;
+
+    //! the carved buffers can't be given back, so the lists keep all of them
+    for (uint32_t i = 0; i != PoolClassCount; ++i)
+        pool.classes[i].capacity = 0xFFFFFFFF;
+
+    pool.isHugePagesEnabled = true;
+    return true;
+#else
+    return false;
+#endif
+}
+
+BufferPool::Statistics BufferPool::GetStatistics()
+{
+    SharedBufferPool& pool = _Pool();
+    Statistics statistics = { 0, 0, 0, 0, 0, 0 };
+
+    for (uint32_t i = 0; i != PoolClassCount; ++i)
+    {
+        SizeClass& sizeClass = pool.classes[i];
+        size_t classLength = _ClassLength(i);
+
+        statistics.reusedCount += sizeClass.reusedCount;
+        statistics.allocatedCount += sizeClass.allocatedCount;
+        statistics.releasedCount += sizeClass.releasedCount;
+        statistics.usedCount += sizeClass.usedCount;
+        statistics.usedBytes += static_cast<uint64_t>(sizeClass.usedCount) * classLength;
+
+        AutoLock<CriticalSection> locker(&sizeClass.lock);
+        statistics.idleBytes += static_cast<uint64_t>(sizeClass.idleCount) * classLength;
+    }
+
+    AutoLock<CriticalSection> locker(&pool.largeLock);
+    statistics.allocatedCount += pool.largeAllocatedCount;
+    statistics.releasedCount += pool.largeAllocatedCount - pool.largeUsedCount;
+    statistics.usedCount += pool.largeUsedCount;
+    statistics.usedBytes += pool.largeUsedBytes;
+
+    return statistics;
+}
+
+void BufferPool::Trim()
+{
+    SharedBufferPool& pool = _Pool();
+
+    if (pool.isHugePagesEnabled)
+        return;
+
+    _FlushThreadCache(&_threadCache);
+
+    for (uint32_t i = 0; i != PoolClassCount; ++i)
+    {
+        SizeClass& sizeClass = pool.classes[i];
+
+        IdleBuffer *idle = NULL;
+        {
+            AutoLock<CriticalSection> locker(&sizeClass.lock);
+
+            idle = sizeClass.idle;
+            sizeClass.idle = NULL;
+            sizeClass.idleCount = 0;
+        }
+
+        while (NULL != idle)
+        {
+            IdleBuffer *next = idle->next;
+            _Release(sizeClass, idle);
+            idle = next;
+        }
+    }
+}
@@ -0,0 +1,646 @@
+#include "IoEngine.h"
+
+#if defined(__linux__)
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <vector>
+
+#include "BufferPool.h"
+
+namespace Net
+{
+    namespace Details
+    {
+        enum
+        {
+            MaxEvents = 256,
+            //! the initial read length of a channel
+            ReceiveBufferLength = 16 * 1024
+        };
+
+        class EpollChannel;
+        typedef std::multimap<uint64_t, EpollChannel *> Deadlines;
+
+        class EpollChannel : public Channel
+        {
+        public:
+            int m_fd;
+            ChannelHandler *m_handler;
+            SocketOptions m_options;
+
+            //! readiness reported by the edges, cleared by EAGAIN
+            bool m_isReadable;
+            bool m_isWritable;
+
+            //! pending operations
+            bool m_isConnecting;
+            bool m_isReceiving;
+            AdaptiveReadLength m_receiveLength;
+            const uint8_t *m_sendData;
+            uint32_t m_sendLength;
+            uint32_t m_sentLength;
+
+            //! in ready list
+            bool m_isQueued;
+            bool m_isClosed;
+
+            bool m_hasDeadline;
+            Deadlines::iterator m_deadline;
+
+        public:
+            EpollChannel(ChannelHandler *handler, const SocketOptions& options)
+                : m_fd(-1)
+                , m_handler(handler)
+                , m_options(options)
+                , m_isReadable(false)
+                , m_isWritable(false)
+                , m_isConnecting(false)
+                , m_isReceiving(false)
+                , m_receiveLength(ReceiveBufferLength)
+                , m_sendData(NULL)
+                , m_sendLength(0)
+                , m_sentLength(0)
+                , m_isQueued(false)
+                , m_isClosed(false)
+                , m_hasDeadline(false)
+                , m_deadline()
+            {}
+
+        public:
+            bool IsReady() const
+            {
+                return (m_isWritable && (m_isConnecting || NULL != m_sendData))
+                    || (m_isReadable && m_isReceiving);
+            }
+        };
+
+        //
+        //  edge-triggered epoll
+        //      every socket registered once for both directions
+        //      operations are attempted when the edge says it's ready, the ones would block wait for the next edge
+        //
+        class EpollIoEngine : public IoEngine
+        {
+        private:
+            int m_epollFd;
+            int m_wakeupFd;
+
+            //! only touched in the engine thread
+            std::vector<EpollChannel *> m_ready;
+            Deadlines m_deadlines;
+            //! shared by the channels, as long as the longest read length among them
+            uint8_t *m_receiveBuffer;
+            uint32_t m_receiveBufferLength;
+
+            CriticalSection m_postLock;
+            std::vector<Callable *> m_posted;
+            bool m_isWakingUp;
+
+        public:
+            EpollIoEngine();
+            virtual ~EpollIoEngine();
+
+        public:
+            virtual Channel *CreateChannel(ChannelHandler *handler, const SocketOptions& options);
+
+            virtual void Connect(Channel *channel, const struct sockaddr *addr, socklen_t addrLen);
+            virtual void Send(Channel *channel, const uint8_t *data, uint32_t len);
+            virtual void Receive(Channel *channel);
+            virtual void Close(Channel *channel);
+
+            virtual bool IsAlive(Channel *channel);
+
+            virtual void Post(Callable *callable);
+
+        public:
+            virtual void RunOnce(DWORD timeout);
+
+        public:
+            //! called in the engine thread
+            void OnConnecting(EpollChannel *channel, const struct sockaddr_storage& addr, socklen_t addrLen);
+            void OnClosing(EpollChannel *channel);
+
+        private:
+            void Schedule(EpollChannel *channel);
+            void Perform(EpollChannel *channel);
+            void Detach(EpollChannel *channel);
+
+            void SetDeadline(EpollChannel *channel, uint32_t timeout);
+            void ClearDeadline(EpollChannel *channel);
+            //! once an operation completed, the other one still pending keeps its own timeout
+            void RearmDeadline(EpollChannel *channel);
+
+            void DispatchReady();
+            void DispatchPosted();
+            void DispatchDeadlines();
+        };
+
+        class ConnectCallable : public Callable
+        {
+        private:
+            EpollIoEngine *m_engine;
+            EpollChannel *m_channel;
+
+            struct sockaddr_storage m_addr;
+            socklen_t m_addrLen;
+
+        public:
+            ConnectCallable(EpollIoEngine *engine, EpollChannel *channel, const struct sockaddr *addr, socklen_t addrLen)
+                : m_engine(engine)
+                , m_channel(channel)
+                , m_addr()
+                , m_addrLen(addrLen)
+            {
+                ::memcpy(&m_addr, addr, addrLen);
+            }
+
+        public:
+            virtual void Invoke()
+            {
+                m_engine->OnConnecting(m_channel, m_addr, m_addrLen);
+            }
+        };
+
+        class CloseCallable : public Callable
+        {
+        private:
+            EpollIoEngine *m_engine;
+            EpollChannel *m_channel;
+
+        public:
+            CloseCallable(EpollIoEngine *engine, EpollChannel *channel)
+                : m_engine(engine)
+                , m_channel(channel)
+            {}
+
+        public:
+            virtual void Invoke()
+            {
+                m_engine->OnClosing(m_channel);
+            }
+        };
+
+        EpollIoEngine::EpollIoEngine()
+            : m_epollFd(-1)
+            , m_wakeupFd(-1)
+            , m_ready()
+            , m_deadlines()
+            , m_receiveBuffer(NULL)
+            , m_receiveBufferLength(ReceiveBufferLength)
+            , m_postLock()
+            , m_posted()
+            , m_isWakingUp(false)
+        {
+            m_epollFd = ::epoll_create1(EPOLL_CLOEXEC);
+            m_wakeupFd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+            //! NULL stands for wakeup
+            struct epoll_event ev;
+            ev.events = EPOLLIN;
+            ev.data.ptr = NULL;
+            ::epoll_ctl(m_epollFd, EPOLL_CTL_ADD, m_wakeupFd, &ev);
+
+            m_receiveBuffer = static_cast<uint8_t *>(BufferPool::Allocate(m_receiveBufferLength));
+        }
+
+        EpollIoEngine::~EpollIoEngine()
+        {
+            DispatchPosted();
+
+            //! the closed ones left to the ready list are never dispatched again
+            std::vector<EpollChannel *>::iterator it = m_ready.begin();
+            for (; it != m_ready.end(); ++it)
+            {
+                if ((*it)->m_isClosed)
+                    delete *it;
+            }
+            m_ready.clear();
+
+            ::close(m_wakeupFd);
+            ::close(m_epollFd);
+
+            BufferPool::Free(m_receiveBuffer, m_receiveBufferLength);
+        }
+
+        Channel *EpollIoEngine::CreateChannel(ChannelHandler *handler, const SocketOptions& options)
+        {
+            return new EpollChannel(handler, options);
+        }
+
+        void EpollIoEngine::Connect(Channel *channel, const struct sockaddr *addr, socklen_t addrLen)
+        {
+            Post(new ConnectCallable(this, static_cast<EpollChannel *>(channel), addr, addrLen));
+        }
+
+        void EpollIoEngine::Send(Channel *channel, const uint8_t *data, uint32_t len)
+        {
+            EpollChannel *epollChannel = static_cast<EpollChannel *>(channel);
+
+            epollChannel->m_sendData = data;
+            epollChannel->m_sendLength = len;
+            epollChannel->m_sentLength = 0;
+
+            SetDeadline(epollChannel, SendTimeout);
+            Schedule(epollChannel);
+        }
+
+        void EpollIoEngine::Receive(Channel *channel)
+        {
+            EpollChannel *epollChannel = static_cast<EpollChannel *>(channel);
+
+            epollChannel->m_isReceiving = true;
+
+            SetDeadline(epollChannel, ReceiveTimeout);
+            Schedule(epollChannel);
+        }
+
+        void EpollIoEngine::Close(Channel *channel)
+        {
+            //! always deferred, the channel may still be referenced by the events in dispatching
+            Post(new CloseCallable(this, static_cast<EpollChannel *>(channel)));
+        }
+
+        bool EpollIoEngine::IsAlive(Channel *channel)
+        {
+            EpollChannel *epollChannel = static_cast<EpollChannel *>(channel);
+            if (epollChannel->m_fd < 0 || epollChannel->m_isClosed)
+                return false;
+
+            //! nothing readable, neither data nor FIN
+            uint8_t peek = 0;
+            ssize_t received = ::recv(epollChannel->m_fd, &peek, sizeof(peek), MSG_PEEK | MSG_DONTWAIT);
+
+            return received < 0 && (EAGAIN == errno || EWOULDBLOCK == errno);
+        }
+
+        void EpollIoEngine::Post(Callable *callable)
+        {
+            bool isWakingUp = false;
+            {
+                AutoLock<CriticalSection> locker(&m_postLock);
+                m_posted.push_back(callable);
+
+                isWakingUp = m_isWakingUp;
+                m_isWakingUp = true;
+            }
+
+            if (!isWakingUp)
+            {
+                uint64_t value = 1;
+                ssize_t written = ::write(m_wakeupFd, &value, sizeof(value));
+                (void)written;
+            }
+        }
+
+        void EpollIoEngine::OnConnecting(EpollChannel *channel, const struct sockaddr_storage& addr, socklen_t addrLen)
+        {
+            Detach(channel);
+
+            int fd = ::socket(addr.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+            if (fd < 0)
+            {
+                channel->m_handler->OnConnected(errno);
+                return;
+            }
+
+            int noDelay = 1;
+            ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+            ApplySocketOptions(fd, channel->m_options);
+
+            struct epoll_event ev;
+            ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+            ev.data.ptr = channel;
+            if (0 != ::epoll_ctl(m_epollFd, EPOLL_CTL_ADD, fd, &ev))
+            {
+                int err = errno;
+                ::close(fd);
+
+                channel->m_handler->OnConnected(err);
+                return;
+            }
+
+            channel->m_fd = fd;
+            channel->m_isConnecting = true;
+
+            if (0 == ::connect(fd, reinterpret_cast<const struct sockaddr *>(&addr), addrLen))
+            {
+                channel->m_isWritable = true;
+                Schedule(channel);
+            }
+            else if (EINPROGRESS == errno)
+            {
+                SetDeadline(channel, ConnectTimeout);
+            }
+            else
+            {
+                int err = errno;
+                channel->m_isConnecting = false;
+                Detach(channel);
+
+                channel->m_handler->OnConnected(err);
+            }
+        }
+
+        void EpollIoEngine::OnClosing(EpollChannel *channel)
+        {
+            Detach(channel);
+
+            channel->m_isClosed = true;
+            channel->m_isConnecting = false;
+            channel->m_isReceiving = false;
+            channel->m_sendData = NULL;
+
+            channel->m_handler->OnClosed();
+
+            //! the ready list will delete it
+            if (!channel->m_isQueued)
+                delete channel;
+        }
+
+        void EpollIoEngine::Detach(EpollChannel *channel)
+        {
+            ClearDeadline(channel);
+
+            if (channel->m_fd >= 0)
+            {
+                ::epoll_ctl(m_epollFd, EPOLL_CTL_DEL, channel->m_fd, NULL);
+                ::close(channel->m_fd);
+
+                channel->m_fd = -1;
+            }
+
+            channel->m_isReadable = false;
+            channel->m_isWritable = false;
+        }
+
+        void EpollIoEngine::Schedule(EpollChannel *channel)
+        {
+            if (!channel->m_isQueued && !channel->m_isClosed && channel->IsReady())
+            {
+                channel->m_isQueued = true;
+                m_ready.push_back(channel);
+            }
+        }
+
+        //! complete at most one operation, the operations issued by the notification will be scheduled
+        void EpollIoEngine::Perform(EpollChannel *channel)
+        {
+            if (channel->m_isConnecting && channel->m_isWritable)
+            {
+                int err = 0;
+                socklen_t errLen = sizeof(err);
+                if (0 != ::getsockopt(channel->m_fd, SOL_SOCKET, SO_ERROR, &err, &errLen))
+                    err = errno;
+
+                channel->m_isConnecting = false;
+                ClearDeadline(channel);
+
+                channel->m_handler->OnConnected(err);
+                return;
+            }
+
+            if (NULL != channel->m_sendData && channel->m_isWritable)
+            {
+                int err = 0;
+                while (channel->m_sentLength < channel->m_sendLength)
+                {
+                    ssize_t sent = ::send(channel->m_fd
+                        , channel->m_sendData + channel->m_sentLength
+                        , channel->m_sendLength - channel->m_sentLength
+                        , MSG_NOSIGNAL);
+
+                    if (sent >= 0)
+                    {
+                        channel->m_sentLength += static_cast<uint32_t>(sent);
+                    }
+                    else if (EINTR != errno)
+                    {
+                        err = errno;
+                        break;
+                    }
+                }
+
+                if (EAGAIN == err || EWOULDBLOCK == err)
+                {
+                    //! wait for the next edge
+                    channel->m_isWritable = false;
+                }
+                else
+                {
+                    channel->m_sendData = NULL;
+                    RearmDeadline(channel);
+
+                    channel->m_handler->OnSent(channel->m_sentLength, err);
+                    return;
+                }
+            }
+
+            if (channel->m_isReceiving && channel->m_isReadable)
+            {
+                uint32_t length = channel->m_receiveLength.Get();
+                if (length > m_receiveBufferLength)
+                {
+                    //! the previous one is kept when out of memory
+                    uint8_t *grown = static_cast<uint8_t *>(BufferPool::Allocate(length));
+                    if (NULL != grown)
+                    {
+                        BufferPool::Free(m_receiveBuffer, m_receiveBufferLength);
+                        m_receiveBuffer = grown;
+                        m_receiveBufferLength = length;
+                    }
+                    else
+                    {
+                        length = m_receiveBufferLength;
+                    }
+                }
+
+                ssize_t received = -1;
+                do
+                {
+                    received = ::recv(channel->m_fd, m_receiveBuffer, length, 0);
+                } while (received < 0 && EINTR == errno);
+
+                if (received < 0 && (EAGAIN == errno || EWOULDBLOCK == errno))
+                {
+                    //! wait for the next edge
+                    channel->m_isReadable = false;
+                }
+                else
+                {
+                    channel->m_isReceiving = false;
+                    RearmDeadline(channel);
+
+                    if (received < 0)
+                    {
+                        channel->m_handler->OnReceived(NULL, 0, errno);
+                    }
+                    else
+                    {
+                        channel->m_receiveLength.Update(static_cast<uint32_t>(received));
+                        channel->m_handler->OnReceived(m_receiveBuffer, static_cast<uint32_t>(received), 0);
+                    }
+                }
+            }
+        }
+
+        void EpollIoEngine::SetDeadline(EpollChannel *channel, uint32_t timeout)
+        {
+            ClearDeadline(channel);
+
+            channel->m_deadline = m_deadlines.insert(std::make_pair(NowInMilliseconds() + timeout, channel));
+            channel->m_hasDeadline = true;
+        }
+
+        void EpollIoEngine::ClearDeadline(EpollChannel *channel)
+        {
+            if (channel->m_hasDeadline)
+            {
+                m_deadlines.erase(channel->m_deadline);
+                channel->m_hasDeadline = false;
+            }
+        }
+
+        void EpollIoEngine::RearmDeadline(EpollChannel *channel)
+        {
+            if (NULL != channel->m_sendData)
+                SetDeadline(channel, SendTimeout);
+            else if (channel->m_isReceiving)
+                SetDeadline(channel, ReceiveTimeout);
+            else
+                ClearDeadline(channel);
+        }
+
+        void EpollIoEngine::RunOnce(DWORD timeout)
+        {
+            int waitTimeout = INFINITE == timeout ? -1 : static_cast<int>(timeout);
+
+            if (!m_ready.empty())
+            {
+                waitTimeout = 0;
+            }
+            else if (!m_deadlines.empty())
+            {
+                uint64_t now = NowInMilliseconds();
+                uint64_t earliest = m_deadlines.begin()->first;
+                int untilDeadline = earliest > now ? static_cast<int>(earliest - now) : 0;
+
+                if (waitTimeout < 0 || untilDeadline < waitTimeout)
+                    waitTimeout = untilDeadline;
+            }
+
+            struct epoll_event events[MaxEvents];
+            int count = ::epoll_wait(m_epollFd, events, MaxEvents, waitTimeout);
+
+            for (int i = 0; i < count; ++i)
+            {
+                EpollChannel *channel = static_cast<EpollChannel *>(events[i].data.ptr);
+                if (NULL == channel)
+                {
+                    uint64_t value = 0;
+                    ssize_t read = ::read(m_wakeupFd, &value, sizeof(value));
+                    (void)read;
+                    continue;
+                }
+
+                uint32_t flags = events[i].events;
+                if (flags & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+                    channel->m_isReadable = true;
+
+                if (flags & (EPOLLOUT | EPOLLHUP | EPOLLERR))
+                    channel->m_isWritable = true;
+
+                Schedule(channel);
+            }
+
+            DispatchReady();
+            DispatchPosted();
+            DispatchDeadlines();
+        }
+
+        void EpollIoEngine::DispatchReady()
+        {
+            //! the ones scheduled during dispatching wait for the next round
+            std::vector<EpollChannel *> ready;
+            ready.swap(m_ready);
+
+            std::vector<EpollChannel *>::iterator it = ready.begin();
+            for (; it != ready.end(); ++it)
+            {
+                EpollChannel *channel = *it;
+                channel->m_isQueued = false;
+
+                if (channel->m_isClosed)
+                {
+                    delete channel;
+                    continue;
+                }
+
+                Perform(channel);
+                Schedule(channel);
+            }
+        }
+
+        void EpollIoEngine::DispatchPosted()
+        {
+            std::vector<Callable *> posted;
+            {
+                AutoLock<CriticalSection> locker(&m_postLock);
+                posted.swap(m_posted);
+                m_isWakingUp = false;
+            }
+
+            std::vector<Callable *>::iterator it = posted.begin();
+            for (; it != posted.end(); ++it)
+            {
+                (*it)->Invoke();
+                delete *it;
+            }
+        }
+
+        void EpollIoEngine::DispatchDeadlines()
+        {
+            uint64_t now = NowInMilliseconds();
+
+            while (!m_deadlines.empty() && m_deadlines.begin()->first <= now)
+            {
+                EpollChannel *channel = m_deadlines.begin()->second;
+                m_deadlines.erase(m_deadlines.begin());
+                channel->m_hasDeadline = false;
+
+                if (channel->m_isConnecting)
+                {
+                    channel->m_isConnecting = false;
+                    channel->m_handler->OnConnected(ETIMEDOUT);
+                }
+                else if (NULL != channel->m_sendData)
+                {
+                    channel->m_sendData = NULL;
+                    RearmDeadline(channel);
+
+                    channel->m_handler->OnSent(channel->m_sentLength, ETIMEDOUT);
+                }
+                else if (channel->m_isReceiving)
+                {
+                    channel->m_isReceiving = false;
+                    channel->m_handler->OnReceived(NULL, 0, ETIMEDOUT);
+                }
+            }
+        }
+
+        IoEngine *CreateEpollIoEngine()
+        {
+            return new EpollIoEngine;
+        }
+    }
+}
+
+#endif
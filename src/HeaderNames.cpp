@@ -0,0 +1,205 @@
+#include "HeaderNames.h"
+
+#include <type_traits>
+
+namespace Net
+{
+    namespace Details
+    {
+        //! the hashes are precomputed, HashHeaderName of each name
+        const KnownHeader KnownHeaders[HeaderName::Unknown] =
+        {
+            { "Accept", "accept", 6, 0x08247E29u },
+            { "Accept-Charset", "accept-charset", 14, 0xDA645C68u },
+            { "Accept-Encoding", "accept-encoding", 15, 0xC9715A99u },
+            { "Accept-Language", "accept-language", 15, 0x75F67716u },
+            { "Accept-Ranges", "accept-ranges", 13, 0x6625CF66u },
+            { "Age", "age", 3, 0x2C41499Cu },
+            { "Allow", "allow", 5, 0xAEB1A832u },
+            { "Authorization", "authorization", 13, 0x913657BEu },
+            { "Cache-Control", "cache-control", 13, 0x50C8A4CDu },
+            { "Connection", "connection", 10, 0x38B99ED9u },
+            { "Content-Disposition", "content-disposition", 19, 0xE7D03E5Cu },
+            { "Content-Encoding", "content-encoding", 16, 0x03E2ED88u },
+            { "Content-Language", "content-language", 16, 0x017D1113u },
+            { "Content-Length", "content-length", 14, 0x4DF9451Du },
+            { "Content-Location", "content-location", 16, 0x893B4C2Eu },
+            { "Content-Range", "content-range", 13, 0xD3ECFA4Au },
+            { "Content-Type", "content-type", 12, 0xFCF70995u },
+            { "Cookie", "cookie", 6, 0x77A740BFu },
+            { "Date", "date", 4, 0xD472DC59u },
+            { "ETag", "etag", 4, 0x06C857C0u },
+            { "Expect", "expect", 6, 0x96DA6B58u },
+            { "Expires", "expires", 7, 0x3E8EC783u },
+            { "Host", "host", 4, 0xAFFEA56Fu },
+            { "If-Match", "if-match", 8, 0xD67076EAu },
+            { "If-Modified-Since", "if-modified-since", 17, 0x83E879A9u },
+            { "If-None-Match", "if-none-match", 13, 0x972B6177u },
+            { "If-Range", "if-range", 8, 0x8B887E3Eu },
+            { "Keep-Alive", "keep-alive", 10, 0xE18EDB80u },
+            { "Last-Modified", "last-modified", 13, 0xC0575A6Bu },
+            { "Location", "location", 8, 0x0BF5A9A6u },
+            { "Pragma", "pragma", 6, 0x19FA4625u },
+            { "Proxy-Authenticate", "proxy-authenticate", 18, 0xA17EDAEFu },
+            { "Proxy-Authorization", "proxy-authorization", 19, 0xA01F18BBu },
+            { "Proxy-Connection", "proxy-connection", 16, 0x32C09DA6u },
+            { "Range", "range", 5, 0xFADC0CD2u },
+            { "Referer", "referer", 7, 0xEC9AF966u },
+            { "Retry-After", "retry-after", 11, 0xC6DA1376u },
+            { "Server", "server", 6, 0x40AC3DD2u },
+            { "Set-Cookie", "set-cookie", 10, 0x6E2BE738u },
+            { "TE", "te", 2, 0x3C453EB2u },
+            { "Trailer", "trailer", 7, 0x816FEDE0u },
+            { "Transfer-Encoding", "transfer-encoding", 17, 0xDDB4744Cu },
+            { "Upgrade", "upgrade", 7, 0xDC97CC77u },
+            { "User-Agent", "user-agent", 10, 0x24259BEEu },
+            { "Vary", "vary", 4, 0x40ABDE45u },
+            { "Via", "via", 3, 0x69122C13u },
+            { "WWW-Authenticate", "www-authenticate", 16, 0x2E7BCF02u }
+        };
+
+        enum
+        {
+            //! twice more than the names at least, so that the probes are short
+            KnownSlotCount = 128,
+            EmptySlot = 0xFF
+        };
+
+        //
+        //  the ids placed at hash % KnownSlotCount, the next free slot on collisions
+        //      built from the hashes above, to be rebuilt once a name is added
+        //
+        static const uint8_t KnownSlots[KnownSlotCount] =
+        {
+             27, 255,  46,  21, 255, 255, 255, 255,  11, 255, 255, 255, 255, 255, 255, 255,
+            255, 255, 255,  12,  45,  16,   3, 255, 255,   2, 255, 255,   5,  13, 255, 255,
+            255, 255, 255, 255, 255,  30,  29,  33, 255,   0,  24, 255, 255, 255,  14, 255,
+            255, 255,   6,  39, 255, 255, 255, 255,  38, 255, 255,  32, 255, 255,   7,  17,
+             19,  26, 255, 255, 255,  44, 255, 255, 255, 255,  15, 255,  41,   8, 255, 255,
+            255, 255,  34,  37, 255, 255, 255, 255,  20,   9,  18, 255,  10, 255, 255, 255,
+             40, 255, 255, 255, 255, 255,   4,  35,   1, 255,  23,  28, 255, 255,  43,  22,
+             31, 255, 255, 255, 255, 255,  36,  25,  42, 255, 255, 255, 255, 255, 255, 255
+        };
+
+        template<typename CharType>
+        static inline uint32_t _LowerOf(CharType c)
+        {
+            uint32_t u = static_cast<uint32_t>(static_cast<typename std::make_unsigned<CharType>::type>(c));
+            return 'A' <= u && u <= 'Z' ? u - 'A' + 'a' : u;
+        }
+
+        template<typename CharType>
+        uint32_t HashHeaderName(const CharType *name, size_t length)
+        {
+            uint32_t hash = 2166136261u;
+            for (size_t i = 0; i != length; ++i)
+            {
+                hash ^= _LowerOf(name[i]);
+                hash *= 16777619u;
+            }
+
+            return hash;
+        }
+
+        template<typename CharType>
+        HeaderName::Value FindHeaderName(const CharType *name, size_t length, uint32_t hash)
+        {
+            for (uint32_t slot = hash % KnownSlotCount; EmptySlot != KnownSlots[slot]; slot = (slot + 1) % KnownSlotCount)
+            {
+                const KnownHeader& known = KnownHeaders[KnownSlots[slot]];
+                if (known.hash != hash || known.length != length)
+                    continue;
+
+                size_t i = 0;
+                while (i != length && _LowerOf(name[i]) == static_cast<uint32_t>(known.lowerName[i]))
+                    ++i;
+
+                if (i == length)
+                    return static_cast<HeaderName::Value>(KnownSlots[slot]);
+            }
+
+            return HeaderName::Unknown;
+        }
+
+        template uint32_t HashHeaderName<char>(const char *name, size_t length);
+        template uint32_t HashHeaderName<wchar_t>(const wchar_t *name, size_t length);
+        template HeaderName::Value FindHeaderName<char>(const char *name, size_t length, uint32_t hash);
+        template HeaderName::Value FindHeaderName<wchar_t>(const wchar_t *name, size_t length, uint32_t hash);
+
+        static bool _IsFramingHeader(const char *line, size_t length)
+        {
+            size_t nameLength = 0;
+            while (nameLength < length && ':' != line[nameLength])
+                ++nameLength;
+
+            if (nameLength == length)
+                return false;
+
+            while (0 < nameLength && (' ' == line[nameLength - 1] || '\t' == line[nameLength - 1]))
+                --nameLength;
+
+            switch (FindHeaderName(line, nameLength, HashHeaderName(line, nameLength)))
+            {
+            case HeaderName::Host:
+            case HeaderName::Connection:
+            case HeaderName::Content_Length:
+            case HeaderName::Transfer_Encoding:
+                return true;
+
+            default:
+                return false;
+            }
+        }
+
+        size_t AppendRequestHeaderLines(const char *lines, size_t length, std::string *head)
+        {
+            size_t kept = 0;
+            bool isDropped = false;
+
+            const char *end = lines + length;
+            while (lines < end)
+            {
+                const char *lineEnd = lines;
+                while (lineEnd < end && !('\r' == *lineEnd && lineEnd + 1 < end && '\n' == lineEnd[1]))
+                    ++lineEnd;
+
+                const size_t lineLength = lineEnd - lines;
+                if (0 < lineLength)
+                {
+                    //! an obsolete folded line goes along with the field it continues
+                    if (' ' != *lines && '\t' != *lines)
+                        isDropped = _IsFramingHeader(lines, lineLength);
+
+                    if (!isDropped)
+                    {
+                        kept += lineLength + 2;
+                        if (NULL != head)
+                            head->append(lines, lineLength).append("\r\n", 2);
+                    }
+                }
+
+                lines = lineEnd < end ? lineEnd + 2 : end;
+            }
+
+            return kept;
+        }
+    }
+
+    const char *HeaderName::GetName(Value name)
+    {
+        return Unknown > name ? Details::KnownHeaders[name].name : NULL;
+    }
+
+    size_t HeaderName::GetLength(Value name)
+    {
+        return Unknown > name ? Details::KnownHeaders[name].length : 0;
+    }
+
+    HeaderName::Value HeaderName::Find(const char *name, size_t length)
+    {
+        if (NULL == name)
+            return Unknown;
+
+        return Details::FindHeaderName(name, length, Details::HashHeaderName(name, length));
+    }
+}
@@ -0,0 +1,40 @@
+#ifndef HEADERNAMES_H
+#define HEADERNAMES_H
+
+#include "HttpClientModule.h"
+
+#include <cstdint>
+#include <string>
+
+namespace Net
+{
+    namespace Details
+    {
+        //! entry of the well-known header names, in the order of HeaderName::Value
+        struct KnownHeader
+        {
+            const char *name;
+            const char *lowerName;
+            uint32_t length;
+            //! HashHeaderName of the name
+            uint32_t hash;
+        };
+
+        extern const KnownHeader KnownHeaders[HeaderName::Unknown];
+
+        //! FNV-1a of the lower case, names are ASCII tokens
+        template<typename CharType>
+        uint32_t HashHeaderName(const CharType *name, size_t length);
+
+        //! the hash is the one of HashHeaderName, Unknown when not a well-known one
+        template<typename CharType>
+        HeaderName::Value FindHeaderName(const CharType *name, size_t length, uint32_t hash);
+
+        //! the CRLF lines of the request headers, each kept one is appended with its CRLF unless head is NULL
+        //! Host, Connection, Content-Length and Transfer-Encoding are dropped, the session writes them itself
+        //! returns the length of the kept lines
+        size_t AppendRequestHeaderLines(const char *lines, size_t length, std::string *head);
+    }
+}
+
+#endif
@@ -0,0 +1,618 @@
+#include "Hpack.h"
+
+namespace Net
+{
+    namespace Details
+    {
+        enum
+        {
+            //! SETTINGS_HEADER_TABLE_SIZE by default, neither side asks for more
+            DefaultHeaderTableSize = 4096,
+            HeaderEntryOverhead = 32,
+            StaticTableLength = 61
+        };
+
+        struct StaticEntry
+        {
+            const char *name;
+            const char *value;
+        };
+
+        //! RFC 7541 Appendix A
+        static const StaticEntry StaticTable[StaticTableLength] =
+        {
+            { ":authority", "" },
+            { ":method", "GET" },
+            { ":method", "POST" },
+            { ":path", "/" },
+            { ":path", "/index.html" },
+            { ":scheme", "http" },
+            { ":scheme", "https" },
+            { ":status", "200" },
+            { ":status", "204" },
+            { ":status", "206" },
+            { ":status", "304" },
+            { ":status", "400" },
+            { ":status", "404" },
+            { ":status", "500" },
+            { "accept-charset", "" },
+            { "accept-encoding", "gzip, deflate" },
+            { "accept-language", "" },
+            { "accept-ranges", "" },
+            { "accept", "" },
+            { "access-control-allow-origin", "" },
+            { "age", "" },
+            { "allow", "" },
+            { "authorization", "" },
+            { "cache-control", "" },
+            { "content-disposition", "" },
+            { "content-encoding", "" },
+            { "content-language", "" },
+            { "content-length", "" },
+            { "content-location", "" },
+            { "content-range", "" },
+            { "content-type", "" },
+            { "cookie", "" },
+            { "date", "" },
+            { "etag", "" },
+            { "expect", "" },
+            { "expires", "" },
+            { "from", "" },
+            { "host", "" },
+            { "if-match", "" },
+            { "if-modified-since", "" },
+            { "if-none-match", "" },
+            { "if-range", "" },
+            { "if-unmodified-since", "" },
+            { "last-modified", "" },
+            { "link", "" },
+            { "location", "" },
+            { "max-forwards", "" },
+            { "proxy-authenticate", "" },
+            { "proxy-authorization", "" },
+            { "range", "" },
+            { "referer", "" },
+            { "refresh", "" },
+            { "retry-after", "" },
+            { "server", "" },
+            { "set-cookie", "" },
+            { "strict-transport-security", "" },
+            { "transfer-encoding", "" },
+            { "user-agent", "" },
+            { "vary", "" },
+            { "via", "" },
+            { "www-authenticate", "" },
+        };
+
+        struct HuffmanCode
+        {
+            uint32_t code;
+            uint8_t length;
+        };
+
+        //! RFC 7541 Appendix B, the last one is EOS
+        static const HuffmanCode HuffmanCodes[257] =
+        {
+            { 0x1ff8, 13 }, { 0x7fffd8, 23 }, { 0xfffffe2, 28 }, { 0xfffffe3, 28 },
+            { 0xfffffe4, 28 }, { 0xfffffe5, 28 }, { 0xfffffe6, 28 }, { 0xfffffe7, 28 },
+            { 0xfffffe8, 28 }, { 0xffffea, 24 }, { 0x3ffffffc, 30 }, { 0xfffffe9, 28 },
+            { 0xfffffea, 28 }, { 0x3ffffffd, 30 }, { 0xfffffeb, 28 }, { 0xfffffec, 28 },
+            { 0xfffffed, 28 }, { 0xfffffee, 28 }, { 0xfffffef, 28 }, { 0xffffff0, 28 },
+            { 0xffffff1, 28 }, { 0xffffff2, 28 }, { 0x3ffffffe, 30 }, { 0xffffff3, 28 },
+            { 0xffffff4, 28 }, { 0xffffff5, 28 }, { 0xffffff6, 28 }, { 0xffffff7, 28 },
+            { 0xffffff8, 28 }, { 0xffffff9, 28 }, { 0xffffffa, 28 }, { 0xffffffb, 28 },
+            { 0x14, 6 }, { 0x3f8, 10 }, { 0x3f9, 10 }, { 0xffa, 12 },
+            { 0x1ff9, 13 }, { 0x15, 6 }, { 0xf8, 8 }, { 0x7fa, 11 },
+            { 0x3fa, 10 }, { 0x3fb, 10 }, { 0xf9, 8 }, { 0x7fb, 11 },
+            { 0xfa, 8 }, { 0x16, 6 }, { 0x17, 6 }, { 0x18, 6 },
+            { 0x0, 5 }, { 0x1, 5 }, { 0x2, 5 }, { 0x19, 6 },
+            { 0x1a, 6 }, { 0x1b, 6 }, { 0x1c, 6 }, { 0x1d, 6 },
+            { 0x1e, 6 }, { 0x1f, 6 }, { 0x5c, 7 }, { 0xfb, 8 },
+            { 0x7ffc, 15 }, { 0x20, 6 }, { 0xffb, 12 }, { 0x3fc, 10 },
+            { 0x1ffa, 13 }, { 0x21, 6 }, { 0x5d, 7 }, { 0x5e, 7 },
+            { 0x5f, 7 }, { 0x60, 7 }, { 0x61, 7 }, { 0x62, 7 },
+            { 0x63, 7 }, { 0x64, 7 }, { 0x65, 7 }, { 0x66, 7 },
+            { 0x67, 7 }, { 0x68, 7 }, { 0x69, 7 }, { 0x6a, 7 },
+            { 0x6b, 7 }, { 0x6c, 7 }, { 0x6d, 7 }, { 0x6e, 7 },
+            { 0x6f, 7 }, { 0x70, 7 }, { 0x71, 7 }, { 0x72, 7 },
+            { 0xfc, 8 }, { 0x73, 7 }, { 0xfd, 8 }, { 0x1ffb, 13 },
+            { 0x7fff0, 19 }, { 0x1ffc, 13 }, { 0x3ffc, 14 }, { 0x22, 6 },
+            { 0x7ffd, 15 }, { 0x3, 5 }, { 0x23, 6 }, { 0x4, 5 },
+            { 0x24, 6 }, { 0x5, 5 }, { 0x25, 6 }, { 0x26, 6 },
+            { 0x27, 6 }, { 0x6, 5 }, { 0x74, 7 }, { 0x75, 7 },
+            { 0x28, 6 }, { 0x29, 6 }, { 0x2a, 6 }, { 0x7, 5 },
+            { 0x2b, 6 }, { 0x76, 7 }, { 0x2c, 6 }, { 0x8, 5 },
+            { 0x9, 5 }, { 0x2d, 6 }, { 0x77, 7 }, { 0x78, 7 },
+            { 0x79, 7 }, { 0x7a, 7 }, { 0x7b, 7 }, { 0x7ffe, 15 },
+            { 0x7fc, 11 }, { 0x3ffd, 14 }, { 0x1ffd, 13 }, { 0xffffffc, 28 },
+            { 0xfffe6, 20 }, { 0x3fffd2, 22 }, { 0xfffe7, 20 }, { 0xfffe8, 20 },
+            { 0x3fffd3, 22 }, { 0x3fffd4, 22 }, { 0x3fffd5, 22 }, { 0x7fffd9, 23 },
+            { 0x3fffd6, 22 }, { 0x7fffda, 23 }, { 0x7fffdb, 23 }, { 0x7fffdc, 23 },
+            { 0x7fffdd, 23 }, { 0x7fffde, 23 }, { 0xffffeb, 24 }, { 0x7fffdf, 23 },
+            { 0xffffec, 24 }, { 0xffffed, 24 }, { 0x3fffd7, 22 }, { 0x7fffe0, 23 },
+            { 0xffffee, 24 }, { 0x7fffe1, 23 }, { 0x7fffe2, 23 }, { 0x7fffe3, 23 },
+            { 0x7fffe4, 23 }, { 0x1fffdc, 21 }, { 0x3fffd8, 22 }, { 0x7fffe5, 23 },
+            { 0x3fffd9, 22 }, { 0x7fffe6, 23 }, { 0x7fffe7, 23 }, { 0xffffef, 24 },
+            { 0x3fffda, 22 }, { 0x1fffdd, 21 }, { 0xfffe9, 20 }, { 0x3fffdb, 22 },
+            { 0x3fffdc, 22 }, { 0x7fffe8, 23 }, { 0x7fffe9, 23 }, { 0x1fffde, 21 },
+            { 0x7fffea, 23 }, { 0x3fffdd, 22 }, { 0x3fffde, 22 }, { 0xfffff0, 24 },
+            { 0x1fffdf, 21 }, { 0x3fffdf, 22 }, { 0x7fffeb, 23 }, { 0x7fffec, 23 },
+            { 0x1fffe0, 21 }, { 0x1fffe1, 21 }, { 0x3fffe0, 22 }, { 0x1fffe2, 21 },
+            { 0x7fffed, 23 }, { 0x3fffe1, 22 }, { 0x7fffee, 23 }, { 0x7fffef, 23 },
+            { 0xfffea, 20 }, { 0x3fffe2, 22 }, { 0x3fffe3, 22 }, { 0x3fffe4, 22 },
+            { 0x7ffff0, 23 }, { 0x3fffe5, 22 }, { 0x3fffe6, 22 }, { 0x7ffff1, 23 },
+            { 0x3ffffe0, 26 }, { 0x3ffffe1, 26 }, { 0xfffeb, 20 }, { 0x7fff1, 19 },
+            { 0x3fffe7, 22 }, { 0x7ffff2, 23 }, { 0x3fffe8, 22 }, { 0x1ffffec, 25 },
+            { 0x3ffffe2, 26 }, { 0x3ffffe3, 26 }, { 0x3ffffe4, 26 }, { 0x7ffffde, 27 },
+            { 0x7ffffdf, 27 }, { 0x3ffffe5, 26 }, { 0xfffff1, 24 }, { 0x1ffffed, 25 },
+            { 0x7fff2, 19 }, { 0x1fffe3, 21 }, { 0x3ffffe6, 26 }, { 0x7ffffe0, 27 },
+            { 0x7ffffe1, 27 }, { 0x3ffffe7, 26 }, { 0x7ffffe2, 27 }, { 0xfffff2, 24 },
+            { 0x1fffe4, 21 }, { 0x1fffe5, 21 }, { 0x3ffffe8, 26 }, { 0x3ffffe9, 26 },
+            { 0xffffffd, 28 }, { 0x7ffffe3, 27 }, { 0x7ffffe4, 27 }, { 0x7ffffe5, 27 },
+            { 0xfffec, 20 }, { 0xfffff3, 24 }, { 0xfffed, 20 }, { 0x1fffe6, 21 },
+            { 0x3fffe9, 22 }, { 0x1fffe7, 21 }, { 0x1fffe8, 21 }, { 0x7ffff3, 23 },
+            { 0x3fffea, 22 }, { 0x3fffeb, 22 }, { 0x1ffffee, 25 }, { 0x1ffffef, 25 },
+            { 0xfffff4, 24 }, { 0xfffff5, 24 }, { 0x3ffffea, 26 }, { 0x7ffff4, 23 },
+            { 0x3ffffeb, 26 }, { 0x7ffffe6, 27 }, { 0x3ffffec, 26 }, { 0x3ffffed, 26 },
+            { 0x7ffffe7, 27 }, { 0x7ffffe8, 27 }, { 0x7ffffe9, 27 }, { 0x7ffffea, 27 },
+            { 0x7ffffeb, 27 }, { 0xffffffe, 28 }, { 0x7ffffec, 27 }, { 0x7ffffed, 27 },
+            { 0x7ffffee, 27 }, { 0x7ffffef, 27 }, { 0x7fffff0, 27 }, { 0x3ffffee, 26 },
+            { 0x3fffffff, 30 }
+        };
+
+        //
+        //  binary tree walked bit by bit while decoding
+        //      a child is either the index of the next node, or the bitwise complement of the symbol
+        //      0 means absent, the root is never a child
+        //
+        class HuffmanTree
+        {
+        private:
+            enum
+            {
+                EosSymbol = 256,
+                MaxNodes = 256
+            };
+
+            int16_t m_children[MaxNodes][2];
+            int16_t m_nodeCount;
+
+        public:
+            HuffmanTree()
+                : m_nodeCount(1)
+            {
+                for (int i = 0; i != MaxNodes; ++i)
+                    m_children[i][0] = m_children[i][1] = 0;
+
+                for (int symbol = 0; symbol != EosSymbol + 1; ++symbol)
+                    Insert(symbol, HuffmanCodes[symbol]);
+            }
+
+        public:
+            //! false when EOS decoded or the padding isn't the most significant bits of EOS
+            bool Decode(const uint8_t *data, uint32_t len, std::string& decoded) const
+            {
+                int16_t node = 0;
+                //! bits walked since the last symbol, all ones in the valid padding
+                uint32_t depth = 0;
+                bool isAllOnes = true;
+
+                for (const uint8_t *end = data + len; data != end; ++data)
+                {
+                    for (int shift = 7; shift >= 0; --shift)
+                    {
+                        int bit = (*data >> shift) & 1;
+                        int16_t child = m_children[node][bit];
+
+                        ++depth;
+                        isAllOnes = isAllOnes && 1 == bit;
+
+                        if (child < 0)
+                        {
+                            int symbol = ~child;
+                            if (EosSymbol == symbol)
+                                return false;
+
+                            decoded.push_back(static_cast<char>(symbol));
+
+                            node = 0;
+                            depth = 0;
+                            isAllOnes = true;
+                        }
+                        else
+                        {
+                            node = child;
+                        }
+                    }
+                }
+
+                return depth <= 7 && isAllOnes;
+            }
+
+        private:
+            void Insert(int symbol, const HuffmanCode& code)
+            {
+                int16_t node = 0;
+                for (int shift = code.length - 1; shift > 0; --shift)
+                {
+                    int bit = (code.code >> shift) & 1;
+                    if (0 == m_children[node][bit])
+                        m_children[node][bit] = m_nodeCount++;
+
+                    node = m_children[node][bit];
+                }
+
+                m_children[node][code.code & 1] = static_cast<int16_t>(~symbol);
+            }
+        };
+
+        //! built while loading, never modified
+        static const HuffmanTree _huffmanTree;
+
+        //! the static table as the dynamic entries, so that Get returns either alike
+        struct StaticFields
+        {
+            HeaderField fields[StaticTableLength];
+
+            StaticFields()
+            {
+                for (uint32_t i = 0; i != StaticTableLength; ++i)
+                    fields[i] = HeaderField(StaticTable[i].name, StaticTable[i].value);
+            }
+        };
+        static const StaticFields _staticFields;
+
+        static uint32_t _HuffmanLengthOf(const std::string& s)
+        {
+            uint64_t bits = 0;
+            for (std::string::size_type i = 0; i != s.size(); ++i)
+                bits += HuffmanCodes[static_cast<unsigned char>(s[i])].length;
+
+            return static_cast<uint32_t>((bits + 7) / 8);
+        }
+
+        static void _HuffmanEncode(const std::string& s, std::string& encoded)
+        {
+            uint64_t bits = 0;
+            uint32_t bitCount = 0;
+
+            for (std::string::size_type i = 0; i != s.size(); ++i)
+            {
+                const HuffmanCode& code = HuffmanCodes[static_cast<unsigned char>(s[i])];
+
+                bits = (bits << code.length) | code.code;
+                bitCount += code.length;
+
+                while (bitCount >= 8)
+                {
+                    bitCount -= 8;
+                    encoded.push_back(static_cast<char>(bits >> bitCount));
+                }
+            }
+
+            //! padded with the most significant bits of EOS
+            if (0 != bitCount)
+                encoded.push_back(static_cast<char>((bits << (8 - bitCount)) | (0xFF >> bitCount)));
+        }
+
+        //! RFC 7541 section 5.1, flags fill the bits before the prefix
+        static void _EncodeInteger(std::string& block, uint8_t flags, int prefixBits, uint32_t value)
+        {
+            uint32_t mask = (1u << prefixBits) - 1;
+            if (value < mask)
+            {
+                block.push_back(static_cast<char>(flags | value));
+                return;
+            }
+
+            block.push_back(static_cast<char>(flags | mask));
+            value -= mask;
+
+            while (value >= 0x80)
+            {
+                block.push_back(static_cast<char>(0x80 | (value & 0x7F)));
+                value >>= 7;
+            }
+            block.push_back(static_cast<char>(value));
+        }
+
+        static bool _DecodeInteger(const uint8_t *&data, const uint8_t *end, int prefixBits, uint32_t& value)
+        {
+            uint32_t mask = (1u << prefixBits) - 1;
+
+            value = *data++ & mask;
+            if (value < mask)
+                return true;
+
+            for (int shift = 0; shift <= 28; shift += 7)
+            {
+                if (data == end)
+                    return false;
+
+                uint8_t b = *data++;
+                uint64_t extended = value + (static_cast<uint64_t>(b & 0x7F) << shift);
+                if (extended > 0xFFFFFFFFu)
+                    return false;
+
+                value = static_cast<uint32_t>(extended);
+                if (0 == (b & 0x80))
+                    return true;
+            }
+
+            return false;
+        }
+
+        static void _EncodeString(std::string& block, const std::string& s)
+        {
+            uint32_t huffmanLength = _HuffmanLengthOf(s);
+            if (huffmanLength < s.size())
+            {
+                _EncodeInteger(block, 0x80, 7, huffmanLength);
+                _HuffmanEncode(s, block);
+            }
+            else
+            {
+                _EncodeInteger(block, 0x00, 7, static_cast<uint32_t>(s.size()));
+                block.append(s);
+            }
+        }
+
+        static bool _DecodeString(const uint8_t *&data, const uint8_t *end, std::string& s)
+        {
+            if (data == end)
+                return false;
+
+            bool isHuffman = 0 != (*data & 0x80);
+
+            uint32_t len = 0;
+            if (!_DecodeInteger(data, end, 7, len) || len > static_cast<uint32_t>(end - data))
+                return false;
+
+            if (isHuffman)
+            {
+                s.reserve(len * 8 / 5);
+                if (!_huffmanTree.Decode(data, len, s))
+                    return false;
+            }
+            else
+            {
+                s.assign(reinterpret_cast<const char *>(data), len);
+            }
+
+            data += len;
+            return true;
+        }
+
+        HpackTable::HpackTable(uint32_t maxSize)
+            : m_entries()
+            , m_size(0)
+            , m_maxSize(maxSize)
+        {}
+
+        const HeaderField *HpackTable::Get(uint32_t index) const
+        {
+            if (0 == index)
+                return NULL;
+
+            if (index <= StaticTableLength)
+                return &_staticFields.fields[index - 1];
+
+            index -= StaticTableLength + 1;
+            return index < m_entries.size() ? &m_entries[index] : NULL;
+        }
+
+        void HpackTable::Add(const HeaderField& field)
+        {
+            uint32_t size = static_cast<uint32_t>(field.name.size() + field.value.size()) + HeaderEntryOverhead;
+            if (size > m_maxSize)
+            {
+                Evict(0);
+                return;
+            }
+
+            Evict(m_maxSize - size);
+
+            m_entries.push_front(field);
+            m_size += size;
+        }
+
+        void HpackTable::Resize(uint32_t maxSize)
+        {
+            m_maxSize = maxSize;
+            Evict(maxSize);
+        }
+
+        uint32_t HpackTable::Find(const std::string& name, const std::string& value, bool& isFullMatch) const
+        {
+            uint32_t nameIndex = 0;
+            isFullMatch = false;
+
+            for (uint32_t i = 0; i != StaticTableLength; ++i)
+            {
+                if (name != StaticTable[i].name)
+                    continue;
+
+                if (value == StaticTable[i].value)
+                {
+                    isFullMatch = true;
+                    return i + 1;
+                }
+
+                if (0 == nameIndex)
+                    nameIndex = i + 1;
+            }
+
+            for (std::deque<HeaderField>::size_type i = 0; i != m_entries.size(); ++i)
+            {
+                const HeaderField& entry = m_entries[i];
+                if (entry.name != name)
+                    continue;
+
+                if (entry.value == value)
+                {
+                    isFullMatch = true;
+                    return static_cast<uint32_t>(i) + StaticTableLength + 1;
+                }
+
+                if (0 == nameIndex)
+                    nameIndex = static_cast<uint32_t>(i) + StaticTableLength + 1;
+            }
+
+            return nameIndex;
+        }
+
+        void HpackTable::Evict(uint32_t maxSize)
+        {
+            while (m_size > maxSize)
+            {
+                const HeaderField& oldest = m_entries.back();
+                m_size -= static_cast<uint32_t>(oldest.name.size() + oldest.value.size()) + HeaderEntryOverhead;
+
+                m_entries.pop_back();
+            }
+        }
+
+        HpackDecoder::HpackDecoder()
+            : m_table(DefaultHeaderTableSize)
+        {}
+
+        bool HpackDecoder::Decode(const uint8_t *data, uint32_t len, HeaderFields& fields)
+        {
+            const uint8_t *end = data + len;
+            //! the size updates come first
+            bool isBeginning = true;
+
+            while (data != end)
+            {
+                uint8_t first = *data;
+
+                if (0 != (first & 0x80))
+                {
+                    //! indexed
+                    uint32_t index = 0;
+                    if (!_DecodeInteger(data, end, 7, index))
+                        return false;
+
+                    const HeaderField *field = m_table.Get(index);
+                    if (NULL == field)
+                        return false;
+
+                    fields.push_back(*field);
+                }
+                else if (0x20 == (first & 0xE0))
+                {
+                    //! dynamic table size update, never beyond what announced
+                    uint32_t maxSize = 0;
+                    if (!isBeginning || !_DecodeInteger(data, end, 5, maxSize) || maxSize > DefaultHeaderTableSize)
+                        return false;
+
+                    m_table.Resize(maxSize);
+                    continue;
+                }
+                else
+                {
+                    //! literal, with incremental indexing, without indexing or never indexed
+                    bool isIndexing = 0 != (first & 0x40);
+
+                    uint32_t index = 0;
+                    if (!_DecodeInteger(data, end, isIndexing ? 6 : 4, index))
+                        return false;
+
+                    HeaderField field;
+                    if (0 == index)
+                    {
+                        if (!_DecodeString(data, end, field.name))
+                            return false;
+                    }
+                    else
+                    {
+                        const HeaderField *named = m_table.Get(index);
+                        if (NULL == named)
+                            return false;
+
+                        field.name = named->name;
+                    }
+
+                    if (!_DecodeString(data, end, field.value))
+                        return false;
+
+                    if (isIndexing)
+                        m_table.Add(field);
+
+                    fields.push_back(field);
+                }
+
+                isBeginning = false;
+            }
+
+            return true;
+        }
+
+        HpackEncoder::HpackEncoder()
+            : m_table(DefaultHeaderTableSize)
+            , m_isResized(false)
+            , m_lowestSize(DefaultHeaderTableSize)
+        {}
+
+        void HpackEncoder::SetMaxTableSize(uint32_t maxSize)
+        {
+            if (maxSize > DefaultHeaderTableSize)
+                maxSize = DefaultHeaderTableSize;
+
+            if (maxSize == m_table.GetMaxSize())
+                return;
+
+            //! the decoder shall see the lowest one since the last block, so that it evicts the same
+            if (!m_isResized || maxSize < m_lowestSize)
+                m_lowestSize = maxSize;
+
+            m_isResized = true;
+            m_table.Resize(maxSize);
+        }
+
+        void HpackEncoder::Encode(const HeaderFields& fields, std::string& block)
+        {
+            if (m_isResized)
+            {
+                if (m_lowestSize < m_table.GetMaxSize())
+                    _EncodeInteger(block, 0x20, 5, m_lowestSize);
+
+                _EncodeInteger(block, 0x20, 5, m_table.GetMaxSize());
+                m_isResized = false;
+            }
+
+            for (HeaderFields::const_iterator it = fields.begin(); it != fields.end(); ++it)
+            {
+                const HeaderField& field = *it;
+
+                bool isSensitive = field.name == "authorization" || field.name == "proxy-authorization"
+                    || (field.name == "cookie" && field.value.size() < 20);
+
+                bool isFullMatch = false;
+                uint32_t index = m_table.Find(field.name, field.value, isFullMatch);
+
+                if (isFullMatch && !isSensitive)
+                {
+                    _EncodeInteger(block, 0x80, 7, index);
+                    continue;
+                }
+
+                //! varies per request, indexing only evicts the others
+                bool isIndexing = !isSensitive && field.name != ":path" && field.name != "content-length";
+
+                if (isIndexing)
+                    _EncodeInteger(block, 0x40, 6, index);
+                else
+                    _EncodeInteger(block, isSensitive ? 0x10 : 0x00, 4, index);
+
+                if (0 == index)
+                    _EncodeString(block, field.name);
+
+                _EncodeString(block, field.value);
+
+                if (isIndexing)
+                    m_table.Add(field);
+            }
+        }
+    }
+}
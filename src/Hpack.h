@@ -0,0 +1,101 @@
+#ifndef HPACK_H
+#define HPACK_H
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+
+namespace Net
+{
+    namespace Details
+    {
+        //! names are in lower case
+        struct HeaderField
+        {
+            std::string name;
+            std::string value;
+
+            HeaderField()
+                : name()
+                , value()
+            {}
+
+            HeaderField(const std::string& fieldName, const std::string& fieldValue)
+                : name(fieldName)
+                , value(fieldValue)
+            {}
+        };
+        typedef std::vector<HeaderField> HeaderFields;
+
+        //
+        //  header table of HPACK(RFC 7541), the static entries followed by the dynamic ones
+        //      index starts from 1, the newest dynamic entry comes right after the static ones
+        //      the oldest ones are evicted to fit the size, each entry counts 32 besides its name and value
+        //
+        class HpackTable
+        {
+        private:
+            std::deque<HeaderField> m_entries;
+            uint32_t m_size;
+            uint32_t m_maxSize;
+
+        public:
+            explicit HpackTable(uint32_t maxSize);
+
+        public:
+            uint32_t GetMaxSize() const { return m_maxSize; }
+
+            //! NULL when out of range
+            const HeaderField *Get(uint32_t index) const;
+            //! the entry larger than the table empties the table
+            void Add(const HeaderField& field);
+            void Resize(uint32_t maxSize);
+
+            //! 0 when not found, isFullMatch tells whether the value matches as well
+            uint32_t Find(const std::string& name, const std::string& value, bool& isFullMatch) const;
+
+        private:
+            void Evict(uint32_t maxSize);
+        };
+
+        //! one per connection, the header blocks shall be decoded in the order of arrival
+        class HpackDecoder
+        {
+        private:
+            HpackTable m_table;
+
+        public:
+            HpackDecoder();
+
+        public:
+            //! a complete header block, false means COMPRESSION_ERROR
+            bool Decode(const uint8_t *data, uint32_t len, HeaderFields& fields);
+        };
+
+        //
+        //  one per connection, the header blocks shall be sent in the order of encoding
+        //      the values varying per request are never indexed, so are the credentials
+        //
+        class HpackEncoder
+        {
+        private:
+            HpackTable m_table;
+            //! the size update to signal at the beginning of the next block
+            bool m_isResized;
+            uint32_t m_lowestSize;
+
+        public:
+            HpackEncoder();
+
+        public:
+            //! SETTINGS_HEADER_TABLE_SIZE of the peer
+            void SetMaxTableSize(uint32_t maxSize);
+
+            //! appended to block
+            void Encode(const HeaderFields& fields, std::string& block);
+        };
+    }
+}
+
+#endif
@@ -0,0 +1,919 @@
+#include "Http2Connection.h"
+
+#if !defined(_WIN32)
+
+#include <errno.h>
+
+#include <algorithm>
+#include <cstring>
+
+namespace Net
+{
+    namespace Details
+    {
+        enum
+        {
+            FrameHeaderLength = 9,
+
+            DataFrame = 0x0,
+            HeadersFrame = 0x1,
+            PriorityFrame = 0x2,
+            ResetFrame = 0x3,
+            SettingsFrame = 0x4,
+            PushPromiseFrame = 0x5,
+            PingFrame = 0x6,
+            GoAwayFrame = 0x7,
+            WindowUpdateFrame = 0x8,
+            ContinuationFrame = 0x9,
+
+            EndStreamFlag = 0x1,
+            AckFlag = 0x1,
+            EndHeadersFlag = 0x4,
+            PaddedFlag = 0x8,
+            PriorityFlag = 0x20,
+
+            HeaderTableSizeSetting = 0x1,
+            EnablePushSetting = 0x2,
+            MaxConcurrentStreamsSetting = 0x3,
+            InitialWindowSizeSetting = 0x4,
+            MaxFrameSizeSetting = 0x5,
+            MaxHeaderListSizeSetting = 0x6,
+
+            NoError = 0x0,
+            ProtocolError = 0x1,
+            FlowControlError = 0x3,
+            FrameSizeError = 0x6,
+            RefusedStream = 0x7,
+            Cancel = 0x8,
+            CompressionError = 0x9,
+
+            DefaultWindowSize = 65535,
+            DefaultMaxFrameSize = 16384,
+            MaxMaxFrameSize = 16777215,
+            MaxWindowSize = 0x7FFFFFFF,
+            MaxStreamId = 0x7FFFFFFF,
+            //! assumed till the settings of the peer arrived
+            DefaultMaxStreams = 100,
+
+            //! the bodies are consumed on arrival, the windows only bound what is in flight
+            StreamWindowSize = 1 << 20,
+            ConnectionWindowSize = 1 << 24,
+            //! same bound as the head of HTTP/1.1
+            MaxHeaderListSize = 64 * 1024,
+            //! the request bodies are read no further ahead
+            MaxQueuedLength = 64 * 1024
+        };
+
+        static const char ConnectionPreface[] = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+
+        static inline uint32_t _ReadUInt32(const uint8_t *p)
+        {
+            return (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16) | (static_cast<uint32_t>(p[2]) << 8) | p[3];
+        }
+
+        static inline void _AppendUInt32(std::string& s, uint32_t value)
+        {
+            s.push_back(static_cast<char>(value >> 24));
+            s.push_back(static_cast<char>(value >> 16));
+            s.push_back(static_cast<char>(value >> 8));
+            s.push_back(static_cast<char>(value));
+        }
+
+        static void _AppendSetting(std::string& s, uint16_t id, uint32_t value)
+        {
+            s.push_back(static_cast<char>(id >> 8));
+            s.push_back(static_cast<char>(id));
+            _AppendUInt32(s, value);
+        }
+
+        //! false when the padding is longer than the frame
+        static bool _Unpad(uint8_t flags, const uint8_t *&payload, uint32_t& len)
+        {
+            if (0 == (flags & PaddedFlag))
+                return true;
+
+            if (0 == len || payload[0] >= len)
+                return false;
+
+            len -= 1 + payload[0];
+            payload += 1;
+
+            return true;
+        }
+
+        Http2Connection::Http2Connection(IoEngine *engine, const SocketOptions& options, const std::string& origin, const Endpoints& endpoints)
+            : m_ref(2)
+            , m_isClosing(0)
+            , m_isClosed(false)
+            , m_engine(engine)
+            , m_channel(NULL)
+            , m_origin(origin)
+            , m_endpoints(endpoints)
+            , m_endpointIndex(0)
+            , m_isConnected(false)
+            , m_isDraining(false)
+            , m_isShuttingDown(false)
+            , m_abortReason(Http2Stream::Reset)
+            , m_abortError(ECONNRESET)
+            , m_streams()
+            , m_sending()
+            , m_reservedCount(0)
+            , m_nextStreamId(1)
+            , m_idleSince(NowInMilliseconds())
+            , m_maxStreams(DefaultMaxStreams)
+            , m_maxFrameSize(DefaultMaxFrameSize)
+            , m_initialWindow(DefaultWindowSize)
+            , m_sendWindow(DefaultWindowSize)
+            , m_receiveWindow(ConnectionWindowSize)
+            , m_encoder()
+            , m_decoder()
+            , m_queued()
+            , m_writing()
+            , m_inbound()
+            , m_body()
+            , m_blockStreamId(0)
+            , m_isBlockEndStream(false)
+            , m_isBlockContinuing(false)
+            , m_headerBlock()
+        {
+            m_channel = engine->CreateChannel(this, options);
+
+            //! written once connected, the requests may follow right away
+            m_queued.append(ConnectionPreface, sizeof(ConnectionPreface) - 1);
+
+            std::string settings;
+            _AppendSetting(settings, EnablePushSetting, 0);
+            _AppendSetting(settings, InitialWindowSizeSetting, StreamWindowSize);
+            _AppendSetting(settings, MaxHeaderListSizeSetting, MaxHeaderListSize);
+            WriteFrame(SettingsFrame, 0, 0, reinterpret_cast<const uint8_t *>(settings.data()), static_cast<uint32_t>(settings.size()));
+
+            WriteWindowUpdate(0, ConnectionWindowSize - DefaultWindowSize);
+        }
+
+        void Http2Connection::AddRef()
+        {
+            ::Increment(&m_ref);
+        }
+
+        void Http2Connection::Release()
+        {
+            if (0 == ::Decrement(&m_ref))
+                delete this;
+        }
+
+        void Http2Connection::Connect()
+        {
+            const Endpoint& endpoint = m_endpoints[m_endpointIndex];
+            m_engine->Connect(m_channel, reinterpret_cast<const struct sockaddr *>(&endpoint.addr), endpoint.addrLen);
+        }
+
+        void Http2Connection::Close()
+        {
+            if (0 != CompareExchange(&m_isClosing, 1, 0))
+                return;
+
+            m_engine->Close(m_channel);
+        }
+
+        bool Http2Connection::IsAccepting() const
+        {
+            return 0 == m_isClosing && !m_isDraining && !m_isShuttingDown
+                && m_streams.size() + m_reservedCount < m_maxStreams && m_nextStreamId + 2 * m_reservedCount <= MaxStreamId;
+        }
+
+        void Http2Connection::Unreserve()
+        {
+            --m_reservedCount;
+
+            if (IsIdle())
+            {
+                m_idleSince = NowInMilliseconds();
+
+                if (m_isDraining)
+                    CloseWhenFlushed();
+            }
+        }
+
+        uint32_t Http2Connection::Open(Http2Stream *stream, const HeaderFields& fields, bool hasBody)
+        {
+            //! closing or going away since reserved
+            if (0 != m_isClosing || m_isDraining || m_isShuttingDown)
+            {
+                Unreserve();
+                return 0;
+            }
+
+            --m_reservedCount;
+
+            uint32_t streamId = m_nextStreamId;
+            m_nextStreamId += 2;
+
+            //! encoded in the order of writing, the decoder of the peer follows the same
+            std::string block;
+            m_encoder.Encode(fields, block);
+
+            const uint8_t *fragment = reinterpret_cast<const uint8_t *>(block.data());
+            uint32_t remaining = static_cast<uint32_t>(block.size());
+
+            uint8_t type = HeadersFrame;
+            uint8_t flags = hasBody ? 0 : EndStreamFlag;
+            do
+            {
+                uint32_t fragmentLength = (std::min)(remaining, m_maxFrameSize);
+                remaining -= fragmentLength;
+
+                WriteFrame(type, 0 == remaining ? flags | EndHeadersFlag : flags, streamId, fragment, fragmentLength);
+                fragment += fragmentLength;
+
+                type = ContinuationFrame;
+                flags = 0;
+            } while (0 != remaining);
+
+            StreamEntry& entry = m_streams[streamId];
+            entry.stream = stream;
+            entry.sendWindow = m_initialWindow;
+            entry.receiveWindow = StreamWindowSize;
+            entry.isLocalClosed = !hasBody;
+            entry.isRemoteClosed = false;
+            entry.isHeadersReceived = false;
+            entry.isBlocked = false;
+
+            //! the body follows once the head written, see OnSent
+            if (hasBody)
+                m_sending.push_back(streamId);
+
+            Flush();
+
+            return streamId;
+        }
+
+        void Http2Connection::Detach(uint32_t streamId)
+        {
+            StreamEntries::iterator found = m_streams.find(streamId);
+            if (found == m_streams.end())
+                return;
+
+            if (!found->second.isLocalClosed || !found->second.isRemoteClosed)
+                WriteReset(streamId, Cancel);
+
+            m_streams.erase(found);
+            m_sending.remove(streamId);
+
+            if (IsIdle())
+            {
+                m_idleSince = NowInMilliseconds();
+
+                if (m_isDraining)
+                    CloseWhenFlushed();
+            }
+
+            Flush();
+        }
+
+        void Http2Connection::OnConnected(int err)
+        {
+            if (0 != err)
+            {
+                //! try next address
+                if (++m_endpointIndex != m_endpoints.size())
+                {
+                    Connect();
+                }
+                else
+                {
+                    m_abortReason = Http2Stream::ConnectFailed;
+                    m_abortError = err;
+
+                    Close();
+                }
+
+                return;
+            }
+
+            m_isConnected = true;
+
+            Flush();
+            m_engine->Receive(m_channel);
+        }
+
+        void Http2Connection::OnSent(uint32_t, int err)
+        {
+            m_writing.clear();
+
+            if (0 != err)
+            {
+                m_abortError = err;
+                Close();
+
+                return;
+            }
+
+            if (m_isShuttingDown && m_queued.empty())
+            {
+                Close();
+                return;
+            }
+
+            Pump();
+            Flush();
+        }
+
+        void Http2Connection::OnReceived(const uint8_t *data, uint32_t len, int err)
+        {
+            if (0 != m_isClosing)
+                return;
+
+            if (0 != err)
+            {
+                //! an idle connection only hears from the peer when it goes away
+                if (ETIMEDOUT == err && IsIdle())
+                {
+                    m_engine->Receive(m_channel);
+                }
+                else
+                {
+                    m_abortError = err;
+                    Close();
+                }
+
+                return;
+            }
+
+            //! peer closed
+            if (0 == len)
+            {
+                Close();
+                return;
+            }
+
+            if (m_inbound.empty())
+            {
+                //! parsed in place, only the partial frame is kept
+                uint32_t consumed = OnFrames(data, len);
+                if (consumed != len)
+                    m_inbound.assign(reinterpret_cast<const char *>(data) + consumed, len - consumed);
+            }
+            else
+            {
+                m_inbound.append(reinterpret_cast<const char *>(data), len);
+
+                uint32_t consumed = OnFrames(reinterpret_cast<const uint8_t *>(m_inbound.data()), static_cast<uint32_t>(m_inbound.size()));
+                m_inbound.erase(0, consumed);
+            }
+
+            if (0 != m_isClosing)
+                return;
+
+            //! the replies of all the frames received go together
+            Flush();
+            m_engine->Receive(m_channel);
+        }
+
+        void Http2Connection::OnClosed()
+        {
+            m_isClosed = true;
+
+            //! none of them has been written yet, so nothing processed
+            Http2Stream::AbortReason reason = m_isConnected ? m_abortReason : Http2Stream::ConnectFailed;
+            int err = m_isConnected ? m_abortError : (ECONNRESET == m_abortError ? ECONNREFUSED : m_abortError);
+
+            while (!m_streams.empty())
+            {
+                AbortStream(m_streams.begin()->first, reason, err);
+            }
+
+            //! the channel is deleted right after
+            m_channel = NULL;
+
+            Release();
+        }
+
+        uint32_t Http2Connection::OnFrames(const uint8_t *data, uint32_t len)
+        {
+            uint32_t consumed = 0;
+
+            while (len - consumed >= FrameHeaderLength && 0 == m_isClosing && !m_isShuttingDown)
+            {
+                const uint8_t *header = data + consumed;
+
+                uint32_t length = (static_cast<uint32_t>(header[0]) << 16) | (static_cast<uint32_t>(header[1]) << 8) | header[2];
+                if (length > DefaultMaxFrameSize)
+                {
+                    Shutdown(FrameSizeError);
+                    break;
+                }
+
+                if (len - consumed - FrameHeaderLength < length)
+                    break;
+
+                consumed += FrameHeaderLength + length;
+
+                if (!OnFrame(header[3], header[4], _ReadUInt32(header + 5) & MaxStreamId, header + FrameHeaderLength, length))
+                    break;
+            }
+
+            return consumed;
+        }
+
+        bool Http2Connection::OnFrame(uint8_t type, uint8_t flags, uint32_t streamId, const uint8_t *payload, uint32_t len)
+        {
+            //! a header block is never interleaved
+            if (m_isBlockContinuing && ContinuationFrame != type)
+                return Shutdown(ProtocolError);
+
+            switch (type)
+            {
+            case DataFrame:
+                return OnData(flags, streamId, payload, len);
+
+            case HeadersFrame:
+                return OnHeaders(flags, streamId, payload, len);
+
+            case ContinuationFrame:
+                return OnContinuation(flags, streamId, payload, len);
+
+            case ResetFrame:
+                return OnReset(streamId, payload, len);
+
+            case SettingsFrame:
+                return OnSettings(flags, streamId, payload, len);
+
+            case PingFrame:
+                return OnPing(flags, streamId, payload, len);
+
+            case GoAwayFrame:
+                return OnGoAway(streamId, payload, len);
+
+            case WindowUpdateFrame:
+                return OnWindowUpdate(streamId, payload, len);
+
+            case PushPromiseFrame:
+                //! disabled by the settings
+                return Shutdown(ProtocolError);
+
+            default:
+                //! PRIORITY and the unknown ones
+                return true;
+            }
+        }
+
+        bool Http2Connection::OnData(uint8_t flags, uint32_t streamId, const uint8_t *payload, uint32_t len)
+        {
+            if (0 == streamId)
+                return Shutdown(ProtocolError);
+
+            //! the whole frame counts, padding included
+            m_receiveWindow -= len;
+            if (m_receiveWindow < 0)
+                return Shutdown(FlowControlError);
+
+            if (m_receiveWindow <= ConnectionWindowSize / 2)
+            {
+                WriteWindowUpdate(0, static_cast<uint32_t>(ConnectionWindowSize - m_receiveWindow));
+                m_receiveWindow = ConnectionWindowSize;
+            }
+
+            uint32_t frameLength = len;
+            if (!_Unpad(flags, payload, len))
+                return Shutdown(ProtocolError);
+
+            //! reset by us meanwhile
+            StreamEntries::iterator found = m_streams.find(streamId);
+            if (found == m_streams.end())
+                return true;
+
+            StreamEntry& entry = found->second;
+            if (!entry.isHeadersReceived || entry.isRemoteClosed)
+            {
+                ResetStream(streamId, ProtocolError, Http2Stream::Reset, EPROTO);
+                return true;
+            }
+
+            bool isEnd = 0 != (flags & EndStreamFlag);
+            entry.isRemoteClosed = isEnd;
+
+            entry.receiveWindow -= frameLength;
+            if (!isEnd && entry.receiveWindow <= StreamWindowSize / 2)
+            {
+                WriteWindowUpdate(streamId, static_cast<uint32_t>(StreamWindowSize - entry.receiveWindow));
+                entry.receiveWindow = StreamWindowSize;
+            }
+
+            //! the entry may be gone after
+            entry.stream->OnStreamData(payload, len, isEnd);
+            return true;
+        }
+
+        bool Http2Connection::OnHeaders(uint8_t flags, uint32_t streamId, const uint8_t *payload, uint32_t len)
+        {
+            if (0 == streamId)
+                return Shutdown(ProtocolError);
+
+            if (!_Unpad(flags, payload, len))
+                return Shutdown(ProtocolError);
+
+            if (0 != (flags & PriorityFlag))
+            {
+                if (len < 5)
+                    return Shutdown(FrameSizeError);
+
+                payload += 5;
+                len -= 5;
+            }
+
+            m_blockStreamId = streamId;
+            m_isBlockEndStream = 0 != (flags & EndStreamFlag);
+            m_headerBlock.assign(reinterpret_cast<const char *>(payload), len);
+
+            if (0 == (flags & EndHeadersFlag))
+            {
+                m_isBlockContinuing = true;
+                return true;
+            }
+
+            return OnHeaderBlock();
+        }
+
+        bool Http2Connection::OnContinuation(uint8_t flags, uint32_t streamId, const uint8_t *payload, uint32_t len)
+        {
+            //! only the stream of the open header block may continue it
+            if (!m_isBlockContinuing || streamId != m_blockStreamId)
+                return Shutdown(ProtocolError);
+
+            m_headerBlock.append(reinterpret_cast<const char *>(payload), len);
+            if (m_headerBlock.size() > MaxHeaderListSize)
+                return Shutdown(ProtocolError);
+
+            if (0 == (flags & EndHeadersFlag))
+                return true;
+
+            m_isBlockContinuing = false;
+            return OnHeaderBlock();
+        }
+
+        bool Http2Connection::OnHeaderBlock()
+        {
+            //! decoded even if the stream is gone, the table is shared by all
+            HeaderFields fields;
+            if (!m_decoder.Decode(reinterpret_cast<const uint8_t *>(m_headerBlock.data()), static_cast<uint32_t>(m_headerBlock.size()), fields))
+                return Shutdown(CompressionError);
+
+            m_headerBlock.clear();
+
+            StreamEntries::iterator found = m_streams.find(m_blockStreamId);
+            if (found == m_streams.end())
+                return true;
+
+            StreamEntry& entry = found->second;
+            if (entry.isRemoteClosed)
+            {
+                ResetStream(m_blockStreamId, ProtocolError, Http2Stream::Reset, EPROTO);
+                return true;
+            }
+
+            if (entry.isHeadersReceived)
+            {
+                //! the trailers end the stream
+                if (!m_isBlockEndStream)
+                {
+                    ResetStream(m_blockStreamId, ProtocolError, Http2Stream::Reset, EPROTO);
+                    return true;
+                }
+
+                entry.isRemoteClosed = true;
+                entry.stream->OnStreamData(NULL, 0, true);
+
+                return true;
+            }
+
+            //! the pseudo header comes first
+            if (fields.empty() || ":status" != fields.front().name || 3 != fields.front().value.size())
+            {
+                ResetStream(m_blockStreamId, ProtocolError, Http2Stream::Reset, EPROTO);
+                return true;
+            }
+
+            //! interim response, the final one follows
+            if ('1' == fields.front().value[0])
+            {
+                if (m_isBlockEndStream)
+                    ResetStream(m_blockStreamId, ProtocolError, Http2Stream::Reset, EPROTO);
+
+                return true;
+            }
+
+            entry.isHeadersReceived = true;
+            entry.isRemoteClosed = m_isBlockEndStream;
+
+            entry.stream->OnStreamHeaders(fields, m_isBlockEndStream);
+            return true;
+        }
+
+        bool Http2Connection::OnReset(uint32_t streamId, const uint8_t *payload, uint32_t len)
+        {
+            if (0 == streamId)
+                return Shutdown(ProtocolError);
+
+            if (4 != len)
+                return Shutdown(FrameSizeError);
+
+            uint32_t errorCode = _ReadUInt32(payload);
+            AbortStream(streamId, RefusedStream == errorCode ? Http2Stream::Refused : Http2Stream::Reset, ECONNRESET);
+
+            return true;
+        }
+
+        bool Http2Connection::OnSettings(uint8_t flags, uint32_t streamId, const uint8_t *payload, uint32_t len)
+        {
+            if (0 != streamId)
+                return Shutdown(ProtocolError);
+
+            if (0 != (flags & AckFlag))
+                return 0 == len ? true : Shutdown(FrameSizeError);
+
+            if (0 != len % 6)
+                return Shutdown(FrameSizeError);
+
+            for (const uint8_t *end = payload + len; payload != end; payload += 6)
+            {
+                uint16_t id = static_cast<uint16_t>((payload[0] << 8) | payload[1]);
+                uint32_t value = _ReadUInt32(payload + 2);
+
+                switch (id)
+                {
+                case HeaderTableSizeSetting:
+                    m_encoder.SetMaxTableSize(value);
+                    break;
+
+                case MaxConcurrentStreamsSetting:
+                    m_maxStreams = value;
+                    break;
+
+                case InitialWindowSizeSetting:
+                {
+                    if (value > MaxWindowSize)
+                        return Shutdown(FlowControlError);
+
+                    //! applies to the open streams as well, the windows may turn negative
+                    int64_t delta = static_cast<int64_t>(value) - m_initialWindow;
+                    m_initialWindow = value;
+
+                    for (StreamEntries::iterator it = m_streams.begin(); it != m_streams.end(); ++it)
+                    {
+                        StreamEntry& entry = it->second;
+
+                        entry.sendWindow += delta;
+                        if (entry.sendWindow > MaxWindowSize)
+                            return Shutdown(FlowControlError);
+
+                        if (entry.isBlocked && entry.sendWindow > 0)
+                        {
+                            entry.isBlocked = false;
+                            m_sending.push_back(it->first);
+                        }
+                    }
+                    break;
+                }
+
+                case MaxFrameSizeSetting:
+                    if (value < DefaultMaxFrameSize || value > MaxMaxFrameSize)
+                        return Shutdown(ProtocolError);
+
+                    m_maxFrameSize = value;
+                    break;
+
+                default:
+                    break;
+                }
+            }
+
+            WriteFrame(SettingsFrame, AckFlag, 0, NULL, 0);
+            Pump();
+
+            return true;
+        }
+
+        bool Http2Connection::OnPing(uint8_t flags, uint32_t streamId, const uint8_t *payload, uint32_t len)
+        {
+            if (0 != streamId)
+                return Shutdown(ProtocolError);
+
+            if (8 != len)
+                return Shutdown(FrameSizeError);
+
+            if (0 == (flags & AckFlag))
+                WriteFrame(PingFrame, AckFlag, 0, payload, len);
+
+            return true;
+        }
+
+        bool Http2Connection::OnGoAway(uint32_t streamId, const uint8_t *payload, uint32_t len)
+        {
+            if (0 != streamId)
+                return Shutdown(ProtocolError);
+
+            if (len < 8)
+                return Shutdown(FrameSizeError);
+
+            uint32_t lastStreamId = _ReadUInt32(payload) & MaxStreamId;
+            m_isDraining = true;
+
+            //! never processed, may be replayed elsewhere
+            while (!m_streams.empty() && m_streams.rbegin()->first > lastStreamId)
+            {
+                AbortStream(m_streams.rbegin()->first, Http2Stream::Refused, ECONNRESET);
+            }
+
+            if (IsIdle())
+                CloseWhenFlushed();
+
+            return true;
+        }
+
+        bool Http2Connection::OnWindowUpdate(uint32_t streamId, const uint8_t *payload, uint32_t len)
+        {
+            if (4 != len)
+                return Shutdown(FrameSizeError);
+
+            uint32_t increment = _ReadUInt32(payload) & MaxWindowSize;
+
+            if (0 == streamId)
+            {
+                if (0 == increment)
+                    return Shutdown(ProtocolError);
+
+                m_sendWindow += increment;
+                if (m_sendWindow > MaxWindowSize)
+                    return Shutdown(FlowControlError);
+            }
+            else
+            {
+                StreamEntries::iterator found = m_streams.find(streamId);
+                if (found == m_streams.end())
+                    return true;
+
+                if (0 == increment)
+                {
+                    ResetStream(streamId, ProtocolError, Http2Stream::Reset, EPROTO);
+                    return true;
+                }
+
+                StreamEntry& entry = found->second;
+
+                entry.sendWindow += increment;
+                if (entry.sendWindow > MaxWindowSize)
+                {
+                    ResetStream(streamId, FlowControlError, Http2Stream::Reset, EPROTO);
+                    return true;
+                }
+
+                if (entry.isBlocked && entry.sendWindow > 0)
+                {
+                    entry.isBlocked = false;
+                    m_sending.push_back(streamId);
+                }
+            }
+
+            Pump();
+            return true;
+        }
+
+        void Http2Connection::WriteFrame(uint8_t type, uint8_t flags, uint32_t streamId, const uint8_t *payload, uint32_t len)
+        {
+            char header[FrameHeaderLength] =
+            {
+                static_cast<char>(len >> 16), static_cast<char>(len >> 8), static_cast<char>(len),
+                static_cast<char>(type),
+                static_cast<char>(flags),
+                static_cast<char>(streamId >> 24), static_cast<char>(streamId >> 16), static_cast<char>(streamId >> 8), static_cast<char>(streamId)
+            };
+
+            m_queued.append(header, FrameHeaderLength);
+            if (0 != len)
+                m_queued.append(reinterpret_cast<const char *>(payload), len);
+        }
+
+        void Http2Connection::WriteReset(uint32_t streamId, uint32_t errorCode)
+        {
+            std::string payload;
+            _AppendUInt32(payload, errorCode);
+
+            WriteFrame(ResetFrame, 0, streamId, reinterpret_cast<const uint8_t *>(payload.data()), 4);
+        }
+
+        void Http2Connection::WriteWindowUpdate(uint32_t streamId, uint32_t increment)
+        {
+            std::string payload;
+            _AppendUInt32(payload, increment);
+
+            WriteFrame(WindowUpdateFrame, 0, streamId, reinterpret_cast<const uint8_t *>(payload.data()), 4);
+        }
+
+        void Http2Connection::Pump()
+        {
+            while (!m_sending.empty() && m_sendWindow > 0 && m_queued.size() < MaxQueuedLength && 0 == m_isClosing && !m_isShuttingDown)
+            {
+                uint32_t streamId = m_sending.front();
+                m_sending.pop_front();
+
+                StreamEntries::iterator found = m_streams.find(streamId);
+                if (found == m_streams.end())
+                    continue;
+
+                if (found->second.sendWindow <= 0)
+                {
+                    found->second.isBlocked = true;
+                    continue;
+                }
+
+                uint32_t len = static_cast<uint32_t>((std::min)(static_cast<int64_t>(m_maxFrameSize), (std::min)(found->second.sendWindow, m_sendWindow)));
+                if (m_body.size() < len)
+                    m_body.resize(len);
+
+                bool isEnd = false;
+                if (!found->second.stream->OnStreamBody(reinterpret_cast<uint8_t *>(&m_body[0]), len, isEnd))
+                    continue;
+
+                //! still there as it didn't detach
+                StreamEntry& entry = m_streams[streamId];
+
+                WriteFrame(DataFrame, isEnd ? EndStreamFlag : 0, streamId, reinterpret_cast<const uint8_t *>(m_body.data()), len);
+
+                entry.sendWindow -= len;
+                m_sendWindow -= len;
+
+                if (isEnd)
+                    entry.isLocalClosed = true;
+                else
+                    m_sending.push_back(streamId);
+            }
+        }
+
+        void Http2Connection::Flush()
+        {
+            if (!m_isConnected || 0 != m_isClosing || !m_writing.empty() || m_queued.empty())
+                return;
+
+            m_writing.swap(m_queued);
+            m_engine->Send(m_channel, reinterpret_cast<const uint8_t *>(m_writing.data()), static_cast<uint32_t>(m_writing.size()));
+        }
+
+        void Http2Connection::ResetStream(uint32_t streamId, uint32_t errorCode, Http2Stream::AbortReason reason, int err)
+        {
+            WriteReset(streamId, errorCode);
+            AbortStream(streamId, reason, err);
+        }
+
+        void Http2Connection::AbortStream(uint32_t streamId, Http2Stream::AbortReason reason, int err)
+        {
+            StreamEntries::iterator found = m_streams.find(streamId);
+            if (found == m_streams.end())
+                return;
+
+            Http2Stream *stream = found->second.stream;
+
+            m_streams.erase(found);
+            m_sending.remove(streamId);
+
+            if (IsIdle())
+                m_idleSince = NowInMilliseconds();
+
+            stream->OnStreamAborted(reason, err);
+        }
+
+        bool Http2Connection::Shutdown(uint32_t errorCode)
+        {
+            if (m_isShuttingDown)
+                return false;
+
+            m_isDraining = true;
+
+            //! no stream is processed by us
+            std::string payload;
+            _AppendUInt32(payload, 0);
+            _AppendUInt32(payload, errorCode);
+            WriteFrame(GoAwayFrame, 0, 0, reinterpret_cast<const uint8_t *>(payload.data()), static_cast<uint32_t>(payload.size()));
+
+            CloseWhenFlushed();
+
+            while (!m_streams.empty())
+            {
+                AbortStream(m_streams.begin()->first, Http2Stream::Reset, EPROTO);
+            }
+
+            return false;
+        }
+
+        void Http2Connection::CloseWhenFlushed()
+        {
+            m_isShuttingDown = true;
+
+            if (!m_isConnected || (m_writing.empty() && m_queued.empty()))
+                Close();
+            else
+                Flush();
+        }
+    }
+}
+
+#endif
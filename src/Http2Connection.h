@@ -0,0 +1,206 @@
+#ifndef HTTP2CONNECTION_H
+#define HTTP2CONNECTION_H
+
+#include "IoEngine.h"
+#include "Hpack.h"
+
+#include <list>
+#include <map>
+#include <string>
+
+namespace Net
+{
+    namespace Details
+    {
+        //
+        //  a request multiplexed on Http2Connection, implemented by the request handler
+        //      called in the engine thread, the stream may detach itself inside any of them
+        //
+        class Http2Stream
+        {
+        public:
+            enum AbortReason
+            {
+                //! none of the endpoints could be connected
+                ConnectFailed,
+                //! GOAWAY or REFUSED_STREAM, the request wasn't processed and may be replayed
+                Refused,
+                //! reset by peer, or the connection failed
+                Reset
+            };
+
+        public:
+            virtual ~Http2Stream() {}
+
+        public:
+            //! the final response head, the interim ones are dropped
+            virtual void OnStreamHeaders(const HeaderFields& fields, bool isEnd) = 0;
+            //! data is empty when ended by the trailers
+            virtual void OnStreamData(const uint8_t *data, uint32_t len, bool isEnd) = 0;
+            //! fills the request body as much as the flow control allows, false means the stream has detached
+            virtual bool OnStreamBody(uint8_t *buffer, uint32_t& len, bool& isEnd) = 0;
+            //! the stream has been detached by the connection
+            virtual void OnStreamAborted(AbortReason reason, int err) = 0;
+        };
+
+        //
+        //  HTTP/2(RFC 7540) connection over cleartext TCP with prior knowledge(h2c), the permanent handler of its channel
+        //      the streams are opened in the engine thread, each request is a stream of its own
+        //      the response bodies are delivered as soon as they arrived, so the receive windows are replenished right away
+        //      the request bodies are written as the send windows allow, one frame of each stream in turn
+        //      no more streams once GOAWAY received, those beyond the last stream id are refused
+        //
+        //  referenced by the pool and by itself till the channel closed
+        //
+        class Http2Connection : public ChannelHandler
+        {
+        private:
+            struct StreamEntry
+            {
+                Http2Stream *stream;
+
+                int64_t sendWindow;
+                int64_t receiveWindow;
+
+                //! END_STREAM sent
+                bool isLocalClosed;
+                //! END_STREAM received
+                bool isRemoteClosed;
+                bool isHeadersReceived;
+                //! the body waits for WINDOW_UPDATE of the stream
+                bool isBlocked;
+            };
+            typedef std::map<uint32_t, StreamEntry> StreamEntries;
+
+        private:
+            REF m_ref;
+            REF m_isClosing;
+            //! the streams have all been aborted
+            volatile bool m_isClosed;
+
+            IoEngine *m_engine;
+            Channel *m_channel;
+
+            std::string m_origin;
+            Endpoints m_endpoints;
+            Endpoints::size_type m_endpointIndex;
+
+            bool m_isConnected;
+            //! GOAWAY received or sent, no more streams
+            bool m_isDraining;
+            //! closes once the queued frames are written
+            bool m_isShuttingDown;
+            //! for the streams remaining when closed
+            Http2Stream::AbortReason m_abortReason;
+            int m_abortError;
+
+            StreamEntries m_streams;
+            //! have the request body to send, in turn
+            std::list<uint32_t> m_sending;
+            //! attached by the pool, not opened yet
+            uint32_t m_reservedCount;
+            uint32_t m_nextStreamId;
+            uint64_t m_idleSince;
+
+            //! settings of the peer
+            uint32_t m_maxStreams;
+            uint32_t m_maxFrameSize;
+            int64_t m_initialWindow;
+
+            int64_t m_sendWindow;
+            int64_t m_receiveWindow;
+
+            HpackEncoder m_encoder;
+            HpackDecoder m_decoder;
+
+            //! frames not written yet
+            std::string m_queued;
+            //! remains valid till OnSent
+            std::string m_writing;
+            //! a partial frame received
+            std::string m_inbound;
+            std::string m_body;
+
+            //! header block spanning CONTINUATION frames
+            uint32_t m_blockStreamId;
+            bool m_isBlockEndStream;
+            bool m_isBlockContinuing;
+            std::string m_headerBlock;
+
+        public:
+            Http2Connection(IoEngine *engine, const SocketOptions& options, const std::string& origin, const Endpoints& endpoints);
+
+        private:
+            virtual ~Http2Connection() {}
+
+        public:
+            void AddRef();
+            void Release();
+
+            const std::string& GetOrigin() const { return m_origin; }
+
+            //! shall be called in the engine thread unless mentioned
+            void Connect();
+            //! thread safe, the streams are aborted once closed
+            void Close();
+            bool IsClosed() const { return m_isClosed; }
+
+            //! more streams may be opened
+            bool IsAccepting() const;
+            bool IsIdle() const { return m_streams.empty() && 0 == m_reservedCount; }
+            uint64_t GetIdleSince() const { return m_idleSince; }
+
+            //! counted as a stream till opened or unreserved
+            void Reserve() { ++m_reservedCount; }
+            void Unreserve();
+            //! consumes the reservation, returns the stream id or 0 when no more streams accepted
+            uint32_t Open(Http2Stream *stream, const HeaderFields& fields, bool hasBody);
+            //! reset unless ended on both sides, no more callings
+            void Detach(uint32_t streamId);
+
+        public:
+            virtual void OnConnected(int err);
+            virtual void OnSent(uint32_t len, int err);
+            virtual void OnReceived(const uint8_t *data, uint32_t len, int err);
+            virtual void OnClosed();
+
+        private:
+            //! returns the length consumed
+            uint32_t OnFrames(const uint8_t *data, uint32_t len);
+            //! false means the connection failed
+            bool OnFrame(uint8_t type, uint8_t flags, uint32_t streamId, const uint8_t *payload, uint32_t len);
+
+            bool OnData(uint8_t flags, uint32_t streamId, const uint8_t *payload, uint32_t len);
+            bool OnHeaders(uint8_t flags, uint32_t streamId, const uint8_t *payload, uint32_t len);
+            bool OnContinuation(uint8_t flags, uint32_t streamId, const uint8_t *payload, uint32_t len);
+            bool OnHeaderBlock();
+            bool OnReset(uint32_t streamId, const uint8_t *payload, uint32_t len);
+            bool OnSettings(uint8_t flags, uint32_t streamId, const uint8_t *payload, uint32_t len);
+            bool OnPing(uint8_t flags, uint32_t streamId, const uint8_t *payload, uint32_t len);
+            bool OnGoAway(uint32_t streamId, const uint8_t *payload, uint32_t len);
+            bool OnWindowUpdate(uint32_t streamId, const uint8_t *payload, uint32_t len);
+
+            void WriteFrame(uint8_t type, uint8_t flags, uint32_t streamId, const uint8_t *payload, uint32_t len);
+            void WriteReset(uint32_t streamId, uint32_t errorCode);
+            void WriteWindowUpdate(uint32_t streamId, uint32_t increment);
+
+            //! writes the request bodies
+            void Pump();
+            void Flush();
+
+            //! stream error
+            void ResetStream(uint32_t streamId, uint32_t errorCode, Http2Stream::AbortReason reason, int err);
+            //! detach the stream and notify it
+            void AbortStream(uint32_t streamId, Http2Stream::AbortReason reason, int err);
+            //! connection error, returns false for OnFrame
+            bool Shutdown(uint32_t errorCode);
+            void CloseWhenFlushed();
+
+        private:
+            Http2Connection(const Http2Connection&);
+            Http2Connection& operator = (const Http2Connection&);
+        };
+    }
+}
+
+#endif
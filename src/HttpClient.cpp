@@ -1,20 +1,22 @@
-#include "HttpClient.h"
+#include "HttpSessionPrivate.h"
 
+#if defined(_WIN32)
 #include <Windows.h>
-#include <Winhttp.h>
+#else
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cstdio>
+#endif
 
-#pragma comment(lib, "Winhttp.lib")
-
-#include <map>
-#include <list>
-#include <fstream>
 #include <sstream>
+#include <vector>
 #include <algorithm>
 #include <cwchar>
+#include <cstring>
 
 #include "StringConvertor.h"
-
-#define ERROR_HTTP_HEADER_NOT_FOUND 12150
+#include "HeaderNames.h"
+#include "BufferPool.h"
 
 SimpleStringInputStream::SimpleStringInputStream(const String& str)
 : m_buffer()
@@ -39,9 +41,11 @@ int64_t SimpleStringInputStream::GetAvailCount() const
 
 uint32_t SimpleStringInputStream::Read(uint8_t *buffer, uint32_t read)
 {
-    uint32_t readCount = static_cast<uint32_t>(min(GetAvailCount(), static_cast<int64_t>(read)));
+    uint32_t readCount = static_cast<uint32_t>((std::min)(GetAvailCount(), static_cast<int64_t>(read)));
     ::memcpy(buffer, m_buffer.data() + m_offset, readCount);
 
+    m_offset += readCount;
+
     return readCount;
 }
 
@@ -80,100 +84,6 @@ RedirectCompletionGenericDelegate *RedirectCompletionGenericDelegate::GetDefault
 
 namespace Net
 {
-    namespace Details
-    {
-        class AbstractHttpHandler;
-        typedef std::list<AbstractHttpHandler *> HttpHandlers;
-        typedef std::map<String, HINTERNET> HostConnections;
-    }
-
-    class HttpSession::Private
-    {
-    protected:
-        struct HttpSecurityOptions
-        {
-            bool isHttps;
-            //! cert
-        };
-
-    protected:
-        HINTERNET m_hSession;
-        Details::HostConnections m_connections;
-        Details::HttpHandlers m_handlers;
-
-        HttpSessionConfig m_config;
-
-    public:
-        Private()
-            : m_hSession(NULL)
-            , m_connections()
-            , m_handlers()
-            , m_config()
-        {}
-
-        Private(const HttpSessionConfig& config)
-            : m_hSession(NULL)
-            , m_connections()
-            , m_handlers()
-            , m_config(config)
-        {}
-
-        virtual ~Private()
-        {
-        }
-
-    public:
-        HINTERNET AcquireRequest(const URL& url, const HttpVerb& verb);
-        void Disconnect();
-
-    public:
-        //! send request
-        //! ###
-        //! When disconnecting, this method should never be invoked
-        //!
-        virtual void SendRequest(HINTERNET hReq, const HttpRequest *req, AsyncCompletionGenericDelegate *delegate);
-        //! notify handlers
-        virtual void OnDisconnect();
-        virtual void OnHandleFinished(Details::AbstractHttpHandler *handler);
-
-        //! send redirect request
-        virtual void SendRedirect(const HttpRequest *req,
-            AsyncCompletionGenericDelegate *delegate,
-            RedirectCompletionGenericDelegate *redirectDelegate,
-            const HttpResponseHeaders& headers);
-
-    private:
-        HINTERNET AcquireConnection(const String& host, uint16_t port);
-        HINTERNET OpenRequest(HINTERNET connection, const String& path, HttpVerb verb, const HttpSecurityOptions& securityOpts);
-    };
-
-    class LockHttpSessionPrivate : public HttpSession::Private
-    {
-    private:
-        CriticalSection m_lock;
-        //! when terminating, the state of the event will shift to unsignaled
-        ManualResetEvent m_disconnectedEvent;
-
-    public:
-        LockHttpSessionPrivate();
-        explicit LockHttpSessionPrivate(const HttpSessionConfig& config);
-
-    public:
-        virtual void SendRequest(HINTERNET hReq, const HttpRequest *req, AsyncCompletionGenericDelegate *delegate);
-        //! notify handlers
-        virtual void OnDisconnect();
-
-        //! ###
-        //! called in thread pool
-        virtual void OnHandleFinished(Details::AbstractHttpHandler *handler);
-
-        //! send redirect request
-        virtual void SendRedirect(const HttpRequest *req,
-            AsyncCompletionGenericDelegate *delegate,
-            RedirectCompletionGenericDelegate *redirectDelegate,
-            const HttpResponseHeaders& headers);
-    };
-
     namespace Details
     {
         class WriteableResponseStream;
@@ -196,66 +106,6 @@ namespace Net
             virtual HttpResponse OnCompleted();
         };
 
-        class OneTimeStream : public InputStream
-        {
-        private:
-            uint32_t m_buffLength;
-
-        public:
-            uint32_t m_readableLength;
-            uint8_t *m_buffer;
-            int64_t m_contentLength;
-
-        public:
-            OneTimeStream()
-                : m_buffLength(4096)
-                , m_contentLength(0)
-                , m_buffer(NULL)
-                , m_readableLength(0)
-            {}
-            ~OneTimeStream()
-            {
-                Deallocate();
-            }
-
-        public:
-            virtual int64_t GetTotal() const { return m_contentLength; }
-
-        public:
-            virtual int64_t GetAvailCount() const { return m_readableLength; }
-            virtual uint32_t Read(uint8_t *buffer, uint32_t read);
-
-        public:
-            uint32_t BufferLength() const { return m_buffLength; }
-
-        public:
-            void Allocate();
-            void Deallocate();
-        };
-
-        uint32_t OneTimeStream::Read(uint8_t *buffer, uint32_t read)
-        {
-            uint32_t aboutToRead = min(read, m_readableLength);
-            ::memcpy(buffer, m_buffer, aboutToRead);
-
-            return aboutToRead;
-        }
-
-        void OneTimeStream::Allocate()
-        {
-            if (!m_buffer)
-                m_buffer = static_cast<uint8_t *>(::malloc(m_buffLength));
-        }
-
-        void OneTimeStream::Deallocate()
-        {
-            if (m_buffer)
-            {
-                ::free(m_buffer);
-                m_buffer = NULL;
-            }
-        }
-
         class WriteableResponseStream : public InputStream
         {
         public:
@@ -266,11 +116,16 @@ namespace Net
         class TempFileWriteableResponseStream : public WriteableResponseStream
         {
         private:
+            AdaptiveReadLength m_readLength;
             uint32_t m_bufferLength;
             uint8_t *m_buffer;
 
+#if defined(_WIN32)
             mutable HANDLE m_hFile; //! when calling GetTotal the handle of file will be refreshed
             String m_filePath;
+#else
+            FILE *m_file;   //! removed automatically once closed
+#endif
 
         private:
             uint64_t m_seeker;
@@ -290,6 +145,8 @@ namespace Net
 
         private:
             void Dispose();
+            //! as long as the read length
+            void AcquireBuffer();
         };
 
         class SimpleBufferWriteableResponseStream : public WriteableResponseStream
@@ -308,8 +165,7 @@ namespace Net
 
             virtual ~SimpleBufferWriteableResponseStream()
             {
-                if (m_buffer)
-                    ::free(m_buffer);
+                BufferPool::Free(m_buffer, m_bufferLength);
             }
 
         public:
@@ -325,7 +181,7 @@ namespace Net
                 if (NULL == m_buffer || 0 == m_offset)
                     return 0;
 
-                uint32_t readCount = min(m_offset, read);
+                uint32_t readCount = (std::min)(m_offset, read);
                 ::memcpy(buffer, m_buffer + m_bufferLength - m_offset, readCount);
 
                 m_offset -= readCount;
@@ -339,7 +195,7 @@ namespace Net
                 if (m_offset < m_bufferLength)
                 {
                     if (NULL == m_buffer)
-                        m_buffer = static_cast<uint8_t *>(::malloc(m_bufferLength));
+                        m_buffer = static_cast<uint8_t *>(BufferPool::Allocate(m_bufferLength));
 
                     m_offset += is.Read(m_buffer + m_offset, m_bufferLength - m_offset);
                 }
@@ -353,8 +209,10 @@ namespace Net
             }
         };
 
+#if defined(_WIN32)
         TempFileWriteableResponseStream::TempFileWriteableResponseStream()
-            : m_bufferLength(4096)
+            : m_readLength()
+            , m_bufferLength(0)
             , m_buffer(NULL)
             , m_hFile(NULL)
             , m_filePath()
@@ -365,8 +223,7 @@ namespace Net
         {
             Dispose();
 
-            if (m_buffer)
-                ::free(m_buffer);
+            BufferPool::Free(m_buffer, m_bufferLength);
         }
 
         int64_t TempFileWriteableResponseStream::GetAvailCount() const
@@ -376,7 +233,7 @@ namespace Net
 
         uint32_t TempFileWriteableResponseStream::Read(uint8_t *buffer, uint32_t read)
         {
-            uint32_t readCount = static_cast<uint32_t>(min(m_seeker, static_cast<uint64_t>(read)));
+            uint32_t readCount = static_cast<uint32_t>((std::min)(m_seeker, static_cast<uint64_t>(read)));
             if (readCount)
             {
                 if (m_hFile == NULL)
@@ -428,12 +285,10 @@ namespace Net
                 }
             }
 
-            if (m_buffer == NULL)
-            {
-                m_buffer = static_cast<uint8_t *>(::malloc(m_bufferLength));
-            }
+            AcquireBuffer();
 
             uint32_t readCount = is.Read(m_buffer, m_bufferLength);
+            m_readLength.Update(readCount);
             DWORD dwWriteCount = 0;
             if (!::WriteFile(m_hFile, m_buffer, readCount, &dwWriteCount, NULL))
             {
@@ -493,598 +348,417 @@ namespace Net
 
             return totalSize;
         }
+#else
+        TempFileWriteableResponseStream::TempFileWriteableResponseStream()
+            : m_readLength()
+            , m_bufferLength(0)
+            , m_buffer(NULL)
+            , m_file(NULL)
+            , m_seeker(0)
+        {}
 
-        void DefaultResponseCompletionHandler::OnHeaderAvailable(const Net::HttpResponseHeaders& headers)
+        TempFileWriteableResponseStream::~TempFileWriteableResponseStream()
         {
-            int64_t length = headers.GetContentLength();
-
-            if (length > 0 && length < 1024 * 1024 * 2) //! lower than 2 MB
-            {
-                m_responseStream = new SimpleBufferWriteableResponseStream(static_cast<uint32_t>(length));
-            }
-            else
-            {
-                //! unknown length or larger than 2MB
-                m_responseStream = new TempFileWriteableResponseStream;
-            }
+            Dispose();
 
-            m_headers = headers;
+            BufferPool::Free(m_buffer, m_bufferLength);
         }
 
-        void DefaultResponseCompletionHandler::OnBodyAvailable(InputStream& inputStream)
+        int64_t TempFileWriteableResponseStream::GetAvailCount() const
         {
-            *m_responseStream << inputStream;
+            return m_seeker;
         }
 
-        HttpResponse DefaultResponseCompletionHandler::OnCompleted()
+        uint32_t TempFileWriteableResponseStream::Read(uint8_t *buffer, uint32_t read)
         {
-            m_responseStream->OnWriteFinished();
-            return HttpResponse(m_headers, m_responseStream);
-        }
+            uint32_t readCount = static_cast<uint32_t>((std::min)(m_seeker, static_cast<uint64_t>(read)));
+            if (readCount)
+            {
+                if (m_file == NULL)
+                {
+                    throw IOException();
+                }
 
-        static Exception *ConvertLastError(DWORD dwErr)
-        {
-            //! check error
-            if (ERROR_WINHTTP_INVALID_URL == dwErr)
-                return new InvalidURLFormatException();
+                size_t alreadRead = ::fread(buffer, 1, readCount, m_file);
+                if (alreadRead != readCount && ::ferror(m_file))
+                {
+                    throw IOException();
+                }
+
+                readCount = static_cast<uint32_t>(alreadRead);
+                //! update seeker
+                m_seeker -= alreadRead;
+            }
 
-            return new NetException(dwErr);
+            return readCount;
         }
 
-        class AbstractHttpHandler
+        WriteableResponseStream& TempFileWriteableResponseStream::operator << (InputStream& is)
         {
-        public:
-            const HttpRequest *m_request;
-
-        protected:
-            //! when closed, all those will be NULL
-            HINTERNET m_hRequest;
-
-            AsyncCompletionGenericDelegate *m_completionAsyncHandler;
-
-            AsyncCompletionGenericDelegate *m_normalAsyncHandler;
-            RedirectCompletionGenericDelegate *m_redirectDelegate;
-
-            HttpSession::Private *m_sessionImpl;
-
-        protected:
-            //! deallocate when closed 
-            OneTimeStream m_bufferStream;
-
-            HttpResponseHeaders m_headers;
-
-        public:
-            AbstractHttpHandler(HINTERNET hReq, const HttpRequest *req, AsyncCompletionGenericDelegate *delegate, HttpSession::Private *sessionImpl)
-                : m_hRequest(hReq)
-                , m_redirectDelegate(DefaultRedirectCompletionGenericDelegate::GetDefaultDelegate())
-                , m_completionAsyncHandler(delegate)
-                , m_normalAsyncHandler(delegate)
-                , m_request(req)
-                , m_sessionImpl(sessionImpl)
-            {}
-
-            AbstractHttpHandler(HINTERNET hReq, const HttpRequest *req, AsyncCompletionGenericDelegate *delegate, RedirectCompletionGenericDelegate *redirectDelegate, HttpSession::Private *sessionImpl)
-                : m_hRequest(hReq)
-                , m_redirectDelegate(redirectDelegate)
-                , m_completionAsyncHandler(delegate)
-                , m_normalAsyncHandler(delegate)
-                , m_request(req)
-                , m_sessionImpl(sessionImpl)
-            {}
-
-            virtual ~AbstractHttpHandler()
+            if (m_file == NULL)
             {
+                m_file = ::tmpfile();
+                if (NULL == m_file)
+                {
+                    throw IOException();
+                }
             }
 
-        public:
-            //! 
-            virtual void Terminate();
-
-            /**
-                When finished, the handler may(will if synchronous) be deleted, which means no more call after sending request
-                */
-            virtual void OnSendingRequest() = 0;
-            /**
-                Events
-                NO more callings after any of those methods showing below
-                */
-            //! on request already sent
-            void OnRequestSent();
-            void OnError(WINHTTP_ASYNC_RESULT *result);
-            //! send request stream
-            //! len means length already sent
-            void OnWriteData(DWORD len);
-
-            void OnReadHeader();
-            void OnReadData(DWORD len);
-
-            //! on handler closed
-            //! no more callings
-            void OnFinished();
-
-        protected:
-            //! close the handler
-            //! request handler is invalid
-            //! exception == nullptr means success
-            virtual void OnClose(Exception *exception);
-
-            virtual void OnReadingData() = 0;
-
-        private:
-            void OnTerminated();
-            /**
-                NO more callings after any of those methods showing below
-                */
-            //! start to receive reponse header
-            void OnReceiveResponse();
-
-            void OnWritingData(InputStream *);
-        };
-
-        static void CALLBACK _Callback(_In_ HINTERNET hInternet,
-            _In_ DWORD_PTR dwContext,
-            _In_ DWORD dwInternetStatus,
-            _In_opt_ LPVOID lpvStatusInformation,
-            _In_ DWORD dwStatusInformationLength)
-        {
-            AbstractHttpHandler *handler = (AbstractHttpHandler *)dwContext;
+            AcquireBuffer();
 
-            switch (dwInternetStatus)
+            uint32_t readCount = is.Read(m_buffer, m_bufferLength);
+            m_readLength.Update(readCount);
+            if (readCount && ::fwrite(m_buffer, 1, readCount, m_file) != readCount)
             {
-                /**
-                    Response
-                    */
-            case WINHTTP_CALLBACK_STATUS_READ_COMPLETE:
-                handler->OnReadData(dwStatusInformationLength);
-                break;
-
-            case WINHTTP_CALLBACK_STATUS_HEADERS_AVAILABLE:
-                handler->OnReadHeader();
-                break;
-
-                /**
-                    Request
-                    */
-            case WINHTTP_CALLBACK_STATUS_WRITE_COMPLETE:
-                handler->OnWriteData(dwStatusInformationLength);
-                break;
-
-            case WINHTTP_CALLBACK_STATUS_SENDREQUEST_COMPLETE:
-                handler->OnRequestSent();
-                break;
-
-            case WINHTTP_CALLBACK_STATUS_REQUEST_SENT:
-                break;
-
-                /**
-                    Error
-                    */
-            case WINHTTP_CALLBACK_STATUS_REQUEST_ERROR:
-                handler->OnError(static_cast<WINHTTP_ASYNC_RESULT*>(lpvStatusInformation));
-                break;
-
-            case WINHTTP_CALLBACK_STATUS_HANDLE_CLOSING:
-                handler->OnFinished();
-                break;
-
-            default:
-                //TRACE(_T("Unknown status:%08X"), dwInternetStatus);
-                break;
+                throw IOException();
             }
-        }
-
-        void AbstractHttpHandler::OnFinished()
-        {
-            //! safe quit will clean request value
-            if (m_hRequest)
-                OnTerminated();
 
-            //! remove from handlers manager
-            m_sessionImpl->OnHandleFinished(this);
+            m_seeker += readCount;
 
-            delete this;
+            return *this;
         }
 
-        void AbstractHttpHandler::Terminate()
+        void TempFileWriteableResponseStream::OnWriteFinished()
         {
-            ::WinHttpCloseHandle(m_hRequest);
+            if (m_file)
+            {
+                ::fflush(m_file);
+                ::rewind(m_file);
+            }
         }
 
-        void AbstractHttpHandler::OnError(WINHTTP_ASYNC_RESULT *result)
+        void TempFileWriteableResponseStream::Dispose()
         {
-            //! close handler failed
-            if (NULL == m_hRequest)
-            {
-                OnFinished();
-            }
-            else
+            if (m_file)
             {
-                OnClose(ConvertLastError(result->dwError));
+                ::fclose(m_file);
+                m_file = NULL;
             }
         }
 
-        void AbstractHttpHandler::OnRequestSent()
+        int64_t TempFileWriteableResponseStream::GetTotal() const
         {
-            //! check request body has any data to be sent
-            InputStream *bodyStream = m_request->GetRequestBodyStream();
-            if (!bodyStream || bodyStream->GetAvailCount() == 0)
-            {
-                OnReceiveResponse();
-            }
-            else
-            {
-                //! start write data
-                if (m_bufferStream.m_buffer == NULL)
-                    m_bufferStream.Allocate();
+            struct stat fileStat;
+            if (NULL == m_file || 0 != ::fstat(::fileno(m_file), &fileStat))
+                return 0;
 
-                OnWritingData(bodyStream);
-            }
+            return fileStat.st_size;
         }
+#endif
 
-        void AbstractHttpHandler::OnReceiveResponse()
+        void TempFileWriteableResponseStream::AcquireBuffer()
         {
-            if (!::WinHttpReceiveResponse(m_hRequest, 0))
+            if (m_readLength.Get() != m_bufferLength)
             {
-                OnClose(ConvertLastError(::GetLastError()));
+                BufferPool::Free(m_buffer, m_bufferLength);
+                m_buffer = NULL;
+                m_bufferLength = m_readLength.Get();
             }
+
+            if (NULL == m_buffer)
+                m_buffer = static_cast<uint8_t *>(BufferPool::Allocate(m_bufferLength));
         }
 
-        void AbstractHttpHandler::OnWriteData(DWORD completedLength)    //! ignored for now
+        void DefaultResponseCompletionHandler::OnHeaderAvailable(const Net::HttpResponseHeaders& headers)
         {
-            InputStream *bodyStream = m_request->GetRequestBodyStream();
+            int64_t length = headers.GetContentLength();
 
-            //! read finished
-            if (bodyStream->GetAvailCount() == 0)
+            if (length > 0 && length < 1024 * 1024 * 2) //! lower than 2 MB
             {
-                OnReceiveResponse();
+                m_responseStream = new SimpleBufferWriteableResponseStream(static_cast<uint32_t>(length));
             }
             else
             {
-                OnWritingData(bodyStream);
+                //! unknown length or larger than 2MB
+                m_responseStream = new TempFileWriteableResponseStream;
             }
+
+            m_headers = headers;
         }
 
-        void AbstractHttpHandler::OnWritingData(InputStream *bodyStream)
+        void DefaultResponseCompletionHandler::OnBodyAvailable(InputStream& inputStream)
         {
-            try
-            {
-                uint32_t readCount = bodyStream->Read(m_bufferStream.m_buffer, m_bufferStream.BufferLength());
+            *m_responseStream << inputStream;
+        }
 
-                if (!::WinHttpWriteData(m_hRequest, m_bufferStream.m_buffer, readCount, NULL))
-                {
-                    OnClose(ConvertLastError(::GetLastError()));
-                }
-            }
-            catch (const Exception& ex)
-            {
-                OnClose(ex.Clone());
-            }
+        HttpResponse DefaultResponseCompletionHandler::OnCompleted()
+        {
+            m_responseStream->OnWriteFinished();
+            return HttpResponse(m_headers, m_responseStream);
         }
+    }
+}
 
-        void AbstractHttpHandler::OnReadData(DWORD len)
+namespace Net
+{
+    namespace Details
+    {
+        static size_t _LengthOf(const char *s) { return std::strlen(s); }
+        static size_t _LengthOf(const wchar_t *s) { return std::wcslen(s); }
+
+        static const char *_Find(const char *s, char c, size_t length) { return static_cast<const char *>(std::memchr(s, c, length)); }
+        static const wchar_t *_Find(const wchar_t *s, wchar_t c, size_t length) { return std::wmemchr(s, c, length); }
+
+        //
+        //  the header lines indexed once, looked up by name case-insensitively
+        //      the well-known names are indexed by id, the first entry of each
+        //      the others are a few at most, so the entries are scanned in order, compared by hash first
+        //
+        template<typename CharType>
+        class HeaderBlock
         {
-            if (len == 0)
+        private:
+            //! offsets into the raw data
+            struct Entry
             {
-                //!	finished
-                OnClose(NULL);
-            }
-            else
+                uint32_t hash;
+                uint32_t lineOffset;
+                uint32_t lineLength;
+                uint32_t nameLength;
+                uint32_t valueOffset;
+                uint32_t valueLength;
+            };
+            typedef std::vector<Entry> Entries;
+
+            enum
             {
-                m_bufferStream.m_readableLength = len;
+                NotFound = 0xFFFFFFFF
+            };
 
-                try
-                {
-                    m_completionAsyncHandler->OnBodyAvailable(m_bufferStream);
+        private:
+            const CharType *m_data;
+            //! including the terminating NULs
+            size_t m_length;
+            Entries m_entries;
+            //! the index of the first entry of each well-known name, NotFound when absent
+            uint32_t m_known[HeaderName::Unknown];
 
-                    //! read next piece
-                    OnReadingData();
-                }
-                catch (const Exception& ex)
-                {
-                    OnClose(ex.Clone());
-                }
+        public:
+            //! takes the ownership
+            explicit HeaderBlock(const CharType *data)
+                : m_data(data)
+                , m_length(0)
+                , m_entries()
+            {
+                std::fill(m_known, m_known + HeaderName::Unknown, static_cast<uint32_t>(NotFound));
+                Index();
             }
-        }
 
-        void AbstractHttpHandler::OnReadHeader()
-        {
-            DWORD statusCode = 0;
-
-            DWORD dwStatusCodeSize = sizeof(statusCode);
-            if (!WinHttpQueryHeaders(m_hRequest
-                , WINHTTP_QUERY_STATUS_CODE | WINHTTP_QUERY_FLAG_NUMBER
-                , WINHTTP_HEADER_NAME_BY_INDEX
-                , &statusCode
-                , &dwStatusCodeSize
-                , WINHTTP_NO_HEADER_INDEX))
+            ~HeaderBlock()
             {
-                OnClose(ConvertLastError(::GetLastError()));
-                return;
+                delete[] m_data;
             }
 
-            WCHAR wszContentLength[32] = { 0 };
-            DWORD dwBufferSize = sizeof(wszContentLength);
-            if (!WinHttpQueryHeaders(m_hRequest
-                , WINHTTP_QUERY_CONTENT_LENGTH
-                , WINHTTP_HEADER_NAME_BY_INDEX
-                , wszContentLength
-                , &dwBufferSize
-                , WINHTTP_NO_HEADER_INDEX))
+        public:
+            const CharType *GetData() const { return m_data; }
+            size_t GetLength() const { return m_length; }
+
+            //! the first one of the name, NULL when not found
+            const CharType *Find(const CharType *name, size_t& lineLength, const CharType *&value, size_t& valueLength) const
             {
-                DWORD dwError = ::GetLastError();
-                if (ERROR_HTTP_HEADER_NOT_FOUND != dwError)
+                size_t nameLength = _LengthOf(name);
+                uint32_t hash = HashHeaderName(name, nameLength);
+
+                HeaderName::Value known = FindHeaderName(name, nameLength, hash);
+                if (HeaderName::Unknown != known)
+                    return Find(known, lineLength, value, valueLength);
+
+                typename Entries::const_iterator it = m_entries.begin();
+                for (; it != m_entries.end(); ++it)
                 {
-                    OnClose(ConvertLastError(dwError));
-                    return;
+                    if (it->hash != hash || it->nameLength != nameLength)
+                        continue;
+
+                    const CharType *line = m_data + it->lineOffset;
+                    if (!EqualsIgnoreCase(line, name, nameLength))
+                        continue;
+
+                    lineLength = it->lineLength;
+                    value = m_data + it->valueOffset;
+                    valueLength = it->valueLength;
+
+                    return line;
                 }
-            }
 
-            //Update the output parameter
-            int64_t contentLength = _wtoi64(wszContentLength);
+                return NULL;
+            }
 
-            //!	query all
+            const CharType *Find(HeaderName::Value name, size_t& lineLength, const CharType *&value, size_t& valueLength) const
             {
-                DWORD dwSize = 0;
-                WinHttpQueryHeaders(m_hRequest
-                    , WINHTTP_QUERY_RAW_HEADERS
-                    , WINHTTP_HEADER_NAME_BY_INDEX
-                    , NULL, &dwSize, WINHTTP_NO_HEADER_INDEX);
-
-                // Allocate memory for the buffer.
-                if (GetLastError() == ERROR_INSUFFICIENT_BUFFER)
-                {
-                    WCHAR *lpOutBuffer = new WCHAR[dwSize / sizeof(WCHAR)];
+                if (HeaderName::Unknown <= name || NotFound == m_known[name])
+                    return NULL;
 
-                    // Now, use WinHttpQueryHeaders to retrieve the header.
-                    if (!WinHttpQueryHeaders(m_hRequest
-                        , WINHTTP_QUERY_RAW_HEADERS
-                        , WINHTTP_HEADER_NAME_BY_INDEX
-                        , lpOutBuffer, &dwSize, WINHTTP_NO_HEADER_INDEX))
-                    {
-                        delete[] lpOutBuffer;
+                const Entry& entry = m_entries[m_known[name]];
+                lineLength = entry.lineLength;
+                value = m_data + entry.valueOffset;
+                valueLength = entry.valueLength;
 
-                        OnClose(ConvertLastError(::GetLastError()));
-                        return;
-                    }
+                return m_data + entry.lineOffset;
+            }
+
+        private:
+            void Index()
+            {
+                if (NULL == m_data)
+                    return;
 
-                    HttpResponseHeaders headers(lpOutBuffer, static_cast<StatusCode::Value>(statusCode), contentLength);
-                    m_headers = headers;
+                //! the status line comes first
+                const CharType *line = m_data;
+                line += _LengthOf(line) + 1;
 
-                    //! check if redirect
-                    if (m_headers.GetStatusCode() == StatusCode::Moved_Permanently ||
-                        m_headers.GetStatusCode() == StatusCode::Found ||
-                        m_headers.GetStatusCode() == StatusCode::See_Other ||
-                        m_headers.GetStatusCode() == StatusCode::Use_Proxy ||
-                        m_headers.GetStatusCode() == StatusCode::Temporary_Redirect)
-                    {
-                        const String& redirectURL = m_headers.GetHead(L"Location");
-                        m_redirectDelegate->SetLocation(redirectURL);
-                        m_completionAsyncHandler = m_redirectDelegate;
-                    }
+                while ('\0' != *line)
+                {
+                    size_t lineLength = _LengthOf(line);
 
-                    try
-                    {
-                        m_completionAsyncHandler->OnHeaderAvailable(m_headers);
-                    }
-                    catch (const Exception& ex)
+                    const CharType *colon = _Find(line, static_cast<CharType>(':'), lineLength);
+                    if (NULL != colon && colon != line)
                     {
-                        OnClose(ex.Clone());
-                        return;
+                        const CharType *value = colon + 1;
+                        const CharType *valueEnd = line + lineLength;
+
+                        while (value < valueEnd && (' ' == *value || '\t' == *value))
+                            ++value;
+                        while (value < valueEnd && (' ' == *(valueEnd - 1) || '\t' == *(valueEnd - 1)))
+                            --valueEnd;
+
+                        Entry entry;
+                        entry.nameLength = static_cast<uint32_t>(colon - line);
+                        entry.hash = HashHeaderName(line, entry.nameLength);
+                        entry.lineOffset = static_cast<uint32_t>(line - m_data);
+                        entry.lineLength = static_cast<uint32_t>(lineLength);
+                        entry.valueOffset = static_cast<uint32_t>(value - m_data);
+                        entry.valueLength = static_cast<uint32_t>(valueEnd - value);
+
+                        HeaderName::Value known = FindHeaderName(line, entry.nameLength, entry.hash);
+                        if (HeaderName::Unknown != known && NotFound == m_known[known])
+                            m_known[known] = static_cast<uint32_t>(m_entries.size());
+
+                        m_entries.push_back(entry);
                     }
 
-                    //! update body
-                    m_bufferStream.m_contentLength = contentLength;
-
-                    OnReadingData();
+                    line += lineLength + 1;
                 }
+
+                m_length = line + 1 - m_data;
             }
-        }
 
-        void AbstractHttpHandler::OnClose(Exception *exception)
-        {
-            //! send results
-            if (NULL != exception)
+            //! names are ASCII tokens
+            static uint32_t ToLower(CharType c)
             {
-                m_completionAsyncHandler->OnError(exception);
+                uint32_t u = static_cast<uint32_t>(c);
+                return 'A' <= u && u <= 'Z' ? u - 'A' + 'a' : u;
             }
-            else
+
+            static bool EqualsIgnoreCase(const CharType *l, const CharType *r, size_t length)
             {
-                //! check if redirect
-                if (m_completionAsyncHandler == m_redirectDelegate && m_redirectDelegate->PerformRedirecting())
-                {
-                    //!
-                    m_sessionImpl->SendRedirect(m_request, m_normalAsyncHandler, m_redirectDelegate, m_headers);
-                }
-                else
+                for (size_t i = 0; i != length; ++i)
                 {
-                    m_completionAsyncHandler->OnCompleted();
+                    if (ToLower(l[i]) != ToLower(r[i]))
+                        return false;
                 }
-                //! clean response and headers
-                //! TO-DO
+
+                return true;
             }
 
-            //! clean the scoped variables
-            m_request = NULL;
-            m_completionAsyncHandler = NULL;
+        private:
+            HeaderBlock(const HeaderBlock&);
+            HeaderBlock& operator = (const HeaderBlock&);
+        };
+    }
+
+    //
+    //  kept as received, UTF 8 from the native session, wide from WinHttp
+    //      the other form is converted on first use and kept along
+    //
+    class HttpResponseHeaders::RawHeaders
+    {
+    private:
+        typedef Details::HeaderBlock<char> ByteBlock;
+        typedef Details::HeaderBlock<wchar_t> WideBlock;
+
+    public:
+        AtomicRef m_ref;
 
-            //! close
-            HINTERNET hReq = m_hRequest;
-            m_hRequest = NULL;
+    private:
+        //! the received one is never changed, accessed without the lock
+        const bool m_isWide;
+        //! the converted one is built lazily under the lock
+        mutable ByteBlock *m_bytes;
+        mutable WideBlock *m_wide;
+        mutable CriticalSection m_lock;
 
-            ::WinHttpCloseHandle(hReq);
+    public:
+        explicit RawHeaders(const char *data)
+            : m_ref()
+            , m_isWide(false)
+            , m_bytes(new ByteBlock(data))
+            , m_wide(NULL)
+            , m_lock()
+        {
         }
 
-        void AbstractHttpHandler::OnTerminated()
+        explicit RawHeaders(const wchar_t *data)
+            : m_ref()
+            , m_isWide(true)
+            , m_bytes(NULL)
+            , m_wide(new WideBlock(data))
+            , m_lock()
         {
-            m_completionAsyncHandler->OnError(new ConnectionTerminatedException);
+        }
 
-            //! clean the scoped variables
-            m_request = NULL;
-            m_completionAsyncHandler = NULL;
+        ~RawHeaders()
+        {
+            delete m_bytes;
+            delete m_wide;
         }
 
-        class SyncHttpHandler : public AbstractHttpHandler
+    public:
+        const ByteBlock *GetBytes() const
         {
-        public:
-            SyncHttpHandler(HINTERNET hReq, const HttpRequest *req, AsyncCompletionGenericDelegate *delegate, HttpSession::Private*session)
-                : AbstractHttpHandler(hReq, req, delegate, session)
-            {}
+            if (!m_isWide)
+                return m_bytes;
 
-            virtual ~SyncHttpHandler()
-            {}
-
-        public:
-            virtual void OnSendingRequest()
+            AutoLock<CriticalSection> locker(&m_lock);
+            if (NULL == m_bytes && NULL == m_wide->GetData())
             {
-                const String& header = m_request->GetHeadersString();
-
-                //! #
-                DWORD dwTotal = m_request->GetRequestBodyStream() == NULL ? 0 : static_cast<DWORD>(m_request->GetRequestBodyStream()->GetTotal());
-
-                if (!WinHttpSendRequest(m_hRequest,
-                    header.empty() ? WINHTTP_NO_ADDITIONAL_HEADERS : header.c_str(), -1,
-                    WINHTTP_NO_REQUEST_DATA, 0,
-                    dwTotal, NULL))// context
-                {
-                    OnClose(ConvertLastError(::GetLastError()));
-                    return;
-                }
-
-                OnRequestSent();
-
-                //! completion has been cleaned
-                if (m_completionAsyncHandler)
-                {
-                    OnReadHeader();
-                }
-
-                //! delete itself
-                OnFinished();
+                m_bytes = new ByteBlock(NULL);
             }
-
-        protected:
-            virtual void OnReadingData()
+            else if (NULL == m_bytes)
             {
-                if (m_bufferStream.m_buffer == NULL)
-                    m_bufferStream.Allocate();
-
-                DWORD dwAvailCount = 0;
-                if (!WinHttpQueryDataAvailable(m_hRequest, &dwAvailCount))
-                {
-                    OnClose(ConvertLastError(::GetLastError()));
-                    return;
-                }
+                std::string bytes;
+                StringConvertor::FromString(m_wide->GetData(), m_wide->GetLength(), bytes);
 
-                DWORD dwRead = 0;
-                if (!::WinHttpReadData(m_hRequest, m_bufferStream.m_buffer, min(dwAvailCount, m_bufferStream.BufferLength()), &dwRead))
-                {
-                    OnClose(ConvertLastError(::GetLastError()));
-                    return;
-                }
+                char *data = new char[bytes.size()];
+                std::memcpy(data, bytes.data(), bytes.size());
 
-                OnReadData(dwRead);
+                m_bytes = new ByteBlock(data);
             }
-        };
 
-        class AsyncHttpHandler : public AbstractHttpHandler
-        {
-        private:
-            REF m_isClosed;
-
-        public:
-            AsyncHttpHandler(HINTERNET hReq, const HttpRequest *req, AsyncCompletionGenericDelegate *delegate, HttpSession::Private*session)
-                : AbstractHttpHandler(hReq, req, delegate, session)
-                , m_isClosed(0)
-            {}
-
-            AsyncHttpHandler(HINTERNET hReq, const HttpRequest *req, AsyncCompletionGenericDelegate *delegate, RedirectCompletionGenericDelegate *redirectDelegate, HttpSession::Private*session)
-                : AbstractHttpHandler(hReq, req, delegate, redirectDelegate, session)
-                , m_isClosed(0)
-            {}
-
-        public:
-            virtual void OnSendingRequest()
-            {
-                const String& header = m_request->GetHeadersString();
-
-                WINHTTP_STATUS_CALLBACK installed = WinHttpSetStatusCallback(m_hRequest, _Callback, WINHTTP_CALLBACK_FLAG_ALL_NOTIFICATIONS, 0);
-                DWORD dwError = ::GetLastError();
-                if (dwError != ERROR_SUCCESS)
-                {
-                    OnClose(ConvertLastError(dwError));
-                    return;
-                }
-
-                //! #
-                DWORD dwTotal = m_request->GetRequestBodyStream() == NULL ? 0 : static_cast<DWORD>(m_request->GetRequestBodyStream()->GetTotal());
+            return m_bytes;
+        }
 
-                if (!WinHttpSendRequest(m_hRequest,
-                    header.empty() ? WINHTTP_NO_ADDITIONAL_HEADERS : header.c_str(), -1,
-                    WINHTTP_NO_REQUEST_DATA, 0,
-                    dwTotal, (UINT_PTR)this))// context
-                {
-                    OnClose(ConvertLastError(::GetLastError()));
-                    return;
-                }
-            }
+        const WideBlock *GetWide() const
+        {
+            if (m_isWide)
+                return m_wide;
 
-            virtual void Terminate()
+            AutoLock<CriticalSection> locker(&m_lock);
+            if (NULL == m_wide && NULL == m_bytes->GetData())
             {
-                //! if has set(value equals 1)
-                if (CompareExchange(&m_isClosed, 1, 0) == 1)
-                    return;
-
-                __super::Terminate();
+                m_wide = new WideBlock(NULL);
             }
-
-        protected:
-            void OnClose(Exception *exception)
+            else if (NULL == m_wide)
             {
-                //! if has set(value equals 1)
-                if (CompareExchange(&m_isClosed, 1, 0) == 1)
-                {
-                    //! free the exception
-                    delete exception;
-                    return;
-                }
+                std::wstring wide;
+                StringConvertor::ToString(m_bytes->GetData(), m_bytes->GetLength(), wide);
 
-                __super::OnClose(exception);
-            }
+                wchar_t *data = new wchar_t[wide.size()];
+                std::wmemcpy(data, wide.data(), wide.size());
 
-            virtual void OnReadingData()
-            {
-                if (m_bufferStream.m_buffer == NULL)
-                    m_bufferStream.Allocate();
-
-                if (!::WinHttpReadData(m_hRequest, m_bufferStream.m_buffer, m_bufferStream.BufferLength(), 0))
-                {
-                    OnClose(ConvertLastError(::GetLastError()));
-                }
+                m_wide = new WideBlock(data);
             }
-        };
-
-    }
-}
 
-namespace Net
-{
-    class HttpResponseHeaders::RawHeaders
-    {
-    public:
-        AtomicRef m_ref;
-        const wchar_t *m_rawHeadersData;
-
-    public:
-        RawHeaders(const wchar_t *data)
-            : m_ref()
-            , m_rawHeadersData(data)
-        {
-        }
-
-        ~RawHeaders()
-        {
-            if (m_rawHeadersData)
-                delete[] m_rawHeadersData;
+            return m_wide;
         }
     };
 
@@ -1171,6 +845,14 @@ namespace Net
         m_rawHeaders = new RawHeaders(rawHeader);
     }
 
+    HttpResponseHeaders::HttpResponseHeaders(const char *rawHeader, const StatusCode& statusCode, const int64_t& contentLength)
+        : m_statusCode(statusCode)
+        , m_rawHeaders(NULL)
+        , m_contentLength(contentLength)
+    {
+        m_rawHeaders = new RawHeaders(rawHeader);
+    }
+
     HttpResponseHeaders::HttpResponseHeaders(const HttpResponseHeaders& r)
         : m_statusCode(r.m_statusCode)
         , m_rawHeaders(r.m_rawHeaders)
@@ -1191,346 +873,357 @@ namespace Net
     {
     }
 
-    const wchar_t *HttpResponseHeaders::Get(const wchar_t *name, size_t& out_len) const
+    const wchar_t *HttpResponseHeaders::Get(const wchar_t *name, size_t& len) const
     {
-        const wchar_t *current = m_rawHeaders->m_rawHeadersData;
+        if (!m_rawHeaders)
+            return NULL;
 
-        if (NULL != current)
-        {
-            while (true)
-            {
-                size_t len = std::wcslen(current);
+        const wchar_t *value = NULL;
+        size_t valueLength = 0;
 
-                const wchar_t *found = std::wcsstr(current, name);
+        return m_rawHeaders->GetWide()->Find(name, len, value, valueLength);
+    }
 
-                //! found
-                if (found == current)
-                {
-                    out_len = len;
-                    break;
-                }
+    const wchar_t *HttpResponseHeaders::GetValue(const wchar_t *name, size_t& len) const
+    {
+        if (!m_rawHeaders)
+            return NULL;
 
-                current += (len + 1);
-                if (L'\0' == *current)
-                {
-                    current = NULL;
-                    break;
-                }
-            }
-        }
+        const wchar_t *value = NULL;
+        size_t lineLength = 0;
 
-        return current;
+        if (NULL == m_rawHeaders->GetWide()->Find(name, lineLength, value, len))
+            return NULL;
+
+        return value;
     }
 
-    String  HttpResponseHeaders::GetHead(const wchar_t *headName) const
+    String HttpResponseHeaders::GetHead(const wchar_t *headName) const
     {
-        size_t entryLength = 0;
-        const wchar_t *headEntry = Get(headName, entryLength);
-
-        if (NULL != headEntry && 0 != entryLength)
-        {
-            String::size_type offset = std::wcslen(headName);
-            const wchar_t *colon = std::wcsstr(headEntry + offset, L":"); // find separator colon
-
-            if (NULL != colon)
-            {
-                const wchar_t *substart = colon + 1;
-                const wchar_t *eol = headEntry + entryLength;
+        size_t valueLength = 0;
+        const wchar_t *value = GetValue(headName, valueLength);
 
-                // trim start
-                while (substart < eol && (*substart) == ' ')
-                    ++substart;
+        return NULL == value ? String() : String(value, valueLength);
+    }
 
-                // trim end
-                while (substart < eol && *(eol - 1) == ' ')
-                    --eol;
+    const char *HttpResponseHeaders::Get(const char *name, size_t& len) const
+    {
+        if (!m_rawHeaders)
+            return NULL;
 
-                return String(substart, eol);
-            }
-        }
+        const char *value = NULL;
+        size_t valueLength = 0;
 
-        return String();
+        return m_rawHeaders->GetBytes()->Find(name, len, value, valueLength);
     }
 
-    String RequestHeadersBuilder::ToString() const
+    const char *HttpResponseHeaders::GetValue(const char *name, size_t& len) const
     {
-        if (m_headers.empty())
-            return String();
+        if (!m_rawHeaders)
+            return NULL;
 
-        std::wstringstream ss;
+        const char *value = NULL;
+        size_t lineLength = 0;
 
-        Headers::const_iterator it = m_headers.begin();
-        for (; it != m_headers.end(); ++it)
-        {
-            ss << it->first << L": " << it->second << L"\r\n";
-        }
+        if (NULL == m_rawHeaders->GetBytes()->Find(name, lineLength, value, len))
+            return NULL;
 
-        ss << L"\r\n";
-        return ss.str();
+        return value;
     }
 
-    RequestHeadersBuilder& RequestHeadersBuilder::operator << (const Headers::value_type& eachHeader)
+    std::string HttpResponseHeaders::GetHead(const char *headName) const
     {
-        m_headers.insert(eachHeader);
-        return *this;
+        size_t valueLength = 0;
+        const char *value = GetValue(headName, valueLength);
+
+        return NULL == value ? std::string() : std::string(value, valueLength);
     }
 
-    HINTERNET HttpSession::Private::AcquireRequest(const URL& url, const HttpVerb& verb)
+    const char *HttpResponseHeaders::GetValue(HeaderName::Value name, size_t& len) const
     {
-        URL_COMPONENTS urlComp;
+        if (!m_rawHeaders)
+            return NULL;
 
-        ZeroMemory(&urlComp, sizeof(urlComp));
-        urlComp.dwStructSize = sizeof(urlComp);
+        const char *value = NULL;
+        size_t lineLength = 0;
 
-        urlComp.dwSchemeLength = (DWORD)-1;
-        urlComp.dwHostNameLength = (DWORD)-1;
-        urlComp.dwUrlPathLength = (DWORD)-1;
-        urlComp.dwExtraInfoLength = (DWORD)-1;
+        if (NULL == m_rawHeaders->GetBytes()->Find(name, lineLength, value, len))
+            return NULL;
+
+        return value;
+    }
+
+    std::string HttpResponseHeaders::GetHead(HeaderName::Value name) const
+    {
+        size_t valueLength = 0;
+        const char *value = GetValue(name, valueLength);
 
-        // Crack the URL.
-        if (!WinHttpCrackUrl(url.c_str(), url.size(), 0, &urlComp))
+        return NULL == value ? std::string() : std::string(value, valueLength);
+    }
+
+    String RequestHeadersBuilder::ToString() const
+    {
+        String headers;
+        if (!m_lines.empty())
         {
-            throw InvalidURLFormatException();
+            StringConvertor::ToString(m_lines, headers);
+            headers.append(L"\r\n");
         }
 
-        String host(urlComp.lpszHostName, urlComp.dwHostNameLength);
-        String path(urlComp.lpszUrlPath, urlComp.dwUrlPathLength);
-        if (NULL != urlComp.lpszExtraInfo)
-            path.append(String(urlComp.lpszExtraInfo, urlComp.dwExtraInfoLength));
+        return headers;
+    }
+
+    std::string RequestHeadersBuilder::ToBytes() const
+    {
+        if (m_lines.empty())
+            return std::string();
 
-        HttpSecurityOptions opts;
-        opts.isHttps = urlComp.nScheme == INTERNET_SCHEME_HTTPS;
+        std::string headers;
+        headers.reserve(m_lines.size() + 2);
+        headers.append(m_lines).append("\r\n");
 
-        return OpenRequest(AcquireConnection(host, urlComp.nPort), path, verb, opts);
+        return headers;
     }
 
-    HINTERNET HttpSession::Private::AcquireConnection(const String& host, uint16_t port)
+    RequestHeadersBuilder& RequestHeadersBuilder::Add(const char *name, size_t nameLength, const char *value, size_t valueLength)
     {
-        if (!m_hSession)
-        {
-            m_hSession = ::WinHttpOpen(L"HTTP/1.1"
-                , WINHTTP_ACCESS_TYPE_DEFAULT_PROXY
-                , WINHTTP_NO_PROXY_NAME
-                , WINHTTP_NO_PROXY_BYPASS
-                , m_config.IsAsync ? WINHTTP_FLAG_ASYNC : NULL);  //! async
-
-            //! config
-            WinHttpSetTimeouts(m_hSession, 3000, 3000, 10000, 10000);
+        m_lines.append(name, nameLength).append(": ", 2).append(value, valueLength).append("\r\n", 2);
 
-            if (!m_config.IsAutoRedirectEnabled)
-            {
-                DWORD redirectFeature = WINHTTP_OPTION_REDIRECT_POLICY_NEVER;
-                WinHttpSetOption(m_hSession, WINHTTP_OPTION_REDIRECT_POLICY, &redirectFeature, sizeof(redirectFeature));
-            }
-        }
+        return *this;
+    }
 
-        Details::HostConnections::iterator found = m_connections.find(host);
+    RequestHeadersBuilder& RequestHeadersBuilder::Add(HeaderName::Value name, const std::string& value)
+    {
+        return Add(HeaderName::GetName(name), HeaderName::GetLength(name), value.data(), value.size());
+    }
 
-        HINTERNET connection = NULL;
-        //! no such connection
-        if (found == m_connections.end())
-        {
-            connection = WinHttpConnect(m_hSession, host.c_str(), port, 0);
-            if (!connection)
-            {
-                throw ConnectionFailedException();
-            }
-        }
-        else
-        {
-            connection = found->second;
-        }
+    RequestHeadersBuilder& RequestHeadersBuilder::operator << (const Headers::value_type& eachHeader)
+    {
+        std::string line;
+        StringConvertor::FromString(eachHeader.first, line);
+        line.append(": ");
+        StringConvertor::FromString(eachHeader.second, line);
+        line.append("\r\n");
 
-        return connection;
+        m_lines.append(line);
+        return *this;
     }
 
-    HINTERNET HttpSession::Private::OpenRequest(HINTERNET hConnection, const String& path, HttpVerb verb, const HttpSecurityOptions& securityOpts)
+    QueryBuilder& QueryBuilder::Add(const char *key, size_t keyLength, const char *value, size_t valueLength)
     {
-        static const LPWSTR VerbMapper[] = { L"GET", L"POST", L"DELETE", L"PUT" };
+        size_t encodedKeyLength = StringConvertor::GetPercentEncodedLength(key, keyLength);
+        size_t encodedValueLength = StringConvertor::GetPercentEncodedLength(value, valueLength);
 
-        HINTERNET hRequest = WinHttpOpenRequest(hConnection, VerbMapper[verb], path.c_str(),
-            NULL,
-            WINHTTP_NO_REFERER,
-            WINHTTP_DEFAULT_ACCEPT_TYPES,
-            securityOpts.isHttps ? WINHTTP_FLAG_SECURE : 0);
+        size_t pairLength = 1 + encodedKeyLength + 1 + encodedValueLength;
+        if (m_url.size() == m_queryEnd)
+            m_url.resize(m_queryEnd + pairLength);
+        else
+            m_url.insert(m_queryEnd, pairLength, '\0');
 
-        if (securityOpts.isHttps)
-        {
-            DWORD options = SECURITY_FLAG_IGNORE_CERT_CN_INVALID
-                | SECURITY_FLAG_IGNORE_CERT_DATE_INVALID
-                | SECURITY_FLAG_IGNORE_UNKNOWN_CA;
-            ::WinHttpSetOption(hRequest,
-                WINHTTP_OPTION_SECURITY_FLAGS,
-                (LPVOID)&options,
-                sizeof(DWORD));
-        }
+        char *pair = &m_url[m_queryEnd];
+        *pair++ = m_hasQuery ? '&' : '?';
+        pair += StringConvertor::ToPercentEncoding(key, keyLength, pair);
+        *pair++ = '=';
+        StringConvertor::ToPercentEncoding(value, valueLength, pair);
 
-        return hRequest;
+        m_queryEnd += pairLength;
+        m_hasQuery = true;
+        return *this;
     }
 
-    void HttpSession::Private::Disconnect()
+    QueryBuilder& QueryBuilder::Add(const String& key, const String& value)
     {
-        if (m_hSession)
-        {
-            OnDisconnect();
+        std::string keyBytes;
+        std::string valueBytes;
+        StringConvertor::FromString(key, keyBytes);
+        StringConvertor::FromString(value, valueBytes);
 
-            Details::HostConnections::iterator it = m_connections.begin();
-            for (; it != m_connections.end(); ++it)
-            {
-                ::WinHttpCloseHandle(it->second);
-            }
-
-            //
-            ::WinHttpCloseHandle(m_hSession);
-            m_hSession = NULL;
-        }
+        return Add(keyBytes, valueBytes);
     }
 
-    //
-    //  ###
-    //  DANGER
-    //  When operation is sync, Terminate will trigger handler erasing
-    //
-    void HttpSession::Private::OnDisconnect()
+    PreparedRequest::PreparedRequest()
+        : m_d(NULL)
+    {}
+
+    PreparedRequest::PreparedRequest(const std::string& url, const HttpVerb& verb)
+        : m_d(NULL)
     {
-        //! under the condition the type of handlers is linked list
-        Details::HttpHandlers::iterator it = m_handlers.begin();
+        Prepare(url, verb, std::string());
+    }
 
-        while (m_handlers.end() != it)
-        {
-            Details::HttpHandlers::iterator cur = it++;
-            (*cur)->Terminate();
-        }
+    PreparedRequest::PreparedRequest(const std::string& url, const HttpVerb& verb, const RequestHeadersBuilder& headers)
+        : m_d(NULL)
+    {
+        Prepare(url, verb, headers.m_lines);
     }
 
-    void HttpSession::Private::OnHandleFinished(Details::AbstractHttpHandler *handler)
+    PreparedRequest::PreparedRequest(const PreparedRequest& r)
+        : m_d(r.m_d)
+    {}
+
+    PreparedRequest::~PreparedRequest()
+    {}
+
+    PreparedRequest& PreparedRequest::operator = (const PreparedRequest& t)
     {
-        Details::HttpHandlers::iterator found = std::find(m_handlers.begin(), m_handlers.end(), handler);
-        if (found != m_handlers.end())
-            m_handlers.erase(found);
+        m_d = t.m_d;
+        return *this;
     }
 
-    //! send request
-    void HttpSession::Private::SendRequest(HINTERNET hReq, const HttpRequest *req, AsyncCompletionGenericDelegate *delegate)
+    void PreparedRequest::Prepare(const std::string& url, HttpVerb verb, const std::string& headers)
     {
-        if (m_config.IsAsync)
-        {
-            // non-lock async http session is forbidden
-            throw std::logic_error("non-lock async http session is forbidden");
-        }
+        Details::UrlParts parts;
+        if (!Details::ParseUrl(url.c_str(), url.size(), parts))
+            throw InvalidURLFormatException();
+
+        PrivateData *d = new PrivateData;
+        m_d = d;
 
-        Details::AbstractHttpHandler *handler = new Details::SyncHttpHandler(hReq, req, delegate, this);
-        m_handlers.push_back(handler);
+        d->verb = verb;
+        d->url.assign(url, 0, parts.path.offset + parts.path.length);
+        d->parts = parts;
+        d->parts.fragment.offset = static_cast<uint32_t>(d->url.size());
+        d->parts.fragment.length = 0;
+        d->prefix = Details::CreateUrlPrefix(d->url.c_str(), parts);
 
-        handler->OnSendingRequest();
+        //! origin-form, "/" when the path is empty
+        d->requestLine.append(Details::VerbMapper[verb]).append(" ");
+        if (0 == parts.path.length || '/' != d->url[parts.path.offset])
+            d->requestLine.append("/");
+        d->requestLine.append(d->url, parts.path.offset, parts.path.length).append(" HTTP/1.1\r\n");
+
+        d->headers = headers;
+
+        d->headLines.reserve(8 + d->prefix->authority.size() + Details::AppendRequestHeaderLines(headers.data(), headers.size(), NULL));
+        d->headLines.append("Host: ").append(d->prefix->authority).append("\r\n");
+        Details::AppendRequestHeaderLines(headers.data(), headers.size(), &d->headLines);
     }
 
-    void HttpSession::Private::SendRedirect(const HttpRequest *req,
-        AsyncCompletionGenericDelegate *delegate,
-        RedirectCompletionGenericDelegate *redirectDelegate,
-        const HttpResponseHeaders& headers)
+    HttpVerb PreparedRequest::GetVerb() const
     {
-        const String& location = headers.GetHead(L"Location");
+        return m_d->verb;
+    }
 
-        bool reissuingRequest = headers.GetStatusCode() == StatusCode::See_Other;
+    const std::string& PreparedRequest::GetURLBytes() const
+    {
+        return m_d->url;
+    }
 
-        HINTERNET hReq = NULL;
-        try
-        {
-            hReq = AcquireRequest(location, reissuingRequest ? HttpVerb::Get : req->GetVerb());
-            if (NULL == hReq)
-            {
-                throw ConnectionFailedException();
-            }
-        }
-        catch (const Exception& ex)
-        {
-            delegate->OnError(ex.Clone());
-            return;
-        }
+    const std::string& PreparedRequest::GetHeadersBytes() const
+    {
+        return m_d->headers;
+    }
 
-        //! the redirect request will remain valid till the end
-        //! however, the url and verb still be the first time's
-        SendRequest(hReq, req, delegate);
+    HttpRequest::HttpRequest(const URL& url, const HttpVerb& verb)
+        : m_verb(verb)
+        , m_url()
+        , m_headers()
+        , m_requestBodyStream(NULL)
+        , m_prepared()
+    {
+        StringConvertor::FromString(url, m_url);
     }
 
-    LockHttpSessionPrivate::LockHttpSessionPrivate()
-        : HttpSession::Private()
-        , m_lock()
-        , m_disconnectedEvent(true)    //! signaled
+    HttpRequest::HttpRequest(const URL& url, const HttpVerb& verb, const String& headersString, InputStream *bodyStream)
+        : m_verb(verb)
+        , m_url()
+        , m_headers()
+        , m_requestBodyStream(bodyStream)
+        , m_prepared()
     {
-        }
+        StringConvertor::FromString(url, m_url);
+        StringConvertor::FromString(headersString, m_headers);
+    }
 
-    LockHttpSessionPrivate::LockHttpSessionPrivate(const HttpSessionConfig& config)
-        : HttpSession::Private(config)
-        , m_lock()
-        , m_disconnectedEvent(true)    //! signaled
+    HttpRequest::HttpRequest(const std::string& url, const HttpVerb& verb)
+        : m_verb(verb)
+        , m_url(url)
+        , m_headers()
+        , m_requestBodyStream(NULL)
+        , m_prepared()
     {
-        }
+    }
 
-    void LockHttpSessionPrivate::SendRequest(HINTERNET hReq, const HttpRequest *req, AsyncCompletionGenericDelegate *delegate)
+    HttpRequest::HttpRequest(const std::string& url, const HttpVerb& verb, const std::string& headers, InputStream *bodyStream)
+        : m_verb(verb)
+        , m_url(url)
+        , m_headers(headers)
+        , m_requestBodyStream(bodyStream)
+        , m_prepared()
     {
-        Details::AbstractHttpHandler *handler = NULL;
-        if (m_config.IsAsync)
-            handler = new Details::AsyncHttpHandler(hReq, req, delegate, this);
-        else
-            handler = new Details::SyncHttpHandler(hReq, req, delegate, this);
+    }
 
-        {
-            AutoLock<CriticalSection> locker(&m_lock);
-            m_handlers.push_back(handler);
-        }
+    HttpRequest::HttpRequest(const std::string& url, const HttpVerb& verb, const RequestHeadersBuilder& headers, InputStream *bodyStream)
+        : m_verb(verb)
+        , m_url(url)
+        , m_headers(headers.m_lines)
+        , m_requestBodyStream(bodyStream)
+        , m_prepared()
+    {
+    }
 
-        handler->OnSendingRequest();
+    HttpRequest::HttpRequest(const PreparedRequest& prepared, const std::string& path, const std::string& headers, InputStream *bodyStream)
+        : m_verb(prepared.GetVerb())
+        , m_url()
+        , m_headers(headers)
+        , m_requestBodyStream(bodyStream)
+        , m_prepared(prepared)
+    {
+        Patch(path);
     }
 
-    void LockHttpSessionPrivate::OnDisconnect()
+    HttpRequest::HttpRequest(const PreparedRequest& prepared, const std::string& path, const RequestHeadersBuilder& headers, InputStream *bodyStream)
+        : m_verb(prepared.GetVerb())
+        , m_url()
+        , m_headers(headers.m_lines)
+        , m_requestBodyStream(bodyStream)
+        , m_prepared(prepared)
     {
-        //! reset the event
-        m_disconnectedEvent.Reset();
+        Patch(path);
+    }
 
+    void HttpRequest::Patch(const std::string& path)
+    {
+        const PreparedRequest::PrivateData *prepared = m_prepared.GetData();
+        if (path.empty())
         {
-            AutoLock<CriticalSection> locker(&m_lock);
-            __super::OnDisconnect();
-
-            //! no more handlers
-            //! just signal the event
-            if (m_handlers.empty())
-                m_disconnectedEvent.Signal();
+            m_url = prepared->url;
+            return;
         }
 
-        //! wait till finished
-        m_disconnectedEvent.Wait(INFINITE);
+        //! origin-form only, the fragment is dropped
+        Details::UrlParts parts;
+        if ('/' != path[0] || !Details::ParseUrlPath(path.c_str(), path.size(), 0, parts))
+            throw InvalidURLFormatException();
+
+        m_url.reserve(prepared->parts.prefixLength + parts.path.length);
+        m_url.assign(prepared->url, 0, prepared->parts.prefixLength).append(path, 0, parts.path.length);
     }
 
-    void LockHttpSessionPrivate::SendRedirect(const HttpRequest *req,
-        AsyncCompletionGenericDelegate *delegate,
-        RedirectCompletionGenericDelegate *redirectDelegate,
-        const HttpResponseHeaders& headers)
+    URL HttpRequest::GetURL() const
     {
-        //! terminating 
-        if (!m_disconnectedEvent.IsSignaled())
-            return;
+        URL url;
+        StringConvertor::ToString(m_url, url);
 
-        AutoLock<CriticalSection> locker(&m_lock);
-        __super::SendRedirect(req, delegate, redirectDelegate, headers);
+        return url;
     }
 
-    void LockHttpSessionPrivate::OnHandleFinished(Details::AbstractHttpHandler *handler)
+    String HttpRequest::GetHeadersString() const
     {
-        AutoLock<CriticalSection> locker(&m_lock);
-        __super::OnHandleFinished(handler);
+        String headers;
+        if (!m_prepared.IsNull())
+            StringConvertor::ToString(m_prepared.GetHeadersBytes(), headers);
+        StringConvertor::ToString(m_headers, headers);
 
-        if (m_handlers.empty())
-            m_disconnectedEvent.Signal();
+        return headers;
     }
 
     HttpSession::HttpSession()
-        : m_sessionImpl(new LockHttpSessionPrivate)
+        : m_sessionImpl(Details::CreateSessionPrivate(HttpSessionConfig()))
     {}
 
     HttpSession::HttpSession(const HttpSessionConfig& config)
-        : m_sessionImpl(config.IsAsync ? new LockHttpSessionPrivate(config) : new HttpSession::Private(config))
+        : m_sessionImpl(Details::CreateSessionPrivate(config))
     {}
 
     HttpSession::~HttpSession()
@@ -1548,19 +1241,144 @@ namespace Net
 
     void HttpSession::SendRequest(const HttpRequest *req, AsyncCompletionGenericDelegate *delegate)
     {
-        HINTERNET hReq = m_sessionImpl->AcquireRequest(req->GetURL(), req->GetVerb());
+        m_sessionImpl->SendRequest(req, delegate);
+    }
+
+    static HttpSessionConfig _ConfigOf(const HttpSessionConfig& config, bool isAsync)
+    {
+        HttpSessionConfig each(config);
+        each.IsAsync = isAsync;
+
+        return each;
+    }
+
+    //! the session is published complete to the threads skipping the lock
+    static inline HttpSession *_LoadAcquire(HttpSession *volatile *src)
+    {
+#if defined(_WIN32)
+        return *src;
+#else
+        return __atomic_load_n(src, __ATOMIC_ACQUIRE);
+#endif
+    }
+
+    static inline void _StoreRelease(HttpSession *volatile *dest, HttpSession *value)
+    {
+#if defined(_WIN32)
+        *dest = value;
+#else
+        __atomic_store_n(dest, value, __ATOMIC_RELEASE);
+#endif
+    }
+
+    SharedHttpSession::SharedHttpSession(const HttpSessionConfig& config)
+        : m_ref()
+        , m_config(config)
+        , m_lock()
+        , m_session(NULL)
+    {}
+
+    SharedHttpSession::~SharedHttpSession()
+    {
+        if (NULL != m_session)
+            delete m_session;
+    }
+
+    HttpSession& SharedHttpSession::GetSession()
+    {
+        HttpSession *session = _LoadAcquire(&m_session);
+        if (NULL != session)
+            return *session;
+
+        AutoLock<CriticalSection> locker(&m_lock);
+
+        session = m_session;
+        if (NULL == session)
+        {
+            session = new HttpSession(m_config);
+            _StoreRelease(&m_session, session);
+        }
+
+        return *session;
+    }
+
+    static size_t _CoreCount()
+    {
+#if defined(_WIN32)
+        SYSTEM_INFO info;
+        ::GetSystemInfo(&info);
+        return info.dwNumberOfProcessors > 0 ? static_cast<size_t>(info.dwNumberOfProcessors) : 1;
+#else
+        long count = ::sysconf(_SC_NPROCESSORS_ONLN);
+        return count > 0 ? static_cast<size_t>(count) : 1;
+#endif
+    }
 
-        if (NULL == hReq)
+    SyncHttpSessions::SyncHttpSessions(const HttpSessionConfig& config)
+        : m_ref()
+        , m_config(_ConfigOf(config, false))
+        , m_lock()
+        , m_idle()
+        , m_maxIdleCount(_CoreCount())
+    {
+        m_idle.reserve(m_maxIdleCount);
+    }
+
+    SyncHttpSessions::~SyncHttpSessions()
+    {
+        std::vector<HttpSession *>::iterator it = m_idle.begin();
+        for (; it != m_idle.end(); ++it)
         {
-            throw ConnectionFailedException();
+            delete *it;
+        }
+    }
+
+    HttpSession *SyncHttpSessions::Acquire()
+    {
+        {
+            AutoLock<CriticalSection> locker(&m_lock);
+
+            //! the most recently used one has the connections most likely alive
+            if (!m_idle.empty())
+            {
+                HttpSession *session = m_idle.back();
+                m_idle.pop_back();
+
+                return session;
+            }
         }
 
-        m_sessionImpl->SendRequest(hReq, req, delegate);
+        return new HttpSession(m_config);
     }
 
+    void SyncHttpSessions::Release(HttpSession *session)
+    {
+        {
+            AutoLock<CriticalSection> locker(&m_lock);
+
+            if (m_idle.size() < m_maxIdleCount)
+            {
+                m_idle.push_back(session);
+                return;
+            }
+        }
+
+        //! closes its connections, out of the lock
+        delete session;
+    }
+
+    HttpClient::HttpClient()
+        : m_session(new SharedHttpSession(_ConfigOf(HttpSessionConfig(), true)))
+        , m_syncSessions(new SyncHttpSessions(HttpSessionConfig()))
+    {}
+
+    HttpClient::HttpClient(const HttpSessionConfig& config)
+        : m_session(new SharedHttpSession(_ConfigOf(config, true)))
+        , m_syncSessions(new SyncHttpSessions(config))
+    {}
+
     AsyncHandler<HttpResponse> *HttpClient::AcquireDefaultHandler()
     {
         return new Details::DefaultResponseCompletionHandler();
     }
 }
-
@@ -0,0 +1,73 @@
+#ifndef HTTPSESSIONPRIVATE_H
+#define HTTPSESSIONPRIVATE_H
+
+#include "HttpClient.h"
+#include "UrlParser.h"
+
+namespace Net
+{
+    //
+    //  transport behind HttpSession
+    //      WinHttp on Windows, see WinHttpSession.cpp
+    //      non-blocking sockets driven by epoll on Linux, see NativeHttpSession.cpp
+    //
+    class HttpSession::Private
+    {
+    public:
+        virtual ~Private() {}
+
+    public:
+        //! send request
+        //! ###
+        //! When disconnecting, this method should never be invoked
+        //!
+        virtual void SendRequest(const HttpRequest *req, AsyncCompletionGenericDelegate *delegate) = 0;
+
+        //! terminate all the pending handlers
+        //! will block current thread till all of them finished
+        virtual void Disconnect() = 0;
+    };
+
+    //! immutable once prepared
+    class PreparedRequest::PrivateData
+    {
+    public:
+        AtomicRef m_ref;
+
+        HttpVerb verb;
+        //! without the fragment
+        std::string url;
+        Details::UrlParts parts;
+        RefSharedPointer<Details::UrlPrefix<char> > prefix;
+
+        //! "GET /path HTTP/1.1\r\n"
+        std::string requestLine;
+        //! the fixed ones, each line ends with CRLF
+        std::string headers;
+        //! Host followed by the fixed ones, without the framing ones
+        std::string headLines;
+
+    public:
+        PrivateData()
+            : m_ref()
+            , verb(Get)
+            , url()
+            , parts()
+            , prefix()
+            , requestLine()
+            , headers()
+            , headLines()
+        {}
+    };
+
+    namespace Details
+    {
+        //! method names of HttpVerb
+        static const char *const VerbMapper[] = { "GET", "POST", "DELETE", "PUT" };
+
+        //! implemented by the transport of current platform
+        HttpSession::Private *CreateSessionPrivate(const HttpSessionConfig& config);
+    }
+}
+
+#endif
@@ -0,0 +1,111 @@
+#ifndef INTRUSIVELIST_H
+#define INTRUSIVELIST_H
+
+#include <cstddef>
+
+namespace Net
+{
+    namespace Details
+    {
+        //! embedded in the element by deriving from it, links the element into one list at most
+        class IntrusiveListNode
+        {
+            template<typename T>
+            friend class IntrusiveList;
+
+        private:
+            IntrusiveListNode *m_prev;
+            IntrusiveListNode *m_next;
+
+        public:
+            IntrusiveListNode()
+                : m_prev(NULL)
+                , m_next(NULL)
+            {}
+
+        public:
+            bool IsLinked() const { return NULL != m_next; }
+
+        private:
+            IntrusiveListNode(const IntrusiveListNode&);
+            IntrusiveListNode& operator = (const IntrusiveListNode&);
+        };
+
+        //
+        //  circular doubly linked list with a sentinel, never owns the elements
+        //      pushing and erasing are O(1) without any allocation
+        //      erasing the current element while enumerating is fine once its next one has been taken
+        //
+        template<typename T>
+        class IntrusiveList
+        {
+        private:
+            IntrusiveListNode m_sentinel;
+            std::size_t m_size;
+
+        public:
+            IntrusiveList()
+                : m_sentinel()
+                , m_size(0)
+            {
+                m_sentinel.m_prev = &m_sentinel;
+                m_sentinel.m_next = &m_sentinel;
+            }
+
+        public:
+            bool IsEmpty() const { return 0 == m_size; }
+            std::size_t GetSize() const { return m_size; }
+
+            void PushBack(T *element)
+            {
+                IntrusiveListNode *node = element;
+
+                node->m_prev = m_sentinel.m_prev;
+                node->m_next = &m_sentinel;
+                m_sentinel.m_prev->m_next = node;
+                m_sentinel.m_prev = node;
+
+                ++m_size;
+            }
+
+            //! does nothing if not linked
+            void Erase(T *element)
+            {
+                IntrusiveListNode *node = element;
+                if (!node->IsLinked())
+                    return;
+
+                node->m_prev->m_next = node->m_next;
+                node->m_next->m_prev = node->m_prev;
+                node->m_prev = NULL;
+                node->m_next = NULL;
+
+                --m_size;
+            }
+
+            //! NULL when empty
+            T *GetFirst() const
+            {
+                return ElementOf(m_sentinel.m_next);
+            }
+
+            //! NULL when element is the last one
+            T *GetNext(T *element) const
+            {
+                return ElementOf(static_cast<IntrusiveListNode *>(element)->m_next);
+            }
+
+        private:
+            T *ElementOf(IntrusiveListNode *node) const
+            {
+                return node == &m_sentinel ? NULL : static_cast<T *>(node);
+            }
+
+        private:
+            IntrusiveList(const IntrusiveList&);
+            IntrusiveList& operator = (const IntrusiveList&);
+        };
+    }
+}
+
+#endif
@@ -0,0 +1,123 @@
+#include "IoEngine.h"
+
+#if defined(__linux__)
+
+#include <time.h>
+#include <sched.h>
+#include <unistd.h>
+
+namespace Net
+{
+    namespace Details
+    {
+        uint64_t NowInMilliseconds()
+        {
+            struct timespec now;
+            ::clock_gettime(CLOCK_MONOTONIC, &now);
+
+            return static_cast<uint64_t>(now.tv_sec) * 1000 + now.tv_nsec / 1000000;
+        }
+
+        void ApplySocketOptions(int fd, const SocketOptions& options)
+        {
+            //! the kernel doubles them for its bookkeeping and stops tuning them once set
+            if (0 != options.receiveBufferSize)
+            {
+                int size = static_cast<int>(options.receiveBufferSize);
+                ::setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+            }
+
+            if (0 != options.sendBufferSize)
+            {
+                int size = static_cast<int>(options.sendBufferSize);
+                ::setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+            }
+        }
+
+        static void *_SharedIoEngineProc(void *param)
+        {
+            IoEngine *engine = static_cast<IoEngine *>(param);
+
+            while (true)
+            {
+                engine->RunOnce(INFINITE);
+            }
+
+            return NULL;
+        }
+
+        //! core is ignored when negative
+        static IoEngine *_CreateSharedIoEngine(HttpSessionConfig::IoEngineType type, int core = -1)
+        {
+            IoEngine *engine = CreateIoEngine(type);
+
+            pthread_t thread;
+            if (0 == ::pthread_create(&thread, NULL, _SharedIoEngineProc, engine))
+            {
+                if (core >= 0 && core < CPU_SETSIZE)
+                {
+                    cpu_set_t cpus;
+                    CPU_ZERO(&cpus);
+                    CPU_SET(core, &cpus);
+
+                    //! best effort, the engine runs anywhere when restricted by the cpuset
+                    ::pthread_setaffinity_np(thread, sizeof(cpus), &cpus);
+                }
+
+                ::pthread_detach(thread);
+            }
+
+            return engine;
+        }
+
+        IoEngine *AcquireSharedIoEngine(HttpSessionConfig::IoEngineType type)
+        {
+            //! live as long as the process, same as the thread pool of WinHttp
+            if (HttpSessionConfig::UringEngine == type)
+            {
+                static IoEngine *uringEngine = _CreateSharedIoEngine(type);
+                return uringEngine;
+            }
+
+            static IoEngine *epollEngine = _CreateSharedIoEngine(type);
+            return epollEngine;
+        }
+
+        IoEngine *AcquirePinnedIoEngine(HttpSessionConfig::IoEngineType type, uint32_t index)
+        {
+            static CriticalSection lock;
+            static IoEngine *epollEngines[MaxPinnedIoEngines];
+            static IoEngine *uringEngines[MaxPinnedIoEngines];
+
+            IoEngine **engines = HttpSessionConfig::UringEngine == type ? uringEngines : epollEngines;
+
+            //! only taken when the sessions are created
+            AutoLock<CriticalSection> locker(&lock);
+
+            if (NULL == engines[index])
+                engines[index] = _CreateSharedIoEngine(type, static_cast<int>(index % OnlineCoreCount()));
+
+            return engines[index];
+        }
+
+        uint32_t OnlineCoreCount()
+        {
+            long count = ::sysconf(_SC_NPROCESSORS_ONLN);
+            return count > 0 ? static_cast<uint32_t>(count) : 1;
+        }
+
+        IoEngine *CreateIoEngine(HttpSessionConfig::IoEngineType type)
+        {
+            if (HttpSessionConfig::UringEngine == type)
+            {
+                IoEngine *engine = CreateUringIoEngine();
+                if (NULL != engine)
+                    return engine;
+            }
+
+            return CreateEpollIoEngine();
+        }
+    }
+}
+
+#endif
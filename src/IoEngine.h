@@ -0,0 +1,141 @@
+#ifndef IOENGINE_H
+#define IOENGINE_H
+
+#include "HttpClientModule.h"
+
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#include <cstdint>
+#include <vector>
+
+namespace Net
+{
+    namespace Details
+    {
+        //! same as WinHttpSetTimeouts of WinHttp session
+        enum
+        {
+            ConnectTimeout = 3000,
+            SendTimeout = 10000,
+            ReceiveTimeout = 10000
+        };
+
+        //! resolved address of a host, tried in order
+        struct Endpoint
+        {
+            struct sockaddr_storage addr;
+            socklen_t addrLen;
+        };
+        typedef std::vector<Endpoint> Endpoints;
+
+        //! applied to the socket of a channel before connecting, 0 keeps the default of the system
+        struct SocketOptions
+        {
+            uint32_t receiveBufferSize;
+            uint32_t sendBufferSize;
+
+            SocketOptions()
+                : receiveBufferSize(0)
+                , sendBufferSize(0)
+            {}
+        };
+
+        //! SO_RCVBUF and SO_SNDBUF of the options set
+        void ApplySocketOptions(int fd, const SocketOptions& options);
+
+        //! monotonic clock for the deadlines
+        uint64_t NowInMilliseconds();
+
+        //
+        //  completion notifications of a channel
+        //  always called in the engine thread, one after another
+        //
+        class ChannelHandler
+        {
+        public:
+            virtual ~ChannelHandler() {}
+
+        public:
+            //! err is the errno, 0 means succeeded
+            virtual void OnConnected(int err) = 0;
+            //! len means length already sent
+            virtual void OnSent(uint32_t len, int err) = 0;
+            //! data belongs to the engine and only remains valid during the call
+            //! len == 0 without any error means peer closed
+            virtual void OnReceived(const uint8_t *data, uint32_t len, int err) = 0;
+
+            //! no more callings
+            virtual void OnClosed() = 0;
+        };
+
+        //! socket owned by the engine
+        class Channel
+        {
+        public:
+            virtual ~Channel() {}
+        };
+
+        //
+        //  proactor over the native socket APIs
+        //      completions are delivered through ChannelHandler
+        //      at most one pending operation of each kind per channel, a send and a receive may be pending together
+        //
+        //  CreateChannel, Connect, Close and Post are thread safe
+        //  Send and Receive shall be issued in the engine thread(inside the notifications)
+        //
+        class IoEngine
+        {
+        public:
+            virtual ~IoEngine() {}
+
+        public:
+            virtual Channel *CreateChannel(ChannelHandler *handler, const SocketOptions& options) = 0;
+
+            //! reconnecting a connected channel will close the previous socket
+            virtual void Connect(Channel *channel, const struct sockaddr *addr, socklen_t addrLen) = 0;
+            //! data must remain valid till OnSent
+            virtual void Send(Channel *channel, const uint8_t *data, uint32_t len) = 0;
+            virtual void Receive(Channel *channel) = 0;
+            //! pending operations will be discarded silently
+            //! the channel will be deleted right after OnClosed
+            virtual void Close(Channel *channel) = 0;
+
+            //! health of an idle channel, shall be called in the engine thread
+            //! false when not connected, closed by peer or anything unsolicited arrived
+            virtual bool IsAlive(Channel *channel) = 0;
+
+            //! run the callable in the engine thread, the callable will be deleted after invoked
+            virtual void Post(Callable *callable) = 0;
+
+        public:
+            //! dispatch the completions in current thread
+            //! timeout in milliseconds, INFINITE to wait till anything completed
+            virtual void RunOnce(DWORD timeout) = 0;
+        };
+
+        //! process wide engine running in its own thread, one for each type
+        IoEngine *AcquireSharedIoEngine(HttpSessionConfig::IoEngineType type);
+
+        enum
+        {
+            MaxPinnedIoEngines = 256
+        };
+
+        //! process wide engines of each type, the index-th runs in its own thread pinned to core index % OnlineCoreCount()
+        //! index shall be less than MaxPinnedIoEngines
+        IoEngine *AcquirePinnedIoEngine(HttpSessionConfig::IoEngineType type, uint32_t index);
+        uint32_t OnlineCoreCount();
+
+        //! engine without any thread, drive it through RunOnce
+        //! falls back to epoll when the type is not supported by the kernel
+        IoEngine *CreateIoEngine(HttpSessionConfig::IoEngineType type);
+
+        //! implemented by each engine
+        IoEngine *CreateEpollIoEngine();
+        //! NULL when io_uring or any feature required is not available
+        IoEngine *CreateUringIoEngine();
+    }
+}
+
+#endif
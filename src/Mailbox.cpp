@@ -0,0 +1,193 @@
+#include "Mailbox.h"
+
+#include <stdint.h>
+
+#if !defined(_WIN32)
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#if defined(__linux__)
+#include <sys/eventfd.h>
+#endif
+#endif
+
+#if defined(_WIN32)
+static inline void _FullFence() { ::MemoryBarrier(); }
+
+static inline MailboxNode *_ExchangePointer(MailboxNode *volatile *dest, MailboxNode *value)
+{
+    return static_cast<MailboxNode *>(::InterlockedExchangePointer(reinterpret_cast<PVOID volatile *>(dest), value));
+}
+
+//! volatile accesses are acquire and release on Windows
+static inline MailboxNode *_LoadAcquire(MailboxNode *volatile *src) { return *src; }
+static inline void _StoreRelease(MailboxNode *volatile *dest, MailboxNode *value) { *dest = value; }
+
+static inline bool _IsFlagSet(REF *flag) { return 0 != *flag; }
+static inline void _SetFlag(REF *flag) { *flag = 1; }
+#else
+static inline void _FullFence() { __atomic_thread_fence(__ATOMIC_SEQ_CST); }
+
+//! a full barrier as well, pairs with the fence in BeginWait
+static inline MailboxNode *_ExchangePointer(MailboxNode *volatile *dest, MailboxNode *value)
+{
+    return __atomic_exchange_n(dest, value, __ATOMIC_SEQ_CST);
+}
+
+static inline MailboxNode *_LoadAcquire(MailboxNode *volatile *src) { return __atomic_load_n(src, __ATOMIC_ACQUIRE); }
+static inline void _StoreRelease(MailboxNode *volatile *dest, MailboxNode *value) { __atomic_store_n(dest, value, __ATOMIC_RELEASE); }
+
+static inline bool _IsFlagSet(REF *flag) { return 0 != __atomic_load_n(flag, __ATOMIC_RELAXED); }
+//! publishes the descriptors created before it
+static inline void _SetFlag(REF *flag) { __atomic_store_n(flag, 1, __ATOMIC_RELEASE); }
+#endif
+
+_Mailbox::_Mailbox(DWORD threadID, Disposer disposer)
+    : m_head(&m_stub)
+    , m_tail(&m_stub)
+    , m_stub()
+    , m_isWaiting(0)
+#if defined(_WIN32)
+    , m_wakeup(::CreateEvent(NULL, FALSE, FALSE, NULL))
+#endif
+    , m_ref()
+    , m_threadID(threadID)
+    , m_disposer(disposer)
+{
+#if !defined(_WIN32)
+    m_wakeup[0] = m_wakeup[1] = -1;
+#endif
+}
+
+_Mailbox::~_Mailbox()
+{
+    UINT message = 0;
+    MailboxNode *node = NULL;
+    while (NULL != (node = TryTake(message)))
+    {
+        m_disposer(node, message);
+    }
+
+#if defined(_WIN32)
+    ::CloseHandle(m_wakeup);
+#else
+    if (-1 != m_wakeup[0])
+        ::close(m_wakeup[0]);
+    if (m_wakeup[1] != m_wakeup[0])
+        ::close(m_wakeup[1]);
+#endif
+}
+
+void _Mailbox::Release()
+{
+    if (m_ref.Release())
+        delete this;
+}
+
+void _Mailbox::Post(MailboxNode *node, UINT message)
+{
+    node->m_message = message;
+    Push(node);
+
+    //! the exchange in Push is a full barrier, pairs with the fence in BeginWait
+    if (_IsFlagSet(&m_isWaiting) && 1 == CompareExchange(&m_isWaiting, 0, 1))
+    {
+#if defined(_WIN32)
+        ::SetEvent(m_wakeup);
+#else
+        uint64_t value = 1;
+        while (-1 == ::write(m_wakeup[1], &value, sizeof(value)) && EINTR == errno)
+        {}
+#endif
+    }
+}
+
+void _Mailbox::Push(MailboxNode *node)
+{
+    node->m_next = NULL;
+
+    MailboxNode *previous = _ExchangePointer(&m_head, node);
+    //! the consumer can't see the node till linked, it waits or retries meanwhile
+    _StoreRelease(&previous->m_next, node);
+}
+
+MailboxNode *_Mailbox::TryTake(UINT& message)
+{
+    MailboxNode *tail = m_tail;
+    MailboxNode *next = _LoadAcquire(&tail->m_next);
+
+    if (tail == &m_stub)
+    {
+        if (NULL == next)
+            return NULL;
+
+        m_tail = next;
+        tail = next;
+        next = _LoadAcquire(&next->m_next);
+    }
+
+    if (NULL == next)
+    {
+        //! a producer is linking
+        if (tail != _LoadAcquire(&m_head))
+            return NULL;
+
+        //! the last one, put the stub back behind it
+        Push(&m_stub);
+
+        next = _LoadAcquire(&tail->m_next);
+        if (NULL == next)
+            return NULL;
+    }
+
+    m_tail = next;
+
+    message = tail->m_message;
+    return tail;
+}
+
+bool _Mailbox::BeginWait()
+{
+#if !defined(_WIN32)
+    //! only the threads which ever wait pay for the descriptors
+    if (-1 == m_wakeup[0])
+    {
+#if defined(__linux__)
+        m_wakeup[0] = m_wakeup[1] = ::eventfd(0, EFD_CLOEXEC);
+#else
+        if (0 == ::pipe(m_wakeup))
+        {
+            ::fcntl(m_wakeup[0], F_SETFD, FD_CLOEXEC);
+            ::fcntl(m_wakeup[1], F_SETFD, FD_CLOEXEC);
+        }
+#endif
+    }
+#endif
+
+    _SetFlag(&m_isWaiting);
+    _FullFence();
+
+    //! posted right before
+    return IsEmpty();
+}
+
+void _Mailbox::EndWait()
+{
+    //! a stale signal at most, which only wakes the next wait in vain
+    CompareExchange(&m_isWaiting, 0, 1);
+}
+
+#if !defined(_WIN32)
+void _Mailbox::Wait()
+{
+    uint64_t value = 0;
+    while (-1 == ::read(m_wakeup[0], &value, sizeof(value)) && EINTR == errno)
+    {}
+}
+#endif
+
+bool _Mailbox::IsEmpty() const
+{
+    //! either has any linked, or a producer is linking
+    return NULL == _LoadAcquire(&m_tail->m_next) && m_tail == _LoadAcquire(const_cast<MailboxNode *volatile *>(&m_head));
+}
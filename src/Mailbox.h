@@ -0,0 +1,78 @@
+#ifndef MAILBOX_H
+#define MAILBOX_H
+
+#include "Thread.h"
+
+//
+//  mailbox of a worker or looper context, what PostThreadMessage targets on Windows
+//      unbounded intrusive MPSC queue(Vyukov), the posted Callable is the node itself
+//      posting takes a single atomic exchange and never blocks nor allocates
+//      the consumer sleeps on eventfd(or the event on Windows), producers only signal when it's waiting
+//
+//  referenced by the contexts resolved to it, so posting never looks it up
+//      the messages left when the last reference goes are handed to the disposer
+//
+class _Mailbox
+{
+public:
+    //! called for each message never taken
+    typedef void (*Disposer)(MailboxNode *node, UINT message);
+
+private:
+    //! the latest posted, exchanged by producers
+    MailboxNode *volatile m_head;
+    //! owned by the consumer
+    MailboxNode *m_tail;
+    MailboxNode m_stub;
+
+    REF m_isWaiting;
+#if defined(_WIN32)
+    HANDLE m_wakeup;
+#else
+    //! created by the consumer before its first wait, -1 till then
+    int m_wakeup[2];
+#endif
+
+    AtomicRef m_ref;
+    DWORD m_threadID;
+    Disposer m_disposer;
+
+public:
+    _Mailbox(DWORD threadID, Disposer disposer);
+
+public:
+    void AddRef() { m_ref.AddRef(); }
+    //! deleted with the last reference
+    void Release();
+
+    DWORD GetThreadID() const { return m_threadID; }
+
+public:
+    //! any thread, the node belongs to the mailbox till taken
+    void Post(MailboxNode *node, UINT message);
+
+    //! the consumer only, NULL when empty
+    MailboxNode *TryTake(UINT& message);
+
+    //! false means any message arrived meanwhile, no need to wait
+    bool BeginWait();
+    void EndWait();
+#if defined(_WIN32)
+    //! auto reset, for MsgWaitForMultipleObjects
+    HANDLE GetWakeupEvent() const { return m_wakeup; }
+#else
+    void Wait();
+#endif
+
+private:
+    ~_Mailbox();
+
+    void Push(MailboxNode *node);
+    bool IsEmpty() const;
+
+private:
+    _Mailbox(const _Mailbox&);
+    _Mailbox& operator = (const _Mailbox&);
+};
+
+#endif
@@ -0,0 +1,2319 @@
+#include "HttpSessionPrivate.h"
+
+#if !defined(_WIN32)
+
+#include "IoEngine.h"
+#include "Http2Connection.h"
+#include "ResponseParser.h"
+#include "UrlParser.h"
+#include "HeaderNames.h"
+#include "IntrusiveList.h"
+#include "StringConvertor.h"
+#include "BufferPool.h"
+#include "WorkStealingExecutor.h"
+
+#include <netdb.h>
+#include <errno.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cctype>
+#include <list>
+#include <map>
+#include <vector>
+#include <string>
+#include <algorithm>
+
+namespace Net
+{
+    namespace Details
+    {
+        class NativeHttpHandler;
+        typedef std::list<NativeHttpHandler *> NativeHttpHandlers;
+        //! in flight, each handler unlinks itself when finished
+        typedef IntrusiveList<NativeHttpHandler> InFlightHandlers;
+
+        class ConnectionPool;
+        class EndpointCache;
+
+        enum
+        {
+            ShardCount = 16
+        };
+
+        //! the requests and the connections of the origins hashed to the same shard
+        struct SessionShard
+        {
+            CriticalSection lock;
+            InFlightHandlers handlers;
+            ConnectionPool *pool;
+            //! completions of the shard all come from this one
+            IoEngine *engine;
+        };
+
+        //! components of the url, UTF-8 encoded
+        typedef UrlPrefixCache<char> UrlCache;
+
+        struct CrackedURL
+        {
+            //! scheme and authority, shared by the requests of the same endpoint
+            UrlCache::PrefixPointer prefix;
+            //! path with query, into the url, valid till the request is built
+            const char *path;
+            uint32_t pathLength;
+        };
+    }
+
+    //
+    //  non-blocking sockets driven by IoEngine
+    //      async session shares the process wide engine, completions come from the engine thread
+    //      or the pinned engines when ReactorCount is set, each shard sticks to one of them
+    //      sync session owns an engine and drives it in the calling thread till all the handlers finished
+    //      connections are kept alive in the pool of the session, see ConnectionPool
+    //      the session may be shared by any threads, the state is sharded by origin to keep them apart
+    //
+    class NativeHttpSessionPrivate : public HttpSession::Private
+    {
+    private:
+        //! sync session only, drives all the shards
+        Details::IoEngine *m_ownedEngine;
+
+        //! a handler and its connection never leave the shard of their origin
+        Details::SessionShard *m_shards;
+        //! no less than the engines, so that every engine serves some origins
+        uint32_t m_shardCount;
+        //! handlers of all the shards
+        REF m_handlerCount;
+        //! when terminating, the state of the event will shift to unsignaled
+        ManualResetEvent m_disconnectedEvent;
+
+        HttpSessionConfig m_config;
+        Details::EndpointCache *m_endpointCache;
+        Details::UrlCache m_urlCache;
+
+    public:
+        explicit NativeHttpSessionPrivate(const HttpSessionConfig& config);
+        virtual ~NativeHttpSessionPrivate();
+
+    public:
+        virtual void SendRequest(const HttpRequest *req, AsyncCompletionGenericDelegate *delegate);
+        virtual void Disconnect();
+
+    public:
+        Details::EndpointCache *GetEndpointCache() const { return m_endpointCache; }
+
+        //! ###
+        //! called in the engine thread
+        void OnHandleFinished(Details::NativeHttpHandler *handler);
+
+        //! send redirect request
+        //!     started in the thread pool when the engine is shared, resolving the location may block
+        void SendRedirect(const HttpRequest *req,
+            const std::string& currentURL,
+            AsyncCompletionGenericDelegate *delegate,
+            RedirectCompletionGenericDelegate *redirectDelegate,
+            const HttpResponseHeaders& headers);
+
+        //! counted as a handler till started, so that Disconnect waits for it
+        void StartRedirect(const HttpRequest *req, const std::string& location, bool reissuingRequest
+            , AsyncCompletionGenericDelegate *delegate, RedirectCompletionGenericDelegate *redirectDelegate);
+
+    private:
+        //! the fixed headers of the prepared one are kept when redirected, so is the redirect delegate
+        void StartRequest(const std::string& url, HttpVerb verb, InputStream *bodyStream, const HttpRequest *req
+            , const PreparedRequest::PrivateData *prepared, AsyncCompletionGenericDelegate *delegate, RedirectCompletionGenericDelegate *redirectDelegate);
+        void RunUntilFinished();
+
+        Details::SessionShard *ShardOf(uint32_t originHash);
+    };
+
+    namespace Details
+    {
+        enum
+        {
+            SendBufferLength = 4096,
+            //! in case the server keeps refusing
+            MaxStreamReplays = 4
+        };
+
+        //! location may be relative to current url
+        static std::string ResolveLocation(const std::string& current, const std::string& location)
+        {
+            if (std::string::npos != location.find("://"))
+                return location;
+
+            std::string::size_type schemeEnd = current.find("://");
+            if (std::string::npos == schemeEnd)
+                return location;
+
+            std::string::size_type authorityEnd = current.find_first_of("/?#", schemeEnd + 3);
+            if (std::string::npos == authorityEnd)
+                authorityEnd = current.size();
+
+            //! network-path reference
+            if (0 == location.compare(0, 2, "//"))
+                return current.substr(0, schemeEnd + 1) + location;
+
+            //! absolute-path reference
+            if (!location.empty() && '/' == location[0])
+                return current.substr(0, authorityEnd) + location;
+
+            std::string::size_type pathEnd = current.find_first_of("?#", authorityEnd);
+            std::string::size_type lastSlash = current.rfind('/', std::string::npos == pathEnd ? std::string::npos : pathEnd - 1);
+            if (std::string::npos == lastSlash || lastSlash < authorityEnd)
+                return current.substr(0, authorityEnd) + "/" + location;
+
+            return current.substr(0, lastSlash + 1) + location;
+        }
+
+        static void ResolveEndpoints(const CrackedURL& cracked, Endpoints& endpoints)
+        {
+            struct addrinfo hints;
+            ::memset(&hints, 0, sizeof(hints));
+            hints.ai_family = AF_UNSPEC;
+            hints.ai_socktype = SOCK_STREAM;
+            hints.ai_flags = AI_NUMERICSERV;
+
+            char service[8] = { 0 };
+            std::snprintf(service, sizeof(service), "%u", static_cast<unsigned int>(cracked.prefix->port));
+
+            struct addrinfo *result = NULL;
+            if (0 != ::getaddrinfo(cracked.prefix->host.c_str(), service, &hints, &result))
+                throw ConnectionFailedException();
+
+            for (struct addrinfo *each = result; NULL != each; each = each->ai_next)
+            {
+                Endpoint endpoint;
+                ::memcpy(&endpoint.addr, each->ai_addr, each->ai_addrlen);
+                endpoint.addrLen = each->ai_addrlen;
+
+                endpoints.push_back(endpoint);
+            }
+
+            ::freeaddrinfo(result);
+
+            if (endpoints.empty())
+                throw ConnectionFailedException();
+        }
+
+        //! FNV-1a
+        static uint32_t _HashOf(const std::string& key)
+        {
+            uint32_t hash = 2166136261u;
+            for (std::string::size_type i = 0; i != key.size(); ++i)
+            {
+                hash ^= static_cast<unsigned char>(key[i]);
+                hash *= 16777619u;
+            }
+
+            return hash;
+        }
+
+        //
+        //  resolved endpoints shared by all the threads sending through the session
+        //      sharded by origin, resolving one host never blocks the lookups of the others
+        //      an entry lives for DnsCacheTimeout, or till none of its endpoints could be connected
+        //
+        class EndpointCache
+        {
+        private:
+            struct Entry
+            {
+                Endpoints endpoints;
+                uint64_t expiresAt;
+            };
+            typedef std::map<std::string, Entry> Entries;
+
+            struct Shard
+            {
+                CriticalSection lock;
+                Entries entries;
+            };
+
+        private:
+            uint32_t m_timeout;
+            Shard m_shards[ShardCount];
+
+        public:
+            explicit EndpointCache(uint32_t timeout)
+                : m_timeout(timeout)
+            {}
+
+        public:
+            void Resolve(const std::string& origin, const CrackedURL& cracked, Endpoints& endpoints);
+            void Forget(const std::string& origin);
+        };
+
+        void EndpointCache::Resolve(const std::string& origin, const CrackedURL& cracked, Endpoints& endpoints)
+        {
+            if (0 == m_timeout)
+            {
+                ResolveEndpoints(cracked, endpoints);
+                return;
+            }
+
+            Shard& shard = m_shards[_HashOf(origin) % ShardCount];
+
+            {
+                AutoLock<CriticalSection> locker(&shard.lock);
+
+                Entries::iterator found = shard.entries.find(origin);
+                if (found != shard.entries.end() && found->second.expiresAt > NowInMilliseconds())
+                {
+                    endpoints = found->second.endpoints;
+                    return;
+                }
+            }
+
+            //! resolved outside the lock, the concurrent misses of the same origin may resolve twice
+            ResolveEndpoints(cracked, endpoints);
+
+            uint64_t now = NowInMilliseconds();
+
+            AutoLock<CriticalSection> locker(&shard.lock);
+
+            //! drop the expired ones
+            Entries::iterator it = shard.entries.begin();
+            while (it != shard.entries.end())
+            {
+                if (it->second.expiresAt <= now)
+                    shard.entries.erase(it++);
+                else
+                    ++it;
+            }
+
+            Entry& entry = shard.entries[origin];
+            entry.endpoints = endpoints;
+            entry.expiresAt = now + m_timeout;
+        }
+
+        void EndpointCache::Forget(const std::string& origin)
+        {
+            Shard& shard = m_shards[_HashOf(origin) % ShardCount];
+
+            AutoLock<CriticalSection> locker(&shard.lock);
+            shard.entries.erase(origin);
+        }
+
+        //! origin-form of the request target
+        static void _AppendPath(const CrackedURL& cracked, std::string& target)
+        {
+            if (0 == cracked.pathLength || '/' != cracked.path[0])
+                target.push_back('/');
+
+            target.append(cracked.path, cracked.pathLength);
+        }
+
+        //! sized exactly up front, the head is written in one pass with a single allocation
+        static void BuildRequestHead(const CrackedURL& cracked, HttpVerb verb, InputStream *bodyStream, const HttpRequest *req
+            , const PreparedRequest::PrivateData *prepared, bool isKeepAlive, std::string& head)
+        {
+            static const char RequestVersion[] = " HTTP/1.1\r\n";
+            static const char HostName[] = "Host: ";
+            static const char ConnectionClose[] = "Connection: close\r\n";
+
+            const char *verbName = VerbMapper[verb];
+            std::string::size_type verbLength = ::strlen(verbName);
+            const std::string& authority = cracked.prefix->authority;
+
+            //! the framing ones are written below, whatever the caller set
+            const std::string& headers = req->GetHeadersBytes();
+            std::string::size_type headersLength = AppendRequestHeaderLines(headers.data(), headers.size(), NULL);
+
+            char contentLength[48] = { 0 };
+            std::string::size_type contentLengthLength = 0;
+            if (NULL != bodyStream || Post == verb || Put == verb)
+            {
+                contentLengthLength = std::snprintf(contentLength, sizeof(contentLength), "Content-Length: %lld\r\n"
+                    , static_cast<long long>(NULL == bodyStream ? 0 : bodyStream->GetTotal()));
+            }
+
+            bool isSlashed = 0 != cracked.pathLength && '/' == cracked.path[0];
+
+            //! the lines of the prepared one are copied as they are, the request line unless the path is patched or redirected
+            const std::string *requestLine = NULL;
+            const char *fixedLines = NULL;
+            std::string::size_type fixedLinesLength = 0;
+            bool isHostWritten = true;
+            if (NULL != prepared)
+            {
+                if (verb == prepared->verb && cracked.pathLength == prepared->parts.path.length
+                    && 0 == ::memcmp(cracked.path, prepared->url.data() + prepared->parts.path.offset, cracked.pathLength))
+                {
+                    requestLine = &prepared->requestLine;
+                }
+
+                //! Host leads the lines, only rebuilt when redirected to another authority
+                fixedLines = prepared->headLines.data();
+                fixedLinesLength = prepared->headLines.size();
+                if (authority == prepared->prefix->authority)
+                {
+                    isHostWritten = false;
+                }
+                else
+                {
+                    std::string::size_type hostLineLength = prepared->headLines.find("\r\n") + 2;
+                    fixedLines += hostLineLength;
+                    fixedLinesLength -= hostLineLength;
+                }
+            }
+
+            head.reserve(head.size()
+                + (NULL != requestLine ? requestLine->size() : verbLength + 1 + (isSlashed ? 0 : 1) + cracked.pathLength + sizeof(RequestVersion) - 1)
+                + (isHostWritten ? sizeof(HostName) - 1 + authority.size() + 2 : 0)
+                + fixedLinesLength
+                + headersLength
+                + contentLengthLength
+                + (isKeepAlive ? 0 : sizeof(ConnectionClose) - 1)
+                + 2);
+
+            if (NULL != requestLine)
+            {
+                head.append(*requestLine);
+            }
+            else
+            {
+                head.append(verbName, verbLength).push_back(' ');
+                _AppendPath(cracked, head);
+                head.append(RequestVersion, sizeof(RequestVersion) - 1);
+            }
+
+            if (isHostWritten)
+                head.append(HostName, sizeof(HostName) - 1).append(authority).append("\r\n", 2);
+
+            head.append(fixedLines, fixedLinesLength);
+
+            if (0 != headersLength)
+                AppendRequestHeaderLines(headers.data(), headers.size(), &head);
+
+            head.append(contentLength, contentLengthLength);
+
+            //! persistent by default in HTTP/1.1
+            if (!isKeepAlive)
+                head.append(ConnectionClose, sizeof(ConnectionClose) - 1);
+
+            head.append("\r\n", 2);
+        }
+
+        //! the CRLF lines of the headers, the connection-specific ones are dropped
+        static void _AppendFields(const std::string& headers, HeaderFields& fields)
+        {
+            std::string::size_type lineStart = 0;
+            while (lineStart < headers.size())
+            {
+                std::string::size_type lineEnd = headers.find("\r\n", lineStart);
+                if (std::string::npos == lineEnd)
+                    lineEnd = headers.size();
+
+                std::string::size_type colon = headers.find(':', lineStart);
+                if (colon < lineEnd && colon != lineStart)
+                {
+                    std::string name = headers.substr(lineStart, colon - lineStart);
+                    std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+
+                    std::string::size_type valueStart = headers.find_first_not_of(" \t", colon + 1);
+                    std::string::size_type valueEnd = headers.find_last_not_of(" \t", lineEnd - 1);
+                    std::string value;
+                    if (valueStart < lineEnd && valueEnd >= valueStart)
+                        value = headers.substr(valueStart, valueEnd - valueStart + 1);
+
+                    bool isDropped = false;
+                    switch (FindHeaderName(name.data(), name.size(), HashHeaderName(name.data(), name.size())))
+                    {
+                    case HeaderName::Host:
+                    case HeaderName::Connection:
+                    case HeaderName::Keep_Alive:
+                    case HeaderName::Proxy_Connection:
+                    case HeaderName::Transfer_Encoding:
+                    case HeaderName::Upgrade:
+                    case HeaderName::Content_Length:
+                        isDropped = true;
+                        break;
+
+                    case HeaderName::TE:
+                        isDropped = "trailers" != value;
+                        break;
+
+                    default:
+                        break;
+                    }
+
+                    if (!isDropped)
+                        fields.push_back(HeaderField(name, value));
+                }
+
+                lineStart = lineEnd + 2;
+            }
+        }
+
+        //! the request head of HTTP/2, the pseudo headers first, the names in lower case
+        //! the connection-specific headers are dropped, Host is replaced by :authority
+        static void BuildRequestFields(const CrackedURL& cracked, HttpVerb verb, InputStream *bodyStream, const HttpRequest *req
+            , const PreparedRequest::PrivateData *prepared, HeaderFields& fields)
+        {
+            fields.push_back(HeaderField(":method", VerbMapper[verb]));
+            fields.push_back(HeaderField(":scheme", cracked.prefix->isHttps ? "https" : "http"));
+            fields.push_back(HeaderField(":authority", cracked.prefix->authority));
+            fields.push_back(HeaderField(":path", std::string()));
+            _AppendPath(cracked, fields.back().value);
+
+            if (NULL != prepared)
+                _AppendFields(prepared->headers, fields);
+
+            if (req->HasHeaders())
+                _AppendFields(req->GetHeadersBytes(), fields);
+
+            if (NULL != bodyStream || Post == verb || Put == verb)
+            {
+                char contentLength[24] = { 0 };
+                std::snprintf(contentLength, sizeof(contentLength), "%lld"
+                    , static_cast<long long>(NULL == bodyStream ? 0 : bodyStream->GetTotal()));
+                fields.push_back(HeaderField("content-length", contentLength));
+            }
+        }
+
+        //! a piece of the received data
+        class PieceStream : public InputStream
+        {
+        private:
+            const uint8_t *m_data;
+            uint32_t m_length;
+            uint32_t m_offset;
+
+            int64_t m_total;
+
+        public:
+            PieceStream(const uint8_t *data, uint32_t len, int64_t total)
+                : m_data(data)
+                , m_length(len)
+                , m_offset(0)
+                , m_total(total)
+            {}
+
+        public:
+            virtual int64_t GetAvailCount() const { return m_length - m_offset; }
+            virtual uint32_t Read(uint8_t *buffer, uint32_t read)
+            {
+                uint32_t aboutToRead = (std::min)(read, m_length - m_offset);
+                ::memcpy(buffer, m_data + m_offset, aboutToRead);
+
+                m_offset += aboutToRead;
+                return aboutToRead;
+            }
+            virtual int64_t GetTotal() const { return m_total; }
+        };
+
+        //
+        //  keep-alive connection, the permanent handler of its channel
+        //      notifications are forwarded to the attached request handler, nothing is expected while idle
+        //      deletes itself once the channel closed
+        //
+        //  pipelining
+        //      the owner is the handler receiving, the pipelined ones are queued behind it in the order of their requests
+        //      the heads of the pipelinable requests are written through Write, one Send at a time
+        //
+        class PooledConnection : public ChannelHandler
+        {
+        public:
+            Channel *m_channel;
+            //! NULL while idle or discarded
+            ChannelHandler *m_owner;
+
+            std::string m_origin;
+            uint64_t m_idleSince;
+
+            //! modified in the engine thread under the lock of the shard
+            NativeHttpHandlers m_pipeline;
+            //! any write failed, the pipelined requests may not have all arrived
+            bool m_isBroken;
+            //! the owner's head queued, nothing is written before it
+            bool m_isOpen;
+            //! the owner and the pipelined ones may all be terminated, closed once
+            bool m_isClosing;
+
+        private:
+            IoEngine *m_engine;
+
+            //! heads not written yet
+            std::string m_queued;
+            bool m_isOwnerQueued;
+            //! remains valid till OnSent
+            std::string m_writing;
+            bool m_isOwnerWriting;
+
+        public:
+            PooledConnection(IoEngine *engine, const SocketOptions& options, const std::string& origin, ChannelHandler *owner)
+                : m_channel(NULL)
+                , m_owner(owner)
+                , m_origin(origin)
+                , m_idleSince(0)
+                , m_pipeline()
+                , m_isBroken(false)
+                , m_isOpen(false)
+                , m_isClosing(false)
+                , m_engine(engine)
+                , m_queued()
+                , m_isOwnerQueued(false)
+                , m_writing()
+                , m_isOwnerWriting(false)
+            {
+                m_channel = engine->CreateChannel(this, options);
+            }
+
+        public:
+            //! under the lock of the shard, deletes itself once closed
+            void Close()
+            {
+                if (m_isClosing)
+                    return;
+
+                m_isClosing = true;
+                m_engine->Close(m_channel);
+            }
+
+            //! the owner is notified through OnSent once its own head written
+            void Write(ChannelHandler *handler, const std::string& head)
+            {
+                if (handler == m_owner && !m_isOpen)
+                {
+                    //! the pipelined ones may have queued while connecting
+                    m_queued.insert(0, head);
+                    m_isOwnerQueued = true;
+                    m_isOpen = true;
+                }
+                else
+                {
+                    m_queued.append(head);
+                    if (handler == m_owner)
+                        m_isOwnerQueued = true;
+                }
+
+                Flush();
+            }
+
+        public:
+            virtual void OnConnected(int err)
+            {
+                if (m_owner)
+                    m_owner->OnConnected(err);
+            }
+
+            virtual void OnSent(uint32_t len, int err)
+            {
+                //! sent by the owner itself
+                if (m_writing.empty())
+                {
+                    if (m_owner)
+                        m_owner->OnSent(len, err);
+
+                    return;
+                }
+
+                bool isOwnerWritten = m_isOwnerWriting;
+                m_writing.clear();
+                m_isOwnerWriting = false;
+
+                if (0 != err)
+                    m_isBroken = true;
+                else
+                    Flush();
+
+                if (isOwnerWritten && m_owner)
+                    m_owner->OnSent(len, err);
+            }
+
+            virtual void OnReceived(const uint8_t *data, uint32_t len, int err)
+            {
+                if (m_owner)
+                    m_owner->OnReceived(data, len, err);
+            }
+
+            virtual void OnClosed();
+
+        private:
+            void Flush()
+            {
+                if (!m_isOpen || !m_writing.empty() || m_queued.empty())
+                    return;
+
+                m_writing.swap(m_queued);
+                m_isOwnerWriting = m_isOwnerQueued;
+                m_isOwnerQueued = false;
+
+                m_engine->Send(m_channel, reinterpret_cast<const uint8_t *>(m_writing.data()), static_cast<uint32_t>(m_writing.size()));
+            }
+        };
+        typedef std::list<PooledConnection *> PooledConnections;
+        typedef std::list<Http2Connection *> Http2Connections;
+
+        //
+        //  keep-alive connections of a session, grouped by origin(scheme://host:port)
+        //      the most recently returned one is reused first, the expired ones are evicted lazily
+        //      HTTP/2 connections are shared by the streams instead, a new one is only opened when the others refuse more
+        //      one pool per shard, guarded by the lock of the shard, only Cancel and Clear may be called outside the engine thread
+        //
+        class ConnectionPool
+        {
+        private:
+            struct Origin
+            {
+                //! front is the most recently returned
+                PooledConnections idle;
+                //! idle and in use
+                uint32_t total;
+                //! waiting for MaxConnectionsPerHost
+                NativeHttpHandlers waiters;
+                //! in use by the pipelinable requests, open for more
+                PooledConnections pipelining;
+                //! HTTP/2, referenced by the pool till discarded, counted in total
+                Http2Connections multiplexed;
+
+                Origin()
+                    : idle()
+                    , total(0)
+                    , waiters()
+                    , pipelining()
+                    , multiplexed()
+                {}
+            };
+            typedef std::map<std::string, Origin> Origins;
+
+        private:
+            IoEngine *m_engine;
+            SocketOptions m_socketOptions;
+
+            uint32_t m_maxIdle;
+            uint32_t m_maxTotal;
+            uint32_t m_idleTimeout;
+            uint32_t m_pipeliningDepth;
+
+            Origins m_origins;
+
+        public:
+            ConnectionPool(IoEngine *engine, const HttpSessionConfig& config)
+                : m_engine(engine)
+                , m_socketOptions()
+                , m_maxIdle(config.MaxIdleConnectionsPerHost)
+                , m_maxTotal(config.MaxConnectionsPerHost)
+                , m_idleTimeout(config.IdleConnectionTimeout)
+                , m_pipeliningDepth(config.PipeliningDepth)
+                , m_origins()
+            {
+                m_socketOptions.receiveBufferSize = config.ReceiveBufferSize;
+                m_socketOptions.sendBufferSize = config.SendBufferSize;
+            }
+
+            ~ConnectionPool()
+            {
+                Clear();
+            }
+
+        public:
+            //! attach a healthy idle connection, the pipeline with the most room or a new one to the handler
+            //! NULL means the handler is parked till any connection of the origin returned
+            PooledConnection *Acquire(const std::string& origin, NativeHttpHandler *handler);
+            //! detach the connection from its handler, then hand it over to the next pipelined one, keep or close it
+            //! returns the parked handler resumed by it, which shall be started outside the lock
+            //! the pipelined ones are detached into replayed when not reusable
+            NativeHttpHandler *Release(PooledConnection *connection, bool isReusable, NativeHttpHandler *&successor, NativeHttpHandlers& replayed);
+            //! the connection in use has been closed
+            NativeHttpHandler *OnClosed(PooledConnection *connection);
+            //! replace the connection closed by peer with a new one of the same origin
+            PooledConnection *Renew(PooledConnection *connection, NativeHttpHandler *handler, NativeHttpHandlers& replayed);
+
+            //! attach a stream of the connection accepting more or a new one to the handler, NULL means parked
+            Http2Connection *AcquireStream(const std::string& origin, NativeHttpHandler *handler);
+            //! the stream of the connection has been detached, connection is NULL when the handler was parked
+            //! the parked handlers attached meanwhile are appended to resumed, which shall be started outside the lock
+            void ReleaseStream(const std::string& origin, Http2Connection *connection, NativeHttpHandlers& resumed);
+
+            //! false when the handler is not parked
+            bool Cancel(NativeHttpHandler *handler);
+            //! close all the idle connections and the HTTP/2 ones
+            void Clear();
+
+        private:
+            void Lend(Origin& origin, PooledConnection *connection, NativeHttpHandler *handler, bool isReused);
+            PooledConnection *Join(Origin& origin, NativeHttpHandler *handler);
+            void Unpipeline(Origin& origin, PooledConnection *connection, NativeHttpHandlers& replayed);
+
+            //! NULL when none accepts and no more connections allowed
+            Http2Connection *Multiplex(Origin& origin, const std::string& key, NativeHttpHandler *handler);
+            //! drop the closed ones
+            void Reap(Origin& origin);
+            void Discard(Origin& origin, Http2Connection *connection);
+
+            void Discard(Origin& origin, PooledConnection *connection);
+            NativeHttpHandler *Resume(Origin& origin, const std::string& key);
+            void Evict();
+        };
+
+        //
+        //  one handler per request, same flow as the handler of WinHttp
+        //      borrows a connection from the pool of its shard, returns it once the response completed
+        //      or a stream of the shared HTTP/2 connection when multiplexed, the connection drives it through Http2Stream
+        //      all the notifications come from the engine thread except Terminate
+        //      deletes itself once finished
+        //
+        class NativeHttpHandler : public ChannelHandler, public Http2Stream, public IntrusiveListNode
+        {
+        private:
+            typedef void (NativeHttpHandler::*Step)();
+
+            //! run a step in the engine thread
+            class StepCallable : public Callable
+            {
+            private:
+                NativeHttpHandler *m_handler;
+                Step m_step;
+
+            public:
+                StepCallable(NativeHttpHandler *handler, Step step)
+                    : m_handler(handler)
+                    , m_step(step)
+                {}
+
+            public:
+                virtual void Invoke()
+                {
+                    (m_handler->*m_step)();
+                }
+            };
+
+        private:
+            //! when closed, those will be NULL
+            const HttpRequest *m_request;
+            AsyncCompletionGenericDelegate *m_completionAsyncHandler;
+
+            AsyncCompletionGenericDelegate *m_normalAsyncHandler;
+            RedirectCompletionGenericDelegate *m_redirectDelegate;
+
+            NativeHttpSessionPrivate *m_sessionImpl;
+            SessionShard *m_shard;
+
+            IoEngine *m_engine;
+            //! attached under the lock of the shard
+            PooledConnection *m_connection;
+            //! the connection has served the previous requests
+            bool m_isReused;
+            //! may queue behind the other requests on a keep-alive connection
+            bool m_isPipelinable;
+
+            //! a stream of HTTP/2 connection instead, attached under the lock of the shard
+            bool m_isMultiplexed;
+            Http2Connection *m_http2;
+            uint32_t m_streamId;
+            HeaderFields m_requestFields;
+            //! refused by the connections going away
+            uint32_t m_replayCount;
+
+            REF m_isClosed;
+
+        private:
+            std::string m_url;
+            std::string m_origin;
+            Endpoints m_endpoints;
+            Endpoints::size_type m_endpointIndex;
+
+            std::string m_requestHead;
+            bool m_isHeadSent;
+            InputStream *m_bodyStream;
+            bool m_isBodyTouched;
+            //! deallocate when closed
+            uint8_t *m_buffer;
+
+            ResponseParser m_parser;
+            HttpResponseHeaders m_headers;
+            bool m_isResponding;
+            //! anything received after the response
+            bool m_hasExtraData;
+            //! the response of the next pipelined one, only valid in OnReceived
+            const uint8_t *m_extraData;
+            uint32_t m_extraLength;
+
+        public:
+            //! either requestHead or requestFields is used, depending on isMultiplexed, both are taken by swapping
+            NativeHttpHandler(const std::string& url, const std::string& origin, const Endpoints& endpoints, std::string& requestHead, HeaderFields& requestFields,
+                InputStream *bodyStream, const HttpRequest *req, AsyncCompletionGenericDelegate *delegate, RedirectCompletionGenericDelegate *redirectDelegate,
+                NativeHttpSessionPrivate *sessionImpl, SessionShard *shard, bool isPipelinable, bool isMultiplexed)
+                : m_request(req)
+                , m_completionAsyncHandler(delegate)
+                , m_normalAsyncHandler(delegate)
+                , m_redirectDelegate(redirectDelegate)
+                , m_sessionImpl(sessionImpl)
+                , m_shard(shard)
+                , m_engine(shard->engine)
+                , m_connection(NULL)
+                , m_isReused(false)
+                , m_isPipelinable(isPipelinable)
+                , m_isMultiplexed(isMultiplexed)
+                , m_http2(NULL)
+                , m_streamId(0)
+                , m_requestFields()
+                , m_replayCount(0)
+                , m_isClosed(0)
+                , m_url(url)
+                , m_origin(origin)
+                , m_endpoints(endpoints)
+                , m_endpointIndex(0)
+                , m_requestHead()
+                , m_isHeadSent(false)
+                , m_bodyStream(bodyStream)
+                , m_isBodyTouched(false)
+                , m_buffer(NULL)
+                , m_parser()
+                , m_headers()
+                , m_isResponding(false)
+                , m_hasExtraData(false)
+                , m_extraData(NULL)
+                , m_extraLength(0)
+            {
+                m_requestHead.swap(requestHead);
+                m_requestFields.swap(requestFields);
+            }
+
+            virtual ~NativeHttpHandler()
+            {
+                BufferPool::Free(m_buffer, SendBufferLength);
+            }
+
+        public:
+            const std::string& GetOrigin() const { return m_origin; }
+            SessionShard *GetShard() const { return m_shard; }
+            bool IsPipelinable() const { return m_isPipelinable; }
+            bool IsMultiplexed() const { return m_isMultiplexed; }
+            const Endpoints& GetEndpoints() const { return m_endpoints; }
+
+            //! acquire a connection in the engine thread
+            void OnSendingRequest();
+            //! shall be called under the lock of the shard
+            void Terminate();
+
+            //! by the pool, under the lock of the shard
+            void Attach(PooledConnection *connection, bool isReused);
+            void AttachStream(Http2Connection *connection);
+            //! start on the attached connection
+            void OnAttached();
+
+            //! the previous one on the pipeline completed, data is the beginning of the response
+            void OnPipelineTurn(const uint8_t *data, uint32_t len);
+            //! the pipeline broke before the response, detached by the pool
+            void OnReplaying();
+            //! the pipeline closed while terminating
+            void OnPipelineClosed();
+
+        public:
+            virtual void OnConnected(int err);
+            virtual void OnSent(uint32_t len, int err);
+            virtual void OnReceived(const uint8_t *data, uint32_t len, int err);
+            virtual void OnClosed();
+
+        public:
+            virtual void OnStreamHeaders(const HeaderFields& fields, bool isEnd);
+            virtual void OnStreamData(const uint8_t *data, uint32_t len, bool isEnd);
+            virtual bool OnStreamBody(uint8_t *buffer, uint32_t& len, bool& isEnd);
+            virtual void OnStreamAborted(AbortReason reason, int err);
+
+        private:
+            void OnAcquiring();
+            //! open the stream on the attached connection
+            void OnOpening();
+            void OnConnecting();
+            //! false means not retried
+            bool OnRetrying(int err);
+
+            void OnRequestSent();
+            void OnWriteData();
+            void OnWritingData();
+            void OnReceiveResponse();
+
+            //! false means closed, the ownership of rawHeaders is transferred
+            bool OnReadHeader(char *rawHeaders, uint32_t statusCode, int64_t contentLength);
+            bool OnReadData(const uint8_t *data, uint32_t len);
+
+            //! exception == nullptr means success
+            void OnClose(Exception *exception);
+
+            //! no more callings
+            void OnFinished();
+            void OnTerminated();
+        };
+
+        void PooledConnection::OnClosed()
+        {
+            if (m_owner)
+                m_owner->OnClosed();
+
+            //! the others are all terminated, the broken pipelines have been detached by the pool
+            while (!m_pipeline.empty())
+            {
+                NativeHttpHandler *pipelined = m_pipeline.front();
+                m_pipeline.pop_front();
+
+                pipelined->OnPipelineClosed();
+            }
+
+            delete this;
+        }
+
+        void NativeHttpHandler::OnSendingRequest()
+        {
+            //! the health check of the idle connections takes place in the engine thread
+            m_engine->Post(new StepCallable(this, &NativeHttpHandler::OnAcquiring));
+        }
+
+        void NativeHttpHandler::Terminate()
+        {
+            //! if has set(value equals 1)
+            if (CompareExchange(&m_isClosed, 1, 0) == 1)
+                return;
+
+            if (NULL != m_connection)
+            {
+                m_connection->Close();
+            }
+            else if (NULL != m_http2)
+            {
+                //! the streams are aborted once closed, Disconnect closes the others anyway
+                m_http2->Close();
+            }
+            else if (m_shard->pool->Cancel(this))
+            {
+                //! parked, no one else refers to it
+                m_engine->Post(new StepCallable(this, &NativeHttpHandler::OnFinished));
+            }
+
+            //! otherwise still acquiring, which finishes it
+        }
+
+        void NativeHttpHandler::Attach(PooledConnection *connection, bool isReused)
+        {
+            m_connection = connection;
+            m_isReused = isReused;
+        }
+
+        void NativeHttpHandler::AttachStream(Http2Connection *connection)
+        {
+            m_http2 = connection;
+            connection->Reserve();
+        }
+
+        void NativeHttpHandler::OnAcquiring()
+        {
+            bool isTerminated = false;
+            {
+                AutoLock<CriticalSection> locker(&m_shard->lock);
+
+                isTerminated = 0 != m_isClosed;
+
+                //! parked, resumed by the pool
+                if (!isTerminated && m_isMultiplexed && NULL == m_shard->pool->AcquireStream(m_origin, this))
+                    return;
+
+                if (!isTerminated && !m_isMultiplexed && NULL == m_shard->pool->Acquire(m_origin, this))
+                    return;
+            }
+
+            if (isTerminated)
+                OnFinished();
+            else
+                OnAttached();
+        }
+
+        void NativeHttpHandler::OnAttached()
+        {
+            if (m_isMultiplexed)
+                OnOpening();
+            else if (m_isReused)
+                OnConnected(0);
+            else
+                OnConnecting();
+        }
+
+        void NativeHttpHandler::OnOpening()
+        {
+            bool isTerminated = false;
+            NativeHttpHandlers resumed;
+            {
+                //! opening under the lock, so that termination always follows
+                AutoLock<CriticalSection> locker(&m_shard->lock);
+
+                isTerminated = 0 != m_isClosed;
+                if (!isTerminated)
+                {
+                    bool hasBody = NULL != m_bodyStream && 0 != m_bodyStream->GetAvailCount();
+
+                    m_streamId = m_http2->Open(this, m_requestFields, hasBody);
+                    if (0 != m_streamId)
+                        return;
+                }
+                else
+                {
+                    m_http2->Unreserve();
+                }
+
+                //! the connection is going away, try the others
+                m_shard->pool->ReleaseStream(m_origin, m_http2, resumed);
+                m_http2 = NULL;
+            }
+
+            NativeHttpHandlers::iterator it = resumed.begin();
+            for (; it != resumed.end(); ++it)
+            {
+                (*it)->OnAttached();
+            }
+
+            if (isTerminated)
+                OnFinished();
+            else
+                OnAcquiring();
+        }
+
+        void NativeHttpHandler::OnConnecting()
+        {
+            //! connecting under the lock, so that termination always follows
+            AutoLock<CriticalSection> locker(&m_shard->lock);
+
+            if (m_isClosed)
+                return;
+
+            const Endpoint& endpoint = m_endpoints[m_endpointIndex];
+            m_engine->Connect(m_connection->m_channel, reinterpret_cast<const struct sockaddr *>(&endpoint.addr), endpoint.addrLen);
+        }
+
+        //! the reused connection may have been closed by peer before the request arrived
+        //! replay once on a new connection, as long as neither the body nor the response consumed
+        bool NativeHttpHandler::OnRetrying(int err)
+        {
+            if (!m_isReused || m_isBodyTouched || m_isResponding || ETIMEDOUT == err)
+                return false;
+
+            NativeHttpHandlers replayed;
+            {
+                AutoLock<CriticalSection> locker(&m_shard->lock);
+
+                //! terminating, the closing follows
+                if (m_isClosed)
+                    return true;
+
+                m_shard->pool->Renew(m_connection, this, replayed);
+            }
+
+            m_isHeadSent = false;
+            m_endpointIndex = 0;
+
+            OnConnecting();
+
+            NativeHttpHandlers::iterator it = replayed.begin();
+            for (; it != replayed.end(); ++it)
+            {
+                (*it)->OnReplaying();
+            }
+
+            return true;
+        }
+
+        void NativeHttpHandler::OnConnected(int err)
+        {
+            if (m_isClosed)
+                return;
+
+            if (0 != err)
+            {
+                //! try next address
+                if (++m_endpointIndex != m_endpoints.size())
+                {
+                    OnConnecting();
+                }
+                else
+                {
+                    //! resolve again next time
+                    m_sessionImpl->GetEndpointCache()->Forget(m_origin);
+                    OnClose(new ConnectionFailedException());
+                }
+
+                return;
+            }
+
+            if (m_isPipelinable)
+                m_connection->Write(this, m_requestHead);
+            else
+                m_engine->Send(m_connection->m_channel, reinterpret_cast<const uint8_t *>(m_requestHead.data()), static_cast<uint32_t>(m_requestHead.size()));
+        }
+
+        void NativeHttpHandler::OnSent(uint32_t, int err)
+        {
+            if (m_isClosed)
+                return;
+
+            if (0 != err)
+            {
+                if (!OnRetrying(err))
+                    OnClose(new NetException(err));
+
+                return;
+            }
+
+            if (!m_isHeadSent)
+            {
+                m_isHeadSent = true;
+                OnRequestSent();
+            }
+            else
+            {
+                OnWriteData();
+            }
+        }
+
+        void NativeHttpHandler::OnRequestSent()
+        {
+            //! check request body has any data to be sent
+            if (!m_bodyStream || m_bodyStream->GetAvailCount() == 0)
+            {
+                OnReceiveResponse();
+            }
+            else
+            {
+                //! start write data
+                if (NULL == m_buffer)
+                    m_buffer = static_cast<uint8_t *>(BufferPool::Allocate(SendBufferLength));
+
+                OnWritingData();
+            }
+        }
+
+        void NativeHttpHandler::OnWriteData()
+        {
+            //! read finished
+            if (m_bodyStream->GetAvailCount() == 0)
+            {
+                OnReceiveResponse();
+            }
+            else
+            {
+                OnWritingData();
+            }
+        }
+
+        void NativeHttpHandler::OnWritingData()
+        {
+            //! the body can't be replayed from now on
+            m_isBodyTouched = true;
+
+            try
+            {
+                uint32_t readCount = m_bodyStream->Read(m_buffer, SendBufferLength);
+
+                if (0 == readCount)
+                    OnReceiveResponse();
+                else
+                    m_engine->Send(m_connection->m_channel, m_buffer, readCount);
+            }
+            catch (const Exception& ex)
+            {
+                OnClose(ex.Clone());
+            }
+        }
+
+        void NativeHttpHandler::OnReceiveResponse()
+        {
+            m_engine->Receive(m_connection->m_channel);
+        }
+
+        void NativeHttpHandler::OnReceived(const uint8_t *data, uint32_t len, int err)
+        {
+            if (m_isClosed)
+                return;
+
+            if (0 != err)
+            {
+                if (!OnRetrying(err))
+                    OnClose(new NetException(err));
+
+                return;
+            }
+
+            //! peer closed
+            if (0 == len)
+            {
+                if (m_parser.IsUntilClose())
+                    OnClose(NULL);
+                else if (!OnRetrying(ECONNRESET))
+                    OnClose(new NetException(ECONNRESET));
+
+                return;
+            }
+
+            m_isResponding = true;
+
+            const uint8_t *current = data;
+            uint32_t remaining = len;
+
+            if (!m_parser.IsHeadCompleted())
+            {
+                ResponseParser::Result result = m_parser.ParseHead(current, remaining);
+                if (ResponseParser::Malformed == result)
+                {
+                    OnClose(new NetException(EPROTO));
+                    return;
+                }
+
+                if (ResponseParser::NeedMore == result)
+                {
+                    OnReceiveResponse();
+                    return;
+                }
+
+                if (!OnReadHeader(m_parser.TakeRawHeaders(), m_parser.GetStatusCode(), m_parser.GetContentLength()))
+                    return;
+            }
+
+            while (0 != remaining && !m_parser.IsCompleted())
+            {
+                const uint8_t *piece = NULL;
+                uint32_t pieceLen = 0;
+
+                if (!m_parser.ParseBody(current, remaining, piece, pieceLen))
+                {
+                    OnClose(new NetException(EPROTO));
+                    return;
+                }
+
+                if (0 != pieceLen && !OnReadData(piece, pieceLen))
+                    return;
+            }
+
+            if (m_parser.IsCompleted())
+            {
+                m_hasExtraData = 0 != remaining;
+                m_extraData = current;
+                m_extraLength = remaining;
+
+                //!	finished
+                OnClose(NULL);
+            }
+            else
+            {
+                //! read next piece
+                OnReceiveResponse();
+            }
+        }
+
+        bool NativeHttpHandler::OnReadHeader(char *rawHeaders, uint32_t statusCode, int64_t contentLength)
+        {
+            HttpResponseHeaders headers(rawHeaders, static_cast<StatusCode::Value>(statusCode), contentLength);
+            m_headers = headers;
+
+            //! check if redirect
+            if (m_headers.GetStatusCode() == StatusCode::Moved_Permanently ||
+                m_headers.GetStatusCode() == StatusCode::Found ||
+                m_headers.GetStatusCode() == StatusCode::See_Other ||
+                m_headers.GetStatusCode() == StatusCode::Use_Proxy ||
+                m_headers.GetStatusCode() == StatusCode::Temporary_Redirect)
+            {
+                String redirectURL;
+                StringConvertor::ToString(m_headers.GetHead(HeaderName::Location), redirectURL);
+                m_redirectDelegate->SetLocation(redirectURL);
+                m_completionAsyncHandler = m_redirectDelegate;
+            }
+
+            try
+            {
+                m_completionAsyncHandler->OnHeaderAvailable(m_headers);
+            }
+            catch (const Exception& ex)
+            {
+                OnClose(ex.Clone());
+                return false;
+            }
+
+            return true;
+        }
+
+        bool NativeHttpHandler::OnReadData(const uint8_t *data, uint32_t len)
+        {
+            PieceStream stream(data, len, m_headers.GetContentLength());
+
+            try
+            {
+                //! till drained or the handler stops reading
+                while (stream.GetAvailCount() != 0)
+                {
+                    int64_t before = stream.GetAvailCount();
+                    m_completionAsyncHandler->OnBodyAvailable(stream);
+
+                    if (stream.GetAvailCount() == before)
+                        break;
+                }
+            }
+            catch (const Exception& ex)
+            {
+                OnClose(ex.Clone());
+                return false;
+            }
+
+            return true;
+        }
+
+        void NativeHttpHandler::OnClose(Exception *exception)
+        {
+            //! if has set(value equals 1)
+            if (CompareExchange(&m_isClosed, 1, 0) == 1)
+            {
+                //! free the exception
+                delete exception;
+                return;
+            }
+
+            //! only the response framed completely leaves the connection reusable
+            bool isReusable = NULL == exception && m_parser.IsCompleted() && m_parser.IsKeepAlive();
+
+            //! return the connection before the results, so that the redirect may reuse it
+            NativeHttpHandler *resumed = NULL;
+            NativeHttpHandler *successor = NULL;
+            NativeHttpHandlers replayed;
+            NativeHttpHandlers resumedStreams;
+            {
+                AutoLock<CriticalSection> locker(&m_shard->lock);
+
+                if (m_isMultiplexed)
+                {
+                    //! NULL when failed to connect or aborted by the connection
+                    if (NULL != m_http2)
+                    {
+                        m_http2->Detach(m_streamId);
+                        m_shard->pool->ReleaseStream(m_origin, m_http2, resumedStreams);
+                        m_http2 = NULL;
+                    }
+                }
+                else
+                {
+                    //! unsolicited, unless it's the response of the next pipelined one
+                    if (m_hasExtraData && m_connection->m_pipeline.empty())
+                        isReusable = false;
+
+                    resumed = m_shard->pool->Release(m_connection, isReusable, successor, replayed);
+                    m_connection = NULL;
+                }
+            }
+
+            if (NULL != resumed)
+                resumed->OnAttached();
+
+            NativeHttpHandlers::iterator resumedStream = resumedStreams.begin();
+            for (; resumedStream != resumedStreams.end(); ++resumedStream)
+            {
+                (*resumedStream)->OnAttached();
+            }
+
+            NativeHttpHandlers::iterator it = replayed.begin();
+            for (; it != replayed.end(); ++it)
+            {
+                (*it)->OnReplaying();
+            }
+
+            //! send results
+            if (NULL != exception)
+            {
+                m_completionAsyncHandler->OnError(exception);
+            }
+            else
+            {
+                //! check if redirect
+                if (m_completionAsyncHandler == m_redirectDelegate && m_redirectDelegate->PerformRedirecting())
+                {
+                    m_sessionImpl->SendRedirect(m_request, m_url, m_normalAsyncHandler, m_redirectDelegate, m_headers);
+                }
+                else
+                {
+                    m_completionAsyncHandler->OnCompleted();
+                }
+            }
+
+            //! clean the scoped variables
+            m_request = NULL;
+            m_completionAsyncHandler = NULL;
+
+            //! after the results, so that the responses are delivered in the order of the requests
+            if (NULL != successor)
+                successor->OnPipelineTurn(m_extraData, m_extraLength);
+
+            OnFinished();
+        }
+
+        //! only when terminated, the finished ones have detached
+        void NativeHttpHandler::OnClosed()
+        {
+            NativeHttpHandler *resumed = NULL;
+            {
+                AutoLock<CriticalSection> locker(&m_shard->lock);
+
+                resumed = m_shard->pool->OnClosed(m_connection);
+                m_connection = NULL;
+            }
+
+            if (NULL != resumed)
+                resumed->OnAttached();
+
+            OnFinished();
+        }
+
+        void NativeHttpHandler::OnStreamHeaders(const HeaderFields& fields, bool isEnd)
+        {
+            if (m_isClosed)
+                return;
+
+            m_isResponding = true;
+
+            //! RAW_HEADERS format as WinHttp, the names in title case as the HTTP/1.1 ones usually are
+            std::string head("HTTP/2 ");
+            head.append(fields.front().value).push_back('\0');
+
+            int64_t contentLength = 0;
+
+            HeaderFields::const_iterator it = fields.begin() + 1;
+            for (; it != fields.end(); ++it)
+            {
+                //! no more pseudo headers after the regular ones
+                if (it->name.empty() || ':' == it->name[0])
+                    continue;
+
+                HeaderName::Value known = FindHeaderName(it->name.data(), it->name.size(), HashHeaderName(it->name.data(), it->name.size()));
+                if (HeaderName::Unknown != known)
+                {
+                    //! the canonical case of the well-known ones, "ETag"
+                    head.append(KnownHeaders[known].name, KnownHeaders[known].length);
+                }
+                else
+                {
+                    std::string::size_type nameStart = head.size();
+                    head.append(it->name);
+
+                    bool isWordStart = true;
+                    for (std::string::size_type i = nameStart; i != head.size(); ++i)
+                    {
+                        if (isWordStart)
+                            head[i] = static_cast<char>(std::toupper(static_cast<unsigned char>(head[i])));
+
+                        isWordStart = '-' == head[i];
+                    }
+                }
+                head.append(": ").append(it->value).push_back('\0');
+
+                if (HeaderName::Content_Length == known)
+                {
+                    char *end = NULL;
+                    long long value = std::strtoll(it->value.c_str(), &end, 10);
+                    if (it->value.empty() || '\0' != *end || value < 0)
+                    {
+                        OnClose(new NetException(EPROTO));
+                        return;
+                    }
+
+                    contentLength = value;
+                }
+            }
+
+            //! kept in UTF 8 as received
+            char *rawHeaders = new char[head.size() + 1];
+            ::memcpy(rawHeaders, head.data(), head.size());
+            rawHeaders[head.size()] = '\0';
+
+            uint32_t statusCode = static_cast<uint32_t>(std::strtoul(fields.front().value.c_str(), NULL, 10));
+
+            if (!OnReadHeader(rawHeaders, statusCode, contentLength))
+                return;
+
+            if (isEnd)
+                OnClose(NULL);
+        }
+
+        void NativeHttpHandler::OnStreamData(const uint8_t *data, uint32_t len, bool isEnd)
+        {
+            if (m_isClosed)
+                return;
+
+            if (0 != len && !OnReadData(data, len))
+                return;
+
+            if (isEnd)
+                OnClose(NULL);
+        }
+
+        bool NativeHttpHandler::OnStreamBody(uint8_t *buffer, uint32_t& len, bool& isEnd)
+        {
+            //! terminated, the connection is closing
+            if (m_isClosed)
+            {
+                len = 0;
+                isEnd = true;
+
+                return true;
+            }
+
+            //! the body can't be replayed from now on
+            m_isBodyTouched = true;
+
+            try
+            {
+                len = m_bodyStream->Read(buffer, len);
+                isEnd = 0 == len || 0 == m_bodyStream->GetAvailCount();
+            }
+            catch (const Exception& ex)
+            {
+                OnClose(ex.Clone());
+                return false;
+            }
+
+            return true;
+        }
+
+        void NativeHttpHandler::OnStreamAborted(AbortReason reason, int err)
+        {
+            NativeHttpHandlers resumed;
+            {
+                AutoLock<CriticalSection> locker(&m_shard->lock);
+
+                m_shard->pool->ReleaseStream(m_origin, m_http2, resumed);
+                m_http2 = NULL;
+            }
+
+            NativeHttpHandlers::iterator it = resumed.begin();
+            for (; it != resumed.end(); ++it)
+            {
+                (*it)->OnAttached();
+            }
+
+            //! terminated
+            if (m_isClosed)
+            {
+                OnFinished();
+                return;
+            }
+
+            if (ConnectFailed == reason)
+            {
+                //! resolve again next time
+                m_sessionImpl->GetEndpointCache()->Forget(m_origin);
+                OnClose(new ConnectionFailedException());
+            }
+            else if (Refused == reason && !m_isResponding && !m_isBodyTouched && m_replayCount < MaxStreamReplays)
+            {
+                //! not processed by the server, replay on another connection
+                ++m_replayCount;
+                OnAcquiring();
+            }
+            else
+            {
+                OnClose(new NetException(err));
+            }
+        }
+
+        void NativeHttpHandler::OnPipelineTurn(const uint8_t *data, uint32_t len)
+        {
+            //! terminated, the closing of the connection follows
+            if (m_isClosed)
+                return;
+
+            //! written before the previous response completed
+            m_isHeadSent = true;
+
+            if (0 != len)
+                OnReceived(data, len, 0);
+            else
+                OnReceiveResponse();
+        }
+
+        void NativeHttpHandler::OnReplaying()
+        {
+            //! on a connection of its own, in case the server keeps closing the pipelines
+            m_isPipelinable = false;
+            m_isHeadSent = false;
+            m_endpointIndex = 0;
+
+            OnAcquiring();
+        }
+
+        void NativeHttpHandler::OnPipelineClosed()
+        {
+            {
+                AutoLock<CriticalSection> locker(&m_shard->lock);
+                m_connection = NULL;
+            }
+
+            OnFinished();
+        }
+
+        void NativeHttpHandler::OnFinished()
+        {
+            //! safe quit will clean request value
+            if (m_completionAsyncHandler)
+                OnTerminated();
+
+            //! remove from handlers manager
+            m_sessionImpl->OnHandleFinished(this);
+
+            delete this;
+        }
+
+        void NativeHttpHandler::OnTerminated()
+        {
+            m_completionAsyncHandler->OnError(new ConnectionTerminatedException);
+
+            //! clean the scoped variables
+            m_request = NULL;
+            m_completionAsyncHandler = NULL;
+        }
+
+        PooledConnection *ConnectionPool::Acquire(const std::string& origin, NativeHttpHandler *handler)
+        {
+            Evict();
+
+            Origin& each = m_origins[origin];
+
+            while (!each.idle.empty())
+            {
+                PooledConnection *connection = each.idle.front();
+                each.idle.pop_front();
+
+                if (m_engine->IsAlive(connection->m_channel))
+                {
+                    Lend(each, connection, handler, true);
+                    return connection;
+                }
+
+                //! closed by peer while idle
+                Discard(each, connection);
+            }
+
+            if (handler->IsPipelinable())
+            {
+                PooledConnection *connection = Join(each, handler);
+                if (NULL != connection)
+                    return connection;
+            }
+
+            if (0 != m_maxTotal && each.total >= m_maxTotal)
+            {
+                each.waiters.push_back(handler);
+                return NULL;
+            }
+
+            ++each.total;
+
+            PooledConnection *connection = new PooledConnection(m_engine, m_socketOptions, origin, handler);
+            Lend(each, connection, handler, false);
+
+            return connection;
+        }
+
+        NativeHttpHandler *ConnectionPool::Release(PooledConnection *connection, bool isReusable, NativeHttpHandler *&successor, NativeHttpHandlers& replayed)
+        {
+            Evict();
+
+            connection->m_owner = NULL;
+
+            Origin& each = m_origins[connection->m_origin];
+
+            isReusable = isReusable && !connection->m_isBroken && !connection->m_isClosing;
+
+            //! the next response may have arrived already, the health check doesn't apply
+            if (isReusable && !connection->m_pipeline.empty())
+            {
+                successor = connection->m_pipeline.front();
+                connection->m_pipeline.pop_front();
+
+                connection->m_owner = successor;
+                return NULL;
+            }
+
+            Unpipeline(each, connection, replayed);
+
+            if (isReusable && m_engine->IsAlive(connection->m_channel))
+            {
+                //! handed over to the earliest parked one directly
+                if (!each.waiters.empty())
+                {
+                    NativeHttpHandler *handler = each.waiters.front();
+                    each.waiters.pop_front();
+
+                    Lend(each, connection, handler, true);
+                    return handler;
+                }
+
+                if (each.idle.size() < m_maxIdle)
+                {
+                    connection->m_idleSince = NowInMilliseconds();
+                    each.idle.push_front(connection);
+
+                    return NULL;
+                }
+            }
+
+            Discard(each, connection);
+            return Resume(each, connection->m_origin);
+        }
+
+        NativeHttpHandler *ConnectionPool::OnClosed(PooledConnection *connection)
+        {
+            Origin& each = m_origins[connection->m_origin];
+            --each.total;
+
+            //! the pipelined ones are left to the connection, they are all terminated
+            each.pipelining.remove(connection);
+
+            return Resume(each, connection->m_origin);
+        }
+
+        PooledConnection *ConnectionPool::Renew(PooledConnection *connection, NativeHttpHandler *handler, NativeHttpHandlers& replayed)
+        {
+            Origin& each = m_origins[connection->m_origin];
+
+            Unpipeline(each, connection, replayed);
+
+            //! the total stays the same
+            connection->m_owner = NULL;
+            connection->Close();
+
+            PooledConnection *renewed = new PooledConnection(m_engine, m_socketOptions, connection->m_origin, handler);
+            Lend(each, renewed, handler, false);
+
+            return renewed;
+        }
+
+        Http2Connection *ConnectionPool::AcquireStream(const std::string& origin, NativeHttpHandler *handler)
+        {
+            Evict();
+
+            Origin& each = m_origins[origin];
+
+            Http2Connection *connection = Multiplex(each, origin, handler);
+            if (NULL == connection)
+                each.waiters.push_back(handler);
+
+            return connection;
+        }
+
+        void ConnectionPool::ReleaseStream(const std::string& origin, Http2Connection *connection, NativeHttpHandlers& resumed)
+        {
+            Evict();
+
+            Origin& each = m_origins[origin];
+
+            //! may have been discarded by Clear already
+            Http2Connections::iterator found = std::find(each.multiplexed.begin(), each.multiplexed.end(), connection);
+            if (found != each.multiplexed.end() && !connection->IsClosed() && connection->IsIdle())
+            {
+                //! keep-alive disabled, or going away
+                if (0 == m_maxIdle || !connection->IsAccepting())
+                {
+                    each.multiplexed.erase(found);
+                    Discard(each, connection);
+                }
+            }
+
+            while (!each.waiters.empty())
+            {
+                NativeHttpHandler *handler = each.waiters.front();
+                if (NULL == Multiplex(each, origin, handler))
+                    break;
+
+                each.waiters.pop_front();
+                resumed.push_back(handler);
+            }
+        }
+
+        bool ConnectionPool::Cancel(NativeHttpHandler *handler)
+        {
+            Origins::iterator found = m_origins.find(handler->GetOrigin());
+            if (found == m_origins.end())
+                return false;
+
+            NativeHttpHandlers& waiters = found->second.waiters;
+
+            NativeHttpHandlers::iterator waiter = std::find(waiters.begin(), waiters.end(), handler);
+            if (waiter == waiters.end())
+                return false;
+
+            waiters.erase(waiter);
+            return true;
+        }
+
+        void ConnectionPool::Clear()
+        {
+            Origins::iterator it = m_origins.begin();
+            for (; it != m_origins.end(); ++it)
+            {
+                while (!it->second.idle.empty())
+                {
+                    PooledConnection *connection = it->second.idle.front();
+                    it->second.idle.pop_front();
+
+                    Discard(it->second, connection);
+                }
+
+                //! the idle ones can't be told apart outside the engine thread, the busy ones are terminating anyway
+                while (!it->second.multiplexed.empty())
+                {
+                    Http2Connection *connection = it->second.multiplexed.front();
+                    it->second.multiplexed.pop_front();
+
+                    Discard(it->second, connection);
+                }
+            }
+        }
+
+        void ConnectionPool::Discard(Origin& origin, PooledConnection *connection)
+        {
+            --origin.total;
+
+            connection->Close();
+        }
+
+        void ConnectionPool::Discard(Origin& origin, Http2Connection *connection)
+        {
+            --origin.total;
+
+            connection->Close();
+            connection->Release();
+        }
+
+        NativeHttpHandler *ConnectionPool::Resume(Origin& origin, const std::string& key)
+        {
+            if (origin.waiters.empty() || (0 != m_maxTotal && origin.total >= m_maxTotal))
+                return NULL;
+
+            NativeHttpHandler *handler = origin.waiters.front();
+            origin.waiters.pop_front();
+
+            ++origin.total;
+            Lend(origin, new PooledConnection(m_engine, m_socketOptions, key, handler), handler, false);
+
+            return handler;
+        }
+
+        void ConnectionPool::Lend(Origin& origin, PooledConnection *connection, NativeHttpHandler *handler, bool isReused)
+        {
+            connection->m_owner = handler;
+            connection->m_isOpen = false;
+            handler->Attach(connection, isReused);
+
+            //! the others may queue behind
+            if (handler->IsPipelinable() && m_pipeliningDepth > 1)
+                origin.pipelining.push_back(connection);
+        }
+
+        PooledConnection *ConnectionPool::Join(Origin& origin, NativeHttpHandler *handler)
+        {
+            PooledConnection *shortest = NULL;
+
+            PooledConnections::iterator it = origin.pipelining.begin();
+            for (; it != origin.pipelining.end(); ++it)
+            {
+                PooledConnection *each = *it;
+
+                //! the owner counts
+                if (each->m_isBroken || each->m_pipeline.size() + 1 >= m_pipeliningDepth)
+                    continue;
+
+                if (NULL == shortest || each->m_pipeline.size() < shortest->m_pipeline.size())
+                    shortest = each;
+            }
+
+            if (NULL == shortest)
+                return NULL;
+
+            shortest->m_pipeline.push_back(handler);
+            handler->Attach(shortest, true);
+
+            return shortest;
+        }
+
+        Http2Connection *ConnectionPool::Multiplex(Origin& origin, const std::string& key, NativeHttpHandler *handler)
+        {
+            Reap(origin);
+
+            //! the earliest ones first, so that the later ones idle out
+            Http2Connections::iterator it = origin.multiplexed.begin();
+            for (; it != origin.multiplexed.end(); ++it)
+            {
+                if ((*it)->IsAccepting())
+                {
+                    handler->AttachStream(*it);
+                    return *it;
+                }
+            }
+
+            if (0 != m_maxTotal && origin.total >= m_maxTotal)
+                return NULL;
+
+            ++origin.total;
+
+            Http2Connection *connection = new Http2Connection(m_engine, m_socketOptions, key, handler->GetEndpoints());
+            origin.multiplexed.push_back(connection);
+            connection->Connect();
+
+            handler->AttachStream(connection);
+            return connection;
+        }
+
+        void ConnectionPool::Reap(Origin& origin)
+        {
+            Http2Connections::iterator it = origin.multiplexed.begin();
+            while (it != origin.multiplexed.end())
+            {
+                if ((*it)->IsClosed())
+                {
+                    --origin.total;
+
+                    (*it)->Release();
+                    it = origin.multiplexed.erase(it);
+                }
+                else
+                {
+                    ++it;
+                }
+            }
+        }
+
+        void ConnectionPool::Unpipeline(Origin& origin, PooledConnection *connection, NativeHttpHandlers& replayed)
+        {
+            origin.pipelining.remove(connection);
+
+            NativeHttpHandlers::iterator it = connection->m_pipeline.begin();
+            for (; it != connection->m_pipeline.end(); ++it)
+            {
+                (*it)->Attach(NULL, false);
+            }
+
+            replayed.splice(replayed.end(), connection->m_pipeline);
+        }
+
+        void ConnectionPool::Evict()
+        {
+            uint64_t now = NowInMilliseconds();
+
+            Origins::iterator it = m_origins.begin();
+            while (it != m_origins.end())
+            {
+                //! the back has been idle for the longest
+                PooledConnections& idle = it->second.idle;
+                while (!idle.empty() && idle.back()->m_idleSince + m_idleTimeout <= now)
+                {
+                    PooledConnection *connection = idle.back();
+                    idle.pop_back();
+
+                    Discard(it->second, connection);
+                }
+
+                Reap(it->second);
+
+                Http2Connections& multiplexed = it->second.multiplexed;
+                Http2Connections::iterator connection = multiplexed.begin();
+                while (connection != multiplexed.end())
+                {
+                    if ((*connection)->IsIdle() && (*connection)->GetIdleSince() + m_idleTimeout <= now)
+                    {
+                        Discard(it->second, *connection);
+                        connection = multiplexed.erase(connection);
+                    }
+                    else
+                    {
+                        ++connection;
+                    }
+                }
+
+                //! forget the origins no longer used
+                if (0 == it->second.total && it->second.waiters.empty() && it->second.pipelining.empty() && multiplexed.empty())
+                    m_origins.erase(it++);
+                else
+                    ++it;
+            }
+        }
+    }
+
+    NativeHttpSessionPrivate::NativeHttpSessionPrivate(const HttpSessionConfig& config)
+        : m_ownedEngine(config.IsAsync ? NULL : Details::CreateIoEngine(config.EngineType))
+        , m_shards(NULL)
+        , m_shardCount(Details::ShardCount)
+        , m_handlerCount(0)
+        , m_disconnectedEvent(true)    //! signaled
+        , m_config(config)
+        , m_endpointCache(new Details::EndpointCache(config.DnsCacheTimeout))
+        , m_urlCache()
+    {
+        uint32_t reactorCount = 0 == config.ReactorCount ? Details::OnlineCoreCount() : config.ReactorCount;
+        reactorCount = std::min<uint32_t>(reactorCount, Details::MaxPinnedIoEngines);
+
+        if (m_shardCount < reactorCount)
+            m_shardCount = reactorCount;
+
+        m_shards = new Details::SessionShard[m_shardCount];
+        for (uint32_t i = 0; i != m_shardCount; ++i)
+        {
+            Details::SessionShard& shard = m_shards[i];
+
+            if (NULL != m_ownedEngine)
+                shard.engine = m_ownedEngine;
+            else if (1 == reactorCount)
+                shard.engine = Details::AcquireSharedIoEngine(config.EngineType);
+            else
+                shard.engine = Details::AcquirePinnedIoEngine(config.EngineType, i % reactorCount);
+
+            shard.pool = new Details::ConnectionPool(shard.engine, config);
+        }
+    }
+
+    NativeHttpSessionPrivate::~NativeHttpSessionPrivate()
+    {
+        Disconnect();
+
+        for (uint32_t i = 0; i != m_shardCount; ++i)
+            delete m_shards[i].pool;
+
+        delete[] m_shards;
+        delete m_endpointCache;
+
+        delete m_ownedEngine;
+    }
+
+    void NativeHttpSessionPrivate::SendRequest(const HttpRequest *req, AsyncCompletionGenericDelegate *delegate)
+    {
+        StartRequest(req->GetURLBytes(), req->GetVerb(), req->GetRequestBodyStream(), req, req->GetPrepared().GetData(), delegate
+            , RedirectCompletionGenericDelegate::GetDefaultDelegate());
+
+        if (NULL != m_ownedEngine)
+            RunUntilFinished();
+    }
+
+    void NativeHttpSessionPrivate::StartRequest(const std::string& url, HttpVerb verb, InputStream *bodyStream, const HttpRequest *req
+        , const PreparedRequest::PrivateData *prepared, AsyncCompletionGenericDelegate *delegate, RedirectCompletionGenericDelegate *redirectDelegate)
+    {
+        Details::CrackedURL cracked;
+        if (NULL != prepared && url.data() == req->GetURLBytes().data())
+        {
+            //! cracked once prepared, the url of the request differs in the path only, unless redirected
+            cracked.prefix = prepared->prefix;
+            cracked.path = url.c_str() + prepared->parts.prefixLength;
+            cracked.pathLength = static_cast<uint32_t>(url.size() - prepared->parts.prefixLength);
+        }
+        else
+        {
+            Details::UrlParts parts;
+            m_urlCache.Crack(url.c_str(), url.size(), cracked.prefix, parts);
+
+            cracked.path = url.c_str() + parts.path.offset;
+            cracked.pathLength = parts.path.length;
+        }
+
+        if (cracked.prefix->isHttps)
+            throw UnsupportedProtocolException();
+
+        const std::string& origin = cracked.prefix->origin;
+
+        Details::Endpoints endpoints;
+        m_endpointCache->Resolve(origin, cracked, endpoints);
+
+        bool isMultiplexed = 0 != (m_config.EnabledProtocols & HttpSessionConfig::Http2Protocol);
+
+        std::string requestHead;
+        Details::HeaderFields requestFields;
+        if (isMultiplexed)
+            Details::BuildRequestFields(cracked, verb, bodyStream, req, prepared, requestFields);
+        else
+            Details::BuildRequestHead(cracked, verb, bodyStream, req, prepared, 0 != m_config.MaxIdleConnectionsPerHost, requestHead);
+
+        //! replaying is safe for the idempotent ones only
+        bool isPipelinable = !isMultiplexed && m_config.PipeliningDepth > 1 && 0 != m_config.MaxIdleConnectionsPerHost && Get == verb && NULL == bodyStream;
+
+        Details::SessionShard *shard = ShardOf(cracked.prefix->originHash);
+        Details::NativeHttpHandler *handler = new Details::NativeHttpHandler(url, origin, endpoints, requestHead, requestFields, bodyStream, req, delegate, redirectDelegate, this, shard
+            , isPipelinable, isMultiplexed);
+
+        //! under the lock, so that termination always follows
+        AutoLock<CriticalSection> locker(&shard->lock);
+        shard->handlers.PushBack(handler);
+        ::Increment(&m_handlerCount);
+
+        handler->OnSendingRequest();
+    }
+
+    void NativeHttpSessionPrivate::RunUntilFinished()
+    {
+        //! a pool worker hands its items over meanwhile
+        _WorkStealingExecutor::EnterBlocking();
+
+        //! only the calling thread drives the owned engine
+        while (0 != m_handlerCount)
+        {
+            m_ownedEngine->RunOnce(INFINITE);
+        }
+
+        _WorkStealingExecutor::LeaveBlocking();
+    }
+
+    Details::SessionShard *NativeHttpSessionPrivate::ShardOf(uint32_t originHash)
+    {
+        return &m_shards[originHash % m_shardCount];
+    }
+
+    void NativeHttpSessionPrivate::Disconnect()
+    {
+        //! reset the event
+        m_disconnectedEvent.Reset();
+
+        for (uint32_t i = 0; i != m_shardCount; ++i)
+        {
+            Details::SessionShard& shard = m_shards[i];
+            AutoLock<CriticalSection> locker(&shard.lock);
+
+            Details::NativeHttpHandler *handler = shard.handlers.GetFirst();
+            while (NULL != handler)
+            {
+                Details::NativeHttpHandler *next = shard.handlers.GetNext(handler);
+                handler->Terminate();
+
+                handler = next;
+            }
+
+            shard.pool->Clear();
+        }
+
+        //! no more handlers
+        //! just signal the event
+        if (0 == m_handlerCount)
+            m_disconnectedEvent.Signal();
+
+        if (NULL != m_ownedEngine)
+            RunUntilFinished();
+
+        //! wait till finished
+        m_disconnectedEvent.Wait(INFINITE);
+
+        //! the last handler may be still leaving OnHandleFinished, the session may be deleted right after
+        for (uint32_t i = 0; i != m_shardCount; ++i)
+        {
+            AutoLock<CriticalSection> locker(&m_shards[i].lock);
+        }
+    }
+
+    void NativeHttpSessionPrivate::OnHandleFinished(Details::NativeHttpHandler *handler)
+    {
+        Details::SessionShard *shard = handler->GetShard();
+
+        //! signaled under the lock, Disconnect takes the lock before returning
+        AutoLock<CriticalSection> locker(&shard->lock);
+
+        shard->handlers.Erase(handler);
+
+        if (0 == ::Decrement(&m_handlerCount))
+            m_disconnectedEvent.Signal();
+    }
+
+    namespace Details
+    {
+        class RedirectCallable : public Callable
+        {
+        private:
+            NativeHttpSessionPrivate *m_session;
+            const HttpRequest *m_req;
+            std::string m_location;
+            bool m_reissuingRequest;
+            AsyncCompletionGenericDelegate *m_delegate;
+            RedirectCompletionGenericDelegate *m_redirectDelegate;
+
+        public:
+            RedirectCallable(NativeHttpSessionPrivate *session, const HttpRequest *req, const std::string& location, bool reissuingRequest
+                , AsyncCompletionGenericDelegate *delegate, RedirectCompletionGenericDelegate *redirectDelegate)
+                : m_session(session)
+                , m_req(req)
+                , m_location(location)
+                , m_reissuingRequest(reissuingRequest)
+                , m_delegate(delegate)
+                , m_redirectDelegate(redirectDelegate)
+            {}
+
+        public:
+            virtual void Invoke()
+            {
+                m_session->StartRedirect(m_req, m_location, m_reissuingRequest, m_delegate, m_redirectDelegate);
+            }
+        };
+    }
+
+    void NativeHttpSessionPrivate::SendRedirect(const HttpRequest *req,
+        const std::string& currentURL,
+        AsyncCompletionGenericDelegate *delegate,
+        RedirectCompletionGenericDelegate *redirectDelegate,
+        const HttpResponseHeaders& headers)
+    {
+        //! terminating
+        if (!m_disconnectedEvent.IsSignaled())
+        {
+            delegate->OnError(new ConnectionTerminatedException);
+            return;
+        }
+
+        const std::string& location = Details::ResolveLocation(currentURL, headers.GetHead(HeaderName::Location));
+
+        bool reissuingRequest = headers.GetStatusCode() == StatusCode::See_Other;
+
+        ::Increment(&m_handlerCount);
+
+        //! the calling thread drives the owned engine, nothing else waits on it
+        if (NULL != m_ownedEngine)
+            StartRedirect(req, location, reissuingRequest, delegate, redirectDelegate);
+        else
+            Dispatcher::PostCallable(new Details::RedirectCallable(this, req, location, reissuingRequest, delegate, redirectDelegate), ThreadContext::FromThreadPool());
+    }
+
+    void NativeHttpSessionPrivate::StartRedirect(const HttpRequest *req, const std::string& location, bool reissuingRequest
+        , AsyncCompletionGenericDelegate *delegate, RedirectCompletionGenericDelegate *redirectDelegate)
+    {
+        //! terminated meanwhile
+        if (!m_disconnectedEvent.IsSignaled())
+        {
+            delegate->OnError(new ConnectionTerminatedException);
+        }
+        else
+        {
+            try
+            {
+                //! the redirect request will remain valid till the end
+                //! however, the url and verb still be the first time's
+                StartRequest(location
+                    , reissuingRequest ? Get : req->GetVerb()
+                    , reissuingRequest ? NULL : req->GetRequestBodyStream()
+                    , req
+                    , req->GetPrepared().GetData()
+                    , delegate
+                    , redirectDelegate);
+            }
+            catch (const Exception& ex)
+            {
+                delegate->OnError(ex.Clone());
+            }
+        }
+
+        //! same as a finished handler, Disconnect takes the lock before returning
+        AutoLock<CriticalSection> locker(&m_shards[0].lock);
+
+        if (0 == ::Decrement(&m_handlerCount))
+            m_disconnectedEvent.Signal();
+    }
+
+    namespace Details
+    {
+        HttpSession::Private *CreateSessionPrivate(const HttpSessionConfig& config)
+        {
+            //! no QUIC here, rather than falling back to TCP silently
+            if (0 != (config.EnabledProtocols & HttpSessionConfig::Http3Protocol))
+                throw UnsupportedProtocolException();
+
+            return new NativeHttpSessionPrivate(config);
+        }
+    }
+}
+
+#endif
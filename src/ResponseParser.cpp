@@ -0,0 +1,452 @@
+#include "ResponseParser.h"
+
+#if !defined(_WIN32)
+
+#include "HttpClientModule.h"
+#include "HeaderNames.h"
+
+#include <cstring>
+#include <cctype>
+#include <algorithm>
+
+#if defined(__SSE2__)
+#  include <immintrin.h>
+#endif
+
+namespace Net
+{
+    namespace Details
+    {
+        static bool _EqualsIgnoreCase(const char *l, std::string::size_type length, const char *r)
+        {
+            std::string::size_type i = 0;
+            for (; i != length && '\0' != r[i]; ++i)
+            {
+                if (std::tolower(static_cast<unsigned char>(l[i])) != r[i])
+                    return false;
+            }
+
+            return i == length && '\0' == r[i];
+        }
+
+        //! token shall be in lower case
+        static bool _ContainsIgnoreCase(const char *s, std::string::size_type length, const char *token)
+        {
+            std::string::size_type tokenLength = std::strlen(token);
+
+            for (std::string::size_type i = 0; i + tokenLength <= length; ++i)
+            {
+                if (_EqualsIgnoreCase(s + i, tokenLength, token))
+                    return true;
+            }
+
+            return false;
+        }
+
+        //! one past the first CRLFCRLF, NULL when not found
+        static const uint8_t *_FindBlankLine(const uint8_t *data, uint32_t len)
+        {
+            const uint8_t *p = data;
+            const uint8_t *end = data + len;
+
+            //! each lane tells whether the 4 bytes starting there are CRLFCRLF
+#if defined(__AVX2__)
+            const __m256i cr32 = _mm256_set1_epi8('\r');
+            const __m256i lf32 = _mm256_set1_epi8('\n');
+            for (; end - p >= 32 + 3; p += 32)
+            {
+                __m256i crlf = _mm256_and_si256(
+                    _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(p)), cr32),
+                    _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + 1)), lf32));
+                __m256i nextCrlf = _mm256_and_si256(
+                    _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + 2)), cr32),
+                    _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + 3)), lf32));
+
+                uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_and_si256(crlf, nextCrlf)));
+                if (0 != mask)
+                    return p + __builtin_ctz(mask) + 4;
+            }
+#endif
+
+#if defined(__SSE2__)
+            const __m128i cr16 = _mm_set1_epi8('\r');
+            const __m128i lf16 = _mm_set1_epi8('\n');
+            for (; end - p >= 16 + 3; p += 16)
+            {
+                __m128i crlf = _mm_and_si128(
+                    _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p)), cr16),
+                    _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 1)), lf16));
+                __m128i nextCrlf = _mm_and_si128(
+                    _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 2)), cr16),
+                    _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 3)), lf16));
+
+                uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(_mm_and_si128(crlf, nextCrlf)));
+                if (0 != mask)
+                    return p + __builtin_ctz(mask) + 4;
+            }
+#endif
+
+            for (; end - p >= 4; ++p)
+            {
+                if ('\r' == p[0] && '\n' == p[1] && '\r' == p[2] && '\n' == p[3])
+                    return p + 4;
+            }
+
+            return NULL;
+        }
+
+        //! the blank line beginning in the last 3 bytes of the previous reads
+        static const uint8_t *_FindBlankLineAcross(const std::string& before, const uint8_t *data, uint32_t len)
+        {
+            uint32_t tailLength = static_cast<uint32_t>((std::min)(before.size(), static_cast<std::string::size_type>(3)));
+            uint32_t headLength = (std::min)(len, 3u);
+
+            uint8_t window[6] = { 0 };
+            ::memcpy(window, before.data() + before.size() - tailLength, tailLength);
+            ::memcpy(window + tailLength, data, headLength);
+
+            for (uint32_t i = 0; i != tailLength && i + 4 <= tailLength + headLength; ++i)
+            {
+                if (0 == ::memcmp(window + i, "\r\n\r\n", 4))
+                    return data + (i + 4 - tailLength);
+            }
+
+            return NULL;
+        }
+
+        ResponseParser::ResponseParser()
+            : m_state(HeadState)
+            , m_head()
+            , m_line()
+            , m_remaining(0)
+            , m_statusCode(0)
+            , m_contentLength(0)
+            , m_isKeepAlive(false)
+            , m_rawHeaders(NULL)
+        {}
+
+        ResponseParser::~ResponseParser()
+        {
+            if (m_rawHeaders)
+                delete[] m_rawHeaders;
+        }
+
+        ResponseParser::Result ResponseParser::ParseHead(const uint8_t *&data, uint32_t& len)
+        {
+            while (0 != len)
+            {
+                std::string::size_type before = m_head.size();
+
+                const uint8_t *end = 0 == before ? NULL : _FindBlankLineAcross(m_head, data, len);
+                if (NULL == end)
+                    end = _FindBlankLine(data, len);
+
+                if (NULL == end)
+                {
+                    if (before + len > MaxHeadLength)
+                        return Malformed;
+
+                    m_head.append(reinterpret_cast<const char *>(data), len);
+                    data += len;
+                    len = 0;
+
+                    return NeedMore;
+                }
+
+                uint32_t consumed = static_cast<uint32_t>(end - data);
+                if (before + consumed > MaxHeadLength)
+                    return Malformed;
+
+                //! in place unless split across the reads
+                const char *head = reinterpret_cast<const char *>(data);
+                if (0 != before)
+                {
+                    m_head.append(head, consumed);
+                    head = m_head.data();
+                }
+
+                data += consumed;
+                len -= consumed;
+
+                //! keep the line break of the last line
+                bool isParsed = ParseHeadLines(head, before + consumed - 2);
+                m_head.clear();
+
+                if (!isParsed)
+                    return Malformed;
+
+                //! interim response, the final one follows
+                if (m_statusCode >= 100 && m_statusCode < 200)
+                    continue;
+
+                return Completed;
+            }
+
+            return NeedMore;
+        }
+
+        bool ResponseParser::ParseHeadLines(const char *head, std::string::size_type length)
+        {
+            //! status line
+            if (length < 5 || 0 != ::memcmp(head, "HTTP/", 5))
+                return false;
+
+            const char *space = static_cast<const char *>(::memchr(head, ' ', length));
+            if (NULL == space || static_cast<std::string::size_type>(space - head) + 4 > length)
+                return false;
+
+            m_statusCode = 0;
+            for (const char *digit = space + 1; digit != space + 4; ++digit)
+            {
+                if (!std::isdigit(static_cast<unsigned char>(*digit)))
+                    return false;
+
+                m_statusCode = m_statusCode * 10 + (*digit - '0');
+            }
+
+            if (m_rawHeaders)
+            {
+                delete[] m_rawHeaders;
+                m_rawHeaders = NULL;
+            }
+
+            //! kept in UTF 8 as received, each line ends with NUL and the whole ends with double NUL
+            m_rawHeaders = new char[length + 1];
+            char *raw = m_rawHeaders;
+
+            bool hasContentLength = false;
+            bool isChunked = false;
+            m_contentLength = 0;
+
+            //! HTTP/1.0 closes unless asked to keep
+            m_isKeepAlive = length < 8 || 0 != ::memcmp(head, "HTTP/1.0", 8);
+
+            const char *lineStart = head;
+            const char *headEnd = head + length;
+            while (lineStart < headEnd)
+            {
+                //! the last line ends with the line break as well
+                const char *lineEnd = static_cast<const char *>(::memchr(lineStart, '\n', headEnd - lineStart));
+                if (NULL == lineEnd)
+                    lineEnd = headEnd;
+
+                const char *nextLine = lineEnd + 1;
+                if (lineEnd != lineStart && '\r' == lineEnd[-1])
+                    --lineEnd;
+
+                ::memcpy(raw, lineStart, lineEnd - lineStart);
+                raw += lineEnd - lineStart;
+                *raw++ = '\0';
+
+                const char *colon = lineStart == head ? NULL : static_cast<const char *>(::memchr(lineStart, ':', lineEnd - lineStart));
+                if (NULL != colon)
+                {
+                    const char *name = lineStart;
+                    std::string::size_type nameLength = colon - lineStart;
+
+                    const char *value = colon + 1;
+                    const char *valueEnd = lineEnd;
+                    while (value != valueEnd && (' ' == *value || '\t' == *value))
+                        ++value;
+                    while (valueEnd != value && (' ' == valueEnd[-1] || '\t' == valueEnd[-1]))
+                        --valueEnd;
+
+                    switch (FindHeaderName(name, nameLength, HashHeaderName(name, nameLength)))
+                    {
+                    case HeaderName::Content_Length:
+                        {
+                            if (value == valueEnd || valueEnd - value > 18)
+                                return false;
+
+                            int64_t contentLength = 0;
+                            for (const char *digit = value; digit != valueEnd; ++digit)
+                            {
+                                if (!std::isdigit(static_cast<unsigned char>(*digit)))
+                                    return false;
+
+                                contentLength = contentLength * 10 + (*digit - '0');
+                            }
+
+                            hasContentLength = true;
+                            m_contentLength = contentLength;
+                        }
+                        break;
+
+                    case HeaderName::Transfer_Encoding:
+                        isChunked = _ContainsIgnoreCase(value, valueEnd - value, "chunked");
+                        break;
+
+                    case HeaderName::Connection:
+                        if (_ContainsIgnoreCase(value, valueEnd - value, "close"))
+                            m_isKeepAlive = false;
+                        else if (_ContainsIgnoreCase(value, valueEnd - value, "keep-alive"))
+                            m_isKeepAlive = true;
+                        break;
+
+                    default:
+                        break;
+                    }
+                }
+
+                lineStart = nextLine;
+            }
+            *raw = '\0';
+
+            if ((m_statusCode >= 100 && m_statusCode < 200) || StatusCode::No_Content == m_statusCode || StatusCode::Not_Modified == m_statusCode)
+            {
+                //! no body
+                m_state = m_statusCode < 200 ? HeadState : DoneState;
+            }
+            else if (isChunked)
+            {
+                m_state = ChunkSizeState;
+            }
+            else if (hasContentLength)
+            {
+                m_remaining = static_cast<uint64_t>(m_contentLength);
+                m_state = 0 == m_remaining ? DoneState : LengthState;
+            }
+            else
+            {
+                m_state = UntilCloseState;
+            }
+
+            return true;
+        }
+
+        bool ResponseParser::ReadLine(const uint8_t *&data, uint32_t& len, const char *&line, std::string::size_type& lineLength)
+        {
+            const uint8_t *lf = static_cast<const uint8_t *>(::memchr(data, '\n', len));
+            uint32_t consumed = NULL == lf ? len : static_cast<uint32_t>(lf - data) + 1;
+
+            line = NULL;
+            lineLength = 0;
+
+            if (NULL != lf && m_line.empty())
+            {
+                //! in place
+                line = reinterpret_cast<const char *>(data);
+                lineLength = consumed;
+            }
+            else
+            {
+                m_line.append(reinterpret_cast<const char *>(data), consumed);
+                if (NULL != lf)
+                {
+                    line = m_line.data();
+                    lineLength = m_line.size();
+                }
+            }
+
+            data += consumed;
+            len -= consumed;
+
+            return m_line.size() <= MaxLineLength;
+        }
+
+        bool ResponseParser::ParseBody(const uint8_t *&data, uint32_t& len, const uint8_t *&piece, uint32_t& pieceLen)
+        {
+            piece = NULL;
+            pieceLen = 0;
+
+            while (0 != len && NULL == piece)
+            {
+                const char *line = NULL;
+                std::string::size_type lineLength = 0;
+
+                switch (m_state)
+                {
+                case LengthState:
+                case ChunkDataState:
+                {
+                    pieceLen = static_cast<uint32_t>((std::min)(static_cast<uint64_t>(len), m_remaining));
+                    piece = data;
+
+                    data += pieceLen;
+                    len -= pieceLen;
+                    m_remaining -= pieceLen;
+
+                    if (0 == m_remaining)
+                        m_state = LengthState == m_state ? DoneState : ChunkDataEndState;
+                    break;
+                }
+
+                case UntilCloseState:
+                    piece = data;
+                    pieceLen = len;
+
+                    data += len;
+                    len = 0;
+                    break;
+
+                case ChunkSizeState:
+                {
+                    if (!ReadLine(data, len, line, lineLength))
+                        return false;
+
+                    if (NULL == line)
+                        break;
+
+                    uint64_t size = 0;
+                    std::string::size_type digits = 0;
+                    for (; digits != lineLength && std::isxdigit(static_cast<unsigned char>(line[digits])); ++digits)
+                    {
+                        char c = static_cast<char>(std::tolower(static_cast<unsigned char>(line[digits])));
+                        size = (size << 4) | static_cast<uint64_t>(std::isdigit(static_cast<unsigned char>(c)) ? c - '0' : c - 'a' + 10);
+                    }
+
+                    //! chunk extensions are ignored
+                    if (0 == digits || digits > 15)
+                        return false;
+
+                    m_line.clear();
+
+                    m_remaining = size;
+                    m_state = 0 == size ? TrailerState : ChunkDataState;
+                    break;
+                }
+
+                case ChunkDataEndState:
+                    if (!ReadLine(data, len, line, lineLength))
+                        return false;
+
+                    if (NULL == line)
+                        break;
+
+                    m_line.clear();
+                    m_state = ChunkSizeState;
+                    break;
+
+                case TrailerState:
+                {
+                    if (!ReadLine(data, len, line, lineLength))
+                        return false;
+
+                    if (NULL == line)
+                        break;
+
+                    bool isBlank = (2 == lineLength && '\r' == line[0]) || 1 == lineLength;
+                    m_line.clear();
+
+                    if (isBlank)
+                        m_state = DoneState;
+                    break;
+                }
+
+                case DoneState:
+                    //! nothing expected
+                    data += len;
+                    len = 0;
+                    break;
+
+                default:
+                    return false;
+                }
+            }
+
+            return true;
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,105 @@
+#ifndef RESPONSEPARSER_H
+#define RESPONSEPARSER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace Net
+{
+    namespace Details
+    {
+        //
+        //  incremental HTTP/1.1 response parser
+        //      head is accumulated till the blank line, interim(1xx) responses are skipped
+        //      body is framed by Content-Length, chunked encoding or the closing of connection
+        //
+        //  the received data is parsed in place, only the head or the line split across the reads is copied
+        //      the blank line and the line breaks are located 16 or 32 bytes at a time with SSE2/AVX2 when available
+        //
+        class ResponseParser
+        {
+        public:
+            enum Result
+            {
+                NeedMore,
+                Completed,
+                Malformed
+            };
+
+            enum
+            {
+                MaxHeadLength = 64 * 1024,
+                MaxLineLength = 4096
+            };
+
+        private:
+            enum State
+            {
+                HeadState,
+                LengthState,
+                ChunkSizeState,
+                ChunkDataState,
+                ChunkDataEndState,
+                TrailerState,
+                UntilCloseState,
+                DoneState
+            };
+
+        private:
+            State m_state;
+
+            //! the part of the head or the line received before
+            std::string m_head;
+            std::string m_line;
+            uint64_t m_remaining;
+
+            uint32_t m_statusCode;
+            int64_t m_contentLength;
+            bool m_isKeepAlive;
+            //! RAW_HEADERS format as WinHttp in UTF 8, owned till taken
+            char *m_rawHeaders;
+
+        public:
+            ResponseParser();
+            ~ResponseParser();
+
+        public:
+            bool IsHeadCompleted() const { return HeadState != m_state; }
+            bool IsCompleted() const { return DoneState == m_state; }
+            bool IsUntilClose() const { return UntilCloseState == m_state; }
+            //! the connection persists after the response
+            bool IsKeepAlive() const { return m_isKeepAlive; }
+
+            uint32_t GetStatusCode() const { return m_statusCode; }
+            int64_t GetContentLength() const { return m_contentLength; }
+
+            //! ownership is transferred
+            char *TakeRawHeaders()
+            {
+                char *rawHeaders = m_rawHeaders;
+                m_rawHeaders = NULL;
+
+                return rawHeaders;
+            }
+
+        public:
+            //! data and len will be moved forward, to the body once completed
+            Result ParseHead(const uint8_t *&data, uint32_t& len);
+            //! at most one piece each call, piece points into data
+            bool ParseBody(const uint8_t *&data, uint32_t& len, const uint8_t *&piece, uint32_t& pieceLen);
+
+        private:
+            //! head ends with the line break of the last line
+            bool ParseHeadLines(const char *head, std::string::size_type length);
+            //! line points to the complete line, in data or m_line, NULL when more needed
+            bool ReadLine(const uint8_t *&data, uint32_t& len, const char *&line, std::string::size_type& lineLength);
+
+        private:
+            ResponseParser(const ResponseParser&);
+            ResponseParser& operator = (const ResponseParser&);
+        };
+    }
+}
+
+#endif
@@ -1,25 +1,22 @@
 #include "StringConvertor.h"
 
-void StringConvertor::FromBytes(const ConstBytesArray& array, std::string& out, const std::string& format)
-{
-    static const char *HexTableU = "0123456789ABCDEF";
-    static const char *HexTableL = "0123456789abcdef";
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#  define STRINGCONVERTOR_SSE2
+#  include <emmintrin.h>
+#endif
 
-    const char *HexTable = format == "2x" ? HexTableL : HexTableU;
+#if defined(__SSSE3__) || defined(__AVX2__)
+#  define STRINGCONVERTOR_SSSE3
+#  include <immintrin.h>
+#endif
 
-    std::string &string = out;
+void StringConvertor::FromBytes(const ConstBytesArray& array, std::string& out, const std::string& format)
+{
     if (array.IsNull())
         return;
 
-    string.resize(array.Length() * 2);
-
-    for (uint32_t i = 0; i != array.Length(); ++i)
-    {
-        uint8_t byte = array[i];
-
-        string[i * 2] = HexTable[(byte >> 4) & 0x0F];
-        string[i * 2 + 1] = HexTable[byte & 0x0F];
-    }
+    out.resize(array.Length() * 2);
+    ToHex(array.Data(), array.Length(), &out[0], format != "2x");
 }
 
 void StringConvertor::FromBytes(const ConstBytesArray& array, std::wstring& out, const std::string& format)
@@ -44,41 +41,1037 @@ void StringConvertor::FromBytes(const ConstBytesArray& array, std::wstring& out,
     }
 }
 
-void StringConvertor::FromString(const std::wstring& input, std::string& out)
+static const uint32_t ReplacementCharacter = 0xFFFD;
+
+static inline uint32_t _UnitOf(wchar_t c)
+{
+    return sizeof(wchar_t) == 2 ? static_cast<uint16_t>(c) : static_cast<uint32_t>(c);
+}
+
+//! the count of the leading ASCII units
+static size_t _AsciiPrefix(const wchar_t *src, size_t length)
 {
-    out.reserve(input.size() * (sizeof(wchar_t) / sizeof(char)));
-    const wchar_t *src = input.c_str();
+    size_t i = 0;
 
-    for (auto i = 0; input.size() != i; ++i)
+#if defined(__AVX2__)
+    const __m256i nonAscii32 = sizeof(wchar_t) == 2 ? _mm256_set1_epi16(static_cast<short>(0xFF80)) : _mm256_set1_epi32(static_cast<int>(0xFFFFFF80));
+    for (; length - i >= 32 / sizeof(wchar_t); i += 32 / sizeof(wchar_t))
     {
-        uint32_t each = *(src + i);
+        if (!_mm256_testz_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i)), nonAscii32))
+            break;
+    }
+#endif
+
+#if defined(STRINGCONVERTOR_SSE2)
+    const __m128i nonAscii16 = sizeof(wchar_t) == 2 ? _mm_set1_epi16(static_cast<short>(0xFF80)) : _mm_set1_epi32(static_cast<int>(0xFFFFFF80));
+    const __m128i zero16 = _mm_setzero_si128();
+    for (; length - i >= 16 / sizeof(wchar_t); i += 16 / sizeof(wchar_t))
+    {
+        __m128i high = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i)), nonAscii16);
+        if (0xFFFF != _mm_movemask_epi8(_mm_cmpeq_epi8(high, zero16)))
+            break;
+    }
+#endif
+
+    while (i != length && _UnitOf(src[i]) <= 0x7F)
+        ++i;
 
-        if (each <= 0x7F)
+    return i;
+}
+
+//! copies the leading ASCII units as bytes, returns the count
+static size_t _NarrowAscii(const wchar_t *src, size_t length, char *dst)
+{
+    size_t i = 0;
+
+    //! 32 units a round, packed into 32 bytes
+#if defined(__AVX2__)
+    const __m256i nonAscii32 = sizeof(wchar_t) == 2 ? _mm256_set1_epi16(static_cast<short>(0xFF80)) : _mm256_set1_epi32(static_cast<int>(0xFFFFFF80));
+    for (; length - i >= 32; i += 32)
+    {
+        const __m256i *p = reinterpret_cast<const __m256i *>(src + i);
+        __m256i packed;
+        if (sizeof(wchar_t) == 2)
         {
-            out.push_back(static_cast<char>(each));
+            __m256i a = _mm256_loadu_si256(p);
+            __m256i b = _mm256_loadu_si256(p + 1);
+            if (!_mm256_testz_si256(_mm256_or_si256(a, b), nonAscii32))
+                break;
+
+            //! the packs work in 128 bits lanes, the quarters are put in order afterwards
+            packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(a, b), 0xD8);
         }
-        else if (each <= 0x7FF)
+        else
         {
-            out.push_back(0xC0 | ((each >> 6) & 0x1F));
-            out.push_back(0x80 | (each & 0x3F));
+            __m256i a = _mm256_loadu_si256(p);
+            __m256i b = _mm256_loadu_si256(p + 1);
+            __m256i c = _mm256_loadu_si256(p + 2);
+            __m256i d = _mm256_loadu_si256(p + 3);
+            if (!_mm256_testz_si256(_mm256_or_si256(_mm256_or_si256(a, b), _mm256_or_si256(c, d)), nonAscii32))
+                break;
+
+            __m256i abcd = _mm256_packus_epi16(_mm256_packs_epi32(a, b), _mm256_packs_epi32(c, d));
+            packed = _mm256_permutevar8x32_epi32(abcd, _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7));
+        }
+
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), packed);
+    }
+#endif
+
+    //! 16 units a round, packed into 16 bytes
+#if defined(STRINGCONVERTOR_SSE2)
+    const __m128i nonAscii16 = sizeof(wchar_t) == 2 ? _mm_set1_epi16(static_cast<short>(0xFF80)) : _mm_set1_epi32(static_cast<int>(0xFFFFFF80));
+    const __m128i zero16 = _mm_setzero_si128();
+    for (; length - i >= 16; i += 16)
+    {
+        const __m128i *p = reinterpret_cast<const __m128i *>(src + i);
+        __m128i packed;
+        if (sizeof(wchar_t) == 2)
+        {
+            __m128i a = _mm_loadu_si128(p);
+            __m128i b = _mm_loadu_si128(p + 1);
+            __m128i high = _mm_and_si128(_mm_or_si128(a, b), nonAscii16);
+            if (0xFFFF != _mm_movemask_epi8(_mm_cmpeq_epi8(high, zero16)))
+                break;
+
+            packed = _mm_packus_epi16(a, b);
+        }
+        else
+        {
+            __m128i a = _mm_loadu_si128(p);
+            __m128i b = _mm_loadu_si128(p + 1);
+            __m128i c = _mm_loadu_si128(p + 2);
+            __m128i d = _mm_loadu_si128(p + 3);
+            __m128i high = _mm_and_si128(_mm_or_si128(_mm_or_si128(a, b), _mm_or_si128(c, d)), nonAscii16);
+            if (0xFFFF != _mm_movemask_epi8(_mm_cmpeq_epi8(high, zero16)))
+                break;
+
+            packed = _mm_packus_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d));
+        }
+
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), packed);
+    }
+#endif
+
+    for (; i != length && _UnitOf(src[i]) <= 0x7F; ++i)
+        dst[i] = static_cast<char>(src[i]);
+
+    return i;
+}
+
+//! copies the leading ASCII bytes as units, returns the count
+static size_t _WidenAscii(const uint8_t *src, size_t length, wchar_t *dst)
+{
+    size_t i = 0;
+
+#if defined(__AVX2__)
+    for (; length - i >= 32; i += 32)
+    {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i));
+        if (0 != _mm256_movemask_epi8(v))
+            break;
+
+        __m256i *p = reinterpret_cast<__m256i *>(dst + i);
+        if (sizeof(wchar_t) == 2)
+        {
+            _mm256_storeu_si256(p, _mm256_cvtepu8_epi16(_mm256_castsi256_si128(v)));
+            _mm256_storeu_si256(p + 1, _mm256_cvtepu8_epi16(_mm256_extracti128_si256(v, 1)));
+        }
+        else
+        {
+            for (int quarter = 0; quarter != 4; ++quarter)
+                _mm256_storeu_si256(p + quarter, _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(src + i + quarter * 8))));
+        }
+    }
+#endif
+
+#if defined(STRINGCONVERTOR_SSE2)
+    const __m128i zero16 = _mm_setzero_si128();
+    for (; length - i >= 16; i += 16)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+        if (0 != _mm_movemask_epi8(v))
+            break;
+
+        __m128i low = _mm_unpacklo_epi8(v, zero16);
+        __m128i high = _mm_unpackhi_epi8(v, zero16);
+
+        __m128i *p = reinterpret_cast<__m128i *>(dst + i);
+        if (sizeof(wchar_t) == 2)
+        {
+            _mm_storeu_si128(p, low);
+            _mm_storeu_si128(p + 1, high);
+        }
+        else
+        {
+            _mm_storeu_si128(p, _mm_unpacklo_epi16(low, zero16));
+            _mm_storeu_si128(p + 1, _mm_unpackhi_epi16(low, zero16));
+            _mm_storeu_si128(p + 2, _mm_unpacklo_epi16(high, zero16));
+            _mm_storeu_si128(p + 3, _mm_unpackhi_epi16(high, zero16));
+        }
+    }
+#endif
+
+    for (; i != length && src[i] <= 0x7F; ++i)
+        dst[i] = static_cast<wchar_t>(src[i]);
+
+    return i;
+}
+
+//! the code point at i, surrogate pairs joined, lone surrogates and the ones beyond U+10FFFF replaced
+static uint32_t _NextCodePoint(const wchar_t *src, size_t length, size_t& i)
+{
+    uint32_t each = _UnitOf(src[i++]);
+    if (each < 0xD800 || (0xDFFF < each && each <= 0x10FFFF))
+        return each;
+
+    if (sizeof(wchar_t) == 2 && each <= 0xDBFF && i != length)
+    {
+        uint32_t low = _UnitOf(src[i]);
+        if (0xDC00 <= low && low <= 0xDFFF)
+        {
+            ++i;
+            return 0x10000 + ((each - 0xD800) << 10) + (low - 0xDC00);
+        }
+    }
+
+    return ReplacementCharacter;
+}
+
+static size_t _EncodedLength(uint32_t codePoint)
+{
+    return codePoint <= 0x7F ? 1 : codePoint <= 0x7FF ? 2 : codePoint <= 0xFFFF ? 3 : 4;
+}
+
+void StringConvertor::FromString(const std::wstring& input, std::string& out)
+{
+    FromString(input.c_str(), input.size(), out);
+}
+
+void StringConvertor::FromString(const wchar_t *input, size_t length, std::string& out)
+{
+    if (0 == length)
+        return;
+
+    //! sized exactly first, then written in place
+    size_t encodedLength = 0;
+    for (size_t i = 0; length != i; )
+    {
+        size_t ascii = _AsciiPrefix(input + i, length - i);
+        encodedLength += ascii;
+        i += ascii;
+
+        if (length != i)
+            encodedLength += _EncodedLength(_NextCodePoint(input, length, i));
+    }
+
+    size_t offset = out.size();
+    out.resize(offset + encodedLength);
+    char *dst = &out[offset];
+
+    for (size_t i = 0; length != i; )
+    {
+        size_t ascii = _NarrowAscii(input + i, length - i, dst);
+        dst += ascii;
+        i += ascii;
+
+        if (length == i)
+            break;
+
+        uint32_t each = _NextCodePoint(input, length, i);
+        if (each <= 0x7FF)
+        {
+            *dst++ = static_cast<char>(0xC0 | (each >> 6));
+            *dst++ = static_cast<char>(0x80 | (each & 0x3F));
         }
         else if (each <= 0xFFFF)
         {
-            out.push_back(0xe0 | ((each >> 12) & 0x0F));
-            out.push_back(0x80 | ((each >> 6) & 0x3F));
-            out.push_back(0x80 | (each & 0x3F));
+            *dst++ = static_cast<char>(0xE0 | (each >> 12));
+            *dst++ = static_cast<char>(0x80 | ((each >> 6) & 0x3F));
+            *dst++ = static_cast<char>(0x80 | (each & 0x3F));
+        }
+        else
+        {
+            *dst++ = static_cast<char>(0xF0 | (each >> 18));
+            *dst++ = static_cast<char>(0x80 | ((each >> 12) & 0x3F));
+            *dst++ = static_cast<char>(0x80 | ((each >> 6) & 0x3F));
+            *dst++ = static_cast<char>(0x80 | (each & 0x3F));
+        }
+    }
+}
+
+void StringConvertor::ToString(const std::string& input, std::wstring& out)
+{
+    ToString(input.c_str(), input.size(), out);
+}
+
+void StringConvertor::ToString(const char *input, size_t length, std::wstring& out)
+{
+    if (0 == length)
+        return;
+
+    //! each byte makes a unit at most, even the 4 bytes sequences as surrogate pairs, trimmed at the end
+    size_t offset = out.size();
+    out.resize(offset + length);
+    wchar_t *begin = &out[offset];
+    wchar_t *dst = begin;
+
+    const uint8_t *src = reinterpret_cast<const uint8_t *>(input);
+
+    size_t i = 0;
+    while (length != i)
+    {
+        //! ASCII runs are the common case
+        size_t ascii = _WidenAscii(src + i, length - i, dst);
+        dst += ascii;
+        i += ascii;
+
+        if (length == i)
+            break;
+
+        uint32_t each = src[i];
+
+        uint32_t trailing = 0;
+        uint32_t minimum = 0;
+        if (0xC2 <= each && each <= 0xDF)
+        {
+            trailing = 1;
+            minimum = 0x80;
+            each &= 0x1F;
+        }
+        else if (0xE0 <= each && each <= 0xEF)
+        {
+            trailing = 2;
+            minimum = 0x800;
+            each &= 0x0F;
+        }
+        else if (0xF0 <= each && each <= 0xF4)
+        {
+            trailing = 3;
+            minimum = 0x10000;
+            each &= 0x07;
+        }
+        else
+        {
+            *dst++ = static_cast<wchar_t>(ReplacementCharacter);
+            ++i;
+            continue;
+        }
+
+        size_t next = i + 1;
+        for (; next != length && next - i <= trailing; ++next)
+        {
+            if (0x80 != (src[next] & 0xC0))
+                break;
+
+            each = (each << 6) | (src[next] & 0x3F);
+        }
+
+        //! truncated, overlong, surrogates or beyond U+10FFFF, the valid trailing bytes are consumed
+        if (next - i != trailing + 1 || each < minimum || (0xD800 <= each && each <= 0xDFFF) || each > 0x10FFFF)
+        {
+            *dst++ = static_cast<wchar_t>(ReplacementCharacter);
+            i = next;
+            continue;
+        }
+
+        if (sizeof(wchar_t) == 2 && each > 0xFFFF)
+        {
+            each -= 0x10000;
+            *dst++ = static_cast<wchar_t>(0xD800 + (each >> 10));
+            *dst++ = static_cast<wchar_t>(0xDC00 + (each & 0x3FF));
+        }
+        else
+        {
+            *dst++ = static_cast<wchar_t>(each);
+        }
+
+        i = next;
+    }
+
+    out.resize(offset + (dst - begin));
+}
+
+//
+//  hex and Base64, 16 or 32 bytes a round with SSE2 or AVX2, Base64 requires SSSE3 for the byte shuffles
+//
+
+#if defined(STRINGCONVERTOR_SSE2)
+//! '0' + n, moved to the letters past '9'
+static inline __m128i _HexDigits(__m128i nibbles, __m128i letterOffset)
+{
+    __m128i digits = _mm_add_epi8(nibbles, _mm_set1_epi8('0'));
+    return _mm_add_epi8(digits, _mm_and_si128(_mm_cmpgt_epi8(nibbles, _mm_set1_epi8(9)), letterOffset));
+}
+
+//! the nibbles of the hex digits, the other lanes are cleared in valid
+static inline __m128i _HexNibbles(__m128i c, __m128i& valid)
+{
+    __m128i digit = _mm_sub_epi8(c, _mm_set1_epi8('0'));
+    __m128i isDigit = _mm_and_si128(_mm_cmpgt_epi8(digit, _mm_set1_epi8(-1)), _mm_cmpgt_epi8(_mm_set1_epi8(10), digit));
+    __m128i letter = _mm_sub_epi8(_mm_or_si128(c, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+    __m128i isLetter = _mm_and_si128(_mm_cmpgt_epi8(letter, _mm_set1_epi8(-1)), _mm_cmpgt_epi8(_mm_set1_epi8(6), letter));
+
+    valid = _mm_or_si128(isDigit, isLetter);
+    return _mm_or_si128(_mm_and_si128(isDigit, digit), _mm_and_si128(isLetter, _mm_add_epi8(letter, _mm_set1_epi8(10))));
+}
+
+//! the byte of each pair of nibbles, the high one comes first
+static inline __m128i _JoinNibbles(__m128i nibbles)
+{
+    return _mm_or_si128(_mm_slli_epi16(_mm_and_si128(nibbles, _mm_set1_epi16(0x00FF)), 4), _mm_srli_epi16(nibbles, 8));
+}
+#endif
+
+#if defined(__AVX2__)
+static inline __m256i _HexDigits(__m256i nibbles, __m256i letterOffset)
+{
+    __m256i digits = _mm256_add_epi8(nibbles, _mm256_set1_epi8('0'));
+    return _mm256_add_epi8(digits, _mm256_and_si256(_mm256_cmpgt_epi8(nibbles, _mm256_set1_epi8(9)), letterOffset));
+}
+
+static inline __m256i _HexNibbles(__m256i c, __m256i& valid)
+{
+    __m256i digit = _mm256_sub_epi8(c, _mm256_set1_epi8('0'));
+    __m256i isDigit = _mm256_and_si256(_mm256_cmpgt_epi8(digit, _mm256_set1_epi8(-1)), _mm256_cmpgt_epi8(_mm256_set1_epi8(10), digit));
+    __m256i letter = _mm256_sub_epi8(_mm256_or_si256(c, _mm256_set1_epi8(0x20)), _mm256_set1_epi8('a'));
+    __m256i isLetter = _mm256_and_si256(_mm256_cmpgt_epi8(letter, _mm256_set1_epi8(-1)), _mm256_cmpgt_epi8(_mm256_set1_epi8(6), letter));
+
+    valid = _mm256_or_si256(isDigit, isLetter);
+    return _mm256_or_si256(_mm256_and_si256(isDigit, digit), _mm256_and_si256(isLetter, _mm256_add_epi8(letter, _mm256_set1_epi8(10))));
+}
+
+static inline __m256i _JoinNibbles(__m256i nibbles)
+{
+    return _mm256_or_si256(_mm256_slli_epi16(_mm256_and_si256(nibbles, _mm256_set1_epi16(0x00FF)), 4), _mm256_srli_epi16(nibbles, 8));
+}
+#endif
+
+static inline int _HexValueOf(uint8_t c)
+{
+    if ('0' <= c && c <= '9')
+        return c - '0';
+
+    c |= 0x20;
+    if ('a' <= c && c <= 'f')
+        return c - 'a' + 10;
+
+    return -1;
+}
+
+void StringConvertor::ToHex(const uint8_t *data, size_t length, char *out, bool isUpperCase)
+{
+    const char *digits = isUpperCase ? "0123456789ABCDEF" : "0123456789abcdef";
+    const char letterOffset = isUpperCase ? 'A' - '0' - 10 : 'a' - '0' - 10;
+
+    size_t i = 0;
+
+#if defined(__AVX2__)
+    const __m256i low32 = _mm256_set1_epi8(0x0F);
+    const __m256i letterOffset32 = _mm256_set1_epi8(letterOffset);
+    for (; length - i >= 32; i += 32)
+    {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i));
+        __m256i high = _HexDigits(_mm256_and_si256(_mm256_srli_epi16(v, 4), low32), letterOffset32);
+        __m256i low = _HexDigits(_mm256_and_si256(v, low32), letterOffset32);
+
+        //! the unpacks work in 128 bits lanes, the halves are put in order afterwards
+        __m256i first = _mm256_unpacklo_epi8(high, low);
+        __m256i second = _mm256_unpackhi_epi8(high, low);
+
+        __m256i *p = reinterpret_cast<__m256i *>(out + i * 2);
+        _mm256_storeu_si256(p, _mm256_permute2x128_si256(first, second, 0x20));
+        _mm256_storeu_si256(p + 1, _mm256_permute2x128_si256(first, second, 0x31));
+    }
+#endif
+
+#if defined(STRINGCONVERTOR_SSE2)
+    const __m128i low16 = _mm_set1_epi8(0x0F);
+    const __m128i letterOffset16 = _mm_set1_epi8(letterOffset);
+    for (; length - i >= 16; i += 16)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+        __m128i high = _HexDigits(_mm_and_si128(_mm_srli_epi16(v, 4), low16), letterOffset16);
+        __m128i low = _HexDigits(_mm_and_si128(v, low16), letterOffset16);
+
+        __m128i *p = reinterpret_cast<__m128i *>(out + i * 2);
+        _mm_storeu_si128(p, _mm_unpacklo_epi8(high, low));
+        _mm_storeu_si128(p + 1, _mm_unpackhi_epi8(high, low));
+    }
+#endif
+
+    for (; i != length; ++i)
+    {
+        out[i * 2] = digits[data[i] >> 4];
+        out[i * 2 + 1] = digits[data[i] & 0x0F];
+    }
+}
+
+bool StringConvertor::FromHex(const char *hex, size_t length, uint8_t *out)
+{
+    if (0 != length % 2)
+        return false;
+
+    size_t count = length / 2;
+    size_t i = 0;
+
+#if defined(__AVX2__)
+    for (; count - i >= 32; i += 32)
+    {
+        const __m256i *p = reinterpret_cast<const __m256i *>(hex + i * 2);
+        __m256i firstValid, secondValid;
+        __m256i first = _HexNibbles(_mm256_loadu_si256(p), firstValid);
+        __m256i second = _HexNibbles(_mm256_loadu_si256(p + 1), secondValid);
+        if (-1 != _mm256_movemask_epi8(_mm256_and_si256(firstValid, secondValid)))
+            break;
+
+        __m256i packed = _mm256_packus_epi16(_JoinNibbles(first), _JoinNibbles(second));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i), _mm256_permute4x64_epi64(packed, 0xD8));
+    }
+#endif
+
+#if defined(STRINGCONVERTOR_SSE2)
+    for (; count - i >= 16; i += 16)
+    {
+        const __m128i *p = reinterpret_cast<const __m128i *>(hex + i * 2);
+        __m128i firstValid, secondValid;
+        __m128i first = _HexNibbles(_mm_loadu_si128(p), firstValid);
+        __m128i second = _HexNibbles(_mm_loadu_si128(p + 1), secondValid);
+        if (0xFFFF != _mm_movemask_epi8(_mm_and_si128(firstValid, secondValid)))
+            break;
+
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), _mm_packus_epi16(_JoinNibbles(first), _JoinNibbles(second)));
+    }
+#endif
+
+    //! the rest, and the round holding the invalid digit
+    for (; i != count; ++i)
+    {
+        int high = _HexValueOf(static_cast<uint8_t>(hex[i * 2]));
+        int low = _HexValueOf(static_cast<uint8_t>(hex[i * 2 + 1]));
+        if (high < 0 || low < 0)
+            return false;
+
+        out[i] = static_cast<uint8_t>((high << 4) | low);
+    }
+
+    return true;
+}
+
+static const char Base64StandardDigits[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+static const char Base64UrlSafeDigits[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+
+#if defined(STRINGCONVERTOR_SSSE3)
+//
+//  12 bytes in each 128 bits lane, as 16 characters
+//      the 4 indices of each 3 bytes are split by the multiplies, then mapped by adding the offset of its range
+//
+static inline __m128i _Base64Encode(__m128i bytes, __m128i offsets)
+{
+    __m128i in = _mm_shuffle_epi8(bytes, _mm_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10));
+    __m128i high = _mm_mulhi_epu16(_mm_and_si128(in, _mm_set1_epi32(0x0FC0FC00)), _mm_set1_epi32(0x04000040));
+    __m128i low = _mm_mullo_epi16(_mm_and_si128(in, _mm_set1_epi32(0x003F03F0)), _mm_set1_epi32(0x01000010));
+    __m128i indices = _mm_or_si128(high, low);
+
+    //! 0 for 26..51, 1..10 for the digits, 11 and 12 for the last two, 13 for A..Z
+    __m128i range = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+    range = _mm_or_si128(range, _mm_and_si128(_mm_cmpgt_epi8(_mm_set1_epi8(26), indices), _mm_set1_epi8(13)));
+
+    return _mm_add_epi8(indices, _mm_shuffle_epi8(offsets, range));
+}
+
+static inline __m128i _Base64Offsets(const char *digits)
+{
+    return _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52
+        , static_cast<char>(digits[62] - 62), static_cast<char>(digits[63] - 63), 'A', 0, 0);
+}
+
+static inline __m128i _InRange(__m128i c, char first, char last)
+{
+    return _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8(first - 1)), _mm_cmpgt_epi8(_mm_set1_epi8(last + 1), c));
+}
+
+//! the 6 bits values of 16 characters, the lanes out of the alphabet are cleared in valid
+static inline __m128i _Base64Values(__m128i c, const char *digits, __m128i& valid)
+{
+    __m128i upper = _InRange(c, 'A', 'Z');
+    __m128i lower = _InRange(c, 'a', 'z');
+    __m128i digit = _InRange(c, '0', '9');
+    __m128i plus = _mm_cmpeq_epi8(c, _mm_set1_epi8(digits[62]));
+    __m128i slash = _mm_cmpeq_epi8(c, _mm_set1_epi8(digits[63]));
+
+    valid = _mm_or_si128(_mm_or_si128(_mm_or_si128(upper, lower), _mm_or_si128(digit, plus)), slash);
+
+    __m128i shift = _mm_or_si128(_mm_and_si128(upper, _mm_set1_epi8(-'A')), _mm_and_si128(lower, _mm_set1_epi8(26 - 'a')));
+    shift = _mm_or_si128(shift, _mm_and_si128(digit, _mm_set1_epi8(52 - '0')));
+    shift = _mm_or_si128(shift, _mm_and_si128(plus, _mm_set1_epi8(static_cast<char>(62 - digits[62]))));
+    shift = _mm_or_si128(shift, _mm_and_si128(slash, _mm_set1_epi8(static_cast<char>(63 - digits[63]))));
+
+    return _mm_add_epi8(c, shift);
+}
+
+//! the 24 bits of each 4 values, 12 bytes at the beginning of each 128 bits lane
+static inline __m128i _Base64Join(__m128i values)
+{
+    __m128i pairs = _mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140));
+    __m128i joined = _mm_madd_epi16(pairs, _mm_set1_epi32(0x00011000));
+
+    return _mm_shuffle_epi8(joined, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+}
+#endif
+
+#if defined(__AVX2__)
+static inline __m256i _Base64Encode(__m256i bytes, __m256i offsets)
+{
+    __m256i in = _mm256_shuffle_epi8(bytes, _mm256_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10
+        , 1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10));
+    __m256i high = _mm256_mulhi_epu16(_mm256_and_si256(in, _mm256_set1_epi32(0x0FC0FC00)), _mm256_set1_epi32(0x04000040));
+    __m256i low = _mm256_mullo_epi16(_mm256_and_si256(in, _mm256_set1_epi32(0x003F03F0)), _mm256_set1_epi32(0x01000010));
+    __m256i indices = _mm256_or_si256(high, low);
+
+    __m256i range = _mm256_subs_epu8(indices, _mm256_set1_epi8(51));
+    range = _mm256_or_si256(range, _mm256_and_si256(_mm256_cmpgt_epi8(_mm256_set1_epi8(26), indices), _mm256_set1_epi8(13)));
+
+    return _mm256_add_epi8(indices, _mm256_shuffle_epi8(offsets, range));
+}
+
+static inline __m256i _InRange(__m256i c, char first, char last)
+{
+    return _mm256_and_si256(_mm256_cmpgt_epi8(c, _mm256_set1_epi8(first - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8(last + 1), c));
+}
+
+static inline __m256i _Base64Values(__m256i c, const char *digits, __m256i& valid)
+{
+    __m256i upper = _InRange(c, 'A', 'Z');
+    __m256i lower = _InRange(c, 'a', 'z');
+    __m256i digit = _InRange(c, '0', '9');
+    __m256i plus = _mm256_cmpeq_epi8(c, _mm256_set1_epi8(digits[62]));
+    __m256i slash = _mm256_cmpeq_epi8(c, _mm256_set1_epi8(digits[63]));
+
+    valid = _mm256_or_si256(_mm256_or_si256(_mm256_or_si256(upper, lower), _mm256_or_si256(digit, plus)), slash);
+
+    __m256i shift = _mm256_or_si256(_mm256_and_si256(upper, _mm256_set1_epi8(-'A')), _mm256_and_si256(lower, _mm256_set1_epi8(26 - 'a')));
+    shift = _mm256_or_si256(shift, _mm256_and_si256(digit, _mm256_set1_epi8(52 - '0')));
+    shift = _mm256_or_si256(shift, _mm256_and_si256(plus, _mm256_set1_epi8(static_cast<char>(62 - digits[62]))));
+    shift = _mm256_or_si256(shift, _mm256_and_si256(slash, _mm256_set1_epi8(static_cast<char>(63 - digits[63]))));
+
+    return _mm256_add_epi8(c, shift);
+}
+
+static inline __m256i _Base64Join(__m256i values)
+{
+    __m256i pairs = _mm256_maddubs_epi16(values, _mm256_set1_epi32(0x01400140));
+    __m256i joined = _mm256_madd_epi16(pairs, _mm256_set1_epi32(0x00011000));
+
+    joined = _mm256_shuffle_epi8(joined, _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1
+        , 2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+
+    //! the 24 bytes put together
+    return _mm256_permutevar8x32_epi32(joined, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7));
+}
+#endif
+
+//! value of each character in the low 6 bits, looked up instead of compared to keep the scalar decoding free of branches
+//! 0x80 marks the ones of the standard alphabet only, 0x40 the url-safe ones only, both the invalid ones
+static const uint8_t Base64Values[256] =
+{
+    0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0,
+    0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0,
+    0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xBE, 0xC0, 0x7E, 0xC0, 0xBF,
+    0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3A, 0x3B, 0x3C, 0x3D, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0,
+    0xC0, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E,
+    0x0F, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0xC0, 0xC0, 0xC0, 0xC0, 0x7F,
+    0xC0, 0x1A, 0x1B, 0x1C, 0x1D, 0x1E, 0x1F, 0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28,
+    0x29, 0x2A, 0x2B, 0x2C, 0x2D, 0x2E, 0x2F, 0x30, 0x31, 0x32, 0x33, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0,
+    0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0,
+    0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0,
+    0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0,
+    0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0,
+    0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0,
+    0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0,
+    0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0,
+    0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0, 0xC0
+};
+
+enum
+{
+    Base64StandardOnly = 0x80,
+    Base64UrlSafeOnly = 0x40
+};
+
+size_t StringConvertor::GetBase64Length(size_t length, Base64Alphabet alphabet)
+{
+    if (Base64Standard == alphabet)
+        return (length + 2) / 3 * 4;
+
+    return length / 3 * 4 + (0 == length % 3 ? 0 : length % 3 + 1);
+}
+
+size_t StringConvertor::ToBase64(const uint8_t *data, size_t length, char *out, Base64Alphabet alphabet)
+{
+    const char *digits = Base64Standard == alphabet ? Base64StandardDigits : Base64UrlSafeDigits;
+
+    size_t i = 0;
+    char *dst = out;
+
+    //! 16 bytes are read for each 12, the rest is left to the next round
+#if defined(__AVX2__)
+    const __m256i offsets32 = _mm256_broadcastsi128_si256(_Base64Offsets(digits));
+    for (; length - i >= 28; i += 24, dst += 32)
+    {
+        __m256i bytes = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i)))
+            , _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i + 12)), 1);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst), _Base64Encode(bytes, offsets32));
+    }
+#endif
+
+#if defined(STRINGCONVERTOR_SSSE3)
+    const __m128i offsets16 = _Base64Offsets(digits);
+    for (; length - i >= 16; i += 12, dst += 16)
+    {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst), _Base64Encode(bytes, offsets16));
+    }
+#endif
+
+    for (; length - i >= 3; i += 3, dst += 4)
+    {
+        uint32_t triple = (static_cast<uint32_t>(data[i]) << 16) | (static_cast<uint32_t>(data[i + 1]) << 8) | data[i + 2];
+        dst[0] = digits[triple >> 18];
+        dst[1] = digits[(triple >> 12) & 0x3F];
+        dst[2] = digits[(triple >> 6) & 0x3F];
+        dst[3] = digits[triple & 0x3F];
+    }
+
+    if (length != i)
+    {
+        uint32_t triple = static_cast<uint32_t>(data[i]) << 16;
+        if (2 == length - i)
+            triple |= static_cast<uint32_t>(data[i + 1]) << 8;
+
+        *dst++ = digits[triple >> 18];
+        *dst++ = digits[(triple >> 12) & 0x3F];
+        if (2 == length - i)
+            *dst++ = digits[(triple >> 6) & 0x3F];
+
+        if (Base64Standard == alphabet)
+        {
+            if (1 == length - i)
+                *dst++ = '=';
+            *dst++ = '=';
         }
-        else if (each <= 0x10FFFF)
+    }
+
+    return dst - out;
+}
+
+bool StringConvertor::FromBase64(const char *base64, size_t length, uint8_t *out, size_t& outLength, Base64Alphabet alphabet)
+{
+#if defined(STRINGCONVERTOR_SSSE3)
+    const char *digits = Base64Standard == alphabet ? Base64StandardDigits : Base64UrlSafeDigits;
+#endif
+    const uint8_t *src = reinterpret_cast<const uint8_t *>(base64);
+
+    outLength = 0;
+
+    //! the padding of the plus quad is optional
+    size_t dataLength = length;
+    if (0 != length && 0 == length % 4 && '=' == base64[length - 1])
+    {
+        --dataLength;
+        if ('=' == base64[length - 2])
+            --dataLength;
+    }
+
+    if (1 == dataLength % 4)
+        return false;
+
+    size_t i = 0;
+    uint8_t *dst = out;
+
+    //! the stores overrun the decoded bytes, so a few characters are left to write over them
+#if defined(__AVX2__)
+    for (; dataLength - i >= 32 + 16; i += 32, dst += 24)
+    {
+        __m256i valid;
+        __m256i values = _Base64Values(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i)), digits, valid);
+        if (-1 != _mm256_movemask_epi8(valid))
+            break;
+
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst), _Base64Join(values));
+    }
+#endif
+
+#if defined(STRINGCONVERTOR_SSSE3)
+    for (; dataLength - i >= 16 + 8; i += 16, dst += 12)
+    {
+        __m128i valid;
+        __m128i values = _Base64Values(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i)), digits, valid);
+        if (0xFFFF != _mm_movemask_epi8(valid))
+            break;
+
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst), _Base64Join(values));
+    }
+#endif
+
+    //! the characters of the other alphabet are invalid too
+    const uint32_t invalidMask = Base64Standard == alphabet ? Base64UrlSafeOnly : Base64StandardOnly;
+
+    //! the rest, and the round holding the invalid character
+    for (; dataLength - i >= 4; i += 4, dst += 3)
+    {
+        uint32_t a = Base64Values[src[i]];
+        uint32_t b = Base64Values[src[i + 1]];
+        uint32_t c = Base64Values[src[i + 2]];
+        uint32_t d = Base64Values[src[i + 3]];
+        if (0 != ((a | b | c | d) & invalidMask))
+            return false;
+
+        uint32_t triple = ((a & 0x3F) << 18) | ((b & 0x3F) << 12) | ((c & 0x3F) << 6) | (d & 0x3F);
+        dst[0] = static_cast<uint8_t>(triple >> 16);
+        dst[1] = static_cast<uint8_t>(triple >> 8);
+        dst[2] = static_cast<uint8_t>(triple);
+    }
+
+    if (dataLength != i)
+    {
+        uint32_t a = Base64Values[src[i]];
+        uint32_t b = Base64Values[src[i + 1]];
+        uint32_t c = 3 == dataLength - i ? Base64Values[src[i + 2]] : 0;
+        if (0 != ((a | b | c) & invalidMask))
+            return false;
+
+        a &= 0x3F;
+        b &= 0x3F;
+        c &= 0x3F;
+
+        *dst++ = static_cast<uint8_t>((a << 2) | (b >> 4));
+        if (3 == dataLength - i)
+            *dst++ = static_cast<uint8_t>((b << 4) | (c >> 2));
+    }
+
+    outLength = dst - out;
+    return true;
+}
+
+//
+//  percent-encoding of RFC 3986, the unreserved runs are copied 16 or 32 bytes a round
+//
+
+static inline uint32_t _TrailingZeros(uint32_t mask)
+{
+#if defined(__GNUC__)
+    return __builtin_ctz(mask);
+#else
+    uint32_t count = 0;
+    for (; 0 == (mask & 1); mask >>= 1)
+        ++count;
+
+    return count;
+#endif
+}
+
+static inline uint32_t _PopCount(uint32_t mask)
+{
+#if defined(__GNUC__)
+    return __builtin_popcount(mask);
+#else
+    mask = mask - ((mask >> 1) & 0x55555555);
+    mask = (mask & 0x33333333) + ((mask >> 2) & 0x33333333);
+    return (((mask + (mask >> 4)) & 0x0F0F0F0F) * 0x01010101) >> 24;
+#endif
+}
+
+static inline bool _IsUnreserved(uint8_t c)
+{
+    return ('A' <= c && c <= 'Z') || ('a' <= c && c <= 'z') || ('0' <= c && c <= '9') || '-' == c || '.' == c || '_' == c || '~' == c;
+}
+
+#if defined(STRINGCONVERTOR_SSE2)
+//! a bit for each unreserved byte
+static inline uint32_t _UnreservedMask(__m128i c)
+{
+    __m128i letter = _mm_or_si128(c, _mm_set1_epi8(0x20));
+    __m128i isLetter = _mm_and_si128(_mm_cmpgt_epi8(letter, _mm_set1_epi8('a' - 1)), _mm_cmpgt_epi8(_mm_set1_epi8('z' + 1), letter));
+    __m128i isDigit = _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8('0' - 1)), _mm_cmpgt_epi8(_mm_set1_epi8('9' + 1), c));
+    __m128i isMark = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(c, _mm_set1_epi8('-')), _mm_cmpeq_epi8(c, _mm_set1_epi8('.')))
+        , _mm_or_si128(_mm_cmpeq_epi8(c, _mm_set1_epi8('_')), _mm_cmpeq_epi8(c, _mm_set1_epi8('~'))));
+
+    return static_cast<uint32_t>(_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(isLetter, isDigit), isMark)));
+}
+#endif
+
+#if defined(__AVX2__)
+static inline uint32_t _UnreservedMask(__m256i c)
+{
+    __m256i letter = _mm256_or_si256(c, _mm256_set1_epi8(0x20));
+    __m256i isLetter = _mm256_and_si256(_mm256_cmpgt_epi8(letter, _mm256_set1_epi8('a' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), letter));
+    __m256i isDigit = _mm256_and_si256(_mm256_cmpgt_epi8(c, _mm256_set1_epi8('0' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), c));
+    __m256i isMark = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(c, _mm256_set1_epi8('-')), _mm256_cmpeq_epi8(c, _mm256_set1_epi8('.')))
+        , _mm256_or_si256(_mm256_cmpeq_epi8(c, _mm256_set1_epi8('_')), _mm256_cmpeq_epi8(c, _mm256_set1_epi8('~'))));
+
+    return static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_or_si256(_mm256_or_si256(isLetter, isDigit), isMark)));
+}
+#endif
+
+//! copies the leading unreserved bytes, returns the count
+//! the whole round is stored, dst holds as many bytes as src at least
+static size_t _CopyUnreserved(const uint8_t *src, size_t length, char *dst)
+{
+    size_t i = 0;
+
+#if defined(__AVX2__)
+    for (; length - i >= 32; i += 32)
+    {
+        __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), c);
+
+        uint32_t mask = _UnreservedMask(c);
+        if (0xFFFFFFFF != mask)
+            return i + _TrailingZeros(~mask);
+    }
+#endif
+
+#if defined(STRINGCONVERTOR_SSE2)
+    for (; length - i >= 16; i += 16)
+    {
+        __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), c);
+
+        uint32_t mask = _UnreservedMask(c);
+        if (0xFFFF != mask)
+            return i + _TrailingZeros(~mask);
+    }
+#endif
+
+    for (; i != length && _IsUnreserved(src[i]); ++i)
+        dst[i] = static_cast<char>(src[i]);
+
+    return i;
+}
+
+size_t StringConvertor::GetPercentEncodedLength(const char *data, size_t length)
+{
+    const uint8_t *src = reinterpret_cast<const uint8_t *>(data);
+    size_t escaped = 0;
+    size_t i = 0;
+
+#if defined(__AVX2__)
+    for (; length - i >= 32; i += 32)
+        escaped += 32 - _PopCount(_UnreservedMask(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i))));
+#endif
+
+#if defined(STRINGCONVERTOR_SSE2)
+    for (; length - i >= 16; i += 16)
+        escaped += 16 - _PopCount(_UnreservedMask(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i))));
+#endif
+
+    for (; i != length; ++i)
+    {
+        if (!_IsUnreserved(src[i]))
+            ++escaped;
+    }
+
+    return length + escaped * 2;
+}
+
+size_t StringConvertor::ToPercentEncoding(const char *data, size_t length, char *out)
+{
+    static const char HexDigits[] = "0123456789ABCDEF";
+
+    const uint8_t *src = reinterpret_cast<const uint8_t *>(data);
+    char *dst = out;
+
+    size_t i = 0;
+    while (length != i)
+    {
+        size_t unreserved = _CopyUnreserved(src + i, length - i, dst);
+        i += unreserved;
+        dst += unreserved;
+
+        if (length == i)
+            break;
+
+        uint8_t c = src[i++];
+        dst[0] = '%';
+        dst[1] = HexDigits[c >> 4];
+        dst[2] = HexDigits[c & 0x0F];
+        dst += 3;
+    }
+
+    return dst - out;
+}
+
+bool StringConvertor::FromPercentEncoding(const char *encoded, size_t length, char *out, size_t& outLength, bool isPlusSpace)
+{
+    const uint8_t *src = reinterpret_cast<const uint8_t *>(encoded);
+    char *dst = out;
+
+    outLength = 0;
+
+    size_t i = 0;
+    while (length != i)
+    {
+        //! the runs without '%' or '+' are copied, the whole round is stored as dst never passes src
+#if defined(__AVX2__)
+        const __m256i percent32 = _mm256_set1_epi8('%');
+        const __m256i plus32 = _mm256_set1_epi8(isPlusSpace ? '+' : '%');
+        for (; length - i >= 32; i += 32, dst += 32)
         {
-            out.push_back(0xF0 | ((each >> 18) & 0x07));
-            out.push_back(0x80 | ((each >> 12) & 0x3F));
-            out.push_back(0x80 | ((each >> 6) & 0x3F));
-            out.push_back(0x80 | (each & 0x3F));
+            __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i));
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst), c);
+
+            uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(c, percent32), _mm256_cmpeq_epi8(c, plus32))));
+            if (0 != mask)
+            {
+                uint32_t plain = _TrailingZeros(mask);
+                i += plain;
+                dst += plain;
+                break;
+            }
+        }
+#endif
+
+#if defined(STRINGCONVERTOR_SSE2)
+        const __m128i percent16 = _mm_set1_epi8('%');
+        const __m128i plus16 = _mm_set1_epi8(isPlusSpace ? '+' : '%');
+        for (; length - i >= 16; i += 16, dst += 16)
+        {
+            __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dst), c);
+
+            uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(c, percent16), _mm_cmpeq_epi8(c, plus16))));
+            if (0 != mask)
+            {
+                uint32_t plain = _TrailingZeros(mask);
+                i += plain;
+                dst += plain;
+                break;
+            }
+        }
+#endif
+
+        if (length == i)
+            break;
+
+        uint8_t c = src[i];
+        if ('%' == c)
+        {
+            int high = length - i > 2 ? _HexValueOf(src[i + 1]) : -1;
+            int low = length - i > 2 ? _HexValueOf(src[i + 2]) : -1;
+            if (high < 0 || low < 0)
+                return false;
+
+            *dst++ = static_cast<char>((high << 4) | low);
+            i += 3;
         }
         else
         {
-            //! TO-DO
-            throw 0;
+            *dst++ = isPlusSpace && '+' == c ? ' ' : static_cast<char>(c);
+            ++i;
         }
     }
-}
\ No newline at end of file
+
+    outLength = dst - out;
+    return true;
+}
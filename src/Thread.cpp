@@ -1,29 +1,19 @@
 #include "Thread.h"
+#include "WorkStealingExecutor.h"
+#include "Mailbox.h"
 
 ThreadContext::ThreadContext()
     : m_dwThreadID(0)
     , m_hHandle(NULL)
+#if defined(_WIN32)
     , m_hWnd(NULL)
+#endif
     , m_type(WorkerContext)
+    , m_mailbox(NULL)
 {
 
 }
 
-ThreadContext ThreadContext::Current()
-{
-    return ThreadContext(::GetCurrentThreadId(), ::GetCurrentThread());
-}
-
-ThreadContext ThreadContext::FromUIWindow(HWND hWnd)
-{
-    ThreadContext context;
-    context.m_hWnd = hWnd;
-    context.m_dwThreadID = ::GetWindowThreadProcessId(hWnd, NULL);
-    context.m_type = ThreadContext::UIContext;
-
-    return context;
-}
-
 ThreadContext ThreadContext::FromThreadPool()
 {
     ThreadContext context;
@@ -35,14 +25,50 @@ ThreadContext ThreadContext::FromThreadPool()
 ThreadContext::ThreadContext(DWORD dwThreaID, HANDLE hThread)
     : m_dwThreadID(dwThreaID)
     , m_hHandle(hThread)
+#if defined(_WIN32)
     , m_hWnd(NULL)
+#endif
+    , m_type(WorkerContext)
+    , m_mailbox(NULL)
 {
 
 }
 
+ThreadContext::ThreadContext(const ThreadContext& context)
+    : m_dwThreadID(context.m_dwThreadID)
+    , m_hHandle(context.m_hHandle)
+#if defined(_WIN32)
+    , m_hWnd(context.m_hWnd)
+#endif
+    , m_type(context.m_type)
+    , m_mailbox(context.m_mailbox)
+{
+    if (NULL != m_mailbox)
+        m_mailbox->AddRef();
+}
+
 ThreadContext::~ThreadContext()
 {
+    if (NULL != m_mailbox)
+        m_mailbox->Release();
+}
 
+ThreadContext& ThreadContext::operator = (const ThreadContext& context)
+{
+    if (NULL != context.m_mailbox)
+        context.m_mailbox->AddRef();
+    if (NULL != m_mailbox)
+        m_mailbox->Release();
+
+    m_dwThreadID = context.m_dwThreadID;
+    m_hHandle = context.m_hHandle;
+#if defined(_WIN32)
+    m_hWnd = context.m_hWnd;
+#endif
+    m_type = context.m_type;
+    m_mailbox = context.m_mailbox;
+
+    return *this;
 }
 
 bool ThreadContext::operator == (const ThreadContext& context) const
@@ -62,81 +88,259 @@ void ThreadLocalManager::Clean() throw()
     m_objects.clear();
 }
 
+#if defined(_WIN32)
+
+ThreadContext ThreadContext::FromUIWindow(HWND hWnd)
+{
+    ThreadContext context;
+    context.m_hWnd = hWnd;
+    context.m_dwThreadID = ::GetWindowThreadProcessId(hWnd, NULL);
+    context.m_type = ThreadContext::UIContext;
+
+    return context;
+}
+
 #define CALLABLE_MESSAGE		(WM_USER + 0x7000)
 #define ASYNCALLABLE_MESSAGE	(WM_USER + 0x7002)
 #define QUIT					(WM_USER + 0x7F00)
+#else
+#define CALLABLE_MESSAGE		(0x7000)
+#define ASYNCALLABLE_MESSAGE	(0x7002)
+#define QUIT					(0x7F00)
+#endif
+
+template<typename T>
+class _LocalPointer
+{
+    T *m_;
+public:
+    _LocalPointer(T *p) : m_(p){}
+    ~_LocalPointer() { if (m_) delete m_; }
+
+    T *operator -> () { return m_; }
+};
 
-static DWORD WINAPI _ThreadPoolWorker(LPVOID lpThreadParameter)
+bool Dispatcher::EventDispatch(UINT uMsg, WPARAM wParam, LPARAM lParam)
 {
-    PMSG pMsg = (PMSG)lpThreadParameter;
-    if (pMsg)
+    if (uMsg == CALLABLE_MESSAGE)
     {
-        Dispatcher dispatcher;
-        if (!dispatcher.EventDispatch(pMsg))
-        {
-            return (DWORD)-1;
-        }
+        _LocalPointer<Callable> callable = (Callable *)wParam;
+        callable->Invoke();
+        return true;
+    }
+    else if (uMsg == ASYNCALLABLE_MESSAGE)
+    {
+        AsyncCallable *callable = (AsyncCallable *)wParam;
+        callable->OnEnter(this);
+    }
+
+    return false;
+}
+
+//
+//  every Thread and MessageLooper context owns a mailbox, so does any context of Current() off Windows
+//      the contexts hold a reference to it, so posting to them never takes the lock below
+//      the registry only resolves the contexts made of a bare thread id
+//      the mailbox of a thread is unregistered at its exit, and deleted once no context refers to it
+//
+typedef std::map<DWORD, _Mailbox *> _Mailboxes;
+
+static CriticalSection& _MailboxesLock()
+{
+    static CriticalSection lock;
+    return lock;
+}
+
+static _Mailboxes& _AllMailboxes()
+{
+    static _Mailboxes mailboxes;
+    return mailboxes;
+}
+
+//! the messages never taken, the callables are deleted without being invoked
+static void _DisposeMessage(MailboxNode *node, UINT message)
+{
+    if (message == CALLABLE_MESSAGE)
+        delete static_cast<Callable *>(node);
+    else if (message == QUIT)
+        delete node;
+}
+
+//! the reference returned is the caller's, NULL if the thread owns no mailbox and isCreating is not set
+static _Mailbox *_AcquireMailbox(DWORD threadID, bool isCreating)
+{
+    AutoLock<CriticalSection> locker(&_MailboxesLock());
+
+    _Mailboxes& mailboxes = _AllMailboxes();
+    _Mailboxes::iterator found = mailboxes.find(threadID);
+
+    _Mailbox *mailbox = NULL;
+    if (found != mailboxes.end())
+    {
+        mailbox = found->second;
+    }
+    else if (isCreating)
+    {
+        //! the initial reference is the registry's
+        mailbox = new _Mailbox(threadID, _DisposeMessage);
+        mailboxes.insert(std::make_pair(threadID, mailbox));
     }
 
-    return (DWORD)-1;
+    if (NULL != mailbox)
+        mailbox->AddRef();
+
+    return mailbox;
 }
 
-namespace Private
+//! drops the reference of the registry, once only, the thread id may be taken by another one on Windows
+static void _UnregisterMailbox(_Mailbox *mailbox)
 {
-    void _ThreadPoolAsyncGuard::OnEnter()
     {
-        m_dwThreadID = ::GetCurrentThreadId();
+        AutoLock<CriticalSection> locker(&_MailboxesLock());
+
+        _Mailboxes& mailboxes = _AllMailboxes();
+        _Mailboxes::iterator found = mailboxes.find(mailbox->GetThreadID());
+        if (found == mailboxes.end() || found->second != mailbox)
+            return;
+
+        mailboxes.erase(found);
     }
 
-    void _ThreadPoolAsyncGuard::OnLeave()
+    //! out of the lock, the disposed callables may post again
+    mailbox->Release();
+}
+
+//! the one of the context when resolved, false if the thread owns no mailbox
+static bool _PostToMailbox(_Mailbox *mailbox, DWORD threadID, MailboxNode *node, UINT message)
+{
+    if (NULL != mailbox)
     {
-        ::PostThreadMessage(m_dwThreadID, QUIT, NULL, NULL);
+        mailbox->Post(node, message);
+        return true;
     }
+
+    mailbox = _AcquireMailbox(threadID, false);
+    if (NULL == mailbox)
+        return false;
+
+    mailbox->Post(node, message);
+    mailbox->Release();
+
+    return true;
 }
 
-static DWORD WINAPI _ThreadPoolAsyncWorker(LPVOID lpThreadParameter)
+//! the mailbox of the calling thread, referenced till the thread exits
+#if defined(_WIN32)
+static __declspec(thread) _Mailbox *_currentMailbox = NULL;
+#else
+static __thread _Mailbox *_currentMailbox = NULL;
+#endif
+
+#if defined(_WIN32)
+static VOID WINAPI _OnThreadExit(PVOID value)
+#else
+static void _OnThreadExit(void *value)
+#endif
+{
+    _Mailbox *mailbox = static_cast<_Mailbox *>(value);
+    _currentMailbox = NULL;
+
+    _UnregisterMailbox(mailbox);
+    mailbox->Release();
+}
+
+struct _ThreadExitHook
+{
+#if defined(_WIN32)
+    DWORD index;
+    bool isEnabled;
+
+    _ThreadExitHook()
+        : index(::FlsAlloc(_OnThreadExit))
+        , isEnabled(FLS_OUT_OF_INDEXES != index)
+    {}
+
+    void Set(void *value) { ::FlsSetValue(index, value); }
+#else
+    pthread_key_t key;
+    bool isEnabled;
+
+    _ThreadExitHook()
+        : key()
+        , isEnabled(0 == ::pthread_key_create(&key, _OnThreadExit))
+    {}
+
+    void Set(void *value) { ::pthread_setspecific(key, value); }
+#endif
+};
+
+//! NULL if the thread owns no mailbox and isCreating is not set
+static _Mailbox *_CurrentMailbox(DWORD threadID, bool isCreating)
 {
-    PMSG pMsg = (PMSG)lpThreadParameter;
-    if (pMsg)
+    if (NULL == _currentMailbox)
     {
-        Dispatcher dispatcher;
+        static _ThreadExitHook hook;
 
-        AsyncCallable *callable = (AsyncCallable *)pMsg->wParam;
-        callable->OnEnter(&dispatcher);
+        _currentMailbox = _AcquireMailbox(threadID, isCreating);
+        if (NULL != _currentMailbox && hook.isEnabled)
+            hook.Set(_currentMailbox);
+    }
 
-        MSG msg;
-        while (GetMessage(&msg, 0, WM_USER, 0))
+    return _currentMailbox;
+}
+
+//! false means QUIT received
+static bool _DispatchMailbox(_Mailbox *mailbox, Dispatcher& dispatcher)
+{
+    UINT message = 0;
+    MailboxNode *node = NULL;
+    while (NULL != (node = mailbox->TryTake(message)))
+    {
+        if (message == CALLABLE_MESSAGE)
         {
-            if (!dispatcher.EventDispatch(&msg))
-            {
-                if (msg.message == QUIT)
-                    return 0;
-            }
+            dispatcher.EventDispatch(message, (WPARAM)static_cast<Callable *>(node), 0);
+        }
+        else if (message == ASYNCALLABLE_MESSAGE)
+        {
+            dispatcher.EventDispatch(message, (WPARAM)static_cast<AsyncCallable *>(node), 0);
+        }
+        else if (message == QUIT)
+        {
+            delete node;
+            return false;
         }
     }
 
-    return -1;
+    return true;
+}
+
+#if defined(_WIN32)
+
+ThreadContext ThreadContext::Current()
+{
+    ThreadContext context(::GetCurrentThreadId(), ::GetCurrentThread());
+
+    //! only a looper owns one, the others pump their message queue
+    context.m_mailbox = _currentMailbox;
+    if (NULL != context.m_mailbox)
+        context.m_mailbox->AddRef();
+
+    return context;
 }
 
 void Dispatcher::PostCallable(Callable *callable, const ThreadContext& context)
 {
     if (context.m_type == ThreadContext::ThreadPoolContext)
     {
-        PMSG pMsg = (PMSG)::calloc(1, sizeof(MSG));
-        if (pMsg)
-        {
-            pMsg->message = CALLABLE_MESSAGE;
-            pMsg->wParam = (WPARAM)callable;
-
-            ::QueueUserWorkItem(_ThreadPoolWorker, pMsg, 0);
-        }
+        _WorkStealingExecutor::GetInstance()->Post(callable);
     }
     else if (context.m_hWnd != NULL)
     {
         ::PostMessage(context.m_hWnd, CALLABLE_MESSAGE, (WPARAM)callable, NULL);
     }
-    else
+    else if (!_PostToMailbox(context.m_mailbox, context.m_dwThreadID, callable, CALLABLE_MESSAGE))
     {
+        //! not a looper, the thread pumps its own message queue
         ::PostThreadMessage(context.m_dwThreadID, CALLABLE_MESSAGE, (WPARAM)callable, NULL);
     }
 }
@@ -145,36 +349,19 @@ void Dispatcher::PostCallable(AsyncCallable *callable, const ThreadContext& cont
 {
     if (context.m_type == ThreadContext::ThreadPoolContext)
     {
-        PMSG pMsg = (PMSG)::calloc(1, sizeof(MSG));
-        if (pMsg)
-        {
-            pMsg->message = ASYNCALLABLE_MESSAGE;
-            pMsg->wParam = (WPARAM)callable;
-
-            ::QueueUserWorkItem(_ThreadPoolAsyncWorker, pMsg, 0);
-        }
+        _WorkStealingExecutor::GetInstance()->Post(callable);
     }
     else if (context.m_hWnd != NULL)
     {
         ::PostMessage(context.m_hWnd, ASYNCALLABLE_MESSAGE, (WPARAM)callable, NULL);
     }
-    else
+    else if (!_PostToMailbox(context.m_mailbox, context.m_dwThreadID, callable, ASYNCALLABLE_MESSAGE))
     {
+        //! not a looper, the thread pumps its own message queue
         ::PostThreadMessage(context.m_dwThreadID, ASYNCALLABLE_MESSAGE, (WPARAM)callable, NULL);
     }
 }
 
-template<typename T>
-class _LocalPointer
-{
-    T *m_;
-public:
-    _LocalPointer(T *p) : m_(p){}
-    ~_LocalPointer() { if (m_) delete m_; }
-
-    T *operator -> () { return m_; }
-};
-
 bool Dispatcher::EventDispatch(PMSG pMsg)
 {
     //! Window specific context
@@ -196,56 +383,59 @@ bool Dispatcher::EventDispatch(PMSG pMsg)
     return false;
 }
 
-bool Dispatcher::EventDispatch(UINT uMsg, WPARAM wParam, LPARAM lParam)
-{
-    if (uMsg == CALLABLE_MESSAGE)
-    {
-        _LocalPointer<Callable> callable = (Callable *)wParam;
-        callable->Invoke();
-        return true;
-    }
-    else if (uMsg == ASYNCALLABLE_MESSAGE)
-    {
-        AsyncCallable *callable = (AsyncCallable *)wParam;
-        callable->OnEnter(this);
-    }
-
-    return false;
-}
-
 void MessageLooper::Run()
 {
     Dispatcher dispatcher;
 
-    MSG msg;
-    while (GetMessage(&msg, 0, 0, 0))
+    _Mailbox *mailbox = _CurrentMailbox(::GetCurrentThreadId(), true);
+    HANDLE wakeup = mailbox->GetWakeupEvent();
+
+    while (true)
     {
-        if (!dispatcher.EventDispatch(&msg))
+        if (!_DispatchMailbox(mailbox, dispatcher))
+            return;
+
+        //! posted to the thread before the mailbox existed, or by PostThreadMessage directly
+        MSG msg;
+        while (::PeekMessage(&msg, NULL, 0, 0, PM_REMOVE))
         {
-            if (msg.message == QUIT)
-            {
-                //!	notify
+            if (msg.message == WM_QUIT)
                 return;
+
+            if (!dispatcher.EventDispatch(&msg))
+            {
+                if (msg.message == QUIT)
+                {
+                    //!	notify
+                    return;
+                }
             }
         }
+
+        if (mailbox->BeginWait())
+            ::MsgWaitForMultipleObjectsEx(1, &wakeup, INFINITE, QS_ALLINPUT, MWMO_INPUTAVAILABLE);
+        mailbox->EndWait();
     }
 }
 
 void MessageLooper::Quit()
 {
-    ::PostMessage(NULL, QUIT, NULL, NULL);
+    _Mailbox *mailbox = _CurrentMailbox(::GetCurrentThreadId(), false);
+    if (NULL != mailbox)
+        mailbox->Post(new MailboxNode, QUIT);
+    else
+        ::PostMessage(NULL, QUIT, NULL, NULL);
 }
 
 static DWORD WINAPI WorkerProc(PVOID pParam)
 {
-    DWORD workerID = ::GetCurrentThreadId();
-
     if (pParam != NULL)
     {
         Callable *callable = (Callable *)pParam;
         callable->Invoke();
     }
 
+    //! the mailbox is released by the exit hook
     MessageLooper::Run();
     return 0;
 }
@@ -263,7 +453,16 @@ Thread::~Thread()
 
 void Thread::Start(Callable *callable)
 {
-    m_context.m_hHandle = ::CreateThread(NULL, 0, WorkerProc, callable, 0, &m_context.m_dwThreadID);
+    m_context.m_hHandle = ::CreateThread(NULL, 0, WorkerProc, callable, CREATE_SUSPENDED, &m_context.m_dwThreadID);
+    if (NULL == m_context.m_hHandle)
+    {
+        m_context.m_dwThreadID = 0;
+        return;
+    }
+
+    //! mailbox must be ready before anyone posts to the context
+    m_context.m_mailbox = _AcquireMailbox(m_context.m_dwThreadID, true);
+    ::ResumeThread(m_context.m_hHandle);
 }
 
 void Thread::Stop()
@@ -271,7 +470,7 @@ void Thread::Stop()
     if (NULL != m_context.m_hHandle)
     {
         //!	send quit message 
-        ::PostThreadMessage(m_context.m_dwThreadID, QUIT, NULL, NULL);
+        m_context.m_mailbox->Post(new MailboxNode, QUIT);
 
         DWORD ldwRst = ::WaitForSingleObject(m_context.m_hHandle, 5000);
         if (ldwRst == WAIT_TIMEOUT)
@@ -281,11 +480,262 @@ void Thread::Stop()
 
         ::CloseHandle(m_context.m_hHandle);
 
+        //! no exit hook runs for a terminated one
+        _UnregisterMailbox(m_context.m_mailbox);
+        m_context.m_mailbox->Release();
+
+        m_context.m_mailbox = NULL;
         m_context.m_hHandle = NULL;
         m_context.m_dwThreadID = 0;
     }
 }
 
+#else
+
+#include <time.h>
+#include <errno.h>
+
+ManualResetEvent::ManualResetEvent()
+    : m_mutex()
+    , m_cond()
+    , m_isSignaled(false)
+{
+    pthread_condattr_t attr;
+    ::pthread_condattr_init(&attr);
+    ::pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+
+    ::pthread_mutex_init(&m_mutex, NULL);
+    ::pthread_cond_init(&m_cond, &attr);
+    ::pthread_condattr_destroy(&attr);
+}
+
+ManualResetEvent::ManualResetEvent(bool isSignaled)
+    : m_mutex()
+    , m_cond()
+    , m_isSignaled(isSignaled)
+{
+    pthread_condattr_t attr;
+    ::pthread_condattr_init(&attr);
+    ::pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+
+    ::pthread_mutex_init(&m_mutex, NULL);
+    ::pthread_cond_init(&m_cond, &attr);
+    ::pthread_condattr_destroy(&attr);
+}
+
+ManualResetEvent::~ManualResetEvent()
+{
+    ::pthread_cond_destroy(&m_cond);
+    ::pthread_mutex_destroy(&m_mutex);
+}
+
+bool ManualResetEvent::Wait(DWORD timeout)
+{
+    struct timespec deadline;
+    ::clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += timeout / 1000;
+    deadline.tv_nsec += (timeout % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L)
+    {
+        deadline.tv_sec += 1;
+        deadline.tv_nsec -= 1000000000L;
+    }
+
+    ::pthread_mutex_lock(&m_mutex);
+    while (!m_isSignaled)
+    {
+        if (INFINITE == timeout)
+        {
+            ::pthread_cond_wait(&m_cond, &m_mutex);
+        }
+        else if (ETIMEDOUT == ::pthread_cond_timedwait(&m_cond, &m_mutex, &deadline))
+        {
+            break;
+        }
+    }
+
+    bool isSignaled = m_isSignaled;
+    ::pthread_mutex_unlock(&m_mutex);
+
+    return isSignaled;
+}
+
+bool ManualResetEvent::IsSignaled() const
+{
+    ::pthread_mutex_lock(&m_mutex);
+    bool isSignaled = m_isSignaled;
+    ::pthread_mutex_unlock(&m_mutex);
+
+    return isSignaled;
+}
+
+void ManualResetEvent::Signal()
+{
+    ::pthread_mutex_lock(&m_mutex);
+    m_isSignaled = true;
+    ::pthread_cond_broadcast(&m_cond);
+    ::pthread_mutex_unlock(&m_mutex);
+}
+
+void ManualResetEvent::Reset()
+{
+    ::pthread_mutex_lock(&m_mutex);
+    m_isSignaled = false;
+    ::pthread_mutex_unlock(&m_mutex);
+}
+
+static REF _lastThreadID = 0;
+static __thread DWORD _currentThreadID = 0;
+
+static DWORD _CurrentThreadID()
+{
+    if (0 == _currentThreadID)
+        _currentThreadID = static_cast<DWORD>(::Increment(&_lastThreadID));
+
+    return _currentThreadID;
+}
+
+//! pump current thread's mailbox till QUIT received
+static void _RunMailbox(Dispatcher& dispatcher)
+{
+    _Mailbox *mailbox = _CurrentMailbox(_CurrentThreadID(), true);
+
+    while (_DispatchMailbox(mailbox, dispatcher))
+    {
+        if (mailbox->BeginWait())
+            mailbox->Wait();
+        mailbox->EndWait();
+    }
+}
+
+ThreadContext ThreadContext::Current()
+{
+    DWORD threadID = _CurrentThreadID();
+    ThreadContext context(threadID, NULL);
+
+    //! no message queue but the mailbox here, so any message posted before the looper runs will be kept
+    //!     released at the thread exit, the messages never taken are disposed then
+    context.m_mailbox = _CurrentMailbox(threadID, true);
+    context.m_mailbox->AddRef();
+
+    return context;
+}
+
+void Dispatcher::PostCallable(Callable *callable, const ThreadContext& context)
+{
+    if (context.m_type == ThreadContext::ThreadPoolContext)
+    {
+        _WorkStealingExecutor::GetInstance()->Post(callable);
+    }
+    else if (!_PostToMailbox(context.m_mailbox, context.m_dwThreadID, callable, CALLABLE_MESSAGE))
+    {
+        //! the thread has exited or never had a context
+        _DisposeMessage(callable, CALLABLE_MESSAGE);
+    }
+}
+
+void Dispatcher::PostCallable(AsyncCallable *callable, const ThreadContext& context)
+{
+    if (context.m_type == ThreadContext::ThreadPoolContext)
+    {
+        _WorkStealingExecutor::GetInstance()->Post(callable);
+    }
+    else if (!_PostToMailbox(context.m_mailbox, context.m_dwThreadID, callable, ASYNCALLABLE_MESSAGE))
+    {
+        //! the thread has exited or never had a context
+        _DisposeMessage(callable, ASYNCALLABLE_MESSAGE);
+    }
+}
+
+void MessageLooper::Run()
+{
+    Dispatcher dispatcher;
+    _RunMailbox(dispatcher);
+}
+
+void MessageLooper::Quit()
+{
+    _CurrentMailbox(_CurrentThreadID(), true)->Post(new MailboxNode, QUIT);
+}
+
+struct _WorkerParam
+{
+    DWORD threadID;
+    Callable *callable;
+};
+
+static void *WorkerProc(void *pParam)
+{
+    _WorkerParam *param = static_cast<_WorkerParam *>(pParam);
+
+    _currentThreadID = param->threadID;
+    Callable *callable = param->callable;
+    delete param;
+
+    if (callable != NULL)
+    {
+        callable->Invoke();
+    }
+
+    //! the mailbox is released by the exit hook
+    MessageLooper::Run();
+    return NULL;
+}
+
+Thread::Thread()
+: m_context()
+, m_thread()
+{
+
+}
+
+Thread::~Thread()
+{
+    Stop();
+}
+
+void Thread::Start(Callable *callable)
+{
+    DWORD threadID = static_cast<DWORD>(::Increment(&_lastThreadID));
+
+    _WorkerParam *param = new _WorkerParam;
+    param->threadID = threadID;
+    param->callable = callable;
+
+    //! mailbox must be ready before anyone posts to the context
+    _Mailbox *mailbox = _AcquireMailbox(threadID, true);
+
+    //! param is owned by the worker once started
+    if (0 != ::pthread_create(&m_thread, NULL, WorkerProc, param))
+    {
+        _UnregisterMailbox(mailbox);
+        mailbox->Release();
+        delete param;
+        return;
+    }
+
+    m_context.m_dwThreadID = threadID;
+    m_context.m_mailbox = mailbox;
+}
+
+void Thread::Stop()
+{
+    if (0 != m_context.m_dwThreadID)
+    {
+        //!	send quit message
+        m_context.m_mailbox->Post(new MailboxNode, QUIT);
+
+        ::pthread_join(m_thread, NULL);
+
+        m_context.m_mailbox->Release();
+
+        m_context.m_mailbox = NULL;
+        m_context.m_dwThreadID = 0;
+    }
+}
+
+#endif
+
 #include <set>
 
 DWORD ThreadLocalManager::Register(DWORD hint)
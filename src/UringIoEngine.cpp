@@ -0,0 +1,1131 @@
+#include "IoEngine.h"
+
+#if defined(__linux__)
+
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/eventfd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <vector>
+
+namespace Net
+{
+    namespace Details
+    {
+        enum
+        {
+            RingEntries = 256,
+
+            //! provided buffers shared by all the channels of the engine
+            BufferCount = 64,   //! power of 2
+            BufferLength = 16 * 1024,
+            BufferGroup = 0,
+
+            //! in milliseconds, waiting for the cancellations when destructing
+            DrainTimeout = 1000
+        };
+
+        //! user_data besides the operations
+        enum
+        {
+            //! completion of cancellation, tagged on the operation
+            CancelTag = 1,
+            WakeupData = 2
+        };
+
+        static int _Setup(unsigned entries, struct io_uring_params *params)
+        {
+            return static_cast<int>(::syscall(__NR_io_uring_setup, entries, params));
+        }
+
+        static int _Enter(int ringFd, unsigned toSubmit, unsigned minComplete, unsigned flags, void *arg, size_t argSize)
+        {
+            return static_cast<int>(::syscall(__NR_io_uring_enter, ringFd, toSubmit, minComplete, flags, arg, argSize));
+        }
+
+        static int _Register(int ringFd, unsigned opcode, void *arg, unsigned argCount)
+        {
+            return static_cast<int>(::syscall(__NR_io_uring_register, ringFd, opcode, arg, argCount));
+        }
+
+        class UringChannel;
+        typedef std::multimap<uint64_t, UringChannel *> UringDeadlines;
+
+        //
+        //  user_data of each submission
+        //      alive till both its final completion and the completion of its cancellation arrived
+        //
+        struct UringOp
+        {
+            enum Kind
+            {
+                ConnectOp,
+                SendOp,
+                ReceiveOp
+            };
+
+            Kind kind;
+            UringChannel *channel;
+
+            bool isFinished;
+            bool isCanceling;
+
+            //! connect only, the kernel reads it asynchronously
+            struct sockaddr_storage addr;
+            socklen_t addrLen;
+        };
+
+        class UringChannel : public Channel
+        {
+        public:
+            struct Received
+            {
+                //! -1 means no buffer
+                int bufferID;
+                uint32_t len;
+                int err;
+            };
+
+        public:
+            int m_fd;
+            ChannelHandler *m_handler;
+            SocketOptions m_options;
+
+            //! current operations, the canceled ones are no longer referenced
+            UringOp *m_connectOp;
+            UringOp *m_sendOp;
+            //! multishot, remains armed across the receivings
+            UringOp *m_receiveOp;
+            //! operations not deleted yet, including the canceled ones
+            uint32_t m_inflight;
+
+            const uint8_t *m_sendData;
+            uint32_t m_sendLength;
+            uint32_t m_sentLength;
+
+            bool m_isReceiving;
+            //! peer closed or failed, no more arming
+            bool m_isShutdown;
+            std::deque<Received> m_received;
+
+            //! in ready list
+            bool m_isQueued;
+            bool m_isClosed;
+
+            bool m_hasDeadline;
+            UringDeadlines::iterator m_deadline;
+
+        public:
+            UringChannel(ChannelHandler *handler, const SocketOptions& options)
+                : m_fd(-1)
+                , m_handler(handler)
+                , m_options(options)
+                , m_connectOp(NULL)
+                , m_sendOp(NULL)
+                , m_receiveOp(NULL)
+                , m_inflight(0)
+                , m_sendData(NULL)
+                , m_sendLength(0)
+                , m_sentLength(0)
+                , m_isReceiving(false)
+                , m_isShutdown(false)
+                , m_received()
+                , m_isQueued(false)
+                , m_isClosed(false)
+                , m_hasDeadline(false)
+                , m_deadline()
+            {}
+        };
+
+        //
+        //  io_uring through the raw syscalls
+        //      submissions are batched and flushed once per RunOnce together with the waiting
+        //      receiving is a multishot recv selecting the buffers from a ring shared by all the channels,
+        //      the buffer returns to the ring right after OnReceived
+        //
+        class UringIoEngine : public IoEngine
+        {
+        private:
+            int m_ringFd;
+
+            void *m_ring;
+            size_t m_ringSize;
+
+            //! submission queue
+            unsigned *m_sqHead;
+            unsigned *m_sqTail;
+            unsigned m_sqMask;
+            unsigned m_sqEntries;
+            unsigned *m_sqArray;
+            unsigned m_sqLocalTail;
+
+            struct io_uring_sqe *m_sqes;
+            size_t m_sqesSize;
+
+            //! completion queue
+            unsigned *m_cqHead;
+            unsigned *m_cqTail;
+            unsigned m_cqMask;
+            struct io_uring_cqe *m_cqes;
+
+            //! provided buffers
+            struct io_uring_buf_ring *m_bufferRing;
+            size_t m_bufferRingSize;
+            uint16_t m_bufferTail;
+            uint8_t *m_buffers;
+            //! taken by the completions and not returned yet
+            uint32_t m_heldBuffers;
+            //! channels whose multishot ended for lack of buffers
+            std::vector<UringChannel *> m_starved;
+
+            int m_wakeupFd;
+
+            //! only touched in the engine thread
+            std::vector<UringChannel *> m_ready;
+            UringDeadlines m_deadlines;
+            //! operations not deleted yet of all the channels
+            uint32_t m_pendingOps;
+
+            CriticalSection m_postLock;
+            std::vector<Callable *> m_posted;
+            bool m_isWakingUp;
+
+        public:
+            UringIoEngine();
+            virtual ~UringIoEngine();
+
+        public:
+            //! false when io_uring or the features required are not supported
+            bool Initialize();
+
+        public:
+            virtual Channel *CreateChannel(ChannelHandler *handler, const SocketOptions& options);
+
+            virtual void Connect(Channel *channel, const struct sockaddr *addr, socklen_t addrLen);
+            virtual void Send(Channel *channel, const uint8_t *data, uint32_t len);
+            virtual void Receive(Channel *channel);
+            virtual void Close(Channel *channel);
+
+            virtual bool IsAlive(Channel *channel);
+
+            virtual void Post(Callable *callable);
+
+        public:
+            virtual void RunOnce(DWORD timeout);
+
+        public:
+            //! called in the engine thread
+            void OnConnecting(UringChannel *channel, const struct sockaddr_storage& addr, socklen_t addrLen);
+            void OnClosing(UringChannel *channel);
+
+        private:
+            struct io_uring_sqe *AcquireSqe();
+            void Flush(unsigned waitCount, int timeout);
+
+            void SubmitConnect(UringChannel *channel, const struct sockaddr_storage& addr, socklen_t addrLen);
+            void SubmitSend(UringChannel *channel);
+            void SubmitReceive(UringChannel *channel);
+            void SubmitCancel(UringOp *op);
+            void SubmitWakeup();
+
+            void CancelAll(UringChannel *channel);
+            void ReleaseOp(UringOp *op);
+            void TryDelete(UringChannel *channel);
+
+            void AddBuffer(int bufferID);
+            void RecycleBuffer(int bufferID);
+            void RearmStarved();
+
+            void OnCompletion(uint64_t userData, int res, uint32_t flags);
+            void OnConnectCompleted(UringChannel *channel, int res);
+            void OnSendCompleted(UringChannel *channel, int res);
+            void OnReceiveCompleted(UringChannel *channel, int res, uint32_t flags);
+
+            void Schedule(UringChannel *channel);
+            void Deliver(UringChannel *channel);
+
+            void SetDeadline(UringChannel *channel, uint32_t timeout);
+            void ClearDeadline(UringChannel *channel);
+            //! once an operation completed, the other one still pending keeps its own timeout
+            void RearmDeadline(UringChannel *channel);
+
+            void DispatchCompletions();
+            void DispatchReady();
+            void DispatchPosted();
+            void DispatchDeadlines();
+        };
+
+        class UringConnectCallable : public Callable
+        {
+        private:
+            UringIoEngine *m_engine;
+            UringChannel *m_channel;
+
+            struct sockaddr_storage m_addr;
+            socklen_t m_addrLen;
+
+        public:
+            UringConnectCallable(UringIoEngine *engine, UringChannel *channel, const struct sockaddr *addr, socklen_t addrLen)
+                : m_engine(engine)
+                , m_channel(channel)
+                , m_addr()
+                , m_addrLen(addrLen)
+            {
+                ::memcpy(&m_addr, addr, addrLen);
+            }
+
+        public:
+            virtual void Invoke()
+            {
+                m_engine->OnConnecting(m_channel, m_addr, m_addrLen);
+            }
+        };
+
+        class UringCloseCallable : public Callable
+        {
+        private:
+            UringIoEngine *m_engine;
+            UringChannel *m_channel;
+
+        public:
+            UringCloseCallable(UringIoEngine *engine, UringChannel *channel)
+                : m_engine(engine)
+                , m_channel(channel)
+            {}
+
+        public:
+            virtual void Invoke()
+            {
+                m_engine->OnClosing(m_channel);
+            }
+        };
+
+        UringIoEngine::UringIoEngine()
+            : m_ringFd(-1)
+            , m_ring(MAP_FAILED)
+            , m_ringSize(0)
+            , m_sqHead(NULL)
+            , m_sqTail(NULL)
+            , m_sqMask(0)
+            , m_sqEntries(0)
+            , m_sqArray(NULL)
+            , m_sqLocalTail(0)
+            , m_sqes(static_cast<struct io_uring_sqe *>(MAP_FAILED))
+            , m_sqesSize(0)
+            , m_cqHead(NULL)
+            , m_cqTail(NULL)
+            , m_cqMask(0)
+            , m_cqes(NULL)
+            , m_bufferRing(static_cast<struct io_uring_buf_ring *>(MAP_FAILED))
+            , m_bufferRingSize(0)
+            , m_bufferTail(0)
+            , m_buffers(NULL)
+            , m_heldBuffers(0)
+            , m_starved()
+            , m_wakeupFd(-1)
+            , m_ready()
+            , m_deadlines()
+            , m_pendingOps(0)
+            , m_postLock()
+            , m_posted()
+            , m_isWakingUp(false)
+        {
+        }
+
+        UringIoEngine::~UringIoEngine()
+        {
+            DispatchPosted();
+
+            //! the closed channels are deleted once their canceled operations completed
+            while (0 != m_pendingOps)
+            {
+                Flush(1, DrainTimeout);
+
+                //! nothing completed in time
+                if (*m_cqHead == __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE))
+                    break;
+
+                DispatchCompletions();
+            }
+
+            DispatchReady();
+
+            //! closing the ring cancels everything in flight
+            if (m_ringFd >= 0)
+                ::close(m_ringFd);
+
+            if (m_wakeupFd >= 0)
+                ::close(m_wakeupFd);
+
+            if (MAP_FAILED != m_sqes)
+                ::munmap(m_sqes, m_sqesSize);
+
+            if (MAP_FAILED != m_ring)
+                ::munmap(m_ring, m_ringSize);
+
+            if (MAP_FAILED != m_bufferRing)
+                ::munmap(m_bufferRing, m_bufferRingSize);
+
+            ::free(m_buffers);
+        }
+
+        bool UringIoEngine::Initialize()
+        {
+            struct io_uring_params params;
+            ::memset(&params, 0, sizeof(params));
+            params.flags = IORING_SETUP_SUBMIT_ALL | IORING_SETUP_COOP_TASKRUN;
+
+            m_ringFd = _Setup(RingEntries, &params);
+            if (m_ringFd < 0)
+                return false;
+
+            const uint32_t requiredFeatures = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG;
+            if (requiredFeatures != (params.features & requiredFeatures))
+                return false;
+
+            //! both queues in one mapping
+            m_ringSize = (std::max)(params.sq_off.array + params.sq_entries * sizeof(unsigned),
+                params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe));
+
+            m_ring = ::mmap(NULL, m_ringSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ringFd, IORING_OFF_SQ_RING);
+            if (MAP_FAILED == m_ring)
+                return false;
+
+            uint8_t *ring = static_cast<uint8_t *>(m_ring);
+            m_sqHead = reinterpret_cast<unsigned *>(ring + params.sq_off.head);
+            m_sqTail = reinterpret_cast<unsigned *>(ring + params.sq_off.tail);
+            m_sqMask = *reinterpret_cast<unsigned *>(ring + params.sq_off.ring_mask);
+            m_sqEntries = params.sq_entries;
+            m_sqArray = reinterpret_cast<unsigned *>(ring + params.sq_off.array);
+            m_sqLocalTail = *m_sqTail;
+
+            m_cqHead = reinterpret_cast<unsigned *>(ring + params.cq_off.head);
+            m_cqTail = reinterpret_cast<unsigned *>(ring + params.cq_off.tail);
+            m_cqMask = *reinterpret_cast<unsigned *>(ring + params.cq_off.ring_mask);
+            m_cqes = reinterpret_cast<struct io_uring_cqe *>(ring + params.cq_off.cqes);
+
+            m_sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+            m_sqes = static_cast<struct io_uring_sqe *>(::mmap(NULL, m_sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ringFd, IORING_OFF_SQES));
+            if (MAP_FAILED == m_sqes)
+                return false;
+
+            //! provided buffer ring, also tells multishot recv is available(both since 5.19)
+            m_bufferRingSize = BufferCount * sizeof(struct io_uring_buf);
+            m_bufferRing = static_cast<struct io_uring_buf_ring *>(::mmap(NULL, m_bufferRingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+            if (MAP_FAILED == m_bufferRing)
+                return false;
+
+            struct io_uring_buf_reg reg;
+            ::memset(&reg, 0, sizeof(reg));
+            reg.ring_addr = reinterpret_cast<uint64_t>(m_bufferRing);
+            reg.ring_entries = BufferCount;
+            reg.bgid = BufferGroup;
+
+            if (0 != _Register(m_ringFd, IORING_REGISTER_PBUF_RING, &reg, 1))
+                return false;
+
+            m_buffers = static_cast<uint8_t *>(::malloc(BufferCount * BufferLength));
+            if (NULL == m_buffers)
+                return false;
+
+            for (int i = 0; i != BufferCount; ++i)
+                AddBuffer(i);
+
+            __atomic_store_n(&m_bufferRing->tail, m_bufferTail, __ATOMIC_RELEASE);
+
+            m_wakeupFd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            if (m_wakeupFd < 0)
+                return false;
+
+            SubmitWakeup();
+            return true;
+        }
+
+        Channel *UringIoEngine::CreateChannel(ChannelHandler *handler, const SocketOptions& options)
+        {
+            return new UringChannel(handler, options);
+        }
+
+        void UringIoEngine::Connect(Channel *channel, const struct sockaddr *addr, socklen_t addrLen)
+        {
+            Post(new UringConnectCallable(this, static_cast<UringChannel *>(channel), addr, addrLen));
+        }
+
+        void UringIoEngine::Send(Channel *channel, const uint8_t *data, uint32_t len)
+        {
+            UringChannel *uringChannel = static_cast<UringChannel *>(channel);
+
+            uringChannel->m_sendData = data;
+            uringChannel->m_sendLength = len;
+            uringChannel->m_sentLength = 0;
+
+            SetDeadline(uringChannel, SendTimeout);
+            SubmitSend(uringChannel);
+        }
+
+        void UringIoEngine::Receive(Channel *channel)
+        {
+            UringChannel *uringChannel = static_cast<UringChannel *>(channel);
+
+            uringChannel->m_isReceiving = true;
+            SetDeadline(uringChannel, ReceiveTimeout);
+
+            //! never delivered inside the calling notification
+            if (!uringChannel->m_received.empty())
+                Schedule(uringChannel);
+            else if (NULL == uringChannel->m_receiveOp && !uringChannel->m_isShutdown)
+                SubmitReceive(uringChannel);
+        }
+
+        void UringIoEngine::Close(Channel *channel)
+        {
+            //! always deferred, the channel may still be referenced by the completions in dispatching
+            Post(new UringCloseCallable(this, static_cast<UringChannel *>(channel)));
+        }
+
+        bool UringIoEngine::IsAlive(Channel *channel)
+        {
+            UringChannel *uringChannel = static_cast<UringChannel *>(channel);
+            if (uringChannel->m_fd < 0 || uringChannel->m_isClosed || NULL != uringChannel->m_connectOp)
+                return false;
+
+            //! the armed multishot has queued whatever arrived, including FIN
+            if (uringChannel->m_isShutdown || !uringChannel->m_received.empty())
+                return false;
+
+            if (NULL != uringChannel->m_receiveOp)
+                return true;
+
+            uint8_t peek = 0;
+            ssize_t received = ::recv(uringChannel->m_fd, &peek, sizeof(peek), MSG_PEEK | MSG_DONTWAIT);
+
+            return received < 0 && (EAGAIN == errno || EWOULDBLOCK == errno);
+        }
+
+        void UringIoEngine::Post(Callable *callable)
+        {
+            bool isWakingUp = false;
+            {
+                AutoLock<CriticalSection> locker(&m_postLock);
+                m_posted.push_back(callable);
+
+                isWakingUp = m_isWakingUp;
+                m_isWakingUp = true;
+            }
+
+            if (!isWakingUp)
+            {
+                uint64_t value = 1;
+                ssize_t written = ::write(m_wakeupFd, &value, sizeof(value));
+                (void)written;
+            }
+        }
+
+        void UringIoEngine::OnConnecting(UringChannel *channel, const struct sockaddr_storage& addr, socklen_t addrLen)
+        {
+            //! reconnecting
+            CancelAll(channel);
+            ClearDeadline(channel);
+
+            if (channel->m_fd >= 0)
+            {
+                ::close(channel->m_fd);
+                channel->m_fd = -1;
+            }
+
+            channel->m_isShutdown = false;
+
+            int fd = ::socket(addr.ss_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            if (fd < 0)
+            {
+                channel->m_handler->OnConnected(errno);
+                return;
+            }
+
+            int noDelay = 1;
+            ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+            ApplySocketOptions(fd, channel->m_options);
+
+            channel->m_fd = fd;
+
+            SetDeadline(channel, ConnectTimeout);
+            SubmitConnect(channel, addr, addrLen);
+        }
+
+        void UringIoEngine::OnClosing(UringChannel *channel)
+        {
+            ClearDeadline(channel);
+            CancelAll(channel);
+
+            if (channel->m_fd >= 0)
+            {
+                ::close(channel->m_fd);
+                channel->m_fd = -1;
+            }
+
+            channel->m_isClosed = true;
+            channel->m_isReceiving = false;
+            channel->m_sendData = NULL;
+
+            //! buffers never delivered
+            while (!channel->m_received.empty())
+            {
+                if (channel->m_received.front().bufferID >= 0)
+                    RecycleBuffer(channel->m_received.front().bufferID);
+
+                channel->m_received.pop_front();
+            }
+
+            std::vector<UringChannel *>::iterator starved = std::find(m_starved.begin(), m_starved.end(), channel);
+            if (starved != m_starved.end())
+                m_starved.erase(starved);
+
+            channel->m_handler->OnClosed();
+
+            TryDelete(channel);
+        }
+
+        struct io_uring_sqe *UringIoEngine::AcquireSqe()
+        {
+            if (m_sqLocalTail - __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE) >= m_sqEntries)
+            {
+                //! full, the kernel consumes all of them synchronously
+                Flush(0, 0);
+            }
+
+            unsigned index = m_sqLocalTail & m_sqMask;
+            struct io_uring_sqe *sqe = &m_sqes[index];
+            ::memset(sqe, 0, sizeof(*sqe));
+
+            m_sqArray[index] = index;
+            ++m_sqLocalTail;
+
+            return sqe;
+        }
+
+        //! timeout in milliseconds, negative means infinite
+        void UringIoEngine::Flush(unsigned waitCount, int timeout)
+        {
+            __atomic_store_n(m_sqTail, m_sqLocalTail, __ATOMIC_RELEASE);
+
+            unsigned toSubmit = m_sqLocalTail - __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE);
+            if (0 == toSubmit && 0 == waitCount)
+                return;
+
+            struct __kernel_timespec ts;
+            ts.tv_sec = timeout / 1000;
+            ts.tv_nsec = static_cast<long long>(timeout % 1000) * 1000000;
+
+            struct io_uring_getevents_arg arg;
+            ::memset(&arg, 0, sizeof(arg));
+            arg.sigmask_sz = _NSIG / 8;
+            arg.ts = timeout < 0 ? 0 : reinterpret_cast<uint64_t>(&ts);
+
+            unsigned flags = 0 == waitCount ? 0 : IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG;
+
+            //! ETIME and EINTR are expected
+            _Enter(m_ringFd, toSubmit, waitCount, flags, 0 == waitCount ? NULL : &arg, 0 == waitCount ? 0 : sizeof(arg));
+        }
+
+        void UringIoEngine::SubmitConnect(UringChannel *channel, const struct sockaddr_storage& addr, socklen_t addrLen)
+        {
+            UringOp *op = new UringOp;
+            op->kind = UringOp::ConnectOp;
+            op->channel = channel;
+            op->isFinished = false;
+            op->isCanceling = false;
+            ::memcpy(&op->addr, &addr, addrLen);
+            op->addrLen = addrLen;
+
+            struct io_uring_sqe *sqe = AcquireSqe();
+            sqe->opcode = IORING_OP_CONNECT;
+            sqe->fd = channel->m_fd;
+            sqe->addr = reinterpret_cast<uint64_t>(&op->addr);
+            sqe->off = op->addrLen;
+            sqe->user_data = reinterpret_cast<uint64_t>(op);
+
+            channel->m_connectOp = op;
+            ++channel->m_inflight;
+            ++m_pendingOps;
+        }
+
+        void UringIoEngine::SubmitSend(UringChannel *channel)
+        {
+            UringOp *op = new UringOp;
+            op->kind = UringOp::SendOp;
+            op->channel = channel;
+            op->isFinished = false;
+            op->isCanceling = false;
+
+            struct io_uring_sqe *sqe = AcquireSqe();
+            sqe->opcode = IORING_OP_SEND;
+            sqe->fd = channel->m_fd;
+            sqe->addr = reinterpret_cast<uint64_t>(channel->m_sendData + channel->m_sentLength);
+            sqe->len = channel->m_sendLength - channel->m_sentLength;
+            sqe->msg_flags = MSG_NOSIGNAL;
+            sqe->user_data = reinterpret_cast<uint64_t>(op);
+
+            channel->m_sendOp = op;
+            ++channel->m_inflight;
+            ++m_pendingOps;
+        }
+
+        void UringIoEngine::SubmitReceive(UringChannel *channel)
+        {
+            UringOp *op = new UringOp;
+            op->kind = UringOp::ReceiveOp;
+            op->channel = channel;
+            op->isFinished = false;
+            op->isCanceling = false;
+
+            struct io_uring_sqe *sqe = AcquireSqe();
+            sqe->opcode = IORING_OP_RECV;
+            sqe->fd = channel->m_fd;
+            sqe->ioprio = IORING_RECV_MULTISHOT;
+            sqe->flags = IOSQE_BUFFER_SELECT;
+            sqe->buf_group = BufferGroup;
+            sqe->user_data = reinterpret_cast<uint64_t>(op);
+
+            channel->m_receiveOp = op;
+            ++channel->m_inflight;
+            ++m_pendingOps;
+        }
+
+        void UringIoEngine::SubmitCancel(UringOp *op)
+        {
+            op->isCanceling = true;
+
+            struct io_uring_sqe *sqe = AcquireSqe();
+            sqe->opcode = IORING_OP_ASYNC_CANCEL;
+            sqe->fd = -1;
+            sqe->addr = reinterpret_cast<uint64_t>(op);
+            sqe->user_data = reinterpret_cast<uint64_t>(op) | CancelTag;
+        }
+
+        void UringIoEngine::SubmitWakeup()
+        {
+            struct io_uring_sqe *sqe = AcquireSqe();
+            sqe->opcode = IORING_OP_POLL_ADD;
+            sqe->fd = m_wakeupFd;
+            sqe->poll32_events = POLLIN;
+            sqe->len = IORING_POLL_ADD_MULTI;
+            sqe->user_data = WakeupData;
+        }
+
+        //! the canceled operations are no longer current, their completions will be dropped
+        void UringIoEngine::CancelAll(UringChannel *channel)
+        {
+            UringOp **ops[] = { &channel->m_connectOp, &channel->m_sendOp, &channel->m_receiveOp };
+
+            for (size_t i = 0; i != sizeof(ops) / sizeof(ops[0]); ++i)
+            {
+                if (NULL != *ops[i])
+                {
+                    SubmitCancel(*ops[i]);
+                    *ops[i] = NULL;
+                }
+            }
+        }
+
+        void UringIoEngine::ReleaseOp(UringOp *op)
+        {
+            if (!op->isFinished || op->isCanceling)
+                return;
+
+            UringChannel *channel = op->channel;
+            --channel->m_inflight;
+            --m_pendingOps;
+
+            delete op;
+
+            TryDelete(channel);
+        }
+
+        void UringIoEngine::TryDelete(UringChannel *channel)
+        {
+            //! the ready list will delete it
+            if (channel->m_isClosed && 0 == channel->m_inflight && !channel->m_isQueued)
+                delete channel;
+        }
+
+        void UringIoEngine::AddBuffer(int bufferID)
+        {
+            //! not through bufs, which is shifted by the empty struct of __DECLARE_FLEX_ARRAY in C++
+            struct io_uring_buf *buffer = reinterpret_cast<struct io_uring_buf *>(m_bufferRing) + (m_bufferTail & (BufferCount - 1));
+            buffer->addr = reinterpret_cast<uint64_t>(m_buffers + bufferID * BufferLength);
+            buffer->len = BufferLength;
+            buffer->bid = static_cast<uint16_t>(bufferID);
+
+            ++m_bufferTail;
+        }
+
+        void UringIoEngine::RecycleBuffer(int bufferID)
+        {
+            AddBuffer(bufferID);
+            __atomic_store_n(&m_bufferRing->tail, m_bufferTail, __ATOMIC_RELEASE);
+
+            --m_heldBuffers;
+
+            RearmStarved();
+        }
+
+        //! rearm the ones ended for lack of buffers
+        void UringIoEngine::RearmStarved()
+        {
+            if (m_starved.empty())
+                return;
+
+            std::vector<UringChannel *> starved;
+            starved.swap(m_starved);
+
+            std::vector<UringChannel *>::iterator it = starved.begin();
+            for (; it != starved.end(); ++it)
+            {
+                if (NULL == (*it)->m_receiveOp && !(*it)->m_isShutdown)
+                    SubmitReceive(*it);
+            }
+        }
+
+        void UringIoEngine::OnCompletion(uint64_t userData, int res, uint32_t flags)
+        {
+            if (WakeupData == userData)
+            {
+                uint64_t value = 0;
+                ssize_t read = ::read(m_wakeupFd, &value, sizeof(value));
+                (void)read;
+
+                if (!(flags & IORING_CQE_F_MORE))
+                    SubmitWakeup();
+                return;
+            }
+
+            if (userData & CancelTag)
+            {
+                UringOp *op = reinterpret_cast<UringOp *>(userData & ~static_cast<uint64_t>(CancelTag));
+                op->isCanceling = false;
+
+                ReleaseOp(op);
+                return;
+            }
+
+            UringOp *op = reinterpret_cast<UringOp *>(userData);
+            UringChannel *channel = op->channel;
+
+            bool isFinal = !(flags & IORING_CQE_F_MORE);
+            int bufferID = (flags & IORING_CQE_F_BUFFER) ? static_cast<int>(flags >> IORING_CQE_BUFFER_SHIFT) : -1;
+
+            if (bufferID >= 0)
+                ++m_heldBuffers;
+
+            bool isCurrent = false;
+            switch (op->kind)
+            {
+            case UringOp::ConnectOp:
+                isCurrent = op == channel->m_connectOp;
+                break;
+            case UringOp::SendOp:
+                isCurrent = op == channel->m_sendOp;
+                break;
+            case UringOp::ReceiveOp:
+                isCurrent = op == channel->m_receiveOp;
+                break;
+            }
+
+            if (isFinal)
+            {
+                if (isCurrent)
+                {
+                    if (UringOp::ConnectOp == op->kind)
+                        channel->m_connectOp = NULL;
+                    else if (UringOp::SendOp == op->kind)
+                        channel->m_sendOp = NULL;
+                    else
+                        channel->m_receiveOp = NULL;
+                }
+
+                op->isFinished = true;
+            }
+
+            if (isCurrent && !channel->m_isClosed)
+            {
+                switch (op->kind)
+                {
+                case UringOp::ConnectOp:
+                    OnConnectCompleted(channel, res);
+                    break;
+                case UringOp::SendOp:
+                    OnSendCompleted(channel, res);
+                    break;
+                case UringOp::ReceiveOp:
+                    //! the buffer is taken
+                    OnReceiveCompleted(channel, res, flags);
+                    bufferID = -1;
+                    break;
+                }
+            }
+
+            if (bufferID >= 0)
+                RecycleBuffer(bufferID);
+
+            if (isFinal)
+                ReleaseOp(op);
+        }
+
+        void UringIoEngine::OnConnectCompleted(UringChannel *channel, int res)
+        {
+            ClearDeadline(channel);
+            channel->m_handler->OnConnected(res < 0 ? -res : 0);
+        }
+
+        void UringIoEngine::OnSendCompleted(UringChannel *channel, int res)
+        {
+            if (res > 0)
+            {
+                channel->m_sentLength += static_cast<uint32_t>(res);
+
+                //! partially sent
+                if (channel->m_sentLength < channel->m_sendLength)
+                {
+                    SubmitSend(channel);
+                    return;
+                }
+            }
+
+            channel->m_sendData = NULL;
+            RearmDeadline(channel);
+
+            channel->m_handler->OnSent(channel->m_sentLength, res < 0 ? -res : 0);
+        }
+
+        void UringIoEngine::OnReceiveCompleted(UringChannel *channel, int res, uint32_t flags)
+        {
+            if (-ENOBUFS == res)
+            {
+                //! rearmed once any buffer returned
+                m_starved.push_back(channel);
+                return;
+            }
+
+            UringChannel::Received received;
+            received.bufferID = (flags & IORING_CQE_F_BUFFER) ? static_cast<int>(flags >> IORING_CQE_BUFFER_SHIFT) : -1;
+            received.len = res > 0 ? static_cast<uint32_t>(res) : 0;
+            received.err = res < 0 ? -res : 0;
+
+            if (res <= 0)
+                channel->m_isShutdown = true;
+
+            channel->m_received.push_back(received);
+
+            //! otherwise kept till next Receive, which also rearms the ended multishot
+            if (channel->m_isReceiving)
+                Deliver(channel);
+        }
+
+        void UringIoEngine::Schedule(UringChannel *channel)
+        {
+            if (!channel->m_isQueued && !channel->m_isClosed)
+            {
+                channel->m_isQueued = true;
+                m_ready.push_back(channel);
+            }
+        }
+
+        //! complete the pending receiving with the earliest data
+        void UringIoEngine::Deliver(UringChannel *channel)
+        {
+            UringChannel::Received received = channel->m_received.front();
+            channel->m_received.pop_front();
+
+            channel->m_isReceiving = false;
+            RearmDeadline(channel);
+
+            const uint8_t *data = received.bufferID < 0 ? NULL : m_buffers + received.bufferID * BufferLength;
+            channel->m_handler->OnReceived(data, received.len, received.err);
+
+            if (received.bufferID >= 0)
+                RecycleBuffer(received.bufferID);
+        }
+
+        void UringIoEngine::SetDeadline(UringChannel *channel, uint32_t timeout)
+        {
+            ClearDeadline(channel);
+
+            channel->m_deadline = m_deadlines.insert(std::make_pair(NowInMilliseconds() + timeout, channel));
+            channel->m_hasDeadline = true;
+        }
+
+        void UringIoEngine::ClearDeadline(UringChannel *channel)
+        {
+            if (channel->m_hasDeadline)
+            {
+                m_deadlines.erase(channel->m_deadline);
+                channel->m_hasDeadline = false;
+            }
+        }
+
+        void UringIoEngine::RearmDeadline(UringChannel *channel)
+        {
+            if (NULL != channel->m_sendData)
+                SetDeadline(channel, SendTimeout);
+            else if (channel->m_isReceiving)
+                SetDeadline(channel, ReceiveTimeout);
+            else
+                ClearDeadline(channel);
+        }
+
+        void UringIoEngine::RunOnce(DWORD timeout)
+        {
+            int waitTimeout = INFINITE == timeout ? -1 : static_cast<int>(timeout);
+
+            if (!m_ready.empty())
+            {
+                waitTimeout = 0;
+            }
+            else if (!m_deadlines.empty())
+            {
+                uint64_t now = NowInMilliseconds();
+                uint64_t earliest = m_deadlines.begin()->first;
+                int untilDeadline = earliest > now ? static_cast<int>(earliest - now) : 0;
+
+                if (waitTimeout < 0 || untilDeadline < waitTimeout)
+                    waitTimeout = untilDeadline;
+            }
+
+            //! submit everything issued since last round, then wait
+            Flush(0 == waitTimeout ? 0 : 1, waitTimeout);
+
+            DispatchCompletions();
+
+            //! the buffers may have all returned before the ENOBUFS got dispatched
+            if (m_heldBuffers < BufferCount)
+                RearmStarved();
+            DispatchReady();
+            DispatchPosted();
+            DispatchDeadlines();
+        }
+
+        void UringIoEngine::DispatchCompletions()
+        {
+            unsigned head = *m_cqHead;
+
+            while (head != __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE))
+            {
+                const struct io_uring_cqe *cqe = &m_cqes[head & m_cqMask];
+                uint64_t userData = cqe->user_data;
+                int res = cqe->res;
+                uint32_t flags = cqe->flags;
+
+                //! release the entry before dispatching, the notifications may submit again
+                ++head;
+                __atomic_store_n(m_cqHead, head, __ATOMIC_RELEASE);
+
+                OnCompletion(userData, res, flags);
+            }
+        }
+
+        void UringIoEngine::DispatchReady()
+        {
+            //! the ones scheduled during dispatching wait for the next round
+            std::vector<UringChannel *> ready;
+            ready.swap(m_ready);
+
+            std::vector<UringChannel *>::iterator it = ready.begin();
+            for (; it != ready.end(); ++it)
+            {
+                UringChannel *channel = *it;
+                channel->m_isQueued = false;
+
+                if (channel->m_isClosed)
+                {
+                    TryDelete(channel);
+                    continue;
+                }
+
+                if (channel->m_isReceiving && !channel->m_received.empty())
+                    Deliver(channel);
+            }
+        }
+
+        void UringIoEngine::DispatchPosted()
+        {
+            std::vector<Callable *> posted;
+            {
+                AutoLock<CriticalSection> locker(&m_postLock);
+                posted.swap(m_posted);
+                m_isWakingUp = false;
+            }
+
+            std::vector<Callable *>::iterator it = posted.begin();
+            for (; it != posted.end(); ++it)
+            {
+                (*it)->Invoke();
+                delete *it;
+            }
+        }
+
+        void UringIoEngine::DispatchDeadlines()
+        {
+            uint64_t now = NowInMilliseconds();
+
+            while (!m_deadlines.empty() && m_deadlines.begin()->first <= now)
+            {
+                UringChannel *channel = m_deadlines.begin()->second;
+                m_deadlines.erase(m_deadlines.begin());
+                channel->m_hasDeadline = false;
+
+                if (NULL != channel->m_connectOp)
+                {
+                    SubmitCancel(channel->m_connectOp);
+                    channel->m_connectOp = NULL;
+
+                    channel->m_handler->OnConnected(ETIMEDOUT);
+                }
+                else if (NULL != channel->m_sendData)
+                {
+                    if (NULL != channel->m_sendOp)
+                    {
+                        SubmitCancel(channel->m_sendOp);
+                        channel->m_sendOp = NULL;
+                    }
+
+                    channel->m_sendData = NULL;
+                    RearmDeadline(channel);
+
+                    channel->m_handler->OnSent(channel->m_sentLength, ETIMEDOUT);
+                }
+                else if (channel->m_isReceiving)
+                {
+                    //! multishot remains armed
+                    channel->m_isReceiving = false;
+                    channel->m_handler->OnReceived(NULL, 0, ETIMEDOUT);
+                }
+            }
+        }
+
+        IoEngine *CreateUringIoEngine()
+        {
+            UringIoEngine *engine = new UringIoEngine;
+            if (!engine->Initialize())
+            {
+                delete engine;
+                return NULL;
+            }
+
+            return engine;
+        }
+    }
+}
+
+#endif
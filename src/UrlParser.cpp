@@ -0,0 +1,482 @@
+#include "UrlParser.h"
+#include "HttpClient.h"
+
+#include <type_traits>
+
+namespace Net
+{
+    namespace Details
+    {
+        enum
+        {
+            UnreservedClass = 0x01,
+            SubDelimClass = 0x02,
+            HexClass = 0x04,
+            SchemeClass = 0x08
+        };
+
+        //! RFC 3986 2.2, 2.3 and 3.1, ASCII only
+        static const uint8_t CharClasses[128] =
+        {
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+            0x00, 0x02, 0x00, 0x00, 0x02, 0x00, 0x02, 0x02, 0x02, 0x02, 0x02, 0x0A, 0x02, 0x09, 0x09, 0x00,
+            0x0D, 0x0D, 0x0D, 0x0D, 0x0D, 0x0D, 0x0D, 0x0D, 0x0D, 0x0D, 0x00, 0x02, 0x00, 0x02, 0x00, 0x00,
+            0x00, 0x0D, 0x0D, 0x0D, 0x0D, 0x0D, 0x0D, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09,
+            0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x00, 0x00, 0x00, 0x00, 0x01,
+            0x00, 0x0D, 0x0D, 0x0D, 0x0D, 0x0D, 0x0D, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09,
+            0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x00, 0x00, 0x00, 0x01, 0x00
+        };
+
+        template<typename CharType>
+        static inline uint32_t _CodeOf(CharType c)
+        {
+            return static_cast<uint32_t>(static_cast<typename std::make_unsigned<CharType>::type>(c));
+        }
+
+        static inline bool _IsClass(uint32_t c, uint8_t classes)
+        {
+            return c < 128 && 0 != (CharClasses[c] & classes);
+        }
+
+        static inline uint32_t _ToLower(uint32_t c)
+        {
+            return 'A' <= c && c <= 'Z' ? c - 'A' + 'a' : c;
+        }
+
+        //! pct-encoded is skipped as a whole, false when malformed
+        template<typename CharType>
+        static inline bool _SkipEscaped(const CharType *url, size_t length, size_t& i)
+        {
+            if (i + 2 >= length || !_IsClass(_CodeOf(url[i + 1]), HexClass) || !_IsClass(_CodeOf(url[i + 2]), HexClass))
+                return false;
+
+            i += 2;
+            return true;
+        }
+
+        //! userinfo and reg-name, ':' is allowed by userinfo only
+        template<typename CharType>
+        static bool _IsValidAuthorityPart(const CharType *url, size_t start, size_t end, bool isColonAllowed)
+        {
+            for (size_t i = start; i != end; ++i)
+            {
+                uint32_t c = _CodeOf(url[i]);
+                if ('%' == c)
+                {
+                    if (!_SkipEscaped(url, end, i))
+                        return false;
+                }
+                else if (!_IsClass(c, UnreservedClass | SubDelimClass) && !(isColonAllowed && ':' == c))
+                {
+                    return false;
+                }
+            }
+
+            return true;
+        }
+
+        //! IPv6address or IPvFuture, loosely, the resolver has the last word
+        template<typename CharType>
+        static bool _IsValidIpLiteral(const CharType *url, size_t start, size_t end)
+        {
+            if (start == end)
+                return false;
+
+            uint32_t first = _ToLower(_CodeOf(url[start]));
+            if ('v' == first)
+                return _IsValidAuthorityPart(url, start + 1, end, true);
+
+            for (size_t i = start; i != end; ++i)
+            {
+                uint32_t c = _CodeOf(url[i]);
+                if (!_IsClass(c, HexClass) && ':' != c && '.' != c)
+                    return false;
+            }
+
+            return true;
+        }
+
+        //! the path, the query and the fragment
+        //! besides pchar, the non-ASCII ones are allowed as IRI, and are sent as they are
+        template<typename CharType>
+        bool ParseUrlPath(const CharType *url, size_t length, uint32_t prefixLength, UrlParts& parts)
+        {
+            size_t fragmentStart = length;
+
+            for (size_t i = prefixLength; i != length; ++i)
+            {
+                uint32_t c = _CodeOf(url[i]);
+                //! '?' starts the query, and is allowed by the query and the fragment as well
+                if (_IsClass(c, UnreservedClass | SubDelimClass) || '/' == c || ':' == c || '@' == c || '?' == c || c >= 128)
+                    continue;
+
+                if ('%' == c)
+                {
+                    if (!_SkipEscaped(url, length, i))
+                        return false;
+                }
+                else if ('#' == c && length == fragmentStart)
+                {
+                    fragmentStart = i;
+                }
+                else
+                {
+                    return false;
+                }
+            }
+
+            parts.path.offset = prefixLength;
+            parts.path.length = static_cast<uint32_t>(fragmentStart - prefixLength);
+            parts.fragment.offset = static_cast<uint32_t>(length == fragmentStart ? length : fragmentStart + 1);
+            parts.fragment.length = static_cast<uint32_t>(length - parts.fragment.offset);
+
+            return true;
+        }
+
+        template<typename CharType>
+        bool ParseUrl(const CharType *url, size_t length, UrlParts& parts)
+        {
+            //! spans are 32 bits
+            if (length > 0xFFFFFFFFu)
+                return false;
+
+            //! scheme = ALPHA *( ALPHA / DIGIT / "+" / "-" / "." )
+            size_t schemeEnd = 0;
+            for (; schemeEnd != length && ':' != _CodeOf(url[schemeEnd]); ++schemeEnd)
+            {
+                if (!_IsClass(_CodeOf(url[schemeEnd]), SchemeClass))
+                    return false;
+            }
+
+            if (4 == schemeEnd || 5 == schemeEnd)
+            {
+                static const char Https[] = "https";
+                for (size_t i = 0; i != schemeEnd; ++i)
+                {
+                    if (_ToLower(_CodeOf(url[i])) != static_cast<uint32_t>(Https[i]))
+                        return false;
+                }
+            }
+            else
+            {
+                return false;
+            }
+
+            parts.isHttps = 5 == schemeEnd;
+
+            //! hier-part of http(s) always comes with the authority
+            if (schemeEnd + 3 > length || '/' != _CodeOf(url[schemeEnd + 1]) || '/' != _CodeOf(url[schemeEnd + 2]))
+                return false;
+
+            size_t authorityStart = schemeEnd + 3;
+            size_t authorityEnd = authorityStart;
+            for (; authorityEnd != length; ++authorityEnd)
+            {
+                uint32_t c = _CodeOf(url[authorityEnd]);
+                if ('/' == c || '?' == c || '#' == c)
+                    break;
+            }
+
+            //! userinfo, the last '@' ends it
+            size_t hostStart = authorityStart;
+            for (size_t i = authorityEnd; i != authorityStart; --i)
+            {
+                if ('@' == _CodeOf(url[i - 1]))
+                {
+                    hostStart = i;
+                    break;
+                }
+            }
+
+            parts.userInfo.offset = static_cast<uint32_t>(authorityStart);
+            parts.userInfo.length = static_cast<uint32_t>(hostStart == authorityStart ? 0 : hostStart - 1 - authorityStart);
+            if (!_IsValidAuthorityPart(url, authorityStart, authorityStart + parts.userInfo.length, true))
+                return false;
+
+            size_t portStart = authorityEnd;
+            if (hostStart != authorityEnd && '[' == _CodeOf(url[hostStart]))
+            {
+                size_t bracket = hostStart + 1;
+                while (bracket != authorityEnd && ']' != _CodeOf(url[bracket]))
+                    ++bracket;
+
+                if (bracket == authorityEnd || !_IsValidIpLiteral(url, hostStart + 1, bracket))
+                    return false;
+
+                parts.host.offset = static_cast<uint32_t>(hostStart + 1);
+                parts.host.length = static_cast<uint32_t>(bracket - hostStart - 1);
+
+                if (bracket + 1 != authorityEnd)
+                {
+                    if (':' != _CodeOf(url[bracket + 1]))
+                        return false;
+
+                    portStart = bracket + 2;
+                }
+            }
+            else
+            {
+                size_t hostEnd = hostStart;
+                while (hostEnd != authorityEnd && ':' != _CodeOf(url[hostEnd]))
+                    ++hostEnd;
+
+                if (hostEnd == hostStart || !_IsValidAuthorityPart(url, hostStart, hostEnd, false))
+                    return false;
+
+                parts.host.offset = static_cast<uint32_t>(hostStart);
+                parts.host.length = static_cast<uint32_t>(hostEnd - hostStart);
+
+                if (hostEnd != authorityEnd)
+                    portStart = hostEnd + 1;
+            }
+
+            //! port = *DIGIT, the default one when empty
+            parts.port = parts.isHttps ? 443 : 80;
+            if (portStart < authorityEnd)
+            {
+                uint32_t port = 0;
+                for (size_t i = portStart; i != authorityEnd; ++i)
+                {
+                    uint32_t c = _CodeOf(url[i]);
+                    if (c < '0' || c > '9')
+                        return false;
+
+                    port = port * 10 + (c - '0');
+                    if (port > 0xFFFF)
+                        return false;
+                }
+
+                parts.port = static_cast<uint16_t>(port);
+            }
+
+            parts.prefixLength = static_cast<uint32_t>(authorityEnd);
+
+            return ParseUrlPath(url, length, parts.prefixLength, parts);
+        }
+
+        template<typename CharType>
+        static void _AppendAscii(std::basic_string<CharType>& s, const char *ascii)
+        {
+            for (; '\0' != *ascii; ++ascii)
+                s.push_back(static_cast<CharType>(*ascii));
+        }
+
+        template<typename CharType>
+        static void _AppendPort(std::basic_string<CharType>& s, uint16_t port)
+        {
+            char digits[8] = { 0 };
+            char *digit = digits + sizeof(digits) - 1;
+            do
+            {
+                *--digit = static_cast<char>('0' + port % 10);
+                port /= 10;
+            } while (0 != port);
+
+            s.push_back(static_cast<CharType>(':'));
+            _AppendAscii(s, digit);
+        }
+
+        //! FNV-1a of the code units
+        template<typename CharType>
+        static uint32_t _HashOf(const CharType *s, size_t length)
+        {
+            uint32_t hash = 2166136261u;
+            for (size_t i = 0; i != length; ++i)
+            {
+                uint32_t c = _CodeOf(s[i]);
+                do
+                {
+                    hash ^= c & 0xFF;
+                    hash *= 16777619u;
+                    c >>= 8;
+                } while (0 != c);
+            }
+
+            return hash;
+        }
+
+        template<typename CharType>
+        UrlPrefixCache<CharType>::UrlPrefixCache(uint32_t capacity)
+            : m_shardCapacity((capacity + CacheShardCount - 1) / CacheShardCount)
+        {
+            if (0 == m_shardCapacity)
+                m_shardCapacity = 1;
+
+            //! twice the entries at most, a power of 2
+            size_t bucketCount = 1;
+            while (bucketCount < m_shardCapacity * 2)
+                bucketCount <<= 1;
+
+            for (uint32_t i = 0; i != CacheShardCount; ++i)
+                m_shards[i].buckets.resize(bucketCount, NULL);
+        }
+
+        template<typename CharType>
+        UrlPrefixCache<CharType>::~UrlPrefixCache()
+        {
+            for (uint32_t i = 0; i != CacheShardCount; ++i)
+            {
+                Shard& shard = m_shards[i];
+                while (!shard.entries.IsEmpty())
+                    Remove(shard, shard.entries.GetFirst());
+            }
+        }
+
+        template<typename CharType>
+        void UrlPrefixCache<CharType>::Crack(const CharType *url, size_t length, PrefixPointer& prefix, UrlParts& parts)
+        {
+            //! the prefix ends at the path, the query or the fragment after "://"
+            size_t keyLength = 0;
+            for (; keyLength != length && ':' != _CodeOf(url[keyLength]); ++keyLength)
+            {
+            }
+
+            keyLength += 3;
+            for (; keyLength < length; ++keyLength)
+            {
+                uint32_t c = _CodeOf(url[keyLength]);
+                if ('/' == c || '?' == c || '#' == c)
+                    break;
+            }
+
+            if (keyLength > length || length > 0xFFFFFFFFu)
+                throw InvalidURLFormatException();
+
+            uint32_t keyHash = _HashOf(url, keyLength);
+            Shard& shard = m_shards[keyHash % CacheShardCount];
+
+            bool isHit = false;
+            {
+                AutoLock<CriticalSection> locker(&shard.lock);
+
+                Prefix *found = Find(shard, url, static_cast<uint32_t>(keyLength), keyHash);
+                if (NULL != found)
+                {
+                    //! the most recently used goes last
+                    shard.entries.Erase(found);
+                    shard.entries.PushBack(found);
+
+                    found->m_ref.AddRef();
+                    prefix = PrefixPointer(found);
+                    isHit = true;
+                }
+            }
+
+            if (isHit)
+            {
+                parts.isHttps = prefix->isHttps;
+                parts.port = prefix->port;
+                parts.prefixLength = static_cast<uint32_t>(keyLength);
+
+                if (!ParseUrlPath(url, length, parts.prefixLength, parts))
+                    throw InvalidURLFormatException();
+
+                return;
+            }
+
+            if (!ParseUrl(url, length, parts))
+                throw InvalidURLFormatException();
+
+            Prefix *built = CreateUrlPrefix(url, parts);
+            built->m_key.assign(url, parts.prefixLength);
+            built->m_keyHash = keyHash;
+
+            //! a concurrent miss of the same prefix may have inserted it, the latest one replaces it
+            AutoLock<CriticalSection> locker(&shard.lock);
+
+            Prefix *found = Find(shard, url, static_cast<uint32_t>(keyLength), keyHash);
+            if (NULL != found)
+                Remove(shard, found);
+
+            if (shard.entries.GetSize() >= m_shardCapacity)
+                Remove(shard, shard.entries.GetFirst());
+
+            built->m_ref.AddRef();
+            Insert(shard, built);
+
+            prefix = PrefixPointer(built);
+        }
+
+        template<typename CharType>
+        typename UrlPrefixCache<CharType>::Prefix *UrlPrefixCache<CharType>::Find(Shard& shard, const CharType *key, uint32_t keyLength, uint32_t keyHash)
+        {
+            Prefix *each = shard.buckets[(keyHash / CacheShardCount) & (shard.buckets.size() - 1)];
+            for (; NULL != each; each = each->m_bucketNext)
+            {
+                if (each->m_keyHash == keyHash && each->m_key.size() == keyLength && 0 == each->m_key.compare(0, keyLength, key, keyLength))
+                    return each;
+            }
+
+            return NULL;
+        }
+
+        template<typename CharType>
+        void UrlPrefixCache<CharType>::Insert(Shard& shard, Prefix *prefix)
+        {
+            Prefix *&bucket = shard.buckets[(prefix->m_keyHash / CacheShardCount) & (shard.buckets.size() - 1)];
+            prefix->m_bucketNext = bucket;
+            bucket = prefix;
+
+            shard.entries.PushBack(prefix);
+        }
+
+        template<typename CharType>
+        void UrlPrefixCache<CharType>::Remove(Shard& shard, Prefix *prefix)
+        {
+            Prefix **link = &shard.buckets[(prefix->m_keyHash / CacheShardCount) & (shard.buckets.size() - 1)];
+            while (*link != prefix)
+                link = &(*link)->m_bucketNext;
+
+            *link = prefix->m_bucketNext;
+            prefix->m_bucketNext = NULL;
+
+            shard.entries.Erase(prefix);
+
+            //! the requests in flight may still hold it
+            if (prefix->m_ref.Release())
+                delete prefix;
+        }
+
+        template<typename CharType>
+        UrlPrefix<CharType> *CreateUrlPrefix(const CharType *url, const UrlParts& parts)
+        {
+            UrlPrefix<CharType> *prefix = new UrlPrefix<CharType>;
+
+            prefix->isHttps = parts.isHttps;
+            prefix->port = parts.port;
+
+            //! reg-name is case-insensitive, so is the hex of an IPv6 literal
+            for (uint32_t i = 0; i != parts.host.length; ++i)
+                prefix->host.push_back(static_cast<CharType>(_ToLower(_CodeOf(url[parts.host.offset + i]))));
+
+            bool isIpLiteral = '[' == _CodeOf(url[parts.host.offset - 1]);
+            if (isIpLiteral)
+                prefix->authority.push_back(static_cast<CharType>('['));
+            prefix->authority.append(prefix->host);
+            if (isIpLiteral)
+                prefix->authority.push_back(static_cast<CharType>(']'));
+
+            _AppendAscii(prefix->origin, parts.isHttps ? "https://" : "http://");
+            prefix->origin.append(prefix->authority);
+            _AppendPort(prefix->origin, parts.port);
+            prefix->originHash = _HashOf(prefix->origin.c_str(), prefix->origin.size());
+
+            if (parts.port != (parts.isHttps ? 443 : 80))
+                _AppendPort(prefix->authority, parts.port);
+
+            return prefix;
+        }
+
+        template bool ParseUrl<char>(const char *url, size_t length, UrlParts& parts);
+        template bool ParseUrl<wchar_t>(const wchar_t *url, size_t length, UrlParts& parts);
+        template bool ParseUrlPath<char>(const char *url, size_t length, uint32_t prefixLength, UrlParts& parts);
+        template bool ParseUrlPath<wchar_t>(const wchar_t *url, size_t length, uint32_t prefixLength, UrlParts& parts);
+
+        template UrlPrefix<char> *CreateUrlPrefix<char>(const char *url, const UrlParts& parts);
+        template UrlPrefix<wchar_t> *CreateUrlPrefix<wchar_t>(const wchar_t *url, const UrlParts& parts);
+
+        template class UrlPrefixCache<char>;
+        template class UrlPrefixCache<wchar_t>;
+    }
+}
@@ -0,0 +1,156 @@
+#ifndef URLPARSER_H
+#define URLPARSER_H
+
+#include "HttpClientModule.h"
+#include "IntrusiveList.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace Net
+{
+    namespace Details
+    {
+        //! part of the url, offset and length into it
+        struct UrlSpan
+        {
+            uint32_t offset;
+            uint32_t length;
+        };
+
+        //
+        //  absolute http(s) url of RFC 3986, validated and split without any allocation
+        //      the spans refer to the parsed buffer, the brackets of an IP literal are excluded from the host
+        //      the prefix is the scheme and the authority, the path is followed by the query
+        //
+        struct UrlParts
+        {
+            bool isHttps;
+            //! the default one of the scheme when absent
+            uint16_t port;
+            uint32_t prefixLength;
+            UrlSpan userInfo;
+            UrlSpan host;
+            //! path with query, empty means "/"
+            UrlSpan path;
+            //! without '#'
+            UrlSpan fragment;
+        };
+
+        //! false when malformed or neither http nor https
+        template<typename CharType>
+        bool ParseUrl(const CharType *url, size_t length, UrlParts& parts);
+
+        //! the part after a prefix known to be valid, only the path and the fragment are filled
+        template<typename CharType>
+        bool ParseUrlPath(const CharType *url, size_t length, uint32_t prefixLength, UrlParts& parts);
+
+        //
+        //  scheme and authority shared by the requests sent to the same endpoint
+        //      the scheme and the host are lowered, so the url differing in case share the connections
+        //
+        template<typename CharType>
+        class UrlPrefix : public IntrusiveListNode
+        {
+        public:
+            typedef std::basic_string<CharType> StringType;
+
+        public:
+            AtomicRef m_ref;
+
+            bool isHttps;
+            uint16_t port;
+            StringType host;
+            //! scheme://host:port, the key of the connections
+            StringType origin;
+            //! FNV-1a of origin
+            uint32_t originHash;
+            //! value of Host, or :authority of HTTP/2
+            StringType authority;
+
+        private:
+            template<typename T>
+            friend class UrlPrefixCache;
+
+            //! as it appears in the url, the key of the cache
+            StringType m_key;
+            uint32_t m_keyHash;
+            UrlPrefix *m_bucketNext;
+
+        public:
+            UrlPrefix()
+                : m_ref()
+                , isHttps(false)
+                , port(0)
+                , host()
+                , origin()
+                , originHash(0)
+                , authority()
+                , m_key()
+                , m_keyHash(0)
+                , m_bucketNext(NULL)
+            {}
+        };
+
+        //! the prefix of the parsed url, not cached
+        template<typename CharType>
+        UrlPrefix<CharType> *CreateUrlPrefix(const CharType *url, const UrlParts& parts);
+
+        //
+        //  the prefixes of the latest urls, the least recently used one is dropped once full
+        //      a hit only validates the path, neither the prefix is parsed nor the origin is built and hashed
+        //      sharded by the hash of the prefix, lookups never allocate
+        //
+        template<typename CharType>
+        class UrlPrefixCache
+        {
+        public:
+            typedef UrlPrefix<CharType> Prefix;
+            typedef RefSharedPointer<Prefix> PrefixPointer;
+
+            enum
+            {
+                //! a few hundreds of endpoints are common, each entry takes about 200 bytes
+                DefaultCapacity = 1024
+            };
+
+        private:
+            enum
+            {
+                CacheShardCount = 8
+            };
+
+            struct Shard
+            {
+                CriticalSection lock;
+                std::vector<Prefix *> buckets;
+                //! least recently used first
+                IntrusiveList<Prefix> entries;
+            };
+
+        private:
+            uint32_t m_shardCapacity;
+            Shard m_shards[CacheShardCount];
+
+        public:
+            explicit UrlPrefixCache(uint32_t capacity = DefaultCapacity);
+            ~UrlPrefixCache();
+
+        public:
+            //! throws InvalidURLFormatException when malformed
+            void Crack(const CharType *url, size_t length, PrefixPointer& prefix, UrlParts& parts);
+
+        private:
+            Prefix *Find(Shard& shard, const CharType *key, uint32_t keyLength, uint32_t keyHash);
+            void Insert(Shard& shard, Prefix *prefix);
+            void Remove(Shard& shard, Prefix *prefix);
+
+        private:
+            UrlPrefixCache(const UrlPrefixCache&);
+            UrlPrefixCache& operator = (const UrlPrefixCache&);
+        };
+    }
+}
+
+#endif
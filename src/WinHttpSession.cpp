@@ -0,0 +1,1123 @@
+#include "HttpSessionPrivate.h"
+
+#if defined(_WIN32)
+
+#include "IntrusiveList.h"
+#include "UrlParser.h"
+#include "BufferPool.h"
+
+#include <Windows.h>
+#include <Winhttp.h>
+
+#pragma comment(lib, "Winhttp.lib")
+
+#include <map>
+
+#define ERROR_HTTP_HEADER_NOT_FOUND 12150
+
+//! not defined by the older SDKs
+#ifndef WINHTTP_OPTION_ENABLE_HTTP_PROTOCOL
+#  define WINHTTP_OPTION_ENABLE_HTTP_PROTOCOL 133
+#endif
+#ifndef WINHTTP_PROTOCOL_FLAG_HTTP2
+#  define WINHTTP_PROTOCOL_FLAG_HTTP2 0x1
+#endif
+#ifndef WINHTTP_PROTOCOL_FLAG_HTTP3
+#  define WINHTTP_PROTOCOL_FLAG_HTTP3 0x2
+#endif
+
+namespace Net
+{
+    namespace Details
+    {
+        class AbstractHttpHandler;
+        //! each handler unlinks itself when finished
+        typedef IntrusiveList<AbstractHttpHandler> HttpHandlers;
+        //! keyed by scheme://host:port
+        typedef std::map<String, HINTERNET> HostConnections;
+        typedef UrlPrefixCache<wchar_t> UrlCache;
+    }
+
+    class WinHttpSessionPrivate : public HttpSession::Private
+    {
+    protected:
+        struct HttpSecurityOptions
+        {
+            bool isHttps;
+            //! cert
+        };
+
+    protected:
+        HINTERNET m_hSession;
+        Details::HostConnections m_connections;
+        Details::HttpHandlers m_handlers;
+        //! thread safe by itself
+        Details::UrlCache m_urlCache;
+
+        HttpSessionConfig m_config;
+
+    public:
+        WinHttpSessionPrivate()
+            : m_hSession(NULL)
+            , m_connections()
+            , m_handlers()
+            , m_urlCache()
+            , m_config()
+        {}
+
+        explicit WinHttpSessionPrivate(const HttpSessionConfig& config)
+            : m_hSession(NULL)
+            , m_connections()
+            , m_handlers()
+            , m_urlCache()
+            , m_config(config)
+        {}
+
+        virtual ~WinHttpSessionPrivate()
+        {
+        }
+
+    public:
+        HINTERNET AcquireRequest(const URL& url, const HttpVerb& verb);
+
+    public:
+        virtual void SendRequest(const HttpRequest *req, AsyncCompletionGenericDelegate *delegate);
+        virtual void Disconnect();
+
+    public:
+        //! send request
+        //! ###
+        //! When disconnecting, this method should never be invoked
+        //!
+        virtual void SendRequest(HINTERNET hReq, const HttpRequest *req, AsyncCompletionGenericDelegate *delegate);
+        //! notify handlers
+        virtual void OnDisconnect();
+        virtual void OnHandleFinished(Details::AbstractHttpHandler *handler);
+
+        //! send redirect request
+        virtual void SendRedirect(const HttpRequest *req,
+            AsyncCompletionGenericDelegate *delegate,
+            RedirectCompletionGenericDelegate *redirectDelegate,
+            const HttpResponseHeaders& headers);
+
+    protected:
+        //! the connection handle is kept for the following requests of the same origin
+        //! so that WinHttp reuses its keep-alive sockets
+        virtual HINTERNET AcquireConnection(const HttpSecurityOptions& securityOpts, const String& host, uint16_t port, const String& origin);
+
+    private:
+        HINTERNET OpenRequest(HINTERNET connection, const String& path, HttpVerb verb, const HttpSecurityOptions& securityOpts);
+    };
+
+    class LockHttpSessionPrivate : public WinHttpSessionPrivate
+    {
+    private:
+        enum
+        {
+            ShardCount = 16
+        };
+
+        //! the handlers are spread by address, so that sending and finishing rarely contend
+        struct HandlerShard
+        {
+            CriticalSection lock;
+            Details::HttpHandlers handlers;
+        };
+
+    private:
+        //! guards the connections only
+        CriticalSection m_lock;
+
+        HandlerShard m_shards[ShardCount];
+        //! handlers of all the shards
+        REF m_handlerCount;
+        //! when terminating, the state of the event will shift to unsignaled
+        ManualResetEvent m_disconnectedEvent;
+
+    public:
+        LockHttpSessionPrivate();
+        explicit LockHttpSessionPrivate(const HttpSessionConfig& config);
+
+    public:
+        virtual void SendRequest(HINTERNET hReq, const HttpRequest *req, AsyncCompletionGenericDelegate *delegate);
+        //! notify handlers
+        virtual void OnDisconnect();
+
+        //! ###
+        //! called in thread pool
+        virtual void OnHandleFinished(Details::AbstractHttpHandler *handler);
+
+        //! send redirect request
+        virtual void SendRedirect(const HttpRequest *req,
+            AsyncCompletionGenericDelegate *delegate,
+            RedirectCompletionGenericDelegate *redirectDelegate,
+            const HttpResponseHeaders& headers);
+
+    protected:
+        virtual HINTERNET AcquireConnection(const HttpSecurityOptions& securityOpts, const String& host, uint16_t port, const String& origin);
+
+    private:
+        HandlerShard& ShardOf(Details::AbstractHttpHandler *handler);
+    };
+
+    namespace Details
+    {
+        class OneTimeStream : public InputStream
+        {
+        private:
+            AdaptiveReadLength m_readLength;
+            uint32_t m_buffLength;
+            uint32_t m_readOffset;
+
+        public:
+            uint32_t m_readableLength;
+            uint8_t *m_buffer;
+            int64_t m_contentLength;
+
+        public:
+            OneTimeStream()
+                : m_readLength()
+                , m_buffLength(0)
+                , m_readOffset(0)
+                , m_readableLength(0)
+                , m_buffer(NULL)
+                , m_contentLength(0)
+            {}
+            ~OneTimeStream()
+            {
+                Deallocate();
+            }
+
+        public:
+            virtual int64_t GetTotal() const { return m_contentLength; }
+
+        public:
+            virtual int64_t GetAvailCount() const { return m_readableLength; }
+            virtual uint32_t Read(uint8_t *buffer, uint32_t read);
+
+        public:
+            uint32_t BufferLength() const { return m_buffLength; }
+
+        public:
+            //! as long as the read length, reallocated once it changed
+            void Allocate();
+            void Deallocate();
+
+            //! length bytes have been read or written through the buffer
+            void OnFilled(uint32_t length);
+        };
+
+        uint32_t OneTimeStream::Read(uint8_t *buffer, uint32_t read)
+        {
+            uint32_t aboutToRead = min(read, m_readableLength);
+            ::memcpy(buffer, m_buffer + m_readOffset, aboutToRead);
+
+            m_readOffset += aboutToRead;
+            m_readableLength -= aboutToRead;
+
+            return aboutToRead;
+        }
+
+        void OneTimeStream::Allocate()
+        {
+            if (m_buffer && m_readLength.Get() != m_buffLength)
+                Deallocate();
+
+            m_buffLength = m_readLength.Get();
+            if (!m_buffer)
+                m_buffer = static_cast<uint8_t *>(BufferPool::Allocate(m_buffLength));
+        }
+
+        void OneTimeStream::Deallocate()
+        {
+            if (m_buffer)
+            {
+                BufferPool::Free(m_buffer, m_buffLength);
+                m_buffer = NULL;
+            }
+        }
+
+        void OneTimeStream::OnFilled(uint32_t length)
+        {
+            m_readLength.Update(length);
+
+            m_readOffset = 0;
+            m_readableLength = length;
+        }
+
+        static Exception *ConvertLastError(DWORD dwErr)
+        {
+            //! check error
+            if (ERROR_WINHTTP_INVALID_URL == dwErr)
+                return new InvalidURLFormatException();
+
+            return new NetException(dwErr);
+        }
+
+        class AbstractHttpHandler : public IntrusiveListNode
+        {
+        public:
+            const HttpRequest *m_request;
+
+        protected:
+            //! when closed, all those will be NULL
+            HINTERNET m_hRequest;
+
+            AsyncCompletionGenericDelegate *m_completionAsyncHandler;
+
+            AsyncCompletionGenericDelegate *m_normalAsyncHandler;
+            RedirectCompletionGenericDelegate *m_redirectDelegate;
+
+            WinHttpSessionPrivate *m_sessionImpl;
+
+        protected:
+            //! deallocate when closed 
+            OneTimeStream m_bufferStream;
+
+            HttpResponseHeaders m_headers;
+
+        public:
+            AbstractHttpHandler(HINTERNET hReq, const HttpRequest *req, AsyncCompletionGenericDelegate *delegate, WinHttpSessionPrivate *sessionImpl)
+                : m_hRequest(hReq)
+                , m_redirectDelegate(RedirectCompletionGenericDelegate::GetDefaultDelegate())
+                , m_completionAsyncHandler(delegate)
+                , m_normalAsyncHandler(delegate)
+                , m_request(req)
+                , m_sessionImpl(sessionImpl)
+            {}
+
+            AbstractHttpHandler(HINTERNET hReq, const HttpRequest *req, AsyncCompletionGenericDelegate *delegate, RedirectCompletionGenericDelegate *redirectDelegate, WinHttpSessionPrivate *sessionImpl)
+                : m_hRequest(hReq)
+                , m_redirectDelegate(redirectDelegate)
+                , m_completionAsyncHandler(delegate)
+                , m_normalAsyncHandler(delegate)
+                , m_request(req)
+                , m_sessionImpl(sessionImpl)
+            {}
+
+            virtual ~AbstractHttpHandler()
+            {
+            }
+
+        public:
+            //! 
+            virtual void Terminate();
+
+            /**
+                When finished, the handler may(will if synchronous) be deleted, which means no more call after sending request
+                */
+            virtual void OnSendingRequest() = 0;
+            /**
+                Events
+                NO more callings after any of those methods showing below
+                */
+            //! on request already sent
+            void OnRequestSent();
+            void OnError(WINHTTP_ASYNC_RESULT *result);
+            //! send request stream
+            //! len means length already sent
+            void OnWriteData(DWORD len);
+
+            void OnReadHeader();
+            void OnReadData(DWORD len);
+
+            //! on handler closed
+            //! no more callings
+            void OnFinished();
+
+        protected:
+            //! close the handler
+            //! request handler is invalid
+            //! exception == nullptr means success
+            virtual void OnClose(Exception *exception);
+
+            virtual void OnReadingData() = 0;
+
+        private:
+            void OnTerminated();
+            /**
+                NO more callings after any of those methods showing below
+                */
+            //! start to receive reponse header
+            void OnReceiveResponse();
+
+            void OnWritingData(InputStream *);
+        };
+
+        static void CALLBACK _Callback(_In_ HINTERNET hInternet,
+            _In_ DWORD_PTR dwContext,
+            _In_ DWORD dwInternetStatus,
+            _In_opt_ LPVOID lpvStatusInformation,
+            _In_ DWORD dwStatusInformationLength)
+        {
+            AbstractHttpHandler *handler = (AbstractHttpHandler *)dwContext;
+
+            switch (dwInternetStatus)
+            {
+                /**
+                    Response
+                    */
+            case WINHTTP_CALLBACK_STATUS_READ_COMPLETE:
+                handler->OnReadData(dwStatusInformationLength);
+                break;
+
+            case WINHTTP_CALLBACK_STATUS_HEADERS_AVAILABLE:
+                handler->OnReadHeader();
+                break;
+
+                /**
+                    Request
+                    */
+            case WINHTTP_CALLBACK_STATUS_WRITE_COMPLETE:
+                handler->OnWriteData(dwStatusInformationLength);
+                break;
+
+            case WINHTTP_CALLBACK_STATUS_SENDREQUEST_COMPLETE:
+                handler->OnRequestSent();
+                break;
+
+            case WINHTTP_CALLBACK_STATUS_REQUEST_SENT:
+                break;
+
+                /**
+                    Error
+                    */
+            case WINHTTP_CALLBACK_STATUS_REQUEST_ERROR:
+                handler->OnError(static_cast<WINHTTP_ASYNC_RESULT*>(lpvStatusInformation));
+                break;
+
+            case WINHTTP_CALLBACK_STATUS_HANDLE_CLOSING:
+                handler->OnFinished();
+                break;
+
+            default:
+                //TRACE(_T("Unknown status:%08X"), dwInternetStatus);
+                break;
+            }
+        }
+
+        void AbstractHttpHandler::OnFinished()
+        {
+            //! safe quit will clean request value
+            if (m_hRequest)
+                OnTerminated();
+
+            //! remove from handlers manager
+            m_sessionImpl->OnHandleFinished(this);
+
+            delete this;
+        }
+
+        void AbstractHttpHandler::Terminate()
+        {
+            ::WinHttpCloseHandle(m_hRequest);
+        }
+
+        void AbstractHttpHandler::OnError(WINHTTP_ASYNC_RESULT *result)
+        {
+            //! close handler failed
+            if (NULL == m_hRequest)
+            {
+                OnFinished();
+            }
+            else
+            {
+                OnClose(ConvertLastError(result->dwError));
+            }
+        }
+
+        void AbstractHttpHandler::OnRequestSent()
+        {
+            //! check request body has any data to be sent
+            InputStream *bodyStream = m_request->GetRequestBodyStream();
+            if (!bodyStream || bodyStream->GetAvailCount() == 0)
+            {
+                OnReceiveResponse();
+            }
+            else
+            {
+                OnWritingData(bodyStream);
+            }
+        }
+
+        void AbstractHttpHandler::OnReceiveResponse()
+        {
+            if (!::WinHttpReceiveResponse(m_hRequest, 0))
+            {
+                OnClose(ConvertLastError(::GetLastError()));
+            }
+        }
+
+        void AbstractHttpHandler::OnWriteData(DWORD completedLength)    //! ignored for now
+        {
+            InputStream *bodyStream = m_request->GetRequestBodyStream();
+
+            //! read finished
+            if (bodyStream->GetAvailCount() == 0)
+            {
+                OnReceiveResponse();
+            }
+            else
+            {
+                OnWritingData(bodyStream);
+            }
+        }
+
+        void AbstractHttpHandler::OnWritingData(InputStream *bodyStream)
+        {
+            try
+            {
+                m_bufferStream.Allocate();
+
+                uint32_t readCount = bodyStream->Read(m_bufferStream.m_buffer, m_bufferStream.BufferLength());
+                m_bufferStream.OnFilled(readCount);
+
+                if (!::WinHttpWriteData(m_hRequest, m_bufferStream.m_buffer, readCount, NULL))
+                {
+                    OnClose(ConvertLastError(::GetLastError()));
+                }
+            }
+            catch (const Exception& ex)
+            {
+                OnClose(ex.Clone());
+            }
+        }
+
+        void AbstractHttpHandler::OnReadData(DWORD len)
+        {
+            if (len == 0)
+            {
+                //!	finished
+                OnClose(NULL);
+            }
+            else
+            {
+                m_bufferStream.OnFilled(len);
+
+                try
+                {
+                    //! till drained or the handler stops reading
+                    while (m_bufferStream.GetAvailCount() != 0)
+                    {
+                        int64_t before = m_bufferStream.GetAvailCount();
+                        m_completionAsyncHandler->OnBodyAvailable(m_bufferStream);
+
+                        if (m_bufferStream.GetAvailCount() == before)
+                            break;
+                    }
+
+                    //! read next piece
+                    OnReadingData();
+                }
+                catch (const Exception& ex)
+                {
+                    OnClose(ex.Clone());
+                }
+            }
+        }
+
+        void AbstractHttpHandler::OnReadHeader()
+        {
+            DWORD statusCode = 0;
+
+            DWORD dwStatusCodeSize = sizeof(statusCode);
+            if (!WinHttpQueryHeaders(m_hRequest
+                , WINHTTP_QUERY_STATUS_CODE | WINHTTP_QUERY_FLAG_NUMBER
+                , WINHTTP_HEADER_NAME_BY_INDEX
+                , &statusCode
+                , &dwStatusCodeSize
+                , WINHTTP_NO_HEADER_INDEX))
+            {
+                OnClose(ConvertLastError(::GetLastError()));
+                return;
+            }
+
+            WCHAR wszContentLength[32] = { 0 };
+            DWORD dwBufferSize = sizeof(wszContentLength);
+            if (!WinHttpQueryHeaders(m_hRequest
+                , WINHTTP_QUERY_CONTENT_LENGTH
+                , WINHTTP_HEADER_NAME_BY_INDEX
+                , wszContentLength
+                , &dwBufferSize
+                , WINHTTP_NO_HEADER_INDEX))
+            {
+                DWORD dwError = ::GetLastError();
+                if (ERROR_HTTP_HEADER_NOT_FOUND != dwError)
+                {
+                    OnClose(ConvertLastError(dwError));
+                    return;
+                }
+            }
+
+            //Update the output parameter
+            int64_t contentLength = _wtoi64(wszContentLength);
+
+            //!	query all
+            {
+                DWORD dwSize = 0;
+                WinHttpQueryHeaders(m_hRequest
+                    , WINHTTP_QUERY_RAW_HEADERS
+                    , WINHTTP_HEADER_NAME_BY_INDEX
+                    , NULL, &dwSize, WINHTTP_NO_HEADER_INDEX);
+
+                // Allocate memory for the buffer.
+                if (GetLastError() == ERROR_INSUFFICIENT_BUFFER)
+                {
+                    WCHAR *lpOutBuffer = new WCHAR[dwSize / sizeof(WCHAR)];
+
+                    // Now, use WinHttpQueryHeaders to retrieve the header.
+                    if (!WinHttpQueryHeaders(m_hRequest
+                        , WINHTTP_QUERY_RAW_HEADERS
+                        , WINHTTP_HEADER_NAME_BY_INDEX
+                        , lpOutBuffer, &dwSize, WINHTTP_NO_HEADER_INDEX))
+                    {
+                        delete[] lpOutBuffer;
+
+                        OnClose(ConvertLastError(::GetLastError()));
+                        return;
+                    }
+
+                    HttpResponseHeaders headers(lpOutBuffer, static_cast<StatusCode::Value>(statusCode), contentLength);
+                    m_headers = headers;
+
+                    //! check if redirect
+                    if (m_headers.GetStatusCode() == StatusCode::Moved_Permanently ||
+                        m_headers.GetStatusCode() == StatusCode::Found ||
+                        m_headers.GetStatusCode() == StatusCode::See_Other ||
+                        m_headers.GetStatusCode() == StatusCode::Use_Proxy ||
+                        m_headers.GetStatusCode() == StatusCode::Temporary_Redirect)
+                    {
+                        const String& redirectURL = m_headers.GetHead(L"Location");
+                        m_redirectDelegate->SetLocation(redirectURL);
+                        m_completionAsyncHandler = m_redirectDelegate;
+                    }
+
+                    try
+                    {
+                        m_completionAsyncHandler->OnHeaderAvailable(m_headers);
+                    }
+                    catch (const Exception& ex)
+                    {
+                        OnClose(ex.Clone());
+                        return;
+                    }
+
+                    //! update body
+                    m_bufferStream.m_contentLength = contentLength;
+
+                    OnReadingData();
+                }
+            }
+        }
+
+        void AbstractHttpHandler::OnClose(Exception *exception)
+        {
+            //! send results
+            if (NULL != exception)
+            {
+                m_completionAsyncHandler->OnError(exception);
+            }
+            else
+            {
+                //! check if redirect
+                if (m_completionAsyncHandler == m_redirectDelegate && m_redirectDelegate->PerformRedirecting())
+                {
+                    //!
+                    m_sessionImpl->SendRedirect(m_request, m_normalAsyncHandler, m_redirectDelegate, m_headers);
+                }
+                else
+                {
+                    m_completionAsyncHandler->OnCompleted();
+                }
+                //! clean response and headers
+                //! TO-DO
+            }
+
+            //! clean the scoped variables
+            m_request = NULL;
+            m_completionAsyncHandler = NULL;
+
+            //! close
+            HINTERNET hReq = m_hRequest;
+            m_hRequest = NULL;
+
+            ::WinHttpCloseHandle(hReq);
+        }
+
+        void AbstractHttpHandler::OnTerminated()
+        {
+            m_completionAsyncHandler->OnError(new ConnectionTerminatedException);
+
+            //! clean the scoped variables
+            m_request = NULL;
+            m_completionAsyncHandler = NULL;
+        }
+
+        class SyncHttpHandler : public AbstractHttpHandler
+        {
+        public:
+            SyncHttpHandler(HINTERNET hReq, const HttpRequest *req, AsyncCompletionGenericDelegate *delegate, WinHttpSessionPrivate *session)
+                : AbstractHttpHandler(hReq, req, delegate, session)
+            {}
+
+            virtual ~SyncHttpHandler()
+            {}
+
+        public:
+            virtual void OnSendingRequest()
+            {
+                const String& header = m_request->GetHeadersString();
+
+                //! #
+                DWORD dwTotal = m_request->GetRequestBodyStream() == NULL ? 0 : static_cast<DWORD>(m_request->GetRequestBodyStream()->GetTotal());
+
+                if (!WinHttpSendRequest(m_hRequest,
+                    header.empty() ? WINHTTP_NO_ADDITIONAL_HEADERS : header.c_str(), -1,
+                    WINHTTP_NO_REQUEST_DATA, 0,
+                    dwTotal, NULL))// context
+                {
+                    OnClose(ConvertLastError(::GetLastError()));
+                    return;
+                }
+
+                OnRequestSent();
+
+                //! completion has been cleaned
+                if (m_completionAsyncHandler)
+                {
+                    OnReadHeader();
+                }
+
+                //! delete itself
+                OnFinished();
+            }
+
+        protected:
+            virtual void OnReadingData()
+            {
+                m_bufferStream.Allocate();
+
+                DWORD dwAvailCount = 0;
+                if (!WinHttpQueryDataAvailable(m_hRequest, &dwAvailCount))
+                {
+                    OnClose(ConvertLastError(::GetLastError()));
+                    return;
+                }
+
+                DWORD dwRead = 0;
+                if (!::WinHttpReadData(m_hRequest, m_bufferStream.m_buffer, min(dwAvailCount, m_bufferStream.BufferLength()), &dwRead))
+                {
+                    OnClose(ConvertLastError(::GetLastError()));
+                    return;
+                }
+
+                OnReadData(dwRead);
+            }
+        };
+
+        class AsyncHttpHandler : public AbstractHttpHandler
+        {
+        private:
+            REF m_isClosed;
+
+        public:
+            AsyncHttpHandler(HINTERNET hReq, const HttpRequest *req, AsyncCompletionGenericDelegate *delegate, WinHttpSessionPrivate *session)
+                : AbstractHttpHandler(hReq, req, delegate, session)
+                , m_isClosed(0)
+            {}
+
+            AsyncHttpHandler(HINTERNET hReq, const HttpRequest *req, AsyncCompletionGenericDelegate *delegate, RedirectCompletionGenericDelegate *redirectDelegate, WinHttpSessionPrivate *session)
+                : AbstractHttpHandler(hReq, req, delegate, redirectDelegate, session)
+                , m_isClosed(0)
+            {}
+
+        public:
+            virtual void OnSendingRequest()
+            {
+                const String& header = m_request->GetHeadersString();
+
+                WINHTTP_STATUS_CALLBACK installed = WinHttpSetStatusCallback(m_hRequest, _Callback, WINHTTP_CALLBACK_FLAG_ALL_NOTIFICATIONS, 0);
+                DWORD dwError = ::GetLastError();
+                if (dwError != ERROR_SUCCESS)
+                {
+                    OnClose(ConvertLastError(dwError));
+                    return;
+                }
+
+                //! #
+                DWORD dwTotal = m_request->GetRequestBodyStream() == NULL ? 0 : static_cast<DWORD>(m_request->GetRequestBodyStream()->GetTotal());
+
+                if (!WinHttpSendRequest(m_hRequest,
+                    header.empty() ? WINHTTP_NO_ADDITIONAL_HEADERS : header.c_str(), -1,
+                    WINHTTP_NO_REQUEST_DATA, 0,
+                    dwTotal, (UINT_PTR)this))// context
+                {
+                    OnClose(ConvertLastError(::GetLastError()));
+                    return;
+                }
+            }
+
+            virtual void Terminate()
+            {
+                //! if has set(value equals 1)
+                if (CompareExchange(&m_isClosed, 1, 0) == 1)
+                    return;
+
+                __super::Terminate();
+            }
+
+        protected:
+            void OnClose(Exception *exception)
+            {
+                //! if has set(value equals 1)
+                if (CompareExchange(&m_isClosed, 1, 0) == 1)
+                {
+                    //! free the exception
+                    delete exception;
+                    return;
+                }
+
+                __super::OnClose(exception);
+            }
+
+            virtual void OnReadingData()
+            {
+                m_bufferStream.Allocate();
+
+                if (!::WinHttpReadData(m_hRequest, m_bufferStream.m_buffer, m_bufferStream.BufferLength(), 0))
+                {
+                    OnClose(ConvertLastError(::GetLastError()));
+                }
+            }
+        };
+    }
+
+    HINTERNET WinHttpSessionPrivate::AcquireRequest(const URL& url, const HttpVerb& verb)
+    {
+        Details::UrlCache::PrefixPointer prefix;
+        Details::UrlParts parts;
+        m_urlCache.Crack(url.c_str(), url.size(), prefix, parts);
+
+        //! path with query
+        String path;
+        if (0 == parts.path.length || L'/' != url[parts.path.offset])
+            path.push_back(L'/');
+        path.append(url, parts.path.offset, parts.path.length);
+
+        HttpSecurityOptions opts;
+        opts.isHttps = prefix->isHttps;
+
+        return OpenRequest(AcquireConnection(opts, prefix->host, prefix->port, prefix->origin), path, verb, opts);
+    }
+
+    HINTERNET WinHttpSessionPrivate::AcquireConnection(const HttpSecurityOptions& securityOpts, const String& host, uint16_t port, const String& origin)
+    {
+        if (!m_hSession)
+        {
+            m_hSession = ::WinHttpOpen(L"HTTP/1.1"
+                , WINHTTP_ACCESS_TYPE_DEFAULT_PROXY
+                , WINHTTP_NO_PROXY_NAME
+                , WINHTTP_NO_PROXY_BYPASS
+                , m_config.IsAsync ? WINHTTP_FLAG_ASYNC : NULL);  //! async
+
+            //! config
+            WinHttpSetTimeouts(m_hSession, 3000, 3000, 10000, 10000);
+
+            if (!m_config.IsAutoRedirectEnabled)
+            {
+                DWORD redirectFeature = WINHTTP_OPTION_REDIRECT_POLICY_NEVER;
+                WinHttpSetOption(m_hSession, WINHTTP_OPTION_REDIRECT_POLICY, &redirectFeature, sizeof(redirectFeature));
+            }
+
+            //! the idle limit and timeout are managed by WinHttp itself
+            if (0 != m_config.MaxConnectionsPerHost)
+            {
+                DWORD maxConnections = m_config.MaxConnectionsPerHost;
+                WinHttpSetOption(m_hSession, WINHTTP_OPTION_MAX_CONNS_PER_SERVER, &maxConnections, sizeof(maxConnections));
+                WinHttpSetOption(m_hSession, WINHTTP_OPTION_MAX_CONNS_PER_1_0_SERVER, &maxConnections, sizeof(maxConnections));
+            }
+
+            //! negotiated per connection, falls back to HTTP/1.1 silently
+            DWORD protocols = 0;
+            if (0 != (m_config.EnabledProtocols & HttpSessionConfig::Http2Protocol))
+                protocols |= WINHTTP_PROTOCOL_FLAG_HTTP2;
+            if (0 != (m_config.EnabledProtocols & HttpSessionConfig::Http3Protocol))
+                protocols |= WINHTTP_PROTOCOL_FLAG_HTTP3;
+
+            if (0 != protocols)
+                WinHttpSetOption(m_hSession, WINHTTP_OPTION_ENABLE_HTTP_PROTOCOL, &protocols, sizeof(protocols));
+        }
+
+        Details::HostConnections::iterator found = m_connections.find(origin);
+
+        HINTERNET connection = NULL;
+        //! no such connection
+        if (found == m_connections.end())
+        {
+            connection = WinHttpConnect(m_hSession, host.c_str(), port, 0);
+            if (!connection)
+            {
+                throw ConnectionFailedException();
+            }
+
+            m_connections.insert(std::make_pair(origin, connection));
+        }
+        else
+        {
+            connection = found->second;
+        }
+
+        return connection;
+    }
+
+    HINTERNET WinHttpSessionPrivate::OpenRequest(HINTERNET hConnection, const String& path, HttpVerb verb, const HttpSecurityOptions& securityOpts)
+    {
+        static const LPWSTR VerbMapper[] = { L"GET", L"POST", L"DELETE", L"PUT" };
+
+        HINTERNET hRequest = WinHttpOpenRequest(hConnection, VerbMapper[verb], path.c_str(),
+            NULL,
+            WINHTTP_NO_REFERER,
+            WINHTTP_DEFAULT_ACCEPT_TYPES,
+            securityOpts.isHttps ? WINHTTP_FLAG_SECURE : 0);
+
+        if (0 == m_config.MaxIdleConnectionsPerHost)
+        {
+            DWORD disabledFeature = WINHTTP_DISABLE_KEEP_ALIVE;
+            ::WinHttpSetOption(hRequest, WINHTTP_OPTION_DISABLE_FEATURE, &disabledFeature, sizeof(disabledFeature));
+        }
+
+        if (securityOpts.isHttps)
+        {
+            DWORD options = SECURITY_FLAG_IGNORE_CERT_CN_INVALID
+                | SECURITY_FLAG_IGNORE_CERT_DATE_INVALID
+                | SECURITY_FLAG_IGNORE_UNKNOWN_CA;
+            ::WinHttpSetOption(hRequest,
+                WINHTTP_OPTION_SECURITY_FLAGS,
+                (LPVOID)&options,
+                sizeof(DWORD));
+        }
+
+        return hRequest;
+    }
+
+    void WinHttpSessionPrivate::Disconnect()
+    {
+        if (m_hSession)
+        {
+            OnDisconnect();
+
+            Details::HostConnections::iterator it = m_connections.begin();
+            for (; it != m_connections.end(); ++it)
+            {
+                ::WinHttpCloseHandle(it->second);
+            }
+            m_connections.clear();
+
+            //
+            ::WinHttpCloseHandle(m_hSession);
+            m_hSession = NULL;
+        }
+    }
+
+    //
+    //  ###
+    //  DANGER
+    //  When operation is sync, Terminate will trigger handler erasing
+    //
+    void WinHttpSessionPrivate::OnDisconnect()
+    {
+        //! the current one may be erased by Terminate
+        Details::AbstractHttpHandler *handler = m_handlers.GetFirst();
+
+        while (NULL != handler)
+        {
+            Details::AbstractHttpHandler *next = m_handlers.GetNext(handler);
+            handler->Terminate();
+
+            handler = next;
+        }
+    }
+
+    void WinHttpSessionPrivate::OnHandleFinished(Details::AbstractHttpHandler *handler)
+    {
+        m_handlers.Erase(handler);
+    }
+
+    void WinHttpSessionPrivate::SendRequest(const HttpRequest *req, AsyncCompletionGenericDelegate *delegate)
+    {
+        HINTERNET hReq = AcquireRequest(req->GetURL(), req->GetVerb());
+
+        if (NULL == hReq)
+        {
+            throw ConnectionFailedException();
+        }
+
+        SendRequest(hReq, req, delegate);
+    }
+
+    //! send request
+    void WinHttpSessionPrivate::SendRequest(HINTERNET hReq, const HttpRequest *req, AsyncCompletionGenericDelegate *delegate)
+    {
+        if (m_config.IsAsync)
+        {
+            // non-lock async http session is forbidden
+            throw std::logic_error("non-lock async http session is forbidden");
+        }
+
+        Details::AbstractHttpHandler *handler = new Details::SyncHttpHandler(hReq, req, delegate, this);
+        m_handlers.PushBack(handler);
+
+        handler->OnSendingRequest();
+    }
+
+    void WinHttpSessionPrivate::SendRedirect(const HttpRequest *req,
+        AsyncCompletionGenericDelegate *delegate,
+        RedirectCompletionGenericDelegate *redirectDelegate,
+        const HttpResponseHeaders& headers)
+    {
+        const String& location = headers.GetHead(L"Location");
+
+        bool reissuingRequest = headers.GetStatusCode() == StatusCode::See_Other;
+
+        HINTERNET hReq = NULL;
+        try
+        {
+            hReq = AcquireRequest(location, reissuingRequest ? HttpVerb::Get : req->GetVerb());
+            if (NULL == hReq)
+            {
+                throw ConnectionFailedException();
+            }
+        }
+        catch (const Exception& ex)
+        {
+            delegate->OnError(ex.Clone());
+            return;
+        }
+
+        //! the redirect request will remain valid till the end
+        //! however, the url and verb still be the first time's
+        SendRequest(hReq, req, delegate);
+    }
+
+    LockHttpSessionPrivate::LockHttpSessionPrivate()
+        : WinHttpSessionPrivate()
+        , m_lock()
+        , m_handlerCount(0)
+        , m_disconnectedEvent(true)    //! signaled
+    {
+        }
+
+    LockHttpSessionPrivate::LockHttpSessionPrivate(const HttpSessionConfig& config)
+        : WinHttpSessionPrivate(config)
+        , m_lock()
+        , m_handlerCount(0)
+        , m_disconnectedEvent(true)    //! signaled
+    {
+        }
+
+    void LockHttpSessionPrivate::SendRequest(HINTERNET hReq, const HttpRequest *req, AsyncCompletionGenericDelegate *delegate)
+    {
+        Details::AbstractHttpHandler *handler = NULL;
+        if (m_config.IsAsync)
+            handler = new Details::AsyncHttpHandler(hReq, req, delegate, this);
+        else
+            handler = new Details::SyncHttpHandler(hReq, req, delegate, this);
+
+        {
+            HandlerShard& shard = ShardOf(handler);
+
+            AutoLock<CriticalSection> locker(&shard.lock);
+            shard.handlers.PushBack(handler);
+            ::Increment(&m_handlerCount);
+        }
+
+        handler->OnSendingRequest();
+    }
+
+    void LockHttpSessionPrivate::OnDisconnect()
+    {
+        //! reset the event
+        m_disconnectedEvent.Reset();
+
+        for (int i = 0; i != ShardCount; ++i)
+        {
+            HandlerShard& shard = m_shards[i];
+            AutoLock<CriticalSection> locker(&shard.lock);
+
+            //! the current one may be erased by Terminate
+            Details::AbstractHttpHandler *handler = shard.handlers.GetFirst();
+            while (NULL != handler)
+            {
+                Details::AbstractHttpHandler *next = shard.handlers.GetNext(handler);
+                handler->Terminate();
+
+                handler = next;
+            }
+        }
+
+        //! no more handlers
+        //! just signal the event
+        if (0 == m_handlerCount)
+            m_disconnectedEvent.Signal();
+
+        //! wait till finished
+        m_disconnectedEvent.Wait(INFINITE);
+
+        //! the last handler may be still leaving OnHandleFinished
+        for (int i = 0; i != ShardCount; ++i)
+        {
+            AutoLock<CriticalSection> locker(&m_shards[i].lock);
+        }
+    }
+
+    void LockHttpSessionPrivate::SendRedirect(const HttpRequest *req,
+        AsyncCompletionGenericDelegate *delegate,
+        RedirectCompletionGenericDelegate *redirectDelegate,
+        const HttpResponseHeaders& headers)
+    {
+        //! terminating 
+        if (!m_disconnectedEvent.IsSignaled())
+            return;
+
+        //! the connection and the handler shard lock for themselves
+        __super::SendRedirect(req, delegate, redirectDelegate, headers);
+    }
+
+    HINTERNET LockHttpSessionPrivate::AcquireConnection(const HttpSecurityOptions& securityOpts, const String& host, uint16_t port, const String& origin)
+    {
+        //! requests may come from any thread
+        AutoLock<CriticalSection> locker(&m_lock);
+        return __super::AcquireConnection(securityOpts, host, port, origin);
+    }
+
+    void LockHttpSessionPrivate::OnHandleFinished(Details::AbstractHttpHandler *handler)
+    {
+        HandlerShard& shard = ShardOf(handler);
+
+        //! signaled under the lock, OnDisconnect takes the lock before returning
+        AutoLock<CriticalSection> locker(&shard.lock);
+        shard.handlers.Erase(handler);
+
+        if (0 == ::Decrement(&m_handlerCount))
+            m_disconnectedEvent.Signal();
+    }
+
+    LockHttpSessionPrivate::HandlerShard& LockHttpSessionPrivate::ShardOf(Details::AbstractHttpHandler *handler)
+    {
+        //! the low bits are always zero by the alignment of the heap
+        return m_shards[(reinterpret_cast<uintptr_t>(handler) >> 4) % ShardCount];
+    }
+
+    namespace Details
+    {
+        HttpSession::Private *CreateSessionPrivate(const HttpSessionConfig& config)
+        {
+            if (config.IsAsync)
+                return new LockHttpSessionPrivate(config);
+
+            return new WinHttpSessionPrivate(config);
+        }
+    }
+}
+
+#endif
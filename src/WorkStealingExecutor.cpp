@@ -0,0 +1,663 @@
+#include "WorkStealingExecutor.h"
+
+#if !defined(_WIN32)
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+#if defined(_WIN32)
+static inline void _FullFence() { ::MemoryBarrier(); }
+
+//! volatile accesses are acquire and release on Windows
+template<typename T>
+static inline T _LoadRelaxed(T volatile *src) { return *src; }
+template<typename T>
+static inline T _LoadAcquire(T volatile *src) { return *src; }
+template<typename T>
+static inline void _StoreRelaxed(T volatile *dest, T value) { *dest = value; }
+template<typename T>
+static inline void _StoreRelease(T volatile *dest, T value) { *dest = value; }
+
+template<typename T>
+static inline T *_CompareExchangePointer(T *volatile *dest, T *exchange, T *comparand)
+{
+    return static_cast<T *>(::InterlockedCompareExchangePointer(reinterpret_cast<PVOID volatile *>(dest), exchange, comparand));
+}
+
+static _Index _CoreCount()
+{
+    SYSTEM_INFO info;
+    ::GetSystemInfo(&info);
+    return info.dwNumberOfProcessors > 0 ? static_cast<_Index>(info.dwNumberOfProcessors) : 1;
+}
+
+static __declspec(thread) void *_currentWorker = NULL;
+#else
+static inline void _FullFence() { __atomic_thread_fence(__ATOMIC_SEQ_CST); }
+
+template<typename T>
+static inline T _LoadRelaxed(T volatile *src) { return __atomic_load_n(src, __ATOMIC_RELAXED); }
+template<typename T>
+static inline T _LoadAcquire(T volatile *src) { return __atomic_load_n(src, __ATOMIC_ACQUIRE); }
+template<typename T>
+static inline void _StoreRelaxed(T volatile *dest, T value) { __atomic_store_n(dest, value, __ATOMIC_RELAXED); }
+template<typename T>
+static inline void _StoreRelease(T volatile *dest, T value) { __atomic_store_n(dest, value, __ATOMIC_RELEASE); }
+
+//! returns the initial value
+template<typename T>
+static inline T *_CompareExchangePointer(T *volatile *dest, T *exchange, T *comparand)
+{
+    __atomic_compare_exchange_n(dest, &comparand, exchange, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+    return comparand;
+}
+
+static _Index _CoreCount()
+{
+    long count = ::sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? static_cast<_Index>(count) : 1;
+}
+
+static __thread void *_currentWorker = NULL;
+#endif
+
+//
+//  Chase-Lev deque, "Correct and Efficient Work-Stealing for Weak Memory Models"(Le et al.)
+//      Push and Pop are called by the owner only, Steal by any other worker
+//      the orderings are the ones of the paper, the CAS on the top is sequentially consistent
+//      the array grows by doubling, the retired ones are kept since the stealers may still read them
+//
+class _WorkStealingExecutor::Deque
+{
+private:
+    enum { InitialCapacity = 256 };
+
+    struct Array
+    {
+        _Index mask;
+        uintptr_t *items;
+        Array *retired;
+
+        Array(_Index capacity, Array *previous)
+            : mask(capacity - 1)
+            , items(new uintptr_t[capacity])
+            , retired(previous)
+        {}
+
+        ~Array()
+        {
+            delete[] items;
+        }
+    };
+
+private:
+    REF m_top;
+    REF m_bottom;
+    Array *volatile m_array;
+
+public:
+    Deque()
+        : m_top(0)
+        , m_bottom(0)
+        , m_array(new Array(InitialCapacity, NULL))
+    {}
+
+    ~Deque()
+    {
+        Array *array = m_array;
+        while (NULL != array)
+        {
+            Array *retired = array->retired;
+            delete array;
+
+            array = retired;
+        }
+    }
+
+public:
+    //! a hint for the other threads
+    bool IsEmpty() const
+    {
+        return _LoadAcquire(const_cast<REF *>(&m_bottom)) <= _LoadAcquire(const_cast<REF *>(&m_top));
+    }
+
+    void Push(uintptr_t item)
+    {
+        _Index bottom = _LoadRelaxed(&m_bottom);
+        _Index top = _LoadAcquire(&m_top);
+        Array *array = _LoadRelaxed(&m_array);
+
+        if (bottom - top > array->mask)
+            array = Grow(array, bottom, top);
+
+        _StoreRelaxed(&array->items[bottom & array->mask], item);
+
+        //! the item is visible before the bottom, as strong as the release fence of the paper
+        _StoreRelease(&m_bottom, bottom + 1);
+    }
+
+    //! 0 means empty
+    uintptr_t Pop()
+    {
+        _Index bottom = _LoadRelaxed(&m_bottom) - 1;
+        Array *array = _LoadRelaxed(&m_array);
+
+        _StoreRelaxed(&m_bottom, bottom);
+        _FullFence();
+        _Index top = _LoadRelaxed(&m_top);
+
+        if (top > bottom)
+        {
+            _StoreRelaxed(&m_bottom, bottom + 1);
+            return 0;
+        }
+
+        uintptr_t item = _LoadRelaxed(&array->items[bottom & array->mask]);
+        if (top == bottom)
+        {
+            //! the last one, races with the stealers
+            if (top != CompareExchange(&m_top, top + 1, top))
+                item = 0;
+
+            _StoreRelaxed(&m_bottom, bottom + 1);
+        }
+
+        return item;
+    }
+
+    //! 0 means empty or lost the race
+    uintptr_t Steal()
+    {
+        _Index top = _LoadAcquire(&m_top);
+        _FullFence();
+        _Index bottom = _LoadAcquire(&m_bottom);
+
+        if (top >= bottom)
+            return 0;
+
+        //! at least as new as the bottom read
+        Array *array = _LoadAcquire(&m_array);
+        uintptr_t item = _LoadRelaxed(&array->items[top & array->mask]);
+
+        if (top != CompareExchange(&m_top, top + 1, top))
+            return 0;
+
+        return item;
+    }
+
+private:
+    Array *Grow(Array *array, _Index bottom, _Index top)
+    {
+        Array *grown = new Array((array->mask + 1) * 2, array);
+        for (_Index i = top; i != bottom; ++i)
+            _StoreRelaxed(&grown->items[i & grown->mask], _LoadRelaxed(&array->items[i & array->mask]));
+
+        _StoreRelease(&m_array, grown);
+
+        return grown;
+    }
+};
+
+struct _WorkStealingExecutor::Worker
+{
+    _WorkStealingExecutor *executor;
+    Deque deque;
+
+    //! the entered async callables refer to it till completed, so it lives with the slot
+    Dispatcher dispatcher;
+    //! set by the thread leaving the slot, cleared by the one taking it
+    REF isRetired;
+
+    uint32_t index;
+    //! items found, for InjectionInterval
+    uint32_t tick;
+    //! xorshift state to pick the victims
+    uint32_t seed;
+    //! nested EnterBlocking
+    uint32_t blockingDepth;
+
+    Worker(_WorkStealingExecutor *owner, uint32_t slot)
+        : executor(owner)
+        , deque()
+        , dispatcher()
+        , isRetired(0)
+        , index(slot)
+        , tick(0)
+        , seed(slot * 2654435761u + 1)
+        , blockingDepth(0)
+    {}
+};
+
+struct _WorkStealingExecutor::InjectedItem
+{
+    InjectedItem *next;
+    uintptr_t item;
+};
+
+_WorkStealingExecutor *_WorkStealingExecutor::GetInstance()
+{
+    static _WorkStealingExecutor *executor = new _WorkStealingExecutor;
+    return executor;
+}
+
+_WorkStealingExecutor::_WorkStealingExecutor()
+    : m_injected(NULL)
+    , m_workerCount(0)
+    , m_liveCount(0)
+    , m_busyCount(0)
+    , m_maxWorkers(_CoreCount() + BlockingWorkers)
+    , m_sleeperCount(0)
+{
+    if (m_maxWorkers > MaxWorkers)
+        m_maxWorkers = MaxWorkers;
+
+    for (int i = 0; i != MaxWorkers; ++i)
+        m_workers[i] = NULL;
+
+#if defined(_WIN32)
+    m_wakeup = ::CreateSemaphore(NULL, 0, MAXLONG, NULL);
+#else
+    ::sem_init(&m_wakeup, 0, 0);
+#endif
+}
+
+void _WorkStealingExecutor::Post(Callable *callable)
+{
+    Post(reinterpret_cast<uintptr_t>(callable));
+}
+
+void _WorkStealingExecutor::Post(AsyncCallable *callable)
+{
+    Post(reinterpret_cast<uintptr_t>(callable) | AsyncItemTag);
+}
+
+void _WorkStealingExecutor::EnterBlocking()
+{
+    Worker *worker = static_cast<Worker *>(_currentWorker);
+    if (NULL == worker)
+        return;
+
+    //! the owner won't come back to its items for long
+    if (0 == worker->blockingDepth++ && !worker->deque.IsEmpty())
+        worker->executor->WakeThief(false);
+}
+
+void _WorkStealingExecutor::LeaveBlocking()
+{
+    Worker *worker = static_cast<Worker *>(_currentWorker);
+    if (NULL != worker)
+        --worker->blockingDepth;
+}
+
+void _WorkStealingExecutor::Post(uintptr_t item)
+{
+    Worker *worker = static_cast<Worker *>(_currentWorker);
+
+    if (NULL != worker)
+    {
+        //! continuation of the running item, stays on the same thread unless stolen
+        worker->deque.Push(item);
+
+        //! posted by the completions of a sync request, the owner is still blocking
+        if (0 != worker->blockingDepth)
+            WakeThief(false);
+        else
+            Notify();
+    }
+    else
+    {
+        Inject(item);
+        WakeThief(false);
+    }
+}
+
+void _WorkStealingExecutor::Inject(uintptr_t item)
+{
+    InjectedItem *injected = new InjectedItem;
+    injected->item = item;
+
+    InjectedItem *head = _LoadRelaxed(&m_injected);
+    while (true)
+    {
+        injected->next = head;
+
+        InjectedItem *found = _CompareExchangePointer(&m_injected, injected, head);
+        if (found == head)
+            break;
+
+        head = found;
+    }
+}
+
+bool _WorkStealingExecutor::Notify()
+{
+    //! pairs with the fence in Park, either the sleeper sees the item or it's woken
+    _FullFence();
+
+    if (0 == _LoadRelaxed(&m_sleeperCount))
+        return false;
+
+#if defined(_WIN32)
+    ::ReleaseSemaphore(m_wakeup, 1, NULL);
+#else
+    ::sem_post(&m_wakeup);
+#endif
+
+    return true;
+}
+
+void _WorkStealingExecutor::WakeThief(bool isCallerIdle)
+{
+    if (Notify())
+        return;
+
+    //! the blocking items may hold every worker for long
+    _Index busy = _LoadRelaxed(&m_busyCount) + (isCallerIdle ? 1 : 0);
+    if (busy >= _LoadRelaxed(&m_liveCount))
+        SpawnWorker();
+}
+
+void _WorkStealingExecutor::SpawnWorker()
+{
+    //! bounded, the items wait for a worker once all are taken
+    _Index live = _LoadRelaxed(&m_liveCount);
+    while (true)
+    {
+        if (live >= m_maxWorkers)
+            return;
+
+        _Index found = CompareExchange(&m_liveCount, live + 1, live);
+        if (found == live)
+            break;
+
+        live = found;
+    }
+
+    Worker *worker = ReviveWorker();
+    if (NULL == worker)
+        worker = CreateWorker();
+
+    if (NULL == worker || !StartWorker(worker))
+    {
+        if (NULL != worker)
+            _StoreRelease(&worker->isRetired, static_cast<_Index>(1));
+
+        ::Decrement(&m_liveCount);
+    }
+}
+
+_WorkStealingExecutor::Worker *_WorkStealingExecutor::ReviveWorker()
+{
+    _Index count = _LoadAcquire(&m_workerCount);
+    for (_Index i = 0; i != count; ++i)
+    {
+        Worker *worker = _LoadAcquire(&m_workers[i]);
+        if (NULL != worker && 0 != _LoadRelaxed(&worker->isRetired) && 1 == CompareExchange(&worker->isRetired, 0, 1))
+            return worker;
+    }
+
+    return NULL;
+}
+
+_WorkStealingExecutor::Worker *_WorkStealingExecutor::CreateWorker()
+{
+    _Index index = _LoadRelaxed(&m_workerCount);
+    while (true)
+    {
+        if (index >= MaxWorkers)
+            return NULL;
+
+        _Index found = CompareExchange(&m_workerCount, index + 1, index);
+        if (found == index)
+            break;
+
+        index = found;
+    }
+
+    Worker *worker = new Worker(this, static_cast<uint32_t>(index));
+    _StoreRelease(&m_workers[index], worker);
+
+    return worker;
+}
+
+bool _WorkStealingExecutor::StartWorker(Worker *worker)
+{
+#if defined(_WIN32)
+    HANDLE thread = ::CreateThread(NULL, 0, WorkerProc, worker, 0, NULL);
+    if (NULL == thread)
+        return false;
+
+    ::CloseHandle(thread);
+#else
+    pthread_t thread;
+    if (0 != ::pthread_create(&thread, NULL, WorkerProc, worker))
+        return false;
+
+    ::pthread_detach(thread);
+#endif
+
+    return true;
+}
+
+bool _WorkStealingExecutor::Retire(Worker *worker)
+{
+    _Index live = _LoadRelaxed(&m_liveCount);
+    while (true)
+    {
+        if (live <= 1)
+            return false;
+
+        _Index found = CompareExchange(&m_liveCount, live - 1, live);
+        if (found == live)
+            break;
+
+        live = found;
+    }
+
+    //! posted right before, the exchange above pairs with the fence in Notify
+    //!     either this sees the item, or the poster sees one worker less and spawns
+    if (HasItem())
+    {
+        ::Increment(&m_liveCount);
+        return false;
+    }
+
+    //! its deque is empty, only the owner pushes onto it
+    _currentWorker = NULL;
+    _StoreRelease(&worker->isRetired, static_cast<_Index>(1));
+
+    return true;
+}
+
+uintptr_t _WorkStealingExecutor::FindItem(Worker *worker)
+{
+    uintptr_t item = 0;
+
+    //! the injected ones go first every so often, so they never starve
+    if (0 == ++worker->tick % InjectionInterval)
+        item = TakeInjected(worker);
+
+    if (0 == item)
+        item = worker->deque.Pop();
+
+    if (0 == item)
+        item = TakeInjected(worker);
+
+    if (0 == item)
+        item = Steal(worker);
+
+    return item;
+}
+
+uintptr_t _WorkStealingExecutor::TakeInjected(Worker *worker)
+{
+    InjectedItem *head = _LoadRelaxed(&m_injected);
+    while (NULL != head)
+    {
+        InjectedItem *found = _CompareExchangePointer(&m_injected, static_cast<InjectedItem *>(NULL), head);
+        if (found == head)
+            break;
+
+        head = found;
+    }
+
+    if (NULL == head)
+        return 0;
+
+    //! the head is the latest, the rest go onto the deque in the order of posting
+    bool hasPushed = false;
+    while (NULL != head->next)
+    {
+        InjectedItem *next = head->next;
+
+        worker->deque.Push(head->item);
+        hasPushed = true;
+
+        delete head;
+        head = next;
+    }
+
+    uintptr_t item = head->item;
+    delete head;
+
+    //! the others may steal them
+    if (hasPushed)
+        WakeThief(true);
+
+    return item;
+}
+
+uintptr_t _WorkStealingExecutor::Steal(Worker *worker)
+{
+    _Index count = _LoadAcquire(&m_workerCount);
+    if (count <= 1)
+        return 0;
+
+    //! xorshift
+    worker->seed ^= worker->seed << 13;
+    worker->seed ^= worker->seed >> 17;
+    worker->seed ^= worker->seed << 5;
+
+    _Index start = worker->seed % count;
+    for (_Index i = 0; i != count; ++i)
+    {
+        Worker *victim = _LoadAcquire(&m_workers[(start + i) % count]);
+        if (NULL == victim || victim == worker)
+            continue;
+
+        uintptr_t item = victim->deque.Steal();
+        if (0 != item)
+        {
+            //! the victim is held by a long one, the rest may need another thief
+            if (!victim->deque.IsEmpty())
+                WakeThief(true);
+
+            return item;
+        }
+    }
+
+    return 0;
+}
+
+bool _WorkStealingExecutor::HasItem()
+{
+    if (NULL != _LoadRelaxed(&m_injected))
+        return true;
+
+    _Index count = _LoadAcquire(&m_workerCount);
+    for (_Index i = 0; i != count; ++i)
+    {
+        Worker *each = _LoadAcquire(&m_workers[i]);
+        if (NULL != each && !each->deque.IsEmpty())
+            return true;
+    }
+
+    return false;
+}
+
+bool _WorkStealingExecutor::Park()
+{
+    ::Increment(&m_sleeperCount);
+    _FullFence();
+
+    bool isWoken = true;
+
+    //! posted right before counted as a sleeper
+    if (!HasItem())
+    {
+#if defined(_WIN32)
+        isWoken = WAIT_OBJECT_0 == ::WaitForSingleObject(m_wakeup, IdleTimeout);
+#else
+        struct timespec deadline;
+        ::clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += IdleTimeout / 1000;
+
+        int result = 0;
+        while (0 != (result = ::sem_timedwait(&m_wakeup, &deadline)) && EINTR == errno)
+        {}
+
+        isWoken = 0 == result;
+#endif
+    }
+
+    //! a signal left by a late Notify only wakes the next park in vain
+    ::Decrement(&m_sleeperCount);
+
+    return isWoken;
+}
+
+void _WorkStealingExecutor::Run(Worker *worker)
+{
+    _currentWorker = worker;
+
+    while (true)
+    {
+        uintptr_t item = FindItem(worker);
+        if (0 == item)
+        {
+            if (!Park() && Retire(worker))
+                return;
+
+            continue;
+        }
+
+        ::Increment(&m_busyCount);
+        RunItem(item, worker->dispatcher);
+        ::Decrement(&m_busyCount);
+    }
+}
+
+void _WorkStealingExecutor::RunItem(uintptr_t item, Dispatcher& dispatcher)
+{
+    if (0 != (item & AsyncItemTag))
+    {
+        AsyncCallable *callable = reinterpret_cast<AsyncCallable *>(item & ~static_cast<uintptr_t>(AsyncItemTag));
+        callable->OnEnter(&dispatcher);
+    }
+    else
+    {
+        Callable *callable = reinterpret_cast<Callable *>(item);
+        callable->Invoke();
+
+        delete callable;
+    }
+}
+
+#if defined(_WIN32)
+DWORD WINAPI _WorkStealingExecutor::WorkerProc(LPVOID param)
+{
+    Worker *worker = static_cast<Worker *>(param);
+    worker->executor->Run(worker);
+
+    return 0;
+}
+#else
+void *_WorkStealingExecutor::WorkerProc(void *param)
+{
+    Worker *worker = static_cast<Worker *>(param);
+    worker->executor->Run(worker);
+
+    return NULL;
+}
+#endif
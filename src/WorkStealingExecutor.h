@@ -0,0 +1,122 @@
+#ifndef WORKSTEALINGEXECUTOR_H
+#define WORKSTEALINGEXECUTOR_H
+
+#include "Thread.h"
+
+#include <stdint.h>
+
+#if defined(_WIN64)
+typedef LONGLONG _Index;
+#elif defined(_WIN32)
+typedef LONG _Index;
+#else
+typedef long _Index;
+#endif
+
+#if !defined(_WIN32)
+#include <semaphore.h>
+#endif
+
+//
+//  backs ThreadContext::FromThreadPool on all the platforms
+//      each worker owns a Chase-Lev deque, pops its own bottom and steals the top of the others
+//      posting from a worker pushes onto its own deque, so the continuations stay on the cache-hot thread
+//      posting from any other thread goes through a lock-free injection stack, taken by the workers in batch
+//      grows when every worker is busy, since the blocking work items may hold a worker for long
+//          bounded by the core count plus BlockingWorkers, the idle ones retire after IdleTimeout
+//      a worker blocking in a sync request hands its deque over, by waking a thief or spawning one
+//
+class _WorkStealingExecutor
+{
+public:
+    enum
+    {
+        MaxWorkers = 512,
+        //! the workers beyond the core count, for the items blocking their worker
+        BlockingWorkers = 64,
+        //! ms, the last worker never retires
+        IdleTimeout = 10000,
+        //! the injected items are checked every so many local ones, so they never starve
+        InjectionInterval = 64,
+        //! set in the item of an AsyncCallable, the callables are aligned at least by 2
+        AsyncItemTag = 1
+    };
+
+private:
+    class Deque;
+    struct Worker;
+    struct InjectedItem;
+
+private:
+    //! pushed by CAS, taken all at once
+    InjectedItem *volatile m_injected;
+
+    //! never deleted, the slot of a retired worker is taken by the next one spawned
+    Worker *volatile m_workers[MaxWorkers];
+    //! slots reserved, the worker may not be stored yet
+    REF m_workerCount;
+    //! the running threads
+    REF m_liveCount;
+    //! running an item
+    REF m_busyCount;
+    _Index m_maxWorkers;
+
+    REF m_sleeperCount;
+#if defined(_WIN32)
+    HANDLE m_wakeup;
+#else
+    sem_t m_wakeup;
+#endif
+
+public:
+    //! never destructed, the workers keep running till the process exits
+    static _WorkStealingExecutor *GetInstance();
+
+public:
+    _WorkStealingExecutor();
+
+public:
+    //! ownership is taken
+    void Post(Callable *callable);
+    //! entered in a worker, deleted by itself once completed
+    void Post(AsyncCallable *callable);
+
+    //! the calling thread, if a worker, is about to block till LeaveBlocking
+    static void EnterBlocking();
+    static void LeaveBlocking();
+
+private:
+    //! tagged pointer, never 0
+    void Post(uintptr_t item);
+    void Inject(uintptr_t item);
+
+    //! false when nobody sleeps
+    bool Notify();
+    //! spawns when nobody sleeps and every worker is running
+    void WakeThief(bool isCallerIdle);
+    void SpawnWorker();
+    Worker *ReviveWorker();
+    Worker *CreateWorker();
+    bool StartWorker(Worker *worker);
+    //! false when it has to stay
+    bool Retire(Worker *worker);
+
+    //! 0 means nothing
+    uintptr_t FindItem(Worker *worker);
+    uintptr_t TakeInjected(Worker *worker);
+    uintptr_t Steal(Worker *worker);
+    bool HasItem();
+    //! false when idle for IdleTimeout
+    bool Park();
+
+    void Run(Worker *worker);
+    static void RunItem(uintptr_t item, Dispatcher& dispatcher);
+
+#if defined(_WIN32)
+    static DWORD WINAPI WorkerProc(LPVOID param);
+#else
+    static void *WorkerProc(void *param);
+#endif
+};
+
+#endif
@@ -0,0 +1,389 @@
+//
+//  hex and Base64 codecs of StringConvertor
+//      random inputs round-trip through both cases of hex and both Base64 alphabets, checked against plain references
+//      the invalid digits, lengths and paddings shall be rejected, nothing is written past the outputs
+//      the throughput over 1 MiB is reported next to the per-byte table loops they replace
+//
+//  CodecTest [round count]
+//      the vector paths are taken when built for them, e.g. make CXXFLAGS="-O2 -mavx2" -C test CodecTest
+//
+
+#include "StringConvertor.h"
+
+#include <sys/time.h>
+
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace
+{
+    enum
+    {
+        Guard = 0xEE,
+        BenchLength = 1024 * 1024,
+        BenchRepeats = 200
+    };
+
+    const char StandardTable[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    const char UrlSafeTable[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+
+    uint32_t g_seed = 11;
+    uint32_t g_failedCount = 0;
+
+    uint32_t _Random()
+    {
+        g_seed ^= g_seed << 13;
+        g_seed ^= g_seed >> 17;
+        g_seed ^= g_seed << 5;
+        return g_seed;
+    }
+
+    void Fail(const char *what, size_t length)
+    {
+        if (g_failedCount++ < 10)
+            std::printf("  %s, %u bytes\n", what, static_cast<uint32_t>(length));
+    }
+
+    std::string ReferenceHex(const std::vector<uint8_t>& data, bool isUpperCase)
+    {
+        std::string hex;
+        for (size_t i = 0; i < data.size(); ++i)
+        {
+            char digits[3];
+            std::snprintf(digits, sizeof(digits), isUpperCase ? "%02X" : "%02x", data[i]);
+            hex.append(digits, 2);
+        }
+
+        return hex;
+    }
+
+    //! padded unless url-safe, as StringConvertor encodes
+    std::string ReferenceBase64(const std::vector<uint8_t>& data, bool isUrlSafe)
+    {
+        const char *table = isUrlSafe ? UrlSafeTable : StandardTable;
+
+        std::string base64;
+        size_t i = 0;
+        for (; i + 3 <= data.size(); i += 3)
+        {
+            uint32_t v = (data[i] << 16) | (data[i + 1] << 8) | data[i + 2];
+            base64.push_back(table[v >> 18]);
+            base64.push_back(table[(v >> 12) & 63]);
+            base64.push_back(table[(v >> 6) & 63]);
+            base64.push_back(table[v & 63]);
+        }
+
+        size_t rest = data.size() - i;
+        if (0 != rest)
+        {
+            uint32_t v = (data[i] << 16) | (2 == rest ? data[i + 1] << 8 : 0);
+            base64.push_back(table[v >> 18]);
+            base64.push_back(table[(v >> 12) & 63]);
+            if (2 == rest)
+                base64.push_back(table[(v >> 6) & 63]);
+
+            if (!isUrlSafe)
+                base64.append(3 - rest, '=');
+        }
+
+        return base64;
+    }
+
+    void CheckHex(const std::vector<uint8_t>& data, bool isUpperCase)
+    {
+        const size_t length = data.size();
+        const std::string reference = ReferenceHex(data, isUpperCase);
+
+        std::vector<char> hex(2 * length + 1, static_cast<char>(Guard));
+        StringConvertor::ToHex(data.empty() ? NULL : &data[0], length, &hex[0], isUpperCase);
+        if (0 != std::memcmp(&hex[0], reference.data(), reference.size()) || static_cast<char>(Guard) != hex[2 * length])
+        {
+            Fail("hex encoded wrongly", length);
+            return;
+        }
+
+        //! the digits of either case are decoded
+        for (size_t i = 0; i < 2 * length; ++i)
+        {
+            if (0 == _Random() % 3)
+                hex[i] = static_cast<char>(std::toupper(hex[i]));
+            else if (0 == _Random() % 3)
+                hex[i] = static_cast<char>(std::tolower(hex[i]));
+        }
+
+        std::vector<uint8_t> decoded(length + 1, Guard);
+        if (!StringConvertor::FromHex(&hex[0], 2 * length, &decoded[0])
+            || (0 != length && 0 != std::memcmp(&decoded[0], &data[0], length)) || Guard != decoded[length])
+        {
+            Fail("hex decoded wrongly", length);
+        }
+
+        if (0 == length)
+            return;
+
+        static const char Invalids[] = "gG/:@`\x80\xff z";
+        size_t at = _Random() % (2 * length);
+        char saved = hex[at];
+        hex[at] = Invalids[_Random() % (sizeof(Invalids) - 1)];
+        if (StringConvertor::FromHex(&hex[0], 2 * length, &decoded[0]))
+            Fail("invalid hex digit accepted", length);
+        hex[at] = saved;
+
+        if (StringConvertor::FromHex(&hex[0], 2 * length - 1, &decoded[0]))
+            Fail("odd hex length accepted", length);
+    }
+
+    bool Decode(const std::string& base64, StringConvertor::Base64Alphabet alphabet, std::vector<uint8_t>& decoded)
+    {
+        //! the bound documented, plus a guard
+        const size_t bound = base64.size() / 4 * 3 + 2;
+        decoded.assign(bound + 1, Guard);
+
+        size_t decodedLength = 0;
+        bool isDecoded = StringConvertor::FromBase64(base64.data(), base64.size(), &decoded[0], decodedLength, alphabet);
+        if (Guard != decoded[bound])
+            return false;
+
+        decoded.resize(decodedLength);
+        return isDecoded;
+    }
+
+    void CheckBase64(const std::vector<uint8_t>& data, bool isUrlSafe)
+    {
+        const size_t length = data.size();
+        StringConvertor::Base64Alphabet alphabet = isUrlSafe ? StringConvertor::Base64UrlSafe : StringConvertor::Base64Standard;
+        const std::string reference = ReferenceBase64(data, isUrlSafe);
+
+        size_t encodedLength = StringConvertor::GetBase64Length(length, alphabet);
+        std::vector<char> encoded(encodedLength + 1, static_cast<char>(Guard));
+        size_t written = StringConvertor::ToBase64(data.empty() ? NULL : &data[0], length, &encoded[0], alphabet);
+        if (written != encodedLength || encodedLength != reference.size()
+            || 0 != std::memcmp(&encoded[0], reference.data(), reference.size()) || static_cast<char>(Guard) != encoded[encodedLength])
+        {
+            Fail("base64 encoded wrongly", length);
+            return;
+        }
+
+        //! both the padded and the unpadded forms are decoded
+        std::string forms[2] = { reference, reference };
+        if (isUrlSafe)
+        {
+            forms[0].append((4 - reference.size() % 4) % 4, '=');
+        }
+        else
+        {
+            std::string::size_type end = forms[1].find_last_not_of('=');
+            forms[1].erase(std::string::npos == end ? 0 : end + 1);
+        }
+
+        for (int i = 0; i < 2; ++i)
+        {
+            const std::string& form = forms[i];
+
+            std::vector<uint8_t> decoded;
+            if (!Decode(form, alphabet, decoded) || decoded != data)
+            {
+                Fail("base64 decoded wrongly", length);
+                continue;
+            }
+
+            if (form.empty())
+                continue;
+
+            static const char Invalids[] = "*\x80 \n.%";
+            std::string broken = form;
+            size_t at = _Random() % broken.size();
+            if ('=' != broken[at])
+            {
+                broken[at] = Invalids[_Random() % (sizeof(Invalids) - 1)];
+                if (Decode(broken, alphabet, decoded))
+                    Fail("invalid base64 character accepted", length);
+            }
+
+            //! a character of the other alphabet
+            std::string other = form;
+            std::string::size_type found = other.find_first_of(isUrlSafe ? "-_" : "+/");
+            if (std::string::npos != found)
+            {
+                other[found] = '-' == other[found] ? '+' : ('_' == other[found] ? '/' : ('+' == other[found] ? '-' : '_'));
+                if (Decode(other, alphabet, decoded))
+                    Fail("base64 of the other alphabet accepted", length);
+            }
+        }
+    }
+
+    void CheckKnownVectors()
+    {
+        //! RFC 4648 section 10
+        static const char *Vectors[][2] =
+        {
+            { "", "" },
+            { "f", "Zg==" },
+            { "fo", "Zm8=" },
+            { "foo", "Zm9v" },
+            { "foob", "Zm9vYg==" },
+            { "fooba", "Zm9vYmE=" },
+            { "foobar", "Zm9vYmFy" }
+        };
+
+        for (size_t i = 0; i < sizeof(Vectors) / sizeof(Vectors[0]); ++i)
+        {
+            std::vector<uint8_t> data(Vectors[i][0], Vectors[i][0] + std::strlen(Vectors[i][0]));
+            if (ReferenceBase64(data, false) != Vectors[i][1])
+                Fail("reference differs from RFC 4648", data.size());
+
+            std::vector<uint8_t> decoded;
+            if (!Decode(Vectors[i][1], StringConvertor::Base64Standard, decoded) || decoded != data)
+                Fail("RFC 4648 vector decoded wrongly", data.size());
+        }
+
+        static const char *Malformed[] = { "Z", "Zg=", "Zg===", "====", "Z===", "Zg==Zg==" };
+        for (size_t i = 0; i < sizeof(Malformed) / sizeof(Malformed[0]); ++i)
+        {
+            std::vector<uint8_t> decoded;
+            if (Decode(Malformed[i], StringConvertor::Base64Standard, decoded))
+                Fail("malformed base64 accepted", std::strlen(Malformed[i]));
+        }
+    }
+
+    double _NowMs()
+    {
+        struct timeval tv;
+        ::gettimeofday(&tv, NULL);
+        return tv.tv_sec * 1000.0 + tv.tv_usec / 1000.0;
+    }
+
+    void Report(const char *name, double startMs, size_t inputLength)
+    {
+        double elapsedMs = _NowMs() - startMs;
+        std::printf("  %-28s %7.2f GB/s\n", name, static_cast<double>(inputLength) * BenchRepeats / elapsedMs / 1e6);
+    }
+
+    //! the per-byte table loop of the former FromBytes
+    void TableHex(const uint8_t *data, size_t length, char *out)
+    {
+        static const char *HexTable = "0123456789abcdef";
+
+        for (size_t i = 0; i != length; ++i)
+        {
+            uint8_t byte = data[i];
+
+            out[i * 2] = HexTable[(byte >> 4) & 0x0F];
+            out[i * 2 + 1] = HexTable[byte & 0x0F];
+        }
+    }
+
+    void TableBase64(const uint8_t *data, size_t length, char *out)
+    {
+        size_t i = 0;
+        for (; i + 3 <= length; i += 3)
+        {
+            uint32_t v = (data[i] << 16) | (data[i + 1] << 8) | data[i + 2];
+            *out++ = StandardTable[v >> 18];
+            *out++ = StandardTable[(v >> 12) & 63];
+            *out++ = StandardTable[(v >> 6) & 63];
+            *out++ = StandardTable[v & 63];
+        }
+    }
+
+    void Bench()
+    {
+        std::vector<uint8_t> data(BenchLength);
+        for (size_t i = 0; i < data.size(); ++i)
+        {
+            data[i] = static_cast<uint8_t>(_Random());
+        }
+
+        std::vector<char> hex(2 * BenchLength);
+        std::vector<char> base64(StringConvertor::GetBase64Length(BenchLength));
+        std::vector<uint8_t> decoded(BenchLength + 2);
+        size_t decodedLength = 0;
+
+        //! read back after each pass, so that none is optimized away
+        volatile char sink = 0;
+
+        std::printf("throughput over %u KiB, of the input:\n", BenchLength / 1024);
+
+        double startMs = _NowMs();
+        for (int i = 0; i < BenchRepeats; ++i)
+        {
+            TableHex(&data[0], BenchLength, &hex[0]);
+            sink = sink + hex[i];
+        }
+        Report("hex encode, table loop", startMs, BenchLength);
+
+        startMs = _NowMs();
+        for (int i = 0; i < BenchRepeats; ++i)
+        {
+            StringConvertor::ToHex(&data[0], BenchLength, &hex[0]);
+            sink = sink + hex[i];
+        }
+        Report("hex encode", startMs, BenchLength);
+
+        startMs = _NowMs();
+        for (int i = 0; i < BenchRepeats; ++i)
+        {
+            StringConvertor::FromHex(&hex[0], hex.size(), &decoded[0]);
+            sink = sink + static_cast<char>(decoded[i]);
+        }
+        Report("hex decode", startMs, hex.size());
+
+        startMs = _NowMs();
+        for (int i = 0; i < BenchRepeats; ++i)
+        {
+            TableBase64(&data[0], BenchLength, &base64[0]);
+            sink = sink + base64[i];
+        }
+        Report("base64 encode, table loop", startMs, BenchLength);
+
+        startMs = _NowMs();
+        for (int i = 0; i < BenchRepeats; ++i)
+        {
+            StringConvertor::ToBase64(&data[0], BenchLength, &base64[0]);
+            sink = sink + base64[i];
+        }
+        Report("base64 encode", startMs, BenchLength);
+
+        startMs = _NowMs();
+        for (int i = 0; i < BenchRepeats; ++i)
+        {
+            StringConvertor::FromBase64(&base64[0], base64.size(), &decoded[0], decodedLength);
+            sink = sink + static_cast<char>(decoded[i]);
+        }
+        Report("base64 decode", startMs, base64.size());
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int roundCount = argc > 1 ? std::atoi(argv[1]) : 20000;
+
+    CheckKnownVectors();
+
+    for (int round = 0; round < roundCount; ++round)
+    {
+        //! mostly the lengths of headers and digests, some longer to cross the vector widths many times
+        size_t length = _Random() % (0 == round % 10 ? 2000 : 120);
+
+        std::vector<uint8_t> data(length);
+        for (size_t i = 0; i < length; ++i)
+        {
+            data[i] = static_cast<uint8_t>(_Random());
+        }
+
+        CheckHex(data, false);
+        CheckHex(data, true);
+        CheckBase64(data, false);
+        CheckBase64(data, true);
+    }
+
+    std::printf("CodecTest: %d rounds, %u failed\n", roundCount, g_failedCount);
+
+    Bench();
+
+    return 0 == g_failedCount ? 0 : 1;
+}
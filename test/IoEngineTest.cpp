@@ -0,0 +1,339 @@
+//
+//  epoll and io_uring engines echoing over loopback
+//      each channel sends its payload to an echo server and checks every byte received back
+//      the engine is driven by RunOnce in this thread, so the CPU time of the thread is the one of the engine
+//
+//  IoEngineTest [MiB per channel] [channel count]
+//
+
+#include "IoEngine.h"
+
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+using namespace Net;
+using namespace Net::Details;
+
+namespace
+{
+    enum
+    {
+        SendChunkLength = 256 * 1024,
+        EchoBufferLength = 64 * 1024
+    };
+
+    void *_Echo(void *param)
+    {
+        int fd = static_cast<int>(reinterpret_cast<intptr_t>(param));
+
+        std::vector<char> buffer(EchoBufferLength);
+        for (;;)
+        {
+            ssize_t received = ::recv(fd, &buffer[0], buffer.size(), 0);
+            if (received <= 0)
+                break;
+
+            for (ssize_t sent = 0; sent < received;)
+            {
+                ssize_t n = ::send(fd, &buffer[sent], received - sent, MSG_NOSIGNAL);
+                if (n <= 0)
+                {
+                    received = 0;
+                    break;
+                }
+
+                sent += n;
+            }
+        }
+
+        ::close(fd);
+        return NULL;
+    }
+
+    void *_Accept(void *param)
+    {
+        int listener = static_cast<int>(reinterpret_cast<intptr_t>(param));
+
+        for (;;)
+        {
+            int fd = ::accept(listener, NULL, NULL);
+            if (fd < 0)
+                break;
+
+            pthread_t thread;
+            if (0 != pthread_create(&thread, NULL, _Echo, reinterpret_cast<void *>(static_cast<intptr_t>(fd))))
+            {
+                ::close(fd);
+                continue;
+            }
+
+            pthread_detach(thread);
+        }
+
+        return NULL;
+    }
+
+    //! the loopback address listened on, false when failed
+    bool StartEchoServer(struct sockaddr_in& addr)
+    {
+        int listener = ::socket(AF_INET, SOCK_STREAM, 0);
+        if (listener < 0)
+            return false;
+
+        std::memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+        socklen_t addrLen = sizeof(addr);
+        if (0 != ::bind(listener, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr))
+            || 0 != ::listen(listener, 128)
+            || 0 != ::getsockname(listener, reinterpret_cast<struct sockaddr *>(&addr), &addrLen))
+        {
+            ::close(listener);
+            return false;
+        }
+
+        pthread_t thread;
+        if (0 != pthread_create(&thread, NULL, _Accept, reinterpret_cast<void *>(static_cast<intptr_t>(listener))))
+        {
+            ::close(listener);
+            return false;
+        }
+
+        pthread_detach(thread);
+        return true;
+    }
+
+    class EchoChannel : public ChannelHandler
+    {
+    public:
+        IoEngine *m_engine;
+        Channel *m_channel;
+
+        const uint8_t *m_payload;
+        uint32_t m_length;
+        uint32_t m_sent;
+        uint32_t m_received;
+        uint32_t m_receivedCount;
+
+        //! errno, or -1 when the echo differs or ends early
+        int m_error;
+        bool m_isClosed;
+
+    public:
+        EchoChannel(IoEngine *engine, const uint8_t *payload, uint32_t length)
+            : m_engine(engine)
+            , m_channel(NULL)
+            , m_payload(payload)
+            , m_length(length)
+            , m_sent(0)
+            , m_received(0)
+            , m_receivedCount(0)
+            , m_error(0)
+            , m_isClosed(false)
+        {}
+
+    public:
+        virtual void OnConnected(int err)
+        {
+            if (0 != err)
+            {
+                Fail(err);
+                return;
+            }
+
+            SendNext();
+            m_engine->Receive(m_channel);
+        }
+
+        virtual void OnSent(uint32_t len, int err)
+        {
+            if (0 != err)
+            {
+                Fail(err);
+                return;
+            }
+
+            m_sent += len;
+            if (m_sent < m_length)
+                SendNext();
+        }
+
+        virtual void OnReceived(const uint8_t *data, uint32_t len, int err)
+        {
+            if (0 != err || 0 == len || len > m_length - m_received || 0 != std::memcmp(data, m_payload + m_received, len))
+            {
+                Fail(0 != err ? err : -1);
+                return;
+            }
+
+            m_received += len;
+            ++m_receivedCount;
+
+            if (m_received == m_length)
+                m_engine->Close(m_channel);
+            else
+                m_engine->Receive(m_channel);
+        }
+
+        virtual void OnClosed()
+        {
+            m_isClosed = true;
+        }
+
+    private:
+        void SendNext()
+        {
+            uint32_t len = m_length - m_sent;
+            if (len > SendChunkLength)
+                len = SendChunkLength;
+
+            m_engine->Send(m_channel, m_payload + m_sent, len);
+        }
+
+        void Fail(int err)
+        {
+            if (0 == m_error)
+                m_error = err;
+
+            m_engine->Close(m_channel);
+        }
+    };
+
+    struct Outcome
+    {
+        bool isPassed;
+        double elapsedMs;
+        double cpuMs;
+        uint64_t receivedCount;
+    };
+
+    double _ToMs(const struct timeval& tv)
+    {
+        return tv.tv_sec * 1000.0 + tv.tv_usec / 1000.0;
+    }
+
+    double _NowMs()
+    {
+        struct timeval tv;
+        ::gettimeofday(&tv, NULL);
+        return _ToMs(tv);
+    }
+
+    double _ThreadCpuMs()
+    {
+        struct rusage usage;
+        ::getrusage(RUSAGE_THREAD, &usage);
+        return _ToMs(usage.ru_utime) + _ToMs(usage.ru_stime);
+    }
+
+    Outcome Run(IoEngine *engine, const struct sockaddr_in& addr, const std::vector<uint8_t>& payload, uint32_t channelCount)
+    {
+        Outcome outcome;
+        outcome.isPassed = true;
+        outcome.receivedCount = 0;
+
+        double startMs = _NowMs();
+        double startCpuMs = _ThreadCpuMs();
+
+        std::vector<EchoChannel *> channels;
+        for (uint32_t i = 0; i < channelCount; ++i)
+        {
+            EchoChannel *channel = new EchoChannel(engine, &payload[0], static_cast<uint32_t>(payload.size()));
+            channel->m_channel = engine->CreateChannel(channel, SocketOptions());
+            channels.push_back(channel);
+
+            engine->Connect(channel->m_channel, reinterpret_cast<const struct sockaddr *>(&addr), sizeof(addr));
+        }
+
+        for (;;)
+        {
+            bool isDone = true;
+            for (uint32_t i = 0; i < channelCount && isDone; ++i)
+            {
+                isDone = channels[i]->m_isClosed;
+            }
+
+            if (isDone)
+                break;
+
+            engine->RunOnce(100);
+        }
+
+        outcome.elapsedMs = _NowMs() - startMs;
+        outcome.cpuMs = _ThreadCpuMs() - startCpuMs;
+
+        for (uint32_t i = 0; i < channelCount; ++i)
+        {
+            EchoChannel *channel = channels[i];
+            if (0 != channel->m_error || channel->m_received != channel->m_length)
+            {
+                std::printf("  channel %u failed, error %d, %u of %u bytes echoed\n", i, channel->m_error, channel->m_received, channel->m_length);
+                outcome.isPassed = false;
+            }
+
+            outcome.receivedCount += channel->m_receivedCount;
+            delete channel;
+        }
+
+        return outcome;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t channelMiB = argc > 1 ? static_cast<uint32_t>(std::atoi(argv[1])) : 16;
+    uint32_t channelCount = argc > 2 ? static_cast<uint32_t>(std::atoi(argv[2])) : 8;
+    if (0 == channelMiB || channelMiB > 1024 || 0 == channelCount)
+    {
+        std::printf("usage: IoEngineTest [MiB per channel, up to 1024] [channel count]\n");
+        return 2;
+    }
+
+    struct sockaddr_in addr;
+    if (!StartEchoServer(addr))
+    {
+        std::printf("IoEngineTest: failed to listen on loopback\n");
+        return 1;
+    }
+
+    std::vector<uint8_t> payload(channelMiB * 1024 * 1024);
+    for (size_t i = 0; i < payload.size(); ++i)
+    {
+        payload[i] = static_cast<uint8_t>(i * 131 + (i >> 12));
+    }
+
+    const char *names[] = { "epoll", "io_uring" };
+    IoEngine *engines[] = { CreateEpollIoEngine(), CreateUringIoEngine() };
+
+    double totalMiB = static_cast<double>(channelMiB) * channelCount;
+    bool isPassed = true;
+    for (int i = 0; i < 2; ++i)
+    {
+        if (NULL == engines[i])
+        {
+            std::printf("%-8s not available, skipped\n", names[i]);
+            continue;
+        }
+
+        Outcome outcome = Run(engines[i], addr, payload, channelCount);
+        delete engines[i];
+
+        std::printf("%-8s %s, %.0f MiB echoed over %u channels in %.0f ms, %.0f MiB/s, engine thread CPU %.0f ms, %llu receive completions\n"
+            , names[i], outcome.isPassed ? "passed" : "FAILED", totalMiB, channelCount, outcome.elapsedMs
+            , totalMiB * 1000.0 / outcome.elapsedMs, outcome.cpuMs, static_cast<unsigned long long>(outcome.receivedCount));
+
+        isPassed = isPassed && outcome.isPassed;
+    }
+
+    return isPassed ? 0 : 1;
+}
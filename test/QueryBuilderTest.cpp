@@ -0,0 +1,222 @@
+//
+//  QueryBuilder and the percent-encoding under it
+//      every byte is encoded against a plain reference, alone and inside the runs the vector paths take
+//      the pairs are appended after the query of the url if any, and before its fragment
+//
+
+#include "HttpClient.h"
+#include "StringConvertor.h"
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using namespace Net;
+
+namespace
+{
+    //! RFC 3986 2.3, the others are escaped in upper case hex
+    std::string _Reference(const std::string& data)
+    {
+        static const char Unreserved[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-._~";
+
+        std::string encoded;
+        for (std::string::size_type i = 0; i != data.size(); ++i)
+        {
+            char c = data[i];
+            if ('\0' != c && NULL != std::strchr(Unreserved, c))
+            {
+                encoded.push_back(c);
+                continue;
+            }
+
+            char escaped[4];
+            std::snprintf(escaped, sizeof(escaped), "%%%02X", static_cast<unsigned int>(static_cast<uint8_t>(c)));
+            encoded.append(escaped);
+        }
+
+        return encoded;
+    }
+
+    std::string _Encode(const std::string& data)
+    {
+        std::string encoded(StringConvertor::GetPercentEncodedLength(data.data(), data.size()), '\0');
+        size_t written = StringConvertor::ToPercentEncoding(data.data(), data.size(), encoded.empty() ? NULL : &encoded[0]);
+        encoded.resize(written);
+
+        return encoded;
+    }
+
+    bool _Decode(const std::string& encoded, std::string& data)
+    {
+        data.assign(encoded.size(), '\0');
+
+        size_t length = 0;
+        if (!StringConvertor::FromPercentEncoding(encoded.data(), encoded.size(), data.empty() ? NULL : &data[0], length))
+            return false;
+
+        data.resize(length);
+        return true;
+    }
+
+    struct Pair
+    {
+        std::string key;
+        std::string value;
+    };
+
+    struct Case
+    {
+        const char *name;
+        std::string url;
+        std::vector<Pair> pairs;
+        std::string expected;
+    };
+
+    void _Add(std::vector<Case>& cases, const char *name, const std::string& url, const char *key, const char *value, const std::string& expected)
+    {
+        Case c;
+        c.name = name;
+        c.url = url;
+        c.expected = expected;
+
+        Pair pair = { key, value };
+        c.pairs.push_back(pair);
+
+        cases.push_back(c);
+    }
+}
+
+int main()
+{
+    uint32_t failedCount = 0;
+    uint32_t runCount = 0;
+
+    //! every byte alone, then in the middle of a run longer than a vector
+    for (uint32_t byte = 0; byte != 256; ++byte)
+    {
+        std::string alone(1, static_cast<char>(byte));
+        std::string run = std::string(37, 'a') + alone + std::string(29, '~') + alone;
+
+        for (int i = 0; i < 2; ++i)
+        {
+            const std::string& data = 0 == i ? alone : run;
+
+            ++runCount;
+            std::string encoded = _Encode(data);
+            std::string decoded;
+            if (encoded != _Reference(data) || !_Decode(encoded, decoded) || decoded != data)
+            {
+                ++failedCount;
+                std::printf("byte %02X: encoded as [%s]\n", byte, encoded.c_str());
+            }
+        }
+    }
+
+    //! gen-delims and sub-delims of RFC 3986 2.2, none is kept
+    {
+        ++runCount;
+        std::string reserved(":/?#[]@!$&'()*+,;=");
+        std::string encoded = _Encode(reserved + reserved + reserved);
+        if (encoded.size() != reserved.size() * 9 || std::string::npos != encoded.find_first_of(reserved.substr(1)))
+        {
+            ++failedCount;
+            std::printf("reserved: encoded as [%s]\n", encoded.c_str());
+        }
+    }
+
+    //! '+' is only a space in forms
+    {
+        ++runCount;
+        const char *encoded = "a+b%20c%2B";
+        char decoded[16];
+        size_t length = 0;
+        bool isPlain = StringConvertor::FromPercentEncoding(encoded, std::strlen(encoded), decoded, length)
+            && std::string(decoded, length) == "a+b c+";
+        bool isForm = StringConvertor::FromPercentEncoding(encoded, std::strlen(encoded), decoded, length, true)
+            && std::string(decoded, length) == "a b c+";
+        if (!isPlain || !isForm)
+        {
+            ++failedCount;
+            std::printf("plus: decoded as space %s\n", isPlain ? "in plain" : "in form");
+        }
+    }
+
+    //! '%' not followed by 2 hex digits
+    {
+        const char *malformed[] = { "%", "%4", "a%G1", "%4g", "abc%" };
+        for (size_t i = 0; i != sizeof(malformed) / sizeof(malformed[0]); ++i)
+        {
+            ++runCount;
+            std::string decoded;
+            if (_Decode(malformed[i], decoded))
+            {
+                ++failedCount;
+                std::printf("malformed [%s]: decoded\n", malformed[i]);
+            }
+        }
+    }
+
+    std::vector<Case> cases;
+
+    _Add(cases, "no query", "http://example.com/a", "k", "v", "http://example.com/a?k=v");
+    _Add(cases, "after a query", "http://example.com/a?x=1", "k", "v", "http://example.com/a?x=1&k=v");
+    _Add(cases, "after an empty query", "http://example.com/a?", "k", "v", "http://example.com/a?&k=v");
+    _Add(cases, "before a fragment", "http://example.com/a#top", "k", "v", "http://example.com/a?k=v#top");
+    _Add(cases, "after a query, before a fragment", "http://example.com/a?x=1#top", "k", "v", "http://example.com/a?x=1&k=v#top");
+    _Add(cases, "'?' in the fragment", "http://example.com/a#top?x", "k", "v", "http://example.com/a?k=v#top?x");
+    _Add(cases, "before an empty fragment", "http://example.com/#", "k", "v", "http://example.com/?k=v#");
+    _Add(cases, "path of a prepared request", "/search", "q", "a b", "/search?q=a%20b");
+    _Add(cases, "empty url", "", "k", "v", "?k=v");
+    _Add(cases, "empty value", "/a", "k", "", "/a?k=");
+    _Add(cases, "empty key", "/a", "", "v", "/a?=v");
+    _Add(cases, "reserved", "/a", "a&b=c", "?#/[]@!$'()*+,;=:", "/a?a%26b%3Dc=%3F%23%2F%5B%5D%40%21%24%27%28%29%2A%2B%2C%3B%3D%3A");
+    _Add(cases, "unreserved", "/a", "AZaz09-._~", "~_.-90zaZA", "/a?AZaz09-._~=~_.-90zaZA");
+    _Add(cases, "percent", "/a", "100%", "%41", "/a?100%25=%2541");
+    _Add(cases, "UTF-8", "/a", "\xE4\xBD\xA0\xE5\xA5\xBD", "caf\xC3\xA9 \xF0\x9F\x98\x80", "/a?%E4%BD%A0%E5%A5%BD=caf%C3%A9%20%F0%9F%98%80");
+
+    Case c;
+    c.name = "pairs in order, before a fragment";
+    c.url = "http://example.com/a?x=1#f";
+    Pair first = { "k", "1" };
+    Pair second = { "k", "" };
+    Pair third = { "long", std::string(40, '/') };
+    c.pairs.push_back(first);
+    c.pairs.push_back(second);
+    c.pairs.push_back(third);
+    c.expected = "http://example.com/a?x=1&k=1&k=&long=";
+    for (int i = 0; i < 40; ++i)
+        c.expected.append("%2F");
+    c.expected.append("#f");
+    cases.push_back(c);
+
+    for (std::vector<Case>::const_iterator it = cases.begin(); it != cases.end(); ++it)
+    {
+        QueryBuilder builder(it->url);
+        for (std::vector<Pair>::const_iterator pair = it->pairs.begin(); pair != it->pairs.end(); ++pair)
+            builder.Add(pair->key, pair->value);
+
+        ++runCount;
+        if (builder.GetURL() != it->expected || builder.GetLength() != it->expected.size())
+        {
+            ++failedCount;
+            std::printf("%s: [%s]\n", it->name, builder.GetURL().c_str());
+        }
+    }
+
+    //! the wide ones are transcoded to UTF-8 first, the surrogates of Windows included
+    {
+        ++runCount;
+        QueryBuilder builder("/a");
+        builder.Add(String(L"\u4F60 k"), String(L"\U0001F600&"));
+        if ("/a?%E4%BD%A0%20k=%F0%9F%98%80%26" != builder.GetURL())
+        {
+            ++failedCount;
+            std::printf("wide: [%s]\n", builder.GetURL().c_str());
+        }
+    }
+
+    std::printf("QueryBuilderTest: %u runs, %u failed\n", runCount, failedCount);
+    return 0 == failedCount ? 0 : 1;
+}
@@ -0,0 +1,354 @@
+//
+//  prepared requests followed across the redirects
+//      two loopback servers record every request head, the one of the last hop is checked
+//      the fixed headers of the prepared request shall be sent again, with the request line and Host of the new location
+//
+
+#include "HttpClient.h"
+
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using namespace Net;
+
+namespace
+{
+    //! the heads received by both servers, in order
+    pthread_mutex_t _headsLock = PTHREAD_MUTEX_INITIALIZER;
+    std::vector<std::string> _heads;
+
+    //! the port the "/b" hop redirects to
+    uint16_t _otherPort = 0;
+
+    void _Respond(int fd, const std::string& path)
+    {
+        char response[256];
+        if ("/a" == path)
+        {
+            std::snprintf(response, sizeof(response), "HTTP/1.1 302 Found\r\nLocation: /b\r\nContent-Length: 0\r\n\r\n");
+        }
+        else if ("/b" == path)
+        {
+            std::snprintf(response, sizeof(response), "HTTP/1.1 301 Moved Permanently\r\nLocation: http://127.0.0.1:%u/c?q=1\r\nContent-Length: 0\r\n\r\n"
+                , static_cast<unsigned int>(_otherPort));
+        }
+        else if ("/s" == path)
+        {
+            std::snprintf(response, sizeof(response), "HTTP/1.1 303 See Other\r\nLocation: /done\r\nContent-Length: 0\r\n\r\n");
+        }
+        else
+        {
+            std::snprintf(response, sizeof(response), "HTTP/1.1 200 OK\r\nContent-Length: %u\r\n\r\n%s"
+                , static_cast<unsigned int>(path.size()), path.c_str());
+        }
+
+        ::send(fd, response, std::strlen(response), MSG_NOSIGNAL);
+    }
+
+    void *_Serve(void *param)
+    {
+        int fd = static_cast<int>(reinterpret_cast<intptr_t>(param));
+
+        std::string received;
+        char buffer[4096];
+        for (;;)
+        {
+            std::string::size_type headEnd = received.find("\r\n\r\n");
+            if (std::string::npos == headEnd)
+            {
+                ssize_t n = ::recv(fd, buffer, sizeof(buffer), 0);
+                if (n <= 0)
+                    break;
+
+                received.append(buffer, n);
+                continue;
+            }
+
+            std::string head = received.substr(0, headEnd + 4);
+
+            //! the body of a POST is skipped
+            std::string::size_type bodyLength = 0;
+            std::string::size_type lengthAt = head.find("Content-Length: ");
+            if (std::string::npos != lengthAt)
+                bodyLength = static_cast<std::string::size_type>(std::atoi(head.c_str() + lengthAt + 16));
+
+            while (received.size() < head.size() + bodyLength)
+            {
+                ssize_t n = ::recv(fd, buffer, sizeof(buffer), 0);
+                if (n <= 0)
+                    break;
+
+                received.append(buffer, n);
+            }
+
+            received.erase(0, head.size() + bodyLength);
+
+            pthread_mutex_lock(&_headsLock);
+            _heads.push_back(head);
+            pthread_mutex_unlock(&_headsLock);
+
+            std::string::size_type pathStart = head.find(' ') + 1;
+            std::string::size_type pathEnd = head.find_first_of(" ?", pathStart);
+            _Respond(fd, head.substr(pathStart, pathEnd - pathStart));
+        }
+
+        ::close(fd);
+        return NULL;
+    }
+
+    void *_Accept(void *param)
+    {
+        int listener = static_cast<int>(reinterpret_cast<intptr_t>(param));
+
+        for (;;)
+        {
+            int fd = ::accept(listener, NULL, NULL);
+            if (fd < 0)
+                break;
+
+            pthread_t thread;
+            if (0 != pthread_create(&thread, NULL, _Serve, reinterpret_cast<void *>(static_cast<intptr_t>(fd))))
+            {
+                ::close(fd);
+                continue;
+            }
+
+            pthread_detach(thread);
+        }
+
+        return NULL;
+    }
+
+    //! the loopback port listened on, 0 when failed
+    uint16_t StartServer()
+    {
+        int listener = ::socket(AF_INET, SOCK_STREAM, 0);
+        if (listener < 0)
+            return 0;
+
+        struct sockaddr_in addr;
+        std::memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+        socklen_t addrLen = sizeof(addr);
+        if (0 != ::bind(listener, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr))
+            || 0 != ::listen(listener, 128)
+            || 0 != ::getsockname(listener, reinterpret_cast<struct sockaddr *>(&addr), &addrLen))
+        {
+            ::close(listener);
+            return 0;
+        }
+
+        pthread_t thread;
+        if (0 != pthread_create(&thread, NULL, _Accept, reinterpret_cast<void *>(static_cast<intptr_t>(listener))))
+        {
+            ::close(listener);
+            return 0;
+        }
+
+        pthread_detach(thread);
+        return ntohs(addr.sin_port);
+    }
+
+    class BodyHandler : public AsyncHandler<std::string>
+    {
+    private:
+        std::string m_body;
+        bool m_isFailed;
+
+    public:
+        BodyHandler()
+            : m_body()
+            , m_isFailed(false)
+        {}
+
+    public:
+        virtual void OnRequestDataFilled() {}
+        virtual void OnHeaderAvailable(const HttpResponseHeaders&) {}
+        virtual void OnBodyAvailable(InputStream& inputStream)
+        {
+            uint8_t buffer[1024];
+            for (;;)
+            {
+                uint32_t read = inputStream.Read(buffer, sizeof(buffer));
+                if (0 == read)
+                    break;
+
+                m_body.append(reinterpret_cast<const char *>(buffer), read);
+            }
+        }
+        virtual std::string OnCompleted() { return m_body; }
+        virtual Exception *OnException(Exception *ex) throw()
+        {
+            m_isFailed = true;
+            return ex;
+        }
+
+    public:
+        bool IsFailed() const { return m_isFailed; }
+    };
+
+    size_t _CountOf(const std::string& text, const std::string& piece)
+    {
+        size_t count = 0;
+        for (std::string::size_type at = text.find(piece); std::string::npos != at; at = text.find(piece, at + 1))
+            ++count;
+
+        return count;
+    }
+
+    struct Case
+    {
+        const char *name;
+        HttpVerb verb;
+        //! of the prepared request
+        const char *path;
+        //! of the HttpRequest made of it, empty to keep the prepared one
+        const char *patchedPath;
+        const char *body;
+        //! the hops sent, the first one included
+        size_t hopCount;
+        //! the last one
+        std::string requestLine;
+        std::string host;
+        const char *finalBody;
+    };
+}
+
+int main()
+{
+    uint16_t port = StartServer();
+    _otherPort = StartServer();
+    if (0 == port || 0 == _otherPort)
+    {
+        std::printf("RedirectTest: failed to listen on loopback\n");
+        return 1;
+    }
+
+    char authority[32];
+    std::snprintf(authority, sizeof(authority), "127.0.0.1:%u", static_cast<unsigned int>(port));
+    char otherAuthority[32];
+    std::snprintf(otherAuthority, sizeof(otherAuthority), "127.0.0.1:%u", static_cast<unsigned int>(_otherPort));
+
+    std::vector<Case> cases;
+
+    Case c;
+    c.name = "same origin, two hops";
+    c.verb = Get;
+    c.path = "/a";
+    c.patchedPath = "";
+    c.body = NULL;
+    c.hopCount = 3;
+    c.requestLine = "GET /c?q=1 HTTP/1.1\r\n";
+    c.host = otherAuthority;
+    c.finalBody = "/c";
+    cases.push_back(c);
+
+    c.name = "another origin";
+    c.path = "/b";
+    c.hopCount = 2;
+    cases.push_back(c);
+
+    c.name = "patched path";
+    c.path = "/x";
+    c.patchedPath = "/b";
+    cases.push_back(c);
+
+    c.name = "see other turns POST into GET";
+    c.verb = Post;
+    c.path = "/s";
+    c.patchedPath = "";
+    c.body = "payload";
+    c.hopCount = 2;
+    c.requestLine = "GET /done HTTP/1.1\r\n";
+    c.host = authority;
+    c.finalBody = "/done";
+    cases.push_back(c);
+
+    c.name = "not redirected";
+    c.verb = Get;
+    c.path = "/plain";
+    c.body = NULL;
+    c.hopCount = 1;
+    c.requestLine = "GET /plain HTTP/1.1\r\n";
+    c.finalBody = "/plain";
+    cases.push_back(c);
+
+    HttpClient client;
+
+    uint32_t failedCount = 0;
+    for (std::vector<Case>::const_iterator it = cases.begin(); it != cases.end(); ++it)
+    {
+        pthread_mutex_lock(&_headsLock);
+        _heads.clear();
+        pthread_mutex_unlock(&_headsLock);
+
+        RequestHeadersBuilder fixed;
+        fixed.Add("X-Fixed", "prepared").Add("Authorization", "Bearer token");
+
+        std::string url = std::string("http://") + authority + it->path;
+        PreparedRequest prepared(url, it->verb, fixed);
+
+        std::string body = NULL != it->body ? it->body : "";
+        SimpleStringInputStream bodyInput(body);
+
+        RequestHeadersBuilder extra;
+        extra.Add("X-Extra", "per request");
+        HttpRequest request(prepared, it->patchedPath, extra, NULL != it->body ? &bodyInput : NULL);
+
+        BodyHandler handler;
+        std::string received;
+        try
+        {
+            received = client.Send(&request, &handler);
+        }
+        catch (Exception *ex)
+        {
+            std::printf("%s: %s\n", it->name, ex->What().c_str());
+            delete ex;
+        }
+
+        pthread_mutex_lock(&_headsLock);
+        std::vector<std::string> heads = _heads;
+        pthread_mutex_unlock(&_headsLock);
+
+        std::string last = heads.empty() ? std::string() : heads.back();
+        std::string hostLine = "Host: " + it->host + "\r\n";
+
+        const char *failure = NULL;
+        if (handler.IsFailed())
+            failure = "failed";
+        else if (received != it->finalBody)
+            failure = "unexpected body";
+        else if (heads.size() != it->hopCount)
+            failure = "unexpected hop count";
+        else if (0 != last.compare(0, it->requestLine.size(), it->requestLine))
+            failure = "unexpected request line";
+        else if (1 != _CountOf(last, "Host: ") || 1 != _CountOf(last, hostLine))
+            failure = "unexpected Host";
+        else if (1 != _CountOf(last, "X-Fixed: prepared\r\n") || 1 != _CountOf(last, "Authorization: Bearer token\r\n"))
+            failure = "the prepared headers are lost";
+        else if (1 != _CountOf(last, "X-Extra: per request\r\n"))
+            failure = "the headers of the request are lost";
+        else if (it->hopCount > 1 && 0 != _CountOf(last, "Content-Length"))
+            failure = "the body is sent again";
+
+        if (NULL != failure)
+        {
+            ++failedCount;
+            std::printf("%s: %s, %u hops, the last one\n%s", it->name, failure, static_cast<uint32_t>(heads.size()), last.c_str());
+        }
+    }
+
+    std::printf("RedirectTest: %u cases, %u failed\n", static_cast<uint32_t>(cases.size()), failedCount);
+    return 0 == failedCount ? 0 : 1;
+}
@@ -0,0 +1,222 @@
+//
+//  ResponseParser fed the same responses split at every offset
+//      every split, and every pair of splits, shall parse exactly as the whole response in one read
+//      covers the heads split anywhere, CRLFCRLF across the reads and the chunk lines straddling them
+//
+
+#include "ResponseParser.h"
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using namespace Net::Details;
+
+namespace
+{
+    struct Parsed
+    {
+        //! 0 when parsed, -1 for a malformed head, -2 for a malformed body
+        int result;
+        uint32_t statusCode;
+        int64_t contentLength;
+        bool isKeepAlive;
+        bool isCompleted;
+        //! the raw headers joined by '|'
+        std::string headers;
+        std::string body;
+
+        Parsed()
+            : result(0)
+            , statusCode(0)
+            , contentLength(0)
+            , isKeepAlive(false)
+            , isCompleted(false)
+            , headers()
+            , body()
+        {}
+
+        bool operator == (const Parsed& r) const
+        {
+            if (result != r.result)
+                return false;
+
+            return 0 != result || (statusCode == r.statusCode && contentLength == r.contentLength && isKeepAlive == r.isKeepAlive
+                && isCompleted == r.isCompleted && headers == r.headers && body == r.body);
+        }
+    };
+
+    //! the reads end at each of the cuts, ascending, then at the end of the response
+    Parsed Parse(const std::string& response, const std::vector<size_t>& cuts)
+    {
+        ResponseParser parser;
+        Parsed parsed;
+
+        size_t offset = 0;
+        for (size_t i = 0; i <= cuts.size(); ++i)
+        {
+            size_t end = i < cuts.size() ? cuts[i] : response.size();
+
+            const uint8_t *data = reinterpret_cast<const uint8_t *>(response.data()) + offset;
+            uint32_t len = static_cast<uint32_t>(end - offset);
+            offset = end;
+
+            if (!parser.IsHeadCompleted())
+            {
+                ResponseParser::Result result = parser.ParseHead(data, len);
+                if (ResponseParser::Malformed == result)
+                {
+                    parsed.result = -1;
+                    return parsed;
+                }
+
+                if (ResponseParser::NeedMore == result)
+                    continue;
+
+                char *rawHeaders = parser.TakeRawHeaders();
+                for (const char *line = rawHeaders; '\0' != *line; line += ::strlen(line) + 1)
+                {
+                    parsed.headers.append(line).push_back('|');
+                }
+                delete[] rawHeaders;
+            }
+
+            while (0 != len && !parser.IsCompleted())
+            {
+                const uint8_t *piece = NULL;
+                uint32_t pieceLen = 0;
+                if (!parser.ParseBody(data, len, piece, pieceLen))
+                {
+                    parsed.result = -2;
+                    return parsed;
+                }
+
+                parsed.body.append(reinterpret_cast<const char *>(piece), pieceLen);
+            }
+        }
+
+        parsed.statusCode = parser.GetStatusCode();
+        parsed.contentLength = parser.GetContentLength();
+        parsed.isKeepAlive = parser.IsKeepAlive();
+        parsed.isCompleted = parser.IsCompleted();
+
+        return parsed;
+    }
+
+    struct Case
+    {
+        const char *name;
+        std::string response;
+        //! of the whole response in one read
+        int result;
+        const char *body;
+    };
+}
+
+int main()
+{
+    std::vector<Case> cases;
+
+    Case c;
+    c.name = "content-length";
+    c.response = "HTTP/1.1 200 OK\r\nContent-Length: 5\r\nX-A:  b \r\n\r\nhello";
+    c.result = 0;
+    c.body = "hello";
+    cases.push_back(c);
+
+    c.name = "interim then chunked";
+    c.response = "HTTP/1.1 100 Continue\r\n\r\n"
+        "HTTP/1.1 200 OK\r\nTransfer-Encoding: Chunked\r\nConnection: Close\r\n\r\n"
+        "5\r\nhello\r\n1a;ext=1\r\nabcdefghijklmnopqrstuvwxyz\r\n0\r\nTrailer: x\r\n\r\n";
+    c.body = "helloabcdefghijklmnopqrstuvwxyz";
+    cases.push_back(c);
+
+    c.name = "until close";
+    c.response = "HTTP/1.0 200 OK\r\nServer: x\r\n\r\nuntil close body";
+    c.body = "until close body";
+    cases.push_back(c);
+
+    c.name = "no content";
+    c.response = "HTTP/1.0 204 No Content\r\nConnection: keep-alive\r\n\r\n";
+    c.body = "";
+    cases.push_back(c);
+
+    c.name = "long head";
+    c.response = "HTTP/1.1 200 OK\r\n";
+    for (int i = 0; i < 40; ++i)
+    {
+        char line[64];
+        std::snprintf(line, sizeof(line), "X-Header-%d: value value value %d\r\n", i, i * 7);
+        c.response.append(line);
+    }
+    c.response.append("Content-Length: 3\r\n\r\nabc");
+    c.body = "abc";
+    cases.push_back(c);
+
+    c.name = "malformed length";
+    c.response = "HTTP/1.1 200 OK\r\nContent-Length: x1\r\n\r\n";
+    c.result = -1;
+    c.body = "";
+    cases.push_back(c);
+
+    c.name = "malformed version";
+    c.response = "HTTX/1.1 200 OK\r\n\r\n";
+    cases.push_back(c);
+
+    c.name = "malformed chunk size";
+    c.response = "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\nz\r\n";
+    c.result = -2;
+    cases.push_back(c);
+
+    uint32_t runCount = 0;
+    uint32_t failedCount = 0;
+
+    std::vector<Case>::const_iterator it = cases.begin();
+    for (; it != cases.end(); ++it)
+    {
+        const std::string& response = it->response;
+        const Parsed whole = Parse(response, std::vector<size_t>());
+
+        if (whole.result != it->result || (0 == whole.result && whole.body != it->body))
+        {
+            std::printf("%s: parsed as %d, body [%s]\n", it->name, whole.result, whole.body.c_str());
+            ++failedCount;
+            continue;
+        }
+
+        for (size_t i = 0; i <= response.size(); ++i)
+        {
+            for (size_t j = i; j <= response.size(); ++j)
+            {
+                std::vector<size_t> cuts;
+                cuts.push_back(i);
+                cuts.push_back(j);
+
+                ++runCount;
+                if (!(Parse(response, cuts) == whole))
+                {
+                    if (failedCount++ < 10)
+                        std::printf("%s: differs when split at %u and %u\n", it->name, static_cast<uint32_t>(i), static_cast<uint32_t>(j));
+                }
+            }
+        }
+
+        //! one byte each read
+        std::vector<size_t> cuts;
+        for (size_t i = 1; i < response.size(); ++i)
+        {
+            cuts.push_back(i);
+        }
+
+        ++runCount;
+        if (!(Parse(response, cuts) == whole))
+        {
+            ++failedCount;
+            std::printf("%s: differs when read byte by byte\n", it->name);
+        }
+    }
+
+    std::printf("ResponseParserTest: %u splits, %u failed\n", runCount, failedCount);
+    return 0 == failedCount ? 0 : 1;
+}